@@ -35,6 +35,9 @@
 #endif
 #include "sysemu/cpus.h"
 #include "sysemu/replay.h"
+#ifdef CONFIG_VPMU_SET
+#include "vpmu/event-tracing/event-tracing-helper.h" // et_has_pending_tbs()
+#endif
 
 /* -icount align implementation. */
 
@@ -347,6 +350,12 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
     if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
                  tb->flags != flags ||
                  tb->trace_vcpu_dstate != *cpu->trace_dstate)) {
+#ifdef CONFIG_VPMU_SET
+        /* The TBs of the page traced before it was mapped */
+        if (unlikely(et_has_pending_tbs())) {
+            et_invalidate_pending_tbs(cpu, pc);
+        }
+#endif
         tb = tb_htable_lookup(cpu, pc, cs_base, flags);
         if (!tb) {
 
@@ -36,6 +36,13 @@
 
 #include "trace-tcg.h"
 
+#ifdef CONFIG_VPMU
+#include "../vpmu/vpmu-extratb.h"                // Extra TB Information
+#include "../vpmu/packet/vpmu-packet.h"          // CACHE_PACKET_{READ,WRITE,etc.}
+#include "../vpmu/arch/arm/vpmu-arm-translate.h" // timing functions
+#include "../vpmu/event-tracing/event-tracing.h" // et_is_traced_address
+#endif
+
 static TCGv_i64 cpu_X[32];
 static TCGv_i64 cpu_pc;
 
@@ -797,6 +804,26 @@ static void gen_adc_CC(int sf, TCGv_i64 dest, TCGv_i64 t0, TCGv_i64 t1)
  * Load/Store generators
  */
 
+#ifdef CONFIG_VPMU
+/*
+ * Count the memory access and feed its address to the cache simulator
+ */
+static void gen_vpmu_memory_access(DisasContext *s, TCGv_i64 tcg_addr,
+                                   int packet, int size)
+{
+    if (packet == CACHE_PACKET_READ) {
+        s->tb->extra_tb_info.counters.load++;
+    } else {
+        s->tb->extra_tb_info.counters.store++;
+    }
+    TCGv_i64 tmp_packet = tcg_const_i64(packet);
+    TCGv_i64 tmp_size   = tcg_const_i64(1 << size);
+    gen_helper_vpmu_memory_access(cpu_env, tcg_addr, tmp_packet, tmp_size);
+    tcg_temp_free_i64(tmp_size);
+    tcg_temp_free_i64(tmp_packet);
+}
+#endif
+
 /*
  * Store from GPR register to memory.
  */
@@ -808,6 +835,9 @@ static void do_gpr_st_memidx(DisasContext *s, TCGv_i64 source,
 {
     g_assert(size <= 3);
     tcg_gen_qemu_st_i64(source, tcg_addr, memidx, s->be_data + size);
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_WRITE, size);
+#endif
 
     if (iss_valid) {
         uint32_t syn;
@@ -852,6 +882,9 @@ static void do_gpr_ld_memidx(DisasContext *s,
     }
 
     tcg_gen_qemu_ld_i64(dest, tcg_addr, memidx, memop);
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_READ, size);
+#endif
 
     if (extend && is_signed) {
         g_assert(size < 3);
@@ -906,6 +939,9 @@ static void do_fp_st(DisasContext *s, int srcidx, TCGv_i64 tcg_addr, int size)
                             s->be_data | MO_Q);
         tcg_temp_free_i64(tcg_hiaddr);
     }
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_WRITE, size);
+#endif
 
     tcg_temp_free_i64(tmp);
 }
@@ -940,6 +976,9 @@ static void do_fp_ld(DisasContext *s, int destidx, TCGv_i64 tcg_addr, int size)
 
     tcg_gen_st_i64(tmplo, cpu_env, fp_reg_offset(s, destidx, MO_64));
     tcg_gen_st_i64(tmphi, cpu_env, fp_reg_hi_offset(s, destidx));
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_READ, size);
+#endif
 
     tcg_temp_free_i64(tmplo);
     tcg_temp_free_i64(tmphi);
@@ -1078,6 +1117,9 @@ static void do_vec_st(DisasContext *s, int srcidx, int element,
 
     read_vec_element(s, tcg_tmp, srcidx, element, size);
     tcg_gen_qemu_st_i64(tcg_tmp, tcg_addr, get_mem_index(s), memop);
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_WRITE, size);
+#endif
 
     tcg_temp_free_i64(tcg_tmp);
 }
@@ -1091,6 +1133,9 @@ static void do_vec_ld(DisasContext *s, int destidx, int element,
 
     tcg_gen_qemu_ld_i64(tcg_tmp, tcg_addr, get_mem_index(s), memop);
     write_vec_element(s, tcg_tmp, destidx, element, size);
+#ifdef CONFIG_VPMU
+    gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_READ, size);
+#endif
 
     tcg_temp_free_i64(tcg_tmp);
 }
@@ -1809,6 +1854,12 @@ static void disas_uncond_b_reg(DisasContext *s, uint32_t insn)
 /* C3.2 Branches, exception generating and system instructions */
 static void disas_b_exc_sys(DisasContext *s, uint32_t insn)
 {
+#ifdef CONFIG_VPMU
+    /* Everything in this group except exceptions and system insns branches */
+    if (extract32(insn, 25, 7) != 0x6a) {
+        s->tb->extra_tb_info.has_branch = 1;
+    }
+#endif
     switch (extract32(insn, 25, 7)) {
     case 0x0a: case 0x0b:
     case 0x4a: case 0x4b: /* Unconditional branch (immediate) */
@@ -1890,6 +1941,10 @@ static void gen_load_exclusive(DisasContext *s, int rt, int rt2,
         tcg_gen_qemu_ld_i64(cpu_exclusive_val, addr, idx, memop);
         tcg_gen_mov_i64(cpu_reg(s, rt), cpu_exclusive_val);
     }
+#ifdef CONFIG_VPMU
+    /* A pair is a single access of both registers */
+    gen_vpmu_memory_access(s, addr, CACHE_PACKET_READ, size + is_pair);
+#endif
     tcg_gen_mov_i64(cpu_exclusive_addr, addr);
 }
 
@@ -1945,6 +2000,10 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
                                    size | MO_ALIGN | s->be_data);
         tcg_gen_setcond_i64(TCG_COND_NE, tmp, tmp, cpu_exclusive_val);
     }
+#ifdef CONFIG_VPMU
+    /* Only the path passing the address check accesses the memory */
+    gen_vpmu_memory_access(s, addr, CACHE_PACKET_WRITE, size + is_pair);
+#endif
 
     tcg_temp_free_i64(addr);
 
@@ -2820,6 +2879,9 @@ static void disas_ldst_single_struct(DisasContext *s, uint32_t insn)
 
             tcg_gen_qemu_ld_i64(tcg_tmp, tcg_addr,
                                 get_mem_index(s), s->be_data + scale);
+#ifdef CONFIG_VPMU
+            gen_vpmu_memory_access(s, tcg_addr, CACHE_PACKET_READ, scale);
+#endif
             switch (scale) {
             case 0:
                 mulconst = 0x0101010101010101ULL;
@@ -11167,6 +11229,9 @@ static void disas_a64_insn(CPUARMState *env, DisasContext *s)
 
     s->fp_access_checked = false;
 
+#ifdef CONFIG_VPMU
+    vpmu_accumulate_arm64_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn);
+#endif
     switch (extract32(insn, 25, 4)) {
     case 0x0: case 0x1: case 0x2: case 0x3: /* UNALLOCATED */
         unallocated_encoding(s);
@@ -11278,6 +11343,14 @@ void gen_intermediate_code_a64(CPUState *cs, TranslationBlock *tb)
     gen_tb_start(tb);
 
     tcg_clear_temp_count();
+#ifdef CONFIG_VPMU
+    // Reset all values in this structure
+    memset(&(tb->extra_tb_info), 0, sizeof(ExtraTBInfo));
+    TCGv_ptr tmp_extra_tb = tcg_const_ptr((void *)&tb->extra_tb_info);
+    gen_helper_vpmu_accumulate_tb_info(cpu_env, tmp_extra_tb);
+    tcg_temp_free_ptr(tmp_extra_tb);
+    vpmu_tb_summary_begin(&tb->extra_tb_info, &dc->vpmu_tb);
+#endif
 
     do {
         dc->insn_start_idx = tcg_op_buf_count();
@@ -11413,6 +11486,17 @@ void gen_intermediate_code_a64(CPUState *cs, TranslationBlock *tb)
 done_generating:
     gen_tb_end(tb, num_insns);
 
+#ifdef CONFIG_VPMU
+    tb->extra_tb_info.counters.total      = num_insns;
+    tb->extra_tb_info.counters.size_bytes = dc->pc - pc_start;
+    tb->extra_tb_info.start_addr          = pc_start;
+#ifdef CONFIG_VPMU_SET
+    tb->extra_tb_info.et_traced           = et_is_traced_address(pc_start);
+#endif
+    vpmu_tb_summary_end(&tb->extra_tb_info, &dc->vpmu_tb);
+    tb->extra_tb_info.cpu_mode = VPMU_CPU_MODE_ARM64;
+#endif
+
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM) &&
         qemu_log_in_addr_range(pc_start)) {
@@ -81,6 +81,7 @@ static const char *regnames[] =
 #include "../vpmu/packet/vpmu-packet.h"          // CACHE_PACKET_{READ,WRITE,etc.}
 #include "../vpmu/misc/vpmu-log.h"               // ERR_MSG
 #include "../vpmu/arch/arm/vpmu-arm-translate.h" // timing functions
+#include "../vpmu/event-tracing/event-tracing.h" // et_is_traced_address
 static uint32_t *pc = NULL;
 // Branch filter, not a branch instruction
 static bool vpmu_branch_from_store = false;
@@ -3336,7 +3337,8 @@ static int disas_vfp_insn(DisasContext *s, uint32_t insn)
     s->tb->extra_tb_info.counters.vfp++;
     s->tb->extra_tb_info.counters.alu++;
 #ifdef CONFIG_VPMU_VFP
-    vpmu_accumulate_vfp_ticks(&(s->tb->extra_tb_info), insn, env->vfp.vec_len);
+    vpmu_accumulate_vfp_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn,
+                              env->vfp.vec_len);
 #endif
 #endif
 
@@ -7665,7 +7667,7 @@ static int disas_coproc_insn(DisasContext *s, uint32_t insn)
     cpnum = (insn >> 8) & 0xf;
 
 #ifdef CONFIG_VPMU
-    vpmu_accumulate_cp14_ticks(&(s->tb->extra_tb_info), insn);
+    vpmu_accumulate_cp14_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn);
 #endif
     /* First check for coprocessor space used for XScale/iwMMXt insns */
     if (arm_dc_feature(s, ARM_FEATURE_XSCALE) && (cpnum < 2)) {
@@ -8213,7 +8215,7 @@ static void disas_arm_insn(DisasContext *s, unsigned int insn)
     }
 
 #ifdef CONFIG_VPMU
-    vpmu_accumulate_arm_ticks(&(s->tb->extra_tb_info), insn);
+    vpmu_accumulate_arm_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn);
 #endif
     cond = insn >> 28;
     if (cond == 0xf){
@@ -9922,7 +9924,7 @@ static int disas_thumb2_insn(CPUARMState *env, DisasContext *s, uint16_t insn_hw
     }
 
 #ifdef CONFIG_VPMU
-    vpmu_accumulate_thumb_ticks(&(s->tb->extra_tb_info), insn);
+    vpmu_accumulate_thumb_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn);
 // TODO: branch counter for thumb mode
 #endif
 
@@ -11324,7 +11326,7 @@ static void disas_thumb_insn(CPUARMState *env, DisasContext *s)
     insn = arm_lduw_code(env, s->pc, s->sctlr_b);
     s->pc += 2;
 #ifdef CONFIG_VPMU
-    vpmu_accumulate_thumb_ticks(&(s->tb->extra_tb_info), insn);
+    vpmu_accumulate_thumb_ticks(&s->tb->extra_tb_info, &s->vpmu_tb, insn);
 #endif
 
     switch (insn >> 12) {
@@ -12226,6 +12228,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
     TCGv_ptr tmp_extra_tb  = tcg_const_ptr((void *)&tb->extra_tb_info);
     gen_helper_vpmu_accumulate_tb_info(cpu_env, tmp_extra_tb);
     tcg_temp_free_ptr(tmp_extra_tb);
+    vpmu_tb_summary_begin(&tb->extra_tb_info, &dc->vpmu_tb);
 #endif
 
     /* A note on handling of the condexec (IT) bits:
@@ -12498,6 +12501,10 @@ done_generating:
     tb->extra_tb_info.counters.total      = num_insns;
     tb->extra_tb_info.counters.size_bytes = dc->pc - pc_start;
     tb->extra_tb_info.start_addr          = pc_start;
+#ifdef CONFIG_VPMU_SET
+    tb->extra_tb_info.et_traced           = et_is_traced_address(pc_start);
+#endif
+    vpmu_tb_summary_end(&tb->extra_tb_info, &dc->vpmu_tb);
     if (dc->thumb) {
         tb->extra_tb_info.cpu_mode = VPMU_CPU_MODE_THUMB;
     }
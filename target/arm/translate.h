@@ -67,6 +67,10 @@ typedef struct DisasContext {
 #define TMP_A64_MAX 16
     int tmp_a64_count;
     TCGv_i64 tmp_a64[TMP_A64_MAX];
+#ifdef CONFIG_VPMU
+    /* The dependency summary of the TB being translated, see vpmu-extratb.h */
+    TB_SummaryState vpmu_tb;
+#endif
 } DisasContext;
 
 typedef struct DisasCompare {
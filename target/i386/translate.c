@@ -36,6 +36,7 @@
 #include "../vpmu/packet/vpmu-packet.h"            // CACHE_PACKET_{READ,WRITE,etc.}
 #include "../vpmu/misc/vpmu-log.h"                 // ERR_MSG
 #include "../vpmu/arch/i386/vpmu-i386-translate.h" // timing functions
+#include "../vpmu/event-tracing/event-tracing.h"   // et_is_traced_address
 
 static uint64_t *pc = NULL;
 // Branch filter, not a branch instruction
@@ -148,6 +149,10 @@ typedef struct DisasContext {
     int cpuid_ext3_features;
     int cpuid_7_0_ebx_features;
     int cpuid_xsave_features;
+#ifdef CONFIG_VPMU
+    /* The dependency summary of the TB being translated, see vpmu-extratb.h */
+    TB_SummaryState vpmu_tb;
+#endif
 } DisasContext;
 
 static void gen_eob(DisasContext *s);
@@ -432,8 +437,9 @@ static inline void gen_op_add_reg_T0(TCGMemOp size, int reg)
 static inline void gen_op_ld_v(DisasContext *s, int idx, TCGv t0, TCGv a0)
 {
 #ifdef CONFIG_VPMU
+    s->tb->extra_tb_info.counters.load++;
     TCGv_i64 tmp_packet = tcg_const_i64(CACHE_PACKET_READ);
-    TCGv_i64 tmp_size   = tcg_const_i64(4);
+    TCGv_i64 tmp_size   = tcg_const_i64(1 << (idx & MO_SIZE));
     gen_helper_vpmu_memory_access(cpu_env, a0, tmp_packet, tmp_size);
     tcg_temp_free_i64(tmp_size);
     tcg_temp_free_i64(tmp_packet);
@@ -444,8 +450,9 @@ static inline void gen_op_ld_v(DisasContext *s, int idx, TCGv t0, TCGv a0)
 static inline void gen_op_st_v(DisasContext *s, int idx, TCGv t0, TCGv a0)
 {
 #ifdef CONFIG_VPMU
+    s->tb->extra_tb_info.counters.store++;
     TCGv_i64 tmp_packet = tcg_const_i64(CACHE_PACKET_WRITE);
-    TCGv_i64 tmp_size   = tcg_const_i64(4);
+    TCGv_i64 tmp_size   = tcg_const_i64(1 << (idx & MO_SIZE));
     gen_helper_vpmu_memory_access(cpu_env, a0, tmp_packet, tmp_size);
     tcg_temp_free_i64(tmp_size);
     tcg_temp_free_i64(tmp_packet);
@@ -4444,6 +4451,23 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
     }
 }
 
+#ifdef CONFIG_VPMU
+/* Pass the decoded instruction to the timing model. The memory operands are
+   known from the loads/stores generated since the beginning of the insn.  */
+static void vpmu_classify_insn(DisasContext *s, int b, int prefixes,
+                               TCGMemOp dflag, int rex_r, int modrm,
+                               uint16_t load, uint16_t store)
+{
+    ExtraTBInfo *ex_tb = &s->tb->extra_tb_info;
+    int rex_rb = (rex_r ? 1 : 0) | (REX_B(s) ? 2 : 0);
+
+    vpmu_accumulate_x86_64_ticks(ex_tb, &s->vpmu_tb,
+                                 VPMU_X86_INSN(b, prefixes, dflag, rex_rb, modrm,
+                                               ex_tb->counters.load - load,
+                                               ex_tb->counters.store - store));
+}
+#endif
+
 /* convert one instruction. s->is_jmp is set if the translation must
    be stopped. Return the next pc value */
 static target_ulong disas_insn(CPUX86State *env, DisasContext *s,
@@ -4455,6 +4479,13 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s,
     int modrm, reg, rm, mod, op, opreg, val;
     target_ulong next_eip, tval;
     int rex_w, rex_r;
+#ifdef CONFIG_VPMU
+    uint16_t vpmu_load  = s->tb->extra_tb_info.counters.load;
+    uint16_t vpmu_store = s->tb->extra_tb_info.counters.store;
+    /* Not all the paths below set them */
+    modrm = 0;
+    dflag = MO_32;
+#endif
 
     s->pc_start = s->pc = pc_start;
     prefixes = 0;
@@ -4614,9 +4645,6 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s,
     s->dflag = dflag;
 
     /* now check op code */
-#ifdef CONFIG_VPMU
-    vpmu_accumulate_x86_64_ticks(&(s->tb->extra_tb_info), (uint64_t)b);
-#endif
  reswitch:
     switch(b) {
     case 0x0f:
@@ -8327,11 +8355,20 @@ static target_ulong disas_insn(CPUX86State *env, DisasContext *s,
     default:
         goto unknown_op;
     }
+#ifdef CONFIG_VPMU
+    vpmu_classify_insn(s, b, prefixes, dflag, rex_r, modrm, vpmu_load, vpmu_store);
+#endif
     return s->pc;
  illegal_op:
+#ifdef CONFIG_VPMU
+    vpmu_classify_insn(s, b, prefixes, dflag, rex_r, modrm, vpmu_load, vpmu_store);
+#endif
     gen_illegal_opcode(s);
     return s->pc;
  unknown_op:
+#ifdef CONFIG_VPMU
+    vpmu_classify_insn(s, b, prefixes, dflag, rex_r, modrm, vpmu_load, vpmu_store);
+#endif
     gen_unknown_opcode(env, s);
     return s->pc;
 }
@@ -8523,6 +8560,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
     TCGv_ptr tmp_extra_tb = tcg_const_ptr((void *)&tb->extra_tb_info);
     gen_helper_vpmu_accumulate_tb_info(cpu_env, tmp_extra_tb);
     tcg_temp_free_ptr(tmp_extra_tb);
+    vpmu_tb_summary_begin(&tb->extra_tb_info, &dc->vpmu_tb);
 #endif
 
     gen_tb_start(tb);
@@ -8617,6 +8655,10 @@ done_generating:
     tb->extra_tb_info.counters.total      = num_insns;
     tb->extra_tb_info.counters.size_bytes = dc->pc - pc_start;
     tb->extra_tb_info.start_addr          = pc_start;
+#ifdef CONFIG_VPMU_SET
+    tb->extra_tb_info.et_traced           = et_is_traced_address(pc_start);
+#endif
+    vpmu_tb_summary_end(&tb->extra_tb_info, &dc->vpmu_tb);
     //s->tb->extra_tb_info.counters.alu++;
 #endif
 
@@ -4,6 +4,8 @@
 
 // Put your own timing simulator below
 #include "simulator/Cortex-A9.hpp"
+#include "simulator/Cortex-A53.hpp"
+#include "simulator/OoO-Core.hpp"
 // Put you own timing simulator above
 InstructionStream::Sim_ptr InstructionStream::create_sim(std::string sim_name)
 {
@@ -11,6 +13,12 @@ InstructionStream::Sim_ptr InstructionStream::create_sim(std::string sim_name)
     // The return will use "move semantics" automatically.
     if (sim_name == "Cortex-A9")
         return std::make_unique<CPU_CortexA9>();
+    else if (sim_name == "Cortex-A9-OoO")
+        return std::make_unique<CPU_OoOCore>(std::make_unique<CPU_CortexA9>());
+    else if (sim_name == "Cortex-A53")
+        return std::make_unique<CPU_CortexA53>();
+    else if (sim_name == "Cortex-A53-OoO")
+        return std::make_unique<CPU_OoOCore>(std::make_unique<CPU_CortexA53>());
     else
         return nullptr;
 }
@@ -19,6 +19,23 @@ ARM_Instructions get_index_of_arm_insn(const char *s)
     return ARM_INSTRUCTION_TOTAL_COUNTS;
 }
 
+// Return array length if not found
+ARM64_Instructions get_index_of_arm64_insn(const char *s)
+{
+#define etype(x) macro_str(x)
+    // static is for putting it in global space
+    static const char *str_arm64_instructions[] = {ARM64_INSTRUCTION};
+    int                i;
+
+    for (i = 0; i < sizeof(str_arm64_instructions) / sizeof(const char *); i++) {
+        if (strcmp(str_arm64_instructions[i], s) == 0) return (ARM64_Instructions)i;
+    }
+
+    ERR_MSG("get_index_of_arm64_insn: could not find field \"%s\"\n", s);
+#undef etype
+    return ARM64_INSTRUCTION_TOTAL_COUNTS;
+}
+
 #ifdef CONFIG_VPMU_VFP
 // Return array length if not found
 ARM_VFP_Instructions get_index_of_arm_vfp_insn(const char *s)
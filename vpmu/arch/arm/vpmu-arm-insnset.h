@@ -184,6 +184,68 @@
 typedef enum { ARM_INSTRUCTION } ARM_Instructions;
 #undef etype
 
+#define etype(x) ARM64_INSTRUCTION_##x
+
+#define ARM64_INSTRUCTION \
+    etype(B), \
+    etype(B_COND), \
+    etype(BL), \
+    etype(BR), \
+    etype(BLR), \
+    etype(RET), \
+    etype(ERET), \
+    etype(CBZ), \
+    etype(TBZ), \
+    etype(ADR), \
+    etype(ADD_IMM), \
+    etype(LOGIC_IMM), \
+    etype(MOV_WIDE), \
+    etype(BFM), \
+    etype(EXTR), \
+    etype(ADD_REG), \
+    etype(ADD_EXT), \
+    etype(LOGIC_REG), \
+    etype(ADC), \
+    etype(CCMP), \
+    etype(CSEL), \
+    etype(DP1), \
+    etype(SHIFT), \
+    etype(CRC32), \
+    etype(UDIV), \
+    etype(SDIV), \
+    etype(MUL), \
+    etype(MULL), \
+    etype(MULH), \
+    etype(LDR), \
+    etype(LDR_LIT), \
+    etype(LDP), \
+    etype(LDXR), \
+    etype(STR), \
+    etype(STP), \
+    etype(STXR), \
+    etype(PRFM), \
+    etype(SIMD_LDST), \
+    etype(SVC), \
+    etype(HINT), \
+    etype(BARRIER), \
+    etype(MSR), \
+    etype(MRS), \
+    etype(SYS), \
+    etype(FP_ALU), \
+    etype(FP_MUL), \
+    etype(FP_MAC), \
+    etype(FP_DIV), \
+    etype(FP_SQRT), \
+    etype(FP_CVT), \
+    etype(SIMD_DP), \
+    etype(UNKNOWN), \
+    etype(NOT_INSTRUMENTED), \
+    etype(TOTAL_COUNT), \
+    etype(TOTAL_COUNTS)
+
+typedef enum { ARM64_INSTRUCTION } ARM64_Instructions;
+#undef etype
+
 #ifdef CONFIG_VPMU_VFP
 #define etype(x) ARM_VFP_INSTRUCTION_##x
 
@@ -269,6 +331,7 @@ typedef enum { ARM_VFP_INSTRUCTION } ARM_VFP_Instructions;
 #endif // CONFIG_VPMU_VFP
 
 ARM_Instructions get_index_of_arm_insn(const char *s);
+ARM64_Instructions get_index_of_arm64_insn(const char *s);
 #ifdef CONFIG_VPMU_VFP
 ARM_VFP_Instructions get_index_of_arm_vfp_insn(const char *s);
 #endif // CONFIG_VPMU_VFP
@@ -18,24 +18,50 @@ extern "C" {
 // #include "exec/exec-all.h"
 // #include "translate.h"
 
-void vpmu_accumulate_arm_ticks(ExtraTBInfo* ex_tb, uint32_t insn)
+void vpmu_accumulate_arm64_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn)
 {
-    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_arm_ticks(insn);
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_arm64_ticks(tb_summary, insn);
 }
 
-void vpmu_accumulate_thumb_ticks(ExtraTBInfo* ex_tb, uint32_t insn)
+void vpmu_accumulate_arm_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn)
 {
-    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_thumb_ticks(insn);
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_arm_ticks(tb_summary, insn);
 }
 
-void vpmu_accumulate_cp14_ticks(ExtraTBInfo* ex_tb, uint32_t insn)
+void vpmu_accumulate_thumb_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn)
 {
-    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_cp14_ticks(insn);
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_thumb_ticks(tb_summary, insn);
+}
+
+void vpmu_accumulate_cp14_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn)
+{
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_cp14_ticks(tb_summary, insn);
+}
+
+void vpmu_tb_summary_begin(ExtraTBInfo* ex_tb, TB_SummaryState* tb)
+{
+    TBSummaryBuilder tb_summary(*tb);
+    vpmu_insn_stream.get_translator(0).begin_tb_summary(tb_summary);
+}
+
+void vpmu_tb_summary_end(ExtraTBInfo* ex_tb, TB_SummaryState* tb)
+{
+    TBSummaryBuilder tb_summary(*tb);
+    vpmu_insn_stream.get_translator(0).end_tb_summary(tb_summary, ex_tb->summary);
 }
 
 #if defined(CONFIG_VPMU) && defined(CONFIG_VPMU_VFP)
-void vpmu_accumulate_vfp_ticks(ExtraTBInfo* ex_tb, uint32_t insn, uint64_t vfp_vec_len)
+void vpmu_accumulate_vfp_ticks(ExtraTBInfo*     ex_tb,
+                               TB_SummaryState* tb,
+                               uint32_t         insn,
+                               uint32_t         vfp_vec_len)
 {
-    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_vfp_ticks(insn);
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks +=
+      vpmu_insn_stream.get_translator(0).get_vfp_ticks(tb_summary, insn, vfp_vec_len);
 }
 #endif
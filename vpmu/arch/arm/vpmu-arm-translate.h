@@ -8,8 +8,16 @@
 // TODO support multi-model??
 // Interface Functions for Instruction Timing.
 // It should be stateless and reentry-able for thread safe!!!
-void vpmu_accumulate_arm_ticks(ExtraTBInfo* ex_tb, uint32_t insn);
-void vpmu_accumulate_thumb_ticks(ExtraTBInfo* ex_tb, uint32_t insn);
-void vpmu_accumulate_cp14_ticks(ExtraTBInfo* ex_tb, uint32_t insn);
-void vpmu_accumulate_vfp_ticks(ExtraTBInfo* ex_tb, uint32_t insn, uint32_t vfp_vec_len);
+// The state of the TB being translated is kept by the caller, i.e. in DisasContext.
+void vpmu_accumulate_arm64_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn);
+void vpmu_accumulate_arm_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn);
+void vpmu_accumulate_thumb_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn);
+void vpmu_accumulate_cp14_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint32_t insn);
+void vpmu_accumulate_vfp_ticks(ExtraTBInfo*     ex_tb,
+                               TB_SummaryState* tb,
+                               uint32_t         insn,
+                               uint32_t         vfp_vec_len);
+// Interface Functions for the dependency summary of a TB.
+void vpmu_tb_summary_begin(ExtraTBInfo* ex_tb, TB_SummaryState* tb);
+void vpmu_tb_summary_end(ExtraTBInfo* ex_tb, TB_SummaryState* tb);
 #endif
@@ -4,6 +4,7 @@
 
 // Put your own timing simulator below
 #include "simulator/Intel-I7.hpp"
+#include "simulator/OoO-Core.hpp"
 
 // Put you own timing simulator above
 InstructionStream::Sim_ptr InstructionStream::create_sim(std::string sim_name)
@@ -12,6 +13,8 @@ InstructionStream::Sim_ptr InstructionStream::create_sim(std::string sim_name)
     // The return will use "move semantics" automatically.
     if (sim_name == "Intel-I7")
         return std::make_unique<CPU_IntelI7>();
+    else if (sim_name == "Intel-I7-OoO")
+        return std::make_unique<CPU_OoOCore>(std::make_unique<CPU_IntelI7>());
     else
         return nullptr;
 }
@@ -5,10 +5,32 @@
 
 #define etype(x) X86_INSTRUCTION_##x
 
+// The uop classes of x86 instructions. LOAD and STORE are the memory uops which
+// are added to the instructions with memory operands.
 #define X86_INSTRUCTION \
-    etype(ADD), \
-    etype(MUL), \
+    etype(ALU), \
+    etype(SHIFT), \
     etype(MOV), \
+    etype(LEA), \
+    etype(IMUL), \
+    etype(MUL), \
+    etype(DIV), \
+    etype(BRANCH), \
+    etype(CALL), \
+    etype(RET), \
+    etype(PUSH), \
+    etype(POP), \
+    etype(STRING), \
+    etype(X87), \
+    etype(SSE_ALU), \
+    etype(SSE_MUL), \
+    etype(SSE_DIV), \
+    etype(SSE_MOV), \
+    etype(SYSTEM), \
+    etype(NOP), \
+    etype(LOAD), \
+    etype(STORE), \
+    etype(UNKNOWN), \
     etype(TOTAL_COUNTS)
 
 typedef enum { X86_INSTRUCTION } X86_Instructions;
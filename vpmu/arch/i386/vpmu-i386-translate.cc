@@ -18,7 +18,20 @@ extern "C" {
 // #include "exec/exec-all.h"
 // #include "translate.h"
 
-void vpmu_accumulate_x86_64_ticks(ExtraTBInfo* ex_tb, uint64_t insn)
+void vpmu_accumulate_x86_64_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint64_t insn)
 {
-    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_x86_64_ticks(insn);
+    TBSummaryBuilder tb_summary(*tb);
+    ex_tb->ticks += vpmu_insn_stream.get_translator(0).get_x86_64_ticks(tb_summary, insn);
+}
+
+void vpmu_tb_summary_begin(ExtraTBInfo* ex_tb, TB_SummaryState* tb)
+{
+    TBSummaryBuilder tb_summary(*tb);
+    vpmu_insn_stream.get_translator(0).begin_tb_summary(tb_summary);
+}
+
+void vpmu_tb_summary_end(ExtraTBInfo* ex_tb, TB_SummaryState* tb)
+{
+    TBSummaryBuilder tb_summary(*tb);
+    vpmu_insn_stream.get_translator(0).end_tb_summary(tb_summary, ex_tb->summary);
 }
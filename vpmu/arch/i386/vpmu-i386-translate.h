@@ -5,8 +5,26 @@
 
 #include "vpmu/vpmu-extratb.h" // ExtraTBInfo
 
+// Pack a decoded x86 instruction into the argument of vpmu_accumulate_x86_64_ticks().
+// bits [15:0]  opcode, 0x1xx for two bytes opcodes (0x0f xx)
+// bits [23:16] prefixes, i.e. PREFIX_* in target/i386/translate.c
+// bits [25:24] operand size (TCGMemOp)
+// bits [27:26] REX.R and REX.B
+// bits [39:32] ModRM byte, zero if the instruction does not have one
+// bits [47:40] number of memory loads
+// bits [55:48] number of memory stores
+#define VPMU_X86_INSN(opcode, prefixes, dflag, rex_rb, modrm, loads, stores)         \
+    (((uint64_t)(opcode)&0xffff) | (((uint64_t)(prefixes)&0xff) << 16)               \
+     | (((uint64_t)(dflag)&0x3) << 24) | (((uint64_t)(rex_rb)&0x3) << 26)             \
+     | (((uint64_t)(modrm)&0xff) << 32) | (((uint64_t)(loads)&0xff) << 40)            \
+     | (((uint64_t)(stores)&0xff) << 48))
+
 // TODO support multi-model??
 // Interface Functions for Instruction Timing.
 // It should be stateless and reentry-able for thread safe!!!
-void vpmu_accumulate_x86_64_ticks(ExtraTBInfo* ex_tb, uint64_t insn);
+// The state of the TB being translated is kept by the caller, i.e. in DisasContext.
+void vpmu_accumulate_x86_64_ticks(ExtraTBInfo* ex_tb, TB_SummaryState* tb, uint64_t insn);
+// Interface Functions for the dependency summary of a TB.
+void vpmu_tb_summary_begin(ExtraTBInfo* ex_tb, TB_SummaryState* tb);
+void vpmu_tb_summary_end(ExtraTBInfo* ex_tb, TB_SummaryState* tb);
 #endif
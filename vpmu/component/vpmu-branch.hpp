@@ -29,16 +29,21 @@ public:
 
     void send(uint8_t core, uint64_t pc, uint32_t taken);
 
-    inline uint64_t get_cycles(int model_idx, int core_id)
+    inline uint64_t get_cycles(VPMU_Branch::Data& data, int model_idx, int core_id)
     {
         VPMU_Branch::Model model = get_model(model_idx);
-        VPMU_Branch::Data  data  = get_data(model_idx);
         if (core_id == -1)
             return vpmu::math::sum_cores(data.wrong) * model.latency;
         else
             return data.wrong[core_id] * model.latency;
     }
 
+    inline uint64_t get_cycles(int model_idx, int core_id)
+    {
+        VPMU_Branch::Data data = get_data(model_idx);
+        return get_cycles(data, model_idx, core_id);
+    }
+
     // TODO
     // Summarize branch misses of all cores means nothing. We define it as prohibit.
     inline uint64_t get_cycles(void) { return get_cycles(0, -1); }
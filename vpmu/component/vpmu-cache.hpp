@@ -31,10 +31,9 @@ public:
     void
     send_hot_tb(uint8_t proc, uint8_t core, uint64_t addr, uint16_t type, uint16_t size);
 
-    inline uint64_t get_cache_cycles(int model_idx, int core_id)
+    inline uint64_t get_cache_cycles(VPMU_Cache::Data& data, int model_idx, int core_id)
     {
         VPMU_Cache::Model model  = get_model(model_idx);
-        VPMU_Cache::Data  data   = get_data(model_idx);
         uint64_t          cycles = 0;
 
         if (core_id == -1) {
@@ -87,6 +86,62 @@ public:
         return cycles;
     }
 
+    inline uint64_t get_cache_cycles(int model_idx, int core_id)
+    {
+        VPMU_Cache::Data data = get_data(model_idx);
+        return get_cache_cycles(data, model_idx, core_id);
+    }
+
+    /// @brief The miss penalties of each core in cycles, from the latest synced data.
+    /// @details It does not wait for any epoch, the OoO core models poll it while the
+    /// trace is being simulated. The misses of shared levels (L2 and beyond) are split
+    /// to the cores by their L1 data cache misses. Only the miss counters are read from
+    /// the published data, the whole VPMU_Cache::Data is not copied.
+    /// @param miss_cycles The cumulative penalties of each core, the output.
+    inline void get_miss_cycles(int model_idx, uint64_t* miss_cycles)
+    {
+        VPMU_Cache::Model model  = get_model(model_idx);
+        uint64_t          shared = 0, l1_total = 0;
+        uint64_t          l1_misses[VPMU_MAX_CPU_CORES] = {};
+
+        read_latest_data(model_idx, [&](const VPMU_Cache::Data& data) {
+            int level = VPMU_Cache::L1_CACHE;
+            shared = l1_total = 0;
+            for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
+                auto& i_cache = data.insn_cache[PROCESSOR_CPU][level][i];
+                auto& d_cache = data.data_cache[PROCESSOR_CPU][level][i];
+
+                l1_misses[i] =
+                  d_cache[VPMU_Cache::READ_MISS] + d_cache[VPMU_Cache::WRITE_MISS];
+                l1_total += l1_misses[i];
+                miss_cycles[i] =
+                  model.latency[level] * (i_cache[VPMU_Cache::READ_MISS] + l1_misses[i]);
+            }
+            for (level = VPMU_Cache::L2_CACHE; level <= model.levels; level++) {
+                auto& cache = data.data_cache[PROCESSOR_CPU][level][0];
+                uint64_t misses =
+                  cache[VPMU_Cache::READ_MISS] + cache[VPMU_Cache::WRITE_MISS];
+                shared += model.latency[level] * misses;
+            }
+        });
+        if (l1_total == 0) return;
+        for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
+            miss_cycles[i] += (double)shared * l1_misses[i] / l1_total;
+        }
+    }
+
+    /// The penalty of a memory access missing all levels of cache, in cycles.
+    inline uint64_t get_max_miss_cycles(int model_idx)
+    {
+        VPMU_Cache::Model model  = get_model(model_idx);
+        uint64_t          cycles = 0;
+
+        for (int level = VPMU_Cache::L1_CACHE; level <= model.levels; level++) {
+            cycles += model.latency[level];
+        }
+        return cycles;
+    }
+
     inline uint64_t get_memory_time_ns(int model_idx)
     {
         VPMU_Cache::Data data = get_data(model_idx);
@@ -37,15 +37,32 @@ public:
             return data.sum_all_mode().total_insn[core_id];
     }
 
-    inline uint64_t get_cycles(int model_idx, int core_id)
+    inline uint64_t get_cycles(VPMU_Insn::Data& data, int core_id)
     {
-        VPMU_Insn::Data data = get_data(model_idx);
         if (core_id == -1)
             return data.sum_all().cycles;
         else
             return data.sum_all_mode().cycles[core_id];
     }
 
+    inline uint64_t get_cycles(int model_idx, int core_id)
+    {
+        VPMU_Insn::Data data = get_data(model_idx);
+        return get_cycles(data, core_id);
+    }
+
+    /// The cache miss penalties which an OoO model has included in its cycles
+    inline uint64_t get_cache_cycles(VPMU_Insn::Data& data)
+    {
+        return data.sum_all().cache_cycles;
+    }
+
+    inline uint64_t get_cache_cycles(int model_idx)
+    {
+        VPMU_Insn::Data data = get_data(model_idx);
+        return get_cache_cycles(data);
+    }
+
     // TODO
     // Summarize instruction count of all cores means nothing. We define it as prohibit.
     inline uint64_t get_insn_count(void) { return get_insn_count(0, -1); }
@@ -0,0 +1,266 @@
+#include <fcntl.h>    // open
+#include <unistd.h>   // close
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat, lstat, mkdir
+
+extern "C" {
+#include "qemu/memfd.h" // qemu_memfd_alloc()
+}
+#include "vpmu.hpp"          // VPMU common headers, vpmu_copy_from_guest()
+#include "vpmu-utils.hpp"    // vpmu::str::demangle
+#include "elf++.hh"          // elf::elf
+#include "dwarf++.hh"        // dwarf::dwarf
+#include "et-debug-info.hpp" // ET_DebugInfo
+
+#include <boost/filesystem.hpp> // boost::filesystem
+
+static const char     cache_magic[8] = {'V', 'P', 'M', 'U', 'E', 'L', 'F', 'C'};
+static const uint32_t cache_version  = 1;
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_sections;
+    uint64_t num_symbols;
+    uint64_t num_files;
+    uint64_t num_lines;
+};
+
+uint64_t ET_DebugInfo::hash_content(const char* buffer, uint64_t size)
+{
+    uint64_t hash = vpmu::math::bitmix_hash(size);
+    uint64_t i    = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, buffer + i, sizeof(word));
+        hash = vpmu::math::bitmix_hash(hash ^ word);
+    }
+    for (; i < size; i++) {
+        hash = vpmu::math::bitmix_hash(hash ^ (uint8_t)buffer[i]);
+    }
+    return hash;
+}
+
+/// @brief The directory of caches, "" if there is no safe one
+/// @details The caches are trusted on load, so the directory must be private to the
+/// user. It is $XDG_CACHE_HOME/vpmu-elf-cache, or ~/.cache/vpmu-elf-cache, or the one
+/// in the output directory of VPMU.
+static std::string cache_dir(void)
+{
+    static std::string dir = []() {
+        const char* xdg  = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        std::string base;
+        struct stat st;
+
+        if (xdg && xdg[0] == '/')
+            base = xdg;
+        else if (home && home[0] == '/')
+            base = std::string(home) + "/.cache";
+        else
+            base = VPMU.output_path;
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(base, ec);
+        std::string path = base + "/vpmu-elf-cache";
+        mkdir(path.c_str(), 0700);
+        // Never follow a link, nor use a directory of others or writable by others
+        if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)
+            || st.st_uid != getuid())
+            return std::string();
+        if ((st.st_mode & 0077) != 0 && chmod(path.c_str(), 0700) != 0)
+            return std::string();
+        return path;
+    }();
+    return dir;
+}
+
+std::string ET_DebugInfo::cache_path(uint64_t hash)
+{
+    std::string dir = cache_dir();
+    if (dir.empty()) return "";
+    return vpmu::str::formated("%s/%016" PRIx64, dir.c_str(), hash);
+}
+
+bool ET_DebugInfo::parse(int fd)
+{
+    // The loader of libelfin closes the file descriptor after mapping it
+    int loader_fd = dup(fd);
+    if (loader_fd < 0) return false;
+
+    try {
+        elf::elf ef(elf::create_mmap_loader(loader_fd));
+        for (auto& sec : ef.sections()) {
+            { // Read section information
+                auto& hdr = sec.get_hdr();
+                // Updata section map table
+                section_table[sec.get_name()].beg = hdr.addr;
+                section_table[sec.get_name()].end = hdr.addr + hdr.size;
+                if (hdr.type != elf::sht::symtab && hdr.type != elf::sht::dynsym)
+                    continue;
+            }
+            // Read only symbol sections
+            for (auto sym : sec.as_symtab()) {
+                auto& d = sym.get_data();
+                if (d.type() == elf::stt::func) {
+                    std::string sym_name = vpmu::str::demangle(sym.get_name());
+                    sym_table[sym_name]  = d.value;
+                }
+            }
+        }
+
+        dwarf::dwarf dw(dwarf::elf::create_loader(ef));
+        for (auto cu : dw.compilation_units()) {
+            auto& lt = cu.get_line_table();
+            for (auto& line : lt) {
+                line_table.push(line.address, line.file->path, line.line);
+            }
+        }
+    } catch (elf::format_error e) {
+        // Do nothing if the file is not a valid ELF binary
+        return false;
+    } catch (dwarf::format_error e) {
+        // The binary does not contatin dwarf sections, keep the symbols
+    }
+    line_table.finalize();
+    return true;
+}
+
+bool ET_DebugInfo::load(std::string path)
+{
+    struct stat st;
+    int         fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) return false;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void*  ptr  = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return false;
+
+    const char*        beg = (const char*)ptr;
+    const char*        end = beg + size;
+    const CacheHeader* hdr = (const CacheHeader*)beg;
+    const char*        p   = beg + sizeof(CacheHeader);
+    // Read a null-terminated string, return false if it runs out of the file
+    auto read_str = [&](std::string& str) {
+        const char* s = (const char*)memchr(p, '\0', end - p);
+        if (s == nullptr) return false;
+        str.assign(p, s - p);
+        p = s + 1;
+        return true;
+    };
+    auto read_u64 = [&](uint64_t& value) {
+        if (end - p < (ptrdiff_t)sizeof(value)) return false;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return true;
+    };
+    // Each record takes at least this many bytes, the counts are bounded by the size
+    uint64_t payload = size - sizeof(CacheHeader);
+    bool     ok      = memcmp(hdr->magic, cache_magic, sizeof(cache_magic)) == 0;
+
+    ok = ok && hdr->version == cache_version && hdr->reserved == 0;
+    ok = ok && hdr->num_lines <= payload / sizeof(ET_LineTable::Entry);
+    ok = ok && hdr->num_sections <= payload / (2 * sizeof(uint64_t) + 1);
+    ok = ok && hdr->num_symbols <= payload / (sizeof(uint64_t) + 1);
+    ok = ok && hdr->num_files <= payload;
+
+    if (ok) {
+        // The packed line table is copied as a whole
+        auto& entries = line_table.entries;
+        entries.resize(hdr->num_lines);
+        memcpy(entries.data(), p, hdr->num_lines * sizeof(ET_LineTable::Entry));
+        p += hdr->num_lines * sizeof(ET_LineTable::Entry);
+    }
+    for (uint64_t i = 0; ok && i < hdr->num_sections; i++) {
+        Pair_beg_end addr;
+        std::string  name;
+        ok = read_u64(addr.beg) && read_u64(addr.end) && read_str(name);
+        ok = ok && addr.beg <= addr.end;
+        section_table[name] = addr;
+    }
+    for (uint64_t i = 0; ok && i < hdr->num_symbols; i++) {
+        uint64_t    addr;
+        std::string name;
+        ok              = read_u64(addr) && read_str(name);
+        sym_table[name] = addr;
+    }
+    if (ok) line_table.files.resize(hdr->num_files);
+    for (uint64_t i = 0; ok && i < hdr->num_files; i++) {
+        ok = read_str(line_table.files[i]);
+    }
+    // The lookups are binary searches of the files indexed by the entries
+    ok = ok && p == end;
+    for (size_t i = 0; ok && i < line_table.entries.size(); i++) {
+        auto& e = line_table.entries[i];
+        if (e.file >= line_table.files.size()) ok = false;
+        if (i > 0 && line_table.entries[i - 1].address >= e.address) ok = false;
+    }
+    munmap(ptr, size);
+
+    if (!ok) *this = ET_DebugInfo();
+    return ok;
+}
+
+void ET_DebugInfo::save(std::string path)
+{
+    // Write to a temporary file first, other instances of QEMU might be reading it
+    std::string tmp_path = path + "." + vpmu::utils::get_random_hash_name(8);
+    CacheHeader hdr      = {};
+
+    if (path.empty()) return;
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == nullptr) return;
+
+    memcpy(hdr.magic, cache_magic, sizeof(cache_magic));
+    hdr.version      = cache_version;
+    hdr.num_sections = section_table.size();
+    hdr.num_symbols  = sym_table.size();
+    hdr.num_files    = line_table.files.size();
+    hdr.num_lines    = line_table.entries.size();
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(line_table.entries.data(), sizeof(ET_LineTable::Entry), hdr.num_lines, fp);
+    for (auto& sec : section_table) {
+        fwrite(&sec.second.beg, sizeof(uint64_t), 1, fp);
+        fwrite(&sec.second.end, sizeof(uint64_t), 1, fp);
+        fwrite(sec.first.c_str(), sec.first.size() + 1, 1, fp);
+    }
+    for (auto& sym : sym_table) {
+        fwrite(&sym.second, sizeof(uint64_t), 1, fp);
+        fwrite(sym.first.c_str(), sym.first.size() + 1, 1, fp);
+    }
+    for (auto& file : line_table.files) {
+        fwrite(file.c_str(), file.size() + 1, 1, fp);
+    }
+    bool failed = ferror(fp);
+    fclose(fp);
+
+    if (failed || rename(tmp_path.c_str(), path.c_str()) != 0) remove(tmp_path.c_str());
+}
+
+ET_BinaryImage::ET_BinaryImage(uint64_t new_size) : size(new_size)
+{
+    if (size == 0) return;
+    data = (char*)qemu_memfd_alloc("vpmu-binary", size, 0, &fd);
+}
+
+ET_BinaryImage::~ET_BinaryImage()
+{
+    if (data != nullptr) qemu_memfd_free(data, size, fd);
+}
+
+uint64_t ET_BinaryImage::receive(void* env, uint64_t vaddr, uint64_t len)
+{
+    if (len > remaining()) len = remaining();
+    if (len == 0) return 0;
+
+    uint64_t copied = vpmu_copy_from_guest(data + received, vaddr, len, env);
+    received += copied;
+    return copied;
+}
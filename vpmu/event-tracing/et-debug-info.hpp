@@ -0,0 +1,145 @@
+#ifndef __VPMU_ET_DEBUG_INFO_HPP_
+#define __VPMU_ET_DEBUG_INFO_HPP_
+#pragma once
+
+#include <string>        // std::string
+#include <vector>        // std::vector
+#include <map>           // std::map
+#include <unordered_map> // std::unordered_map
+#include <algorithm>     // std::stable_sort
+
+#include "beg_eng_pair.hpp" // Pair_beg_end class
+
+/// @brief The DWARF line table of a binary as a sorted flat array
+/// @details Each entry is an address with the index of its file name and the line
+/// number. The file names are interned, so a line table of millions of entries only
+/// keeps one string per source file. Entries are pushed in any order and sorted
+/// once by finalize(), the lookup is a binary search.
+class ET_LineTable
+{
+public:
+    struct Entry {
+        uint64_t address;
+        uint32_t file;
+        uint32_t line;
+    };
+
+    void push(uint64_t address, const std::string& file_path, uint32_t line)
+    {
+        auto it = file_index.find(file_path);
+        if (it == file_index.end()) {
+            it = file_index.emplace(file_path, (uint32_t)files.size()).first;
+            files.push_back(file_path);
+        }
+        entries.push_back({address, it->second, line});
+    }
+
+    /// Sort the entries by addresses. The last one pushed wins on the same address.
+    void finalize(void)
+    {
+        std::stable_sort(entries.begin(), entries.end(), [](auto& a, auto& b) {
+            return a.address < b.address;
+        });
+        std::vector<Entry> unique_entries;
+        unique_entries.reserve(entries.size());
+        for (auto& e : entries) {
+            if (!unique_entries.empty() && unique_entries.back().address == e.address)
+                unique_entries.back() = e;
+            else
+                unique_entries.push_back(e);
+        }
+        entries.swap(unique_entries);
+        file_index.clear();
+    }
+
+    /// @brief Find "file:line" of the biggest address smaller than or equal to pc
+    /// @return "" when not found
+    std::string find(uint64_t pc) const
+    {
+        auto low = std::lower_bound(
+          entries.begin(), entries.end(), pc, [](const Entry& e, uint64_t addr) {
+              return e.address < addr;
+          });
+        if (low == entries.end() || low->address > pc) {
+            if (low == entries.begin()) return "";
+            low--;
+        }
+        return files[low->file] + ":" + std::to_string(low->line);
+    }
+
+    inline size_t size(void) const { return entries.size(); }
+
+public:
+    /// Sorted by addresses after finalize()
+    std::vector<Entry> entries = {};
+    /// The interned file names
+    std::vector<std::string> files = {};
+
+private:
+    /// Only used while pushing the entries
+    std::unordered_map<std::string, uint32_t> file_index = {};
+};
+
+/// @brief The symbols and lines parsed from the ELF/DWARF of a binary
+/// @details Parsing a binary is slow, so the result is cached on disk and keyed by the
+/// hash of the content of the binary. Loading a cache maps the file and copies the
+/// packed line table as a whole.
+///
+/// Cache layout (all integers are little endian as in the host):
+///   "VPMUELFC", uint32_t version, uint32_t reserved,
+///   uint64_t number of sections, symbols, files, lines,
+///   ET_LineTable::Entry lines[number of lines],
+///   {uint64_t beg, uint64_t end, null-terminated name} sections[number of sections],
+///   {uint64_t address, null-terminated name} symbols[number of symbols],
+///   null-terminated file names[number of files]
+class ET_DebugInfo
+{
+public:
+    /// Hash the content of a binary for the key of caches
+    static uint64_t hash_content(const char* buffer, uint64_t size);
+    /// The path to the cache of the content hash
+    static std::string cache_path(uint64_t hash);
+
+    /// @brief Parse the symbols and the line table from an ELF file
+    /// @details The file is mapped by libelfin through a duplicate of fd, the caller
+    /// still owns fd. Return false on failure.
+    bool parse(int fd);
+    /// Return false when the cache does not exist or it is broken
+    bool load(std::string path);
+    void save(std::string path);
+
+    /// The section address table
+    std::map<std::string, Pair_beg_end> section_table = {};
+    /// The function address table
+    std::map<std::string, uint64_t> sym_table = {};
+    /// The dwarf file and line table
+    ET_LineTable line_table = {};
+};
+
+/// @brief The image of a guest binary assembled from the chunks pushed by the guest
+/// @details The image is backed by a memfd (or an unlinked temporary file on the hosts
+/// without memfd), so it is parsed in place without writing it to a shared path.
+/// The host only allocates the pages when the guest writes them.
+class ET_BinaryImage
+{
+public:
+    ET_BinaryImage(uint64_t new_size);
+    ~ET_BinaryImage();
+
+    ET_BinaryImage(const ET_BinaryImage&) = delete;
+    ET_BinaryImage& operator=(const ET_BinaryImage&) = delete;
+
+    /// Copy the next chunk from the guest, return the number of bytes copied
+    uint64_t receive(void* env, uint64_t vaddr, uint64_t len);
+
+    inline bool     valid(void) const { return data != nullptr; }
+    inline bool     complete(void) const { return valid() && received == size; }
+    inline uint64_t remaining(void) const { return valid() ? size - received : 0; }
+
+    uint64_t size     = 0;
+    uint64_t received = 0;
+    char*    data     = nullptr;
+    int      fd       = -1;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "event-tracing.hpp"       // event_tracer, et_get_ret_addr()
+#include "et-function-profile.hpp" // ET_FunctionProfile
+#include "vpmu-math.hpp"           // vpmu::math::sum_cores
+#include "vpmu-utils.hpp"          // vpmu::target
+#include "json.hpp"                // nlohmann::json
+
+#include <map>       // std::map
+#include <algorithm> // std::sort, std::reverse
+
+bool ET_FunctionProfile::add_function(uint64_t           addr,
+                                      const std::string& name,
+                                      const std::string& binary)
+{
+    if (functions.find(addr) != nullptr) return false;
+    functions[addr] = function_list.size();
+    function_list.push_back({name, binary});
+    return true;
+}
+
+void ET_FunctionProfile::inherit_functions(const ET_FunctionProfile& parent)
+{
+    function_list = parent.function_list;
+    functions     = parent.functions;
+    // They are tagged already
+    return_addrs = parent.return_addrs;
+}
+
+uint32_t ET_FunctionProfile::child_node(uint32_t parent, uint32_t function)
+{
+    uint32_t& child = children[(uint64_t)parent << 32 | function];
+    if (child == 0) {
+        Node node;
+        node.function = function;
+        node.parent   = parent;
+        node.depth    = nodes[parent].depth + 1;
+        child         = nodes.size();
+        nodes.push_back(node);
+    }
+    return child;
+}
+
+bool ET_FunctionProfile::call_event(void* env, uint64_t vaddr, ET_Process* process)
+{
+    if (unlikely(!running)) switch_in(vpmu::get_core_id());
+    charge_insn();
+
+    // A return pops the innermost frame returning to vaddr and the frames above it,
+    // which never returned normally (e.g. longjmp)
+    if (return_addrs.find(vaddr) != nullptr) {
+        for (size_t i = frames.size(); i > 0; i--) {
+            if (frames[i - 1].ret_addr == vaddr) {
+                frames.resize(i - 1);
+                return true;
+            }
+        }
+    }
+
+    uint32_t* function = functions.find(vaddr);
+    if (function == nullptr) return false;
+
+    uint32_t parent = current_node();
+    uint32_t node   = parent;
+    if (nodes[parent].depth < max_depth) node = child_node(parent, *function);
+    nodes[node].calls++;
+
+    uint64_t ret_addr = et_get_ret_addr(env);
+    if (frames.size() == max_frames) frames.erase(frames.begin());
+    frames.push_back({node, ret_addr});
+    // The TBs at a new return address must be tagged to see the return
+    if (return_addrs.insert(ret_addr)) event_tracer.trace_address(process, ret_addr);
+    return true;
+}
+
+void ET_FunctionProfile::switch_in(uint64_t new_core_id)
+{
+    core_id   = new_core_id;
+    last_insn = VPMU.core[core_id].insn_count;
+    running   = true;
+}
+
+ET_FunctionProfile::Slice ET_FunctionProfile::switch_out(void)
+{
+    Slice slice;
+
+    if (!running) return slice;
+    charge_insn();
+    running = false;
+
+    slice.counters = node_counters;
+    slice.nodes.reserve(slice_nodes.size());
+    for (auto idx : slice_nodes) {
+        slice.nodes.push_back({idx, nodes[idx].slice_insn});
+        nodes[idx].slice_insn = 0;
+    }
+    slice_nodes.clear();
+    return slice;
+}
+
+void ET_FunctionProfile::charge(const Slice& slice, VPMUSnapshot& delta)
+{
+    using vpmu::math::sum_cores;
+    uint64_t total = 0;
+    uint32_t max   = 0;
+
+    for (auto& s : slice.nodes) {
+        total += s.second;
+        max = std::max(max, s.first);
+    }
+    if (total == 0) return;
+    // The table of the profile taking the slice, which might be reset since then
+    auto& table = *slice.counters;
+    if (table.size() <= max) table.resize(max + 1);
+
+    auto& l1d = delta.cache_data.data_cache[PROCESSOR_CPU][VPMU_Cache::L1_CACHE];
+    // The penalties of branches and caches and the memory time, as the task clock
+    uint64_t memory = vpmu::target::memory_time_ns(delta) / vpmu::target::scale_factor();
+    uint64_t cycles = vpmu::target::in_cpu_cycles(delta) + memory;
+    uint64_t misses = sum_cores(delta.branch_data.wrong);
+    uint64_t cache  = 0;
+    for (int c = 0; c < VPMU.platform.cpu.cores; c++) {
+        cache += l1d[c][VPMU_Cache::READ_MISS] + l1d[c][VPMU_Cache::WRITE_MISS];
+    }
+
+    // The instructions are exact, the others are split by the instructions
+    for (auto& s : slice.nodes) {
+        auto&  counters = table[s.first];
+        double ratio    = (double)s.second / total;
+        counters.insn += s.second;
+        counters.cycles += cycles * ratio;
+        counters.cache_misses += cache * ratio;
+        counters.branch_misses += misses * ratio;
+    }
+}
+
+static nlohmann::json counters_json(const ET_FunctionProfile::Counters& counters)
+{
+    nlohmann::json j;
+
+    j["instructions"] = counters.insn;
+    j["cycles"]       = counters.cycles;
+    j["cacheMisses"]  = counters.cache_misses;
+    j["branchMisses"] = counters.branch_misses;
+    return j;
+}
+
+void ET_FunctionProfile::dump_folded(std::string path, const std::string& root_name)
+{
+    FILE* fp = fopen(path.c_str(), "wt");
+    if (fp == nullptr) return;
+
+    const CountersTable&            table     = *node_counters;
+    size_t                          num_nodes = std::min(table.size(), nodes.size());
+    std::vector<const std::string*> stack;
+    for (size_t i = 0; i < num_nodes; i++) {
+        if (table[i].insn == 0) continue;
+        stack.clear();
+        for (uint32_t n = i; n != 0; n = nodes[n].parent) {
+            stack.push_back(&function_list[nodes[n].function].name);
+        }
+        std::reverse(stack.begin(), stack.end());
+
+        fprintf(fp, "%s", root_name.c_str());
+        for (auto name : stack) fprintf(fp, ";%s", name->c_str());
+        fprintf(fp, " %" PRIu64 "\n", table[i].insn);
+    }
+    fclose(fp);
+}
+
+void ET_FunctionProfile::dump_json(std::string path, const std::string& root_name)
+{
+    struct FunctionStat {
+        uint64_t calls = 0;
+        Counters self  = {};
+        Counters total = {};
+    };
+    const CountersTable&      table     = *node_counters;
+    size_t                    num_nodes = std::min(table.size(), nodes.size());
+    std::vector<Counters>     node_total(nodes.size());
+    std::vector<FunctionStat> stats(function_list.size());
+    // Use std::map to sort the edges by (caller, callee)
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> edges;
+
+    for (size_t i = 0; i < num_nodes; i++) node_total[i] = table[i];
+    // Children are after their parents, sum up the subtrees backward
+    for (size_t i = nodes.size() - 1; i > 0; i--) {
+        node_total[nodes[i].parent] += node_total[i];
+    }
+    for (size_t i = 1; i < nodes.size(); i++) {
+        auto& node = nodes[i];
+        auto& stat = stats[node.function];
+        stat.calls += node.calls;
+        if (i < num_nodes) stat.self += table[i];
+        edges[{nodes[node.parent].function, node.function}] += node.calls;
+
+        // Only the outermost frame of a recursive function counts as its inclusive
+        bool recursive = false;
+        for (uint32_t n = node.parent; n != 0 && !recursive; n = nodes[n].parent) {
+            recursive = (nodes[n].function == node.function);
+        }
+        if (!recursive) stat.total += node_total[i];
+    }
+
+    std::vector<uint32_t> order;
+    for (uint32_t f = 1; f < function_list.size(); f++) {
+        if (stats[f].calls) order.push_back(f);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return stats[a].total.insn > stats[b].total.insn;
+    });
+
+    auto name_of = [&](uint32_t f) {
+        return (f == 0) ? root_name : function_list[f].name;
+    };
+    nlohmann::json j;
+    j["apiVersion"] = SNIPPIT_JSON_API_VERSION;
+    j["total"]      = counters_json(node_total[0]);
+    j["functions"]  = nlohmann::json::array();
+    j["edges"]      = nlohmann::json::array();
+    for (auto f : order) {
+        nlohmann::json e;
+        e["name"]      = function_list[f].name;
+        e["binary"]    = function_list[f].binary;
+        e["calls"]     = stats[f].calls;
+        e["exclusive"] = counters_json(stats[f].self);
+        e["inclusive"] = counters_json(stats[f].total);
+        j["functions"].push_back(e);
+    }
+    for (auto& edge : edges) {
+        j["edges"].push_back({{"caller", name_of(edge.first.first)},
+                              {"callee", name_of(edge.first.second)},
+                              {"calls", edge.second}});
+    }
+
+    FILE* fp = fopen(path.c_str(), "wt");
+    if (fp) {
+        fprintf(fp, "%s\n", j.dump().c_str());
+        fclose(fp);
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef __VPMU_ET_FUNCTION_PROFILE_HPP_
+#define __VPMU_ET_FUNCTION_PROFILE_HPP_
+#pragma once
+
+#include <memory>  // std::shared_ptr
+#include <string>  // std::string
+#include <vector>  // std::vector
+#include <utility> // std::pair
+
+#include "vpmu.hpp"          // VPMU common headers
+#include "vpmu-snapshot.hpp" // VPMUSnapshot
+#include "function-map.hpp"  // FlatHashMap
+
+class ET_Process;
+
+/// @brief Attribute the counters of a guest thread to its functions
+/// @details The entries of functions and the addresses they return to are tagged at
+/// translation time, so call_event() sees every call and return of the thread. A
+/// shadow call stack of these events builds a calling context tree (CCT), one node per
+/// distinct call path. The instructions are read from the cheap per-core counter on
+/// every event and charged to the node on the top of the stack.
+///
+/// The other counters are only known per time slice, i.e. between two context switches
+/// of the thread. The nodes run in a slice are handed to charge() with the counters of
+/// the slice, which splits them by the instructions each node ran. The cycles are the
+/// ones of the task clock, i.e. the pipeline, the branch and cache penalties, and the
+/// memory time in cycles.
+///
+/// The vCPU running the thread owns the stack and the nodes, charge() is run by
+/// VPMU_async() and owns the counters of nodes. A slice holds the counters table of
+/// its profile, so the slices queued before the profile is reset (i.e. the thread
+/// execs) are charged to the table of the old image, which is then dropped.
+class ET_FunctionProfile
+{
+public:
+    /// The counters attributed to a node or a function
+    struct Counters {
+        uint64_t insn          = 0;
+        uint64_t cycles        = 0; ///< Including the cache and memory time
+        uint64_t cache_misses  = 0; ///< L1 data cache read and write misses
+        uint64_t branch_misses = 0;
+
+        Counters& operator+=(const Counters& rhs)
+        {
+            insn += rhs.insn;
+            cycles += rhs.cycles;
+            cache_misses += rhs.cache_misses;
+            branch_misses += rhs.branch_misses;
+            return *this;
+        }
+    };
+
+    /// The counters of the nodes of a profile
+    using CountersTable = std::vector<Counters>;
+
+    /// The nodes run in a time slice and the number of instructions they ran
+    struct Slice {
+        std::vector<std::pair<uint32_t, uint64_t>> nodes;
+        /// The table of the profile the nodes belong to
+        std::shared_ptr<CountersTable> counters;
+    };
+
+    /// The deeper calls are charged to the node at this depth (e.g. deep recursions)
+    static constexpr uint32_t max_depth = 128;
+    /// The oldest frames are dropped when the shadow stack overflows
+    static constexpr uint32_t max_frames = 4096;
+
+    ET_FunctionProfile() { nodes.push_back({}); }
+
+    /// @brief Add a function, return false if the address is added before
+    bool add_function(uint64_t addr, const std::string& name, const std::string& binary);
+    /// Copy the functions (but not the profile) of the thread creating this one
+    void inherit_functions(const ET_FunctionProfile& parent);
+
+    inline bool enabled(void) const { return functions.size() != 0; }
+
+    /// @brief Called with the address of a traced TB of this thread
+    /// @param process The process tracing the return addresses, nullptr to never
+    /// untrace them (see EventTracer::trace_address())
+    /// @return true if it is a call or a return of a profiled function
+    bool call_event(void* env, uint64_t vaddr, ET_Process* process = nullptr);
+
+    /// Start a time slice of this thread on the core
+    void switch_in(uint64_t core_id);
+    /// End the time slice and return the nodes run in it
+    Slice switch_out(void);
+    /// @brief Split the counters of a time slice to its nodes, called by VPMU_async()
+    void charge(const Slice& slice, VPMUSnapshot& delta);
+
+    /// The folded stacks of instructions, the format of FlameGraph (stackcollapse)
+    void dump_folded(std::string path, const std::string& root_name);
+    /// The inclusive and exclusive counters of functions and the call graph edges
+    void dump_json(std::string path, const std::string& root_name);
+
+private:
+    struct Function {
+        std::string name;
+        std::string binary;
+    };
+
+    /// A node of CCT, the root node (index 0) is the thread itself
+    struct Node {
+        uint32_t function   = 0;
+        uint32_t parent     = 0;
+        uint32_t depth      = 0;
+        uint64_t calls      = 0;
+        uint64_t slice_insn = 0; ///< Instructions run in the current time slice
+    };
+
+    /// A call waiting for its return
+    struct Frame {
+        uint32_t node;
+        uint64_t ret_addr;
+    };
+
+    inline uint32_t current_node(void)
+    {
+        return (frames.empty()) ? 0 : frames.back().node;
+    }
+
+    /// Charge the instructions since the last event to the current node
+    inline void charge_insn(void)
+    {
+        uint64_t now  = VPMU.core[core_id].insn_count;
+        uint64_t insn = now - last_insn;
+        uint32_t idx  = current_node();
+
+        last_insn = now;
+        if (insn == 0) return;
+        if (nodes[idx].slice_insn == 0) slice_nodes.push_back(idx);
+        nodes[idx].slice_insn += insn;
+    }
+
+    uint32_t child_node(uint32_t parent, uint32_t function);
+
+    /// The profiled functions, the function 0 is the thread itself
+    std::vector<Function> function_list = {{}};
+    /// The entry addresses of profiled functions to the index of function_list
+    FlatHashMap<uint64_t, uint32_t> functions;
+    /// The return addresses tagged by this thread
+    FlatHashMap<uint64_t, bool> return_addrs;
+
+    /// The calling context tree, a child is always after its parent
+    std::vector<Node> nodes;
+    /// (parent << 32 | function) to the child node
+    FlatHashMap<uint64_t, uint32_t> children;
+    /// The shadow call stack
+    std::vector<Frame> frames = {};
+
+    /// The core running this thread and the instruction counter of the core
+    uint64_t core_id   = 0;
+    uint64_t last_insn = 0;
+    bool     running   = false;
+    /// The nodes with instructions in the current time slice
+    std::vector<uint32_t> slice_nodes = {};
+
+    /// The exclusive counters of nodes. Only accessed by charge() and the dumps.
+    std::shared_ptr<CountersTable> node_counters = std::make_shared<CountersTable>();
+};
+
+#endif
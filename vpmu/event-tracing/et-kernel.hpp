@@ -5,12 +5,18 @@
 extern "C" {
 #include "kernel-event-cb.h"      // Kernel related header
 #include "event-tracing-helper.h" // et_get_ret_addr()
+#include "event-tracing.h"        // et_trace_address()
 }
 
 #include <boost/algorithm/string.hpp> // boost::algorithm::to_lower
 
+#include <atomic>        // std::atomic
+#include <mutex>         // std::mutex
+#include <unordered_map> // std::unordered_map
+
 #include "vpmu.hpp"       // for vpmu-qemu.h and VPMU struct
 #include "vpmu-utils.hpp" // miscellaneous functions
+#include "vpmu-math.hpp"  // vpmu::math::bitmix_hash
 #include "et-program.hpp" // ET_Program class
 
 class ET_Kernel : public ET_Program
@@ -28,23 +34,38 @@ public:
         return true;
     }
 
-    ET_KERNEL_EVENT_TYPE find_event(uint64_t vaddr)
+    /// @brief One probe of the perfect hash table, most of the addresses are not events
+    /// @details The table of the generation read is rebuilt two generations later. The
+    /// probe is retried when the generation changed meanwhile, since the slot might be
+    /// read from a table being rebuilt.
+    inline ET_KERNEL_EVENT_TYPE find_event(uint64_t vaddr)
     {
-        for (int i = 0; i < ET_KERNEL_EVENT_COUNT; i++) {
-            if (kernel_event_table[i] == vaddr) {
-                // DBG(STR_VPMU "Found event-%d \n",i);
-                return (ET_KERNEL_EVENT_TYPE)i;
-            }
-        }
-        return ET_KERNEL_NONE;
+        uint32_t             generation;
+        uint64_t             address;
+        ET_KERNEL_EVENT_TYPE event;
+
+        do {
+            generation            = event_hash_generation.load(std::memory_order_acquire);
+            const EventHash& hash = event_hash[generation & 1];
+            const auto&      slot = hash.slots[(vaddr * hash.multiplier) >> hash.shift];
+            address               = slot.address;
+            event                 = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (event_hash_generation.load(std::memory_order_relaxed) != generation);
+        return (address == vaddr) ? event : ET_KERNEL_NONE;
     }
 
     bool call_event(void* env, uint64_t core_id, uint64_t vaddr)
     {
-        if (functions.call(vaddr, env)) {
-            functions.update_return_key(vaddr, et_get_ret_addr(env));
+        auto& core_functions = functions[core_id];
+        // Only the event addresses have call events, the rest could only be returns
+        if (find_event(vaddr) != ET_KERNEL_NONE && core_functions.call(vaddr, env)) {
+            uint64_t ret_addr = et_get_ret_addr(env);
+            // The TBs at a new return address must be tagged for call_return()
+            if (core_functions.update_return_key(vaddr, ret_addr))
+                et_trace_address(ret_addr);
             return true;
-        } else if (functions.call_return(vaddr, env)) {
+        } else if (core_functions.call_return(vaddr, env)) {
             return true;
         }
         return false;
@@ -61,10 +82,15 @@ public:
     void set_event_address(ET_KERNEL_EVENT_TYPE event, uint64_t address)
     {
         kernel_event_table[event] = address;
-        functions.register_all(address, // Set up all callbacks to the target address
-                               events[event].pre_call,
-                               events[event].on_call,
-                               events[event].on_return);
+        update_event_hash();
+        for (auto& core_functions : functions) {
+            // Set up all callbacks to the target address
+            core_functions.register_all(address,
+                                        events[event].pre_call,
+                                        events[event].on_call,
+                                        events[event].on_return);
+        }
+        et_trace_address(address);
     }
 
     bool set_symbol_address(std::string sym_name, uint64_t address)
@@ -103,6 +129,51 @@ public:
         return true; // Found
     }
 
+    /// @brief Keep the pending kernel calls of a task while it is scheduled out
+    /// @details Called on the context switch of a core. The kernel calls of prev_pid
+    /// waiting for their returns (e.g. a mmap sleeping on I/O) are restored to the
+    /// table of whichever core the task runs on next. Most switches have nothing to
+    /// keep or restore, they never take the lock.
+    void switch_return_stack(uint64_t core_id, uint64_t prev_pid, uint64_t next_pid)
+    {
+        ReturnStack stack;
+
+        bool parking = functions[core_id].has_pending_returns();
+        if (!parking && !maybe_parked(next_pid)) return;
+
+        std::lock_guard<std::mutex> lock(return_stack_lock);
+        if (parking) {
+            functions[core_id].swap_return_stack(stack);
+            park_return_stack(prev_pid, stack);
+        }
+        auto it = task_return_stacks.find(next_pid);
+        if (it != task_return_stacks.end()) {
+            functions[core_id].swap_return_stack(it->second);
+            unpark_return_stack(it);
+        }
+    }
+
+    /// Drop the pending kernel calls of the task running on the core, which exits
+    void clear_return_stack(uint64_t core_id, uint64_t pid)
+    {
+        ReturnStack stack;
+        functions[core_id].swap_return_stack(stack);
+        drop_return_stack(pid);
+    }
+
+    /// @brief Drop the kernel calls kept for the task of pid
+    /// @details A task missing its switch events (e.g. the tracing starts while it is
+    /// sleeping) leaves its calls here. They are dropped when it exits, and when a new
+    /// task takes the pid.
+    void drop_return_stack(uint64_t pid)
+    {
+        if (!maybe_parked(pid)) return;
+
+        std::lock_guard<std::mutex> lock(return_stack_lock);
+        auto                        it = task_return_stacks.find(pid);
+        if (it != task_return_stacks.end()) unpark_return_stack(it);
+    }
+
     uint64_t get_running_pid() { return VPMU.core[vpmu::get_core_id()].current_pid; }
 
     uint64_t get_running_pid(uint64_t core_id)
@@ -115,10 +186,104 @@ public:
     FunctionMap<enum ET_KERNEL_EVENT_TYPE, void*> events;
 
 private:
+    using ReturnStack = FunctionMap<uint64_t, void*>::ReturnStack;
+
+    /// @brief A perfect hash table of the event addresses
+    /// @details The slot of an address is (address * multiplier) >> shift, and the
+    /// multiplier is chosen so that no two event addresses share a slot.
+    struct EventHash {
+        static constexpr uint32_t max_bits = 10;
+
+        struct Slot {
+            uint64_t             address = 0;
+            ET_KERNEL_EVENT_TYPE event   = ET_KERNEL_NONE;
+        };
+
+        uint64_t multiplier = 0;
+        uint32_t shift      = 64 - max_bits;
+        Slot     slots[1 << max_bits];
+    };
+
+    /// Rebuild the perfect hash table of the event addresses
+    void update_event_hash(void)
+    {
+        std::lock_guard<std::mutex> lock(event_hash_lock);
+        // Build the inactive table then publish it as the next generation. The lookups
+        // still reading the inactive one, which is two generations old, are retried.
+        uint32_t   generation = event_hash_generation.load(std::memory_order_relaxed);
+        EventHash& hash       = event_hash[(generation + 1) & 1];
+        uint64_t   seed       = 0x9E3779B97F4A7C15ull;
+
+        // Start from 4 slots per event and double it if no multiplier works
+        for (uint32_t bits = 5; bits <= EventHash::max_bits; bits++) {
+            for (int trial = 0; trial < 1000; trial++) {
+                seed            = vpmu::math::bitmix_hash(seed);
+                hash            = EventHash();
+                hash.multiplier = seed | 1;
+                hash.shift      = 64 - bits;
+                if (fill_event_hash(hash)) {
+                    event_hash_generation.store(generation + 1,
+                                                std::memory_order_release);
+                    return;
+                }
+            }
+        }
+        ERR_MSG(STR_VPMU "Cannot build the hash table of kernel events\n");
+    }
+
+    /// Return false if two event addresses collide
+    bool fill_event_hash(EventHash& hash)
+    {
+        for (int i = 0; i < ET_KERNEL_EVENT_COUNT; i++) {
+            uint64_t address = kernel_event_table[i];
+            if (address == 0) continue;
+            auto& slot = hash.slots[(address * hash.multiplier) >> hash.shift];
+            if (slot.event != ET_KERNEL_NONE && slot.address != address) return false;
+            slot.address = address;
+            slot.event   = (ET_KERNEL_EVENT_TYPE)i;
+        }
+        return true;
+    }
+
+    /// The perfect hash tables of the event addresses, the one of the current
+    /// generation is used by lookups
+    EventHash             event_hash[2]         = {};
+    std::atomic<uint32_t> event_hash_generation = {0};
+    std::mutex            event_hash_lock;
     /// This is only used for checking what critical events are not set
     uint64_t kernel_event_table[ET_KERNEL_EVENT_SIZE] = {0};
     /// This is callback functions of kernel function calls (PC addresses)
-    FunctionMap<uint64_t, void*> functions;
+    /// One table per core, the calls and returns on a core are matched in LIFO order
+    FunctionMap<uint64_t, void*> functions[VPMU_MAX_CPU_CORES];
+    /// The shadow stacks of the tasks scheduled out with kernel calls pending
+    std::unordered_map<uint64_t, ReturnStack> task_return_stacks;
+    // This mutex protects: task_return_stacks, the writes of parked_return_stacks
+    std::mutex return_stack_lock;
+    /// @brief The number of stacks kept for the pids of each bucket, pid % 256
+    /// @details Read without the lock. A task is scheduled in only after the core it
+    /// left has finished the switch, so its stack is counted before it is looked up.
+    std::atomic<uint32_t> parked_return_stacks[256] = {};
+
+    inline bool maybe_parked(uint64_t pid)
+    {
+        auto& count = parked_return_stacks[pid % 256];
+        return count.load(std::memory_order_acquire) != 0;
+    }
+
+    void park_return_stack(uint64_t pid, ReturnStack& stack)
+    {
+        auto result = task_return_stacks.emplace(pid, stack);
+        if (result.second)
+            parked_return_stacks[pid % 256].fetch_add(1, std::memory_order_release);
+        else
+            result.first->second = stack;
+    }
+
+    void unpark_return_stack(std::unordered_map<uint64_t, ReturnStack>::iterator it)
+    {
+        parked_return_stacks[it->first % 256].fetch_sub(1, std::memory_order_release);
+        task_return_stacks.erase(it);
+    }
 };
 
 #endif
@@ -6,19 +6,27 @@ extern "C" {
 #include "vpmu/linux-mm.h" // VM_EXEC and other mmap() mode states
 }
 
-#include <algorithm> // std::sort
-#include <vector>    // std::vector
-#include <string>    // std::string
-#include <mutex>     // Mutex
+#include <map>      // std::map
+#include <vector>   // std::vector
+#include <string>   // std::string
+#include <iterator> // std::next, std::prev
 
 #include "et-program.hpp"   // ET_Program class
 #include "region-info.hpp"  // RegionInfo class
 #include "beg_eng_pair.hpp" // Pair_beg_end class
 
-/// A region can be either region for file or region for named/un-named space
+/// @brief The memory regions mapped in a process, like /proc/<pid>/maps
+/// @details The regions never overlap and they are kept in an interval map keyed by
+/// their start addresses, so looking up an address is O(log n). Mapping, unmapping
+/// and changing the permission of a range split the regions at the boundaries and
+/// only touch the regions inside the range. The executable regions are also packed
+/// into sorted arrays of begin/end addresses for the branch-free find_exec_region().
 class ET_MemoryRegion : public ET_Path
 {
 public:
+    /// The regions keyed by address.beg
+    using RegionMap = std::map<uint64_t, RegionInfo>;
+
     ET_MemoryRegion() {}
     ~ET_MemoryRegion() {}
 
@@ -29,7 +37,9 @@ public:
         RegionInfo r = {};
 
         r.address = {start_addr, end_addr};
-        regions.push_back(r);
+        this->carve(start_addr, end_addr);
+        regions.emplace(start_addr, std::move(r));
+        regions_dirty = true;
     }
 
     void map_region(std::shared_ptr<ET_Program> prog,
@@ -50,17 +60,9 @@ public:
         r.program    = prog;
         r.owner      = {owner_file_name, pc};
 
-        // Overwrite repeated/overlapped regions
-        this->update(start_addr, end_addr - start_addr, permission);
-        RegionInfo& region = this->get(start_addr, end_addr);
-        if (region == RegionInfo::not_found) {
-            // Create a new entry if update can't help to get new memory range
-            regions.push_back(r);
-        } else {
-            // Update the region info
-            region = r;
-        }
-        this->sort_regions();
+        // The new mapping replaces whatever was mapped in its range, as mmap() does
+        this->carve(start_addr, end_addr);
+        regions.emplace(start_addr, std::move(r));
         regions_dirty = true;
     }
 
@@ -73,84 +75,50 @@ public:
         this->map_region({}, pc, start_addr, end_addr, permission, pathname);
     }
 
-    void split(uint64_t split_addr, bool tail_reset_rw, bool rebuild_cache_flag)
-    {
-        auto& region = this->get(split_addr);
-        if (region == RegionInfo::not_found) return;
-        RegionInfo new_regions_l = region;
-        RegionInfo new_regions_r = region;
-
-        // Set rw permission if this region is a tail cut from a bigger one
-        if (tail_reset_rw) {
-            new_regions_r.permission = VM_READ | VM_WRITE;
-        }
-
-        // start_addr <= vaddr <= end_addr
-        new_regions_l.address.end = split_addr;
-        new_regions_r.address.beg = split_addr;
-
-        this->remove_region(region);
-        regions.push_back(new_regions_l);
-        regions.push_back(new_regions_r);
-        if (rebuild_cache_flag) this->rebuild_cache();
-        regions_dirty = true;
-    }
-
     void split(uint64_t split_addr, bool tail_reset_rw)
     {
-        this->split(split_addr, tail_reset_rw, true);
-    }
-
-    void merge(uint64_t start_addr, uint64_t end_addr, bool rebuild_cache_flag)
-    {
-        std::vector<Pair_beg_end> temp_addresses = {};
-        // Store a sample region from the list
-        RegionInfo temp_region = {};
-
-        // Try merge contiguous pages first
-        this->merge_contiguous();
-
-        // Find address range included in [start_addr, end_addr]
-        for (auto& reg : regions) {
-            if (start_addr <= reg.address.beg && reg.address.end <= end_addr) {
-                temp_addresses.push_back(reg.address);
-                temp_region = reg;
-            }
-        }
-
-        // Remove these address ranges in this->regions
-        for (auto& address : temp_addresses) {
-            this->remove_region(address);
-        }
-        if (temp_region.address.beg != 0) {
-            // Update the range of temp_region and push back to this->regions
-            temp_region.address.beg = start_addr;
-            temp_region.address.end = end_addr;
-            this->regions.push_back(temp_region);
-        }
-
-        if (rebuild_cache_flag) this->rebuild_cache();
+        auto it = this->find(split_addr);
+        if (it == regions.end() || it->first == split_addr) return;
+        it = this->split_at(split_addr);
+        // Set rw permission if this region is a tail cut from a bigger one
+        if (tail_reset_rw) it->second.permission = VM_READ | VM_WRITE;
         regions_dirty = true;
     }
 
+    /// Merge the regions inside [start_addr, end_addr) into one region
     void merge(uint64_t start_addr, uint64_t end_addr)
     {
-        this->merge(start_addr, end_addr, true);
+        auto first = regions.lower_bound(start_addr);
+        auto last  = first;
+
+        while (last != regions.end() && last->second.address.end <= end_addr) last++;
+        if (first == last) return;
+        // Keep the info of the last region in the range as a sample
+        RegionInfo merged = std::move(std::prev(last)->second);
+        merged.address    = {start_addr, end_addr};
+        regions.erase(first, last);
+        regions.emplace(start_addr, std::move(merged));
+        regions_dirty = true;
     }
 
     void unmap(uint64_t start_addr, uint64_t end_addr)
     {
-        update_mapping_table_for_region(start_addr, end_addr);
-        this->remove_region({start_addr, end_addr});
+        this->carve(start_addr, end_addr);
+        regions_dirty = true;
     }
 
     void update(uint64_t start_addr, uint64_t end_addr, uint64_t mode)
     {
-        update_mapping_table_for_region(start_addr, end_addr);
-        // Update the permission of target region
-        this->get(start_addr, end_addr).permission = mode;
-        this->sort_regions();  // Sort the regions
-        this->rebuild_cache(); // Rebuild exec mode cache
+        if (start_addr >= end_addr) return;
+        auto first = this->split_at(start_addr);
+        auto last  = this->split_at(end_addr);
+
+        // Update the permission of the regions in the range
+        for (auto it = first; it != last; it++) it->second.permission = mode;
+        // The neighbors might be contiguous with the updated regions now
+        if (first != regions.begin()) first--;
+        this->merge_contiguous(first, last);
+        regions_dirty = true;
     }
 
     bool find_exec_region(uint64_t vaddr)
@@ -158,12 +126,19 @@ public:
         if (regions_dirty) {
             this->rebuild_cache();
         }
-        for (auto& reg : cached_exec_regions) {
-            if (reg.beg <= vaddr && vaddr < reg.end) {
-                return true;
-            }
+        size_t n = cached_exec_beg.size();
+        if (n == 0) return false;
+
+        // Find the last region beginning at or before vaddr. The comparison is
+        // compiled to a conditional move, so there is no branch to mispredict.
+        const uint64_t* base = cached_exec_beg.data();
+        while (n > 1) {
+            size_t half = n / 2;
+            base        = (base[half] <= vaddr) ? base + half : base;
+            n -= half;
         }
-        return false;
+        size_t idx = base - cached_exec_beg.data();
+        return (*base <= vaddr) & (vaddr < cached_exec_end[idx]);
     }
 
     bool find_region(uint64_t vaddr)
@@ -186,42 +161,31 @@ public:
 
     void remove_region(RegionInfo& region)
     {
-        regions.erase(std::remove_if(regions.begin(),
-                                     regions.end(),
-                                     [&](RegionInfo& p) { return (&p == &region); }),
-                      regions.end());
+        auto it = regions.find(region.address.beg);
+        if (it != regions.end() && it->second == region) regions.erase(it);
         regions_dirty = true;
     }
 
     void remove_region(Pair_beg_end address)
     {
-        regions.erase(std::remove_if(regions.begin(),
-                                     regions.end(),
-                                     [&](RegionInfo& p) {
-                                         return (p.address.beg == address.beg)
-                                                && (p.address.end == address.end);
-                                     }),
-                      regions.end());
+        auto it = regions.find(address.beg);
+        if (it != regions.end() && it->second.address.end == address.end) {
+            regions.erase(it);
+        }
         regions_dirty = true;
     }
 
     RegionInfo& get(uint64_t vaddr)
     {
-        for (auto& reg : regions) {
-            if (reg.address.beg <= vaddr && vaddr < reg.address.end) {
-                return reg;
-            }
-        }
+        auto it = this->find(vaddr);
+        if (it != regions.end()) return it->second;
         return RegionInfo::not_found;
     }
 
     RegionInfo& get(uint64_t start_addr, uint64_t end_addr)
     {
-        for (auto& reg : regions) {
-            if (reg.address.beg == start_addr && reg.address.end == end_addr) {
-                return reg;
-            }
-        }
+        auto it = regions.find(start_addr);
+        if (it != regions.end() && it->second.address.end == end_addr) return it->second;
         return RegionInfo::not_found;
     }
 
@@ -229,7 +193,8 @@ public:
 
     RegionInfo& get(std::shared_ptr<ET_Program> program, uint64_t mode)
     {
-        for (auto& reg : regions) {
+        for (auto& r_pair : regions) {
+            auto& reg = r_pair.second;
             // Skip regions with unmatched permissions
             if ((reg.permission & mode) != mode) continue;
             if (reg.program == program) return reg;
@@ -239,7 +204,8 @@ public:
 
     void debug_print_vm_map()
     {
-        for (auto& reg : regions) {
+        for (auto& r_pair : regions) {
+            auto&       reg       = r_pair.second;
             std::string out_str   = "";
             std::string prog_name = (reg.program) ? reg.program->name : "";
             out_str += (reg.permission & VM_READ) ? "r" : "-";
@@ -258,71 +224,86 @@ public:
     }
 
 private:
-    void sort_regions(void)
+    /// Find the region containing vaddr in O(log n)
+    RegionMap::iterator find(uint64_t vaddr)
     {
-        std::sort(regions.begin(), regions.end(), [](RegionInfo a, RegionInfo b) {
-            return a.address.beg < b.address.beg;
-        });
+        auto it = regions.upper_bound(vaddr);
+        if (it == regions.begin()) return regions.end();
+        it--;
+        if (vaddr < it->second.address.end) return it;
+        return regions.end();
     }
 
-    void rebuild_cache(void)
+    /// @brief Split the region containing addr at addr.
+    /// @return The first region beginning at or after addr.
+    RegionMap::iterator split_at(uint64_t addr)
     {
-        cached_exec_regions.clear();
-        for (const auto& reg : regions) {
-            if (reg.permission & VM_EXEC) {
-                cached_exec_regions.push_back(reg.address);
-            }
-        }
-        regions_dirty = false;
+        auto it = this->find(addr);
+        if (it == regions.end()) return regions.lower_bound(addr);
+        if (it->first == addr) return it;
+
+        RegionInfo tail        = it->second;
+        tail.address.beg       = addr;
+        it->second.address.end = addr;
+        return regions.emplace_hint(std::next(it), addr, std::move(tail));
     }
 
-    void merge_contiguous(void)
+    /// Remove [start_addr, end_addr) from the regions, cutting the ones across it
+    void carve(uint64_t start_addr, uint64_t end_addr)
     {
-        std::vector<RegionInfo> temp_region = {};
-
-        // Check size. regions.size() is unsigned, 0-1 would be a big number.
-        if (regions.size() < 2) return;
-        for (int i = 0; i < regions.size() - 1; i++) {
-            auto& p = regions[i];
-            auto& n = regions[i + 1];
-            if (p.address.end == n.address.beg && p.permission == n.permission
-                && p.pathname == n.pathname) {
-                p.address.end  = n.address.end;
-                n.removed_flag = true;
+        if (start_addr >= end_addr) return;
+        auto first = this->split_at(start_addr);
+        auto last  = this->split_at(end_addr);
+        regions.erase(first, last);
+    }
+
+    /// Merge the contiguous regions with the same attributes in [first, last]
+    void merge_contiguous(RegionMap::iterator first, RegionMap::iterator last)
+    {
+        if (last != regions.end()) last++;
+        for (auto p = first; p != last;) {
+            auto n = std::next(p);
+            if (n == last) break;
+            auto& pr = p->second;
+            auto& nr = n->second;
+            if (pr.address.end == nr.address.beg && pr.permission == nr.permission
+                && pr.pathname == nr.pathname) {
+                pr.address.end = nr.address.end;
+                regions.erase(n);
+            } else {
+                p = n;
             }
         }
-
-        regions.erase(std::remove_if(regions.begin(),
-                                     regions.end(),
-                                     [](RegionInfo& p) { return p.removed_flag; }),
-                      regions.end());
-        regions_dirty = true;
     }
 
-    inline void update_mapping_table_for_region(uint64_t start_addr, uint64_t end_addr)
+    void rebuild_cache(void)
     {
-        RegionInfo region = this->get(start_addr);
-
-        // Try merge two VM region first...
-        this->merge(start_addr, end_addr, false);
-
-        // Then try split regions
-        if (region.address.beg != 0 && region.address.beg != start_addr) {
-            this->split(start_addr, true, false);
-        }
-        if (region.address.end != 0 && region.address.end != end_addr) {
-            this->split(end_addr, (region.address.beg != start_addr), false);
+        cached_exec_beg.clear();
+        cached_exec_end.clear();
+        for (const auto& r_pair : regions) {
+            auto& reg = r_pair.second;
+            if ((reg.permission & VM_EXEC) == 0) continue;
+            if (!cached_exec_end.empty() && cached_exec_end.back() == reg.address.beg) {
+                // Pack the contiguous executable regions into one
+                cached_exec_end.back() = reg.address.end;
+            } else {
+                cached_exec_beg.push_back(reg.address.beg);
+                cached_exec_end.push_back(reg.address.end);
+            }
         }
+        regions_dirty = false;
     }
 
 private:
-    std::vector<Pair_beg_end> cached_exec_regions = {};
+    /// The sorted begin/end addresses of the executable regions
+    std::vector<uint64_t> cached_exec_beg = {};
+    std::vector<uint64_t> cached_exec_end = {};
 
     bool regions_dirty = true;
 
 public:
     // Used to identify the mapped virtual address of this program
-    std::vector<RegionInfo> regions = {};
+    RegionMap regions = {};
 };
 
 #endif
@@ -0,0 +1,159 @@
+#include "event-tracing.hpp" // event_tracer
+#include "et-pc-sampler.hpp" // ET_PCSampler
+
+ET_PCSampler pc_sampler;
+
+void ET_PCSampler::set_insn_interval(uint64_t new_insn_interval)
+{
+    insn_interval = new_insn_interval;
+    for (int c = 0; c < VPMU_MAX_CPU_CORES; c++) {
+        auto& core = VPMU.core[c];
+        // Zero disables the check in the TB helper
+        core.next_sample_insn = (insn_interval) ? core.insn_count + insn_interval : 0;
+    }
+}
+
+void ET_PCSampler::tick(uint64_t now_us)
+{
+    // The interval is rounded up to the period of the device tick
+    if (interval_us == 0 || insn_interval != 0) return;
+    if (now_us < next_sample_us) return;
+    next_sample_us = now_us + interval_us;
+
+    for (int c = 0; c < VPMU.platform.cpu.cores; c++) {
+        auto& core = VPMU.core[c];
+        // The core has not executed anything yet
+        if (core.current_pc == 0) continue;
+        push(c, {core.current_pc, (uint32_t)core.current_pid, core.current_user_mode});
+    }
+}
+
+void ET_PCSampler::record(uint64_t core_id)
+{
+    auto& core = VPMU.core[core_id];
+
+    core.next_sample_insn = core.insn_count + insn_interval;
+    push(core_id, {core.current_pc, (uint32_t)core.current_pid, core.current_user_mode});
+}
+
+void ET_PCSampler::drain(void)
+{
+    std::lock_guard<std::mutex> lock(drain_lock);
+    Sample                      samples[256];
+
+    // The samples pushed from now on need another drain
+    drain_pending = false;
+    for (int c = 0; c < VPMU_MAX_CPU_CORES; c++) {
+        while (uint64_t num = buffers[c].pop(0, samples, 256)) {
+            for (uint64_t i = 0; i < num; i++) {
+                auto& histogram = histograms[samples[i].pid];
+                if (samples[i].user_mode)
+                    histogram.user[samples[i].pc]++;
+                else
+                    histogram.kernel[samples[i].pc]++;
+            }
+        }
+    }
+}
+
+/// "binary;function;file:line" of a user PC of the process
+static std::string symbolize(ET_Process& process, uint64_t pc)
+{
+    RegionInfo* region = &process.vm_maps.get(pc);
+    // Fall back to the regions unmapped before the process exited
+    if (*region == RegionInfo::not_found) region = &process.max_vm_maps.get(pc);
+    if (*region == RegionInfo::not_found || region->program == nullptr)
+        return "[unknown]";
+
+    auto&       program = region->program;
+    uint64_t    addr    = pc;
+    std::string frames  = program->name;
+
+    if (program->is_shared_library) addr -= region->address.beg;
+#ifdef TARGET_ARM
+    // The symbols of Thumb functions are odd, this does not change the function found
+    std::string symbol = program->find_symbol_name(addr | 1);
+#else
+    std::string symbol = program->find_symbol_name(addr);
+#endif
+    std::string line = program->find_code_line_number(addr);
+    frames += ";" + ((symbol.size()) ? symbol : "[unknown]");
+    if (line.size()) frames += ";" + line;
+    return frames;
+}
+
+void ET_PCSampler::fold(std::map<std::string, uint64_t>& folded,
+                        const std::string&               root_name,
+                        const Histogram&                 histogram,
+                        ET_Process*                      process)
+{
+    for (auto& h : histogram.user) {
+        std::string frames = (process) ? symbolize(*process, h.first) : "[user]";
+        folded[root_name + ";" + frames] += h.second;
+    }
+    auto& kernel = event_tracer.get_kernel();
+    for (auto& h : histogram.kernel) {
+        // The symbols of vmlinux, if it is given by -vpmu-kernel-symbol
+        std::string symbol = kernel.find_symbol_name(h.first);
+        std::string frames = (symbol.size()) ? "[kernel];" + symbol : "[kernel]";
+        folded[root_name + ";" + frames] += h.second;
+    }
+}
+
+static void write_folded(std::string path, const std::map<std::string, uint64_t>& folded)
+{
+    FILE* fp = fopen(path.c_str(), "wt");
+    if (fp == nullptr) return;
+    for (auto& f : folded) fprintf(fp, "%s %" PRIu64 "\n", f.first.c_str(), f.second);
+    fclose(fp);
+}
+
+void ET_PCSampler::dump(ET_Process& process, std::string path)
+{
+    std::map<std::string, uint64_t> folded;
+    Histogram                       histogram;
+
+    if (interval_us == 0 && insn_interval == 0) return;
+    drain();
+    {
+        std::lock_guard<std::mutex> lock(drain_lock);
+        auto                        it = histograms.find(process.pid);
+        if (it == histograms.end()) return;
+        histogram = std::move(it->second);
+        histograms.erase(it);
+    }
+    fold(folded, process.name, histogram, &process);
+    write_folded(path, folded);
+}
+
+void ET_PCSampler::finish(void)
+{
+    std::map<std::string, uint64_t> folded;
+    uint64_t                        num_dropped = 0;
+
+    if (interval_us == 0 && insn_interval == 0) return;
+    drain();
+    std::lock_guard<std::mutex> lock(drain_lock);
+    for (auto& h : histograms) {
+        uint64_t    pid     = h.first;
+        auto        process = event_tracer.find_process(pid);
+        std::string name    = (process) ? process->name : "pid";
+        // The pid tells the tasks of the same name apart
+        fold(folded, name + "(" + std::to_string(pid) + ")", h.second, process.get());
+    }
+    histograms.clear();
+    write_folded(std::string(VPMU.output_path) + "/pc_samples", folded);
+
+    for (auto d : dropped) num_dropped += d;
+    if (num_dropped) log("%" PRIu64 " samples are dropped on full buffers", num_dropped);
+}
+
+void et_pc_sampler_tick(uint64_t now_us)
+{
+    pc_sampler.tick(now_us);
+}
+
+void et_pc_sampler_record(uint64_t core_id)
+{
+    pc_sampler.record(core_id);
+}
@@ -0,0 +1,109 @@
+#ifndef __VPMU_ET_PC_SAMPLER_HPP_
+#define __VPMU_ET_PC_SAMPLER_HPP_
+#pragma once
+
+#include <map>           // std::map
+#include <mutex>         // std::mutex
+#include <atomic>        // std::atomic
+#include <string>        // std::string
+#include <unordered_map> // std::unordered_map
+
+#include "vpmu.hpp"       // VPMU common headers and thread_pool
+#include "vpmu-log.hpp"   // VPMULog
+#include "ringbuffer.hpp" // RingBuffer
+
+class ET_Process;
+
+/// @brief Statistical sampling of the PCs of all cores
+/// @details Either the virtual clock tick of VPMU device calls tick() to sample all
+/// cores every interval of the target time, or the TB helper calls record() to sample
+/// a core every number of instructions it executes. A sample is the start of the TB
+/// being executed with the pid and the mode (user or kernel) of the core, read from
+/// VPMU.core[].
+///
+/// Each core has a lock-free ring buffer with a single writer, which is the timer or
+/// the vCPU depending on the mode. The buffers are drained into the histograms of PCs
+/// per pid by thread_pool when they are half full. The PCs are only symbolized when a
+/// process is dumped, with the memory maps and the symbols of the process.
+///
+/// The output is in the folded format of FlameGraph (stackcollapse), i.e. lines of
+/// "process;binary;function;file:line count". The kernel samples are
+/// "process;[kernel];function", or "process;[kernel]" without the symbols of vmlinux.
+class ET_PCSampler : public VPMULog
+{
+public:
+    struct Sample {
+        uint64_t pc;
+        uint32_t pid;
+        uint32_t user_mode;
+    };
+
+    static constexpr int buffer_size = 8192;
+
+    ET_PCSampler() : VPMULog("PCSampler") {}
+    ET_PCSampler(const char* module_name) : VPMULog(module_name) {}
+
+    /// Set the sampling interval in target time, zero disables the timer sampling
+    void set_interval(uint64_t new_interval_us) { interval_us = new_interval_us; }
+    uint64_t get_interval(void) { return interval_us; }
+    /// @brief Sample each core every number of instructions, zero disables it
+    /// @details It replaces the timer sampling, since a buffer has only one writer.
+    void set_insn_interval(uint64_t new_insn_interval);
+
+    /// Called by the virtual clock of VPMU device with the current virtual time
+    void tick(uint64_t now_us);
+    /// Called by the vCPU when the core executed the number of instructions
+    void record(uint64_t core_id);
+
+    /// Write the samples of the process and remove them
+    void dump(ET_Process& process, std::string path);
+    /// Write the samples of the tasks never dumped. Called when VPMU finalizes.
+    void finish(void);
+
+private:
+    /// The number of samples of PCs
+    struct Histogram {
+        std::unordered_map<uint64_t, uint64_t> user;
+        std::unordered_map<uint64_t, uint64_t> kernel;
+    };
+
+    inline void push(uint64_t core_id, const Sample& sample)
+    {
+        auto& buffer = buffers[core_id];
+
+        if (buffer.full()) {
+            dropped[core_id]++;
+            return;
+        }
+        buffer.push(sample);
+        if (buffer.size() > buffer_size / 2 && !drain_pending.exchange(true)) {
+            thread_pool.enqueue_static([this]() { this->drain(); });
+        }
+    }
+
+    /// Move the samples in buffers to the histograms
+    void drain(void);
+    /// Fold the samples of a task by the symbols, process is nullptr if not traced
+    static void fold(std::map<std::string, uint64_t>& folded,
+                     const std::string&               root_name,
+                     const Histogram&                 histogram,
+                     ET_Process*                      process);
+
+    uint64_t interval_us    = 0;
+    uint64_t next_sample_us = 0;
+    uint64_t insn_interval  = 0;
+
+    RingBuffer<Sample, buffer_size> buffers[VPMU_MAX_CPU_CORES];
+    /// The samples dropped when the buffers are full, counted by the writers
+    uint64_t dropped[VPMU_MAX_CPU_CORES] = {};
+    /// True when a drain is enqueued and not started yet
+    std::atomic<bool> drain_pending{false};
+    /// The histograms of PCs of each pid
+    std::unordered_map<uint64_t, Histogram> histograms;
+    // This mutex protects: histograms and the reader side of buffers
+    std::mutex drain_lock;
+};
+
+extern ET_PCSampler pc_sampler;
+
+#endif
@@ -6,9 +6,12 @@ extern "C" {
 #include "event-tracing.hpp" // Event tracing functions
 #include "et-process.hpp"    // ET_Process class
 #include "region-info.hpp"   // RegionInfo class
+#include "phase-detect.hpp"  // phase_detect
+#include "et-pc-sampler.hpp" // pc_sampler
 
 #include "vpmu-template-output.hpp" // vpmu::dump::snapshot
 
+#include <array>     // std::array
 #include <algorithm> // std::set_intersection
 #include <iterator>  // iterator
 
@@ -48,7 +51,8 @@ void ET_Process::dump_vm_map(std::string path)
     FILE* fp = fopen(path.c_str(), "wt");
     if (fp == nullptr) return;
     // Use max_vm_maps instead of vm_maps for coverage
-    for (auto& reg : max_vm_maps.regions) {
+    for (auto& r_pair : max_vm_maps.regions) {
+        auto&       reg       = r_pair.second;
         std::string out_str   = "";
         std::string prog_name = (reg.program) ? reg.program->name : "";
         out_str += (reg.permission & VM_READ) ? "r" : "-";
@@ -70,6 +74,135 @@ void ET_Process::dump_vm_map(std::string path)
     fclose(fp);
 }
 
+/// The events of `perf stat`, in the order of perf_stat_table
+enum PerfStatIndex {
+    PERF_TASK_CLOCK,
+    PERF_CONTEXT_SWITCHES,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_LOADS,
+    PERF_L1D_LOAD_MISSES,
+    PERF_L1D_STORES,
+    PERF_L1D_STORE_MISSES,
+    PERF_L1I_LOADS,
+    PERF_L1I_LOAD_MISSES,
+    PERF_STAT_SIZE
+};
+
+struct PerfStatEvent {
+    const char* event; ///< The event name in perf stat
+    const char* key;   ///< The key in JSON
+};
+
+// clang-format off
+static const PerfStatEvent perf_stat_table[PERF_STAT_SIZE] = {
+    {"task-clock",             "taskClockNs"},
+    {"context-switches",       "contextSwitches"},
+    {"cycles",                 "cycles"},
+    {"instructions",           "instructions"},
+    {"branches",               "branches"},
+    {"branch-misses",          "branchMisses"},
+    {"L1-dcache-loads",        "l1DcacheLoads"},
+    {"L1-dcache-load-misses",  "l1DcacheLoadMisses"},
+    {"L1-dcache-stores",       "l1DcacheStores"},
+    {"L1-dcache-store-misses", "l1DcacheStoreMisses"},
+    {"L1-icache-loads",        "l1IcacheLoads"},
+    {"L1-icache-load-misses",  "l1IcacheLoadMisses"},
+};
+// clang-format on
+
+using PerfStatValues = std::array<uint64_t, PERF_STAT_SIZE>;
+
+/// The counters of a task in the events of `perf stat`
+static PerfStatValues perf_stat_values(ET_Process& process)
+{
+    using vpmu::math::sum_cores;
+    auto&          counters = process.prof_counters;
+    auto           insn     = counters.insn_data.sum_all();
+    auto&          cache    = counters.cache_data;
+    auto&          l1d      = cache.data_cache[PROCESSOR_CPU][VPMU_Cache::L1_CACHE];
+    auto&          l1i      = cache.insn_cache[PROCESSOR_CPU][VPMU_Cache::L1_CACHE];
+    uint64_t       d[VPMU_Cache::SIZE_OF_INDEX] = {};
+    uint64_t       i[VPMU_Cache::SIZE_OF_INDEX] = {};
+    PerfStatValues v                            = {};
+
+    for (int c = 0; c < VPMU.platform.cpu.cores; c++) {
+        for (int idx = 0; idx < VPMU_Cache::SIZE_OF_INDEX; idx++) {
+            d[idx] += l1d[c][idx];
+            i[idx] += l1i[c][idx];
+        }
+    }
+
+    v[PERF_CONTEXT_SWITCHES] = process.context_switches;
+    v[PERF_CYCLES]           = insn.cycles;
+    v[PERF_INSTRUCTIONS]     = insn.total_insn;
+    v[PERF_BRANCHES]         = insn.branch;
+    v[PERF_BRANCH_MISSES]    = sum_cores(counters.branch_data.wrong);
+    v[PERF_L1D_LOADS]        = d[VPMU_Cache::READ];
+    v[PERF_L1D_LOAD_MISSES]  = d[VPMU_Cache::READ_MISS];
+    v[PERF_L1D_STORES]       = d[VPMU_Cache::WRITE];
+    v[PERF_L1D_STORE_MISSES] = d[VPMU_Cache::WRITE_MISS];
+    v[PERF_L1I_LOADS]        = i[VPMU_Cache::READ];
+    v[PERF_L1I_LOAD_MISSES]  = i[VPMU_Cache::READ_MISS];
+
+    // The task clock is the time of the task itself, as vpmu::target::time_ns()
+    // computes it for all cores. The time_ns of the counters is the target time elapsed
+    // while the task ran, which includes the other cores.
+    v[PERF_TASK_CLOCK] = vpmu::target::time_ns(counters);
+    return v;
+}
+
+static nlohmann::json perf_stat_json(ET_Process& process)
+{
+    nlohmann::json j;
+    auto           values = perf_stat_values(process);
+
+    for (int e = 0; e < PERF_STAT_SIZE; e++) j[perf_stat_table[e].key] = values[e];
+    return j;
+}
+
+void ET_Process::dump_perf_stat(std::string path)
+{
+    FILE* fp = fopen(path.c_str(), "wt");
+    if (fp == nullptr) return;
+
+    // This task first, then the tasks (threads or processes) it created
+    std::vector<ET_Process*> tasks = {this};
+    for (auto& child : child_list) tasks.push_back(child.get());
+
+    for (auto task : tasks) {
+        auto v = perf_stat_values(*task);
+
+        fprintf(fp,
+                "\n Performance counter stats for '%s' (pid %" PRIu64 "):\n\n",
+                task->name.c_str(),
+                task->pid);
+        for (int e = 0; e < PERF_STAT_SIZE; e++) {
+            fprintf(fp, "%'20" PRIu64 "      %-24s", v[e], perf_stat_table[e].event);
+            switch (e) {
+            case PERF_TASK_CLOCK:
+                fprintf(fp, " #  in nanoseconds");
+                break;
+            case PERF_INSTRUCTIONS:
+                if (v[PERF_CYCLES] == 0) break;
+                fprintf(fp, " #  %6.2lf  insn per cycle", (double)v[e] / v[PERF_CYCLES]);
+                break;
+            case PERF_BRANCH_MISSES:
+                if (v[PERF_BRANCHES] == 0) break;
+                fprintf(
+                  fp, " #  %6.2lf%% of all branches", 100.0 * v[e] / v[PERF_BRANCHES]);
+                break;
+            default:
+                break;
+            }
+            fprintf(fp, "\n");
+        }
+    }
+    fclose(fp);
+}
+
 void ET_Process::dump_process_info(std::string path)
 {
     // For shorter line
@@ -85,8 +218,11 @@ void ET_Process::dump_process_info(std::string path)
     j["isTopProcess"]    = is_top_process;
     j["hostLaunchTime"]  = host_launchtime;
     j["guestLaunchTime"] = guest_launchtime;
+    j["perfStat"]        = perf_stat_json(*this);
     for (auto& child : child_list) {
-        j["childrens"].push_back({{"name", child->name}, {"pid", child->pid}});
+        j["childrens"].push_back({{"name", child->name},
+                                  {"pid", child->pid},
+                                  {"perfStat", perf_stat_json(*child)}});
     }
     for (auto& binary : binary_list) {
         nlohmann::json b;
@@ -98,7 +234,8 @@ void ET_Process::dump_process_info(std::string path)
 
         j["binaries"].push_back(b);
     }
-    for (auto& region : vm_maps.regions) {
+    for (auto& r_pair : vm_maps.regions) {
+        auto&       region    = r_pair.second;
         std::string perm_str  = "";
         std::string prog_name = "";
         perm_str += (region.permission & VM_READ) ? "r" : "-";
@@ -207,6 +344,34 @@ void ET_Process::dump_timeline(std::string path)
     }
 }
 
+void ET_Process::dump_fast_forward(std::string path)
+{
+    nlohmann::json j;
+    auto&          ff        = ff_report;
+    uint64_t       host_ns   = ff.detailed_host_ns + ff.fast_host_ns;
+    double         insn_cost = 0.0;
+
+    if (ff.detailed_insn) insn_cost = (double)ff.detailed_host_ns / ff.detailed_insn;
+
+    j["detailedWindows"] = ff.detailed_windows;
+    j["fastWindows"]     = ff.fast_windows;
+    j["extrapolatedNs"]  = ff.extrapolated_ns;
+    // The errors of the recorded rates against the detailed simulation
+    j["validations"]   = ff.validations;
+    j["invalidations"] = ff.invalidations;
+    j["meanError"]     = (ff.validations) ? ff.error_sum / ff.validations : 0.0;
+    j["maxError"]      = ff.error_max;
+    // The host time if all the windows were simulated in detail over the real one
+    j["speedup"] =
+      (host_ns) ? insn_cost * (ff.detailed_insn + ff.fast_insn) / host_ns : 1.0;
+
+    FILE* fp = fopen(path.c_str(), "wt");
+    if (fp) {
+        fprintf(fp, "%s\n", j.dump(JSON_DUMP_LEVEL).c_str());
+        fclose(fp);
+    }
+}
+
 template <typename T>
 static inline auto map_to_set(T const& a_map)
 {
@@ -296,7 +461,8 @@ std::map<std::string, uint64_t> ET_Process::get_code_mapping(const Phase& phase)
     std::map<std::string, uint64_t> ret;
 
     // Find out all executable and tracked regions
-    for (auto& region : vm_maps.regions) {
+    for (auto& r_pair : vm_maps.regions) {
+        auto& region = r_pair.second;
         if (region.permission & VM_EXEC && region.program != nullptr) {
             walk_count_vectors.push_back({region.address, region.program, false, {}});
         }
@@ -304,7 +470,7 @@ std::map<std::string, uint64_t> ET_Process::get_code_mapping(const Phase& phase)
 
     // Reset all walk count vectors
     for (auto& region : walk_count_vectors) {
-        if (region.program->line_table.size() > 0) {
+        if (region.program->has_line_table()) {
             region.walk_count.resize(region.addr.end - region.addr.beg);
             std::fill(region.walk_count.begin(), region.walk_count.end(), 0);
             region.has_dwarf = true;
@@ -367,10 +533,18 @@ void ET_Process::dump(void)
 
     // process_info
     dump_process_info(output_dir + "/process_info");
+    dump_perf_stat(output_dir + "/perf_stat");
     dump_vm_map(output_dir + "/vm_maps");
     dump_phases(output_dir + "/phases");
     dump_timeline(output_dir + "/timeline");
     dump_phase_similarity(output_dir + "/phase_similarity_matrix");
+    if (phase_detect.fast_forward_enabled(name))
+        dump_fast_forward(output_dir + "/fast_forward");
+    if (profile.enabled()) {
+        profile.dump_folded(output_dir + "/folded_stacks", name);
+        profile.dump_json(output_dir + "/function_profile", name);
+    }
+    pc_sampler.dump(*this, output_dir + "/pc_samples");
 
     auto  file_path = output_dir + "/profiling";
     FILE* fp        = fopen(file_path.c_str(), "wt");
@@ -389,7 +563,7 @@ void ET_Process::dump(void)
 std::string ET_Process::find_code_line_number(uint64_t pc)
 {
     for (auto& binary : binary_list) {
-        if (binary->line_table.size() == 0) continue;
+        if (!binary->has_line_table()) continue;
         auto ret = binary->find_code_line_number(pc);
         if (ret != "") return ret;
     }
@@ -398,13 +572,14 @@ std::string ET_Process::find_code_line_number(uint64_t pc)
 
 uint64_t ET_Process::get_symbol_addr(std::string name)
 {
-    for (auto& region : this->vm_maps.regions) {
+    for (auto& r_pair : this->vm_maps.regions) {
+        auto& region = r_pair.second;
         if (auto binary = region.program) {
-            if (binary->sym_table.size() == 0) continue;
-            if (binary->sym_table.find(name) == binary->sym_table.end()) continue;
-
+            // Never wait for the binaries being parsed, they are bound when ready
+            if (!binary->is_debug_info_ready()) continue;
             // addr == 0 means the symbol is externed from other libs (relocation sym.)
-            if (uint64_t addr = binary->sym_table[name]) {
+            // or it is not found in this binary
+            if (uint64_t addr = binary->find_symbol_addr(name)) {
                 // Add offsets if it is a shared library
                 if (binary->is_shared_library)
                     return addr + region.address.beg;
@@ -418,8 +593,13 @@ uint64_t ET_Process::get_symbol_addr(std::string name)
 
 bool ET_Process::call_event(void* env, uint64_t vaddr)
 {
+    // The profile must see every call and return, not only the ones of callbacks
+    if (profile.enabled()) profile.call_event(env, vaddr, this);
     if (functions.call(vaddr, env, this)) {
-        functions.update_return_key(vaddr, et_get_ret_addr(env));
+        uint64_t ret_addr = et_get_ret_addr(env);
+        // The TBs at a new return address must be tagged for call_return()
+        if (functions.update_return_key(vaddr, ret_addr))
+            event_tracer.trace_address(this, ret_addr);
         return true;
     }
     if (functions.call_return(vaddr, env, this)) return true;
@@ -2,19 +2,22 @@
 #define __VPMU_PROCESS_HPP_
 #pragma once
 
-#include <string>    // std::string
-#include <vector>    // std::vector
-#include <utility>   // std::forward
-#include <map>       // std::map
-#include <algorithm> // std::remove_if
-
-#include "vpmu.hpp"             // VPMU common headers
-#include "vpmu-utils.hpp"       // miscellaneous functions
-#include "et-program.hpp"       // ET_Program class
-#include "et-memory-region.hpp" // ET_MemoryRegion class for linux/mm
-#include "phase/phase.hpp"      // Phase class
-#include "function-map.hpp"     // FunctionMap class
-#include "json.hpp"             // nlohmann::json
+#include <string>        // std::string
+#include <vector>        // std::vector
+#include <utility>       // std::forward
+#include <map>           // std::map
+#include <unordered_set> // std::unordered_set
+#include <memory>        // std::enable_shared_from_this
+#include <algorithm>     // std::remove_if
+
+#include "vpmu.hpp"                // VPMU common headers
+#include "vpmu-utils.hpp"          // miscellaneous functions
+#include "et-program.hpp"          // ET_Program class
+#include "et-memory-region.hpp"    // ET_MemoryRegion class for linux/mm
+#include "phase/phase.hpp"         // Phase class
+#include "function-map.hpp"        // FunctionMap class
+#include "et-function-profile.hpp" // ET_FunctionProfile class
+#include "json.hpp"                // nlohmann::json
 
 typedef struct {
     uint64_t vaddr;
@@ -25,7 +28,7 @@ typedef struct {
 
 // NOTE that binary_list[0] always exists and is the main program
 //
-class ET_Process : public ET_Path
+class ET_Process : public ET_Path, public std::enable_shared_from_this<ET_Process>
 {
 public:
     ET_Process() = delete; // A process can not be null initialized
@@ -59,27 +62,30 @@ public:
         binary_list  = target_process.binary_list;
         timing_model = target_process.timing_model;
 
-        vm_maps     = target_process.vm_maps;
-        max_vm_maps = target_process.max_vm_maps;
+        vm_maps          = target_process.vm_maps;
+        max_vm_maps      = target_process.max_vm_maps;
+        pending_bindings = target_process.pending_bindings;
+        profile.inherit_functions(target_process.profile);
     }
-    ~ET_Process() { vpmu_qemu_free_cpu_arch_state(cpu_state); }
 
     inline bool operator==(const ET_Process& rhs) { return (this == &rhs); }
     inline bool operator!=(const ET_Process& rhs) { return !(this == &rhs); }
 
-    // CPUState *
+    // CPUArchState *
     inline void set_cpu_state(void* cs)
     {
         // Update the core number that runs this process
         core_id = vpmu::get_core_id();
-        if (cpu_state == nullptr) {
-            cpu_state = vpmu_qemu_clone_cpu_arch_state(cs);
-        } else {
-            // TODO Do we need to update this? It's heavy (about 100 KB)
-            // vpmu_qemu_update_cpu_arch_state(cs, cpu_state);
-        }
+        // Only the MMU registers are copied, it's cheap to update on every switch
+        vpmu_mmu_capture(&mmu_state, cs);
     }
 
+    /// Drop the cached translations when the mappings of this process change
+    inline void flush_tlb(void) { vpmu_mmu_flush(&mmu_state); }
+
+    /// The MMU state for reading the guest memory of this process with vpmu_mmu_read_*
+    inline VPMUMMUState* get_mmu_state(void) { return &mmu_state; }
+
     uint64_t get_symbol_addr(std::string name);
 
     bool call_event(void* env, uint64_t vaddr);
@@ -88,23 +94,24 @@ public:
 
     inline void set_last_mapped_info(MMapInfo new_info)
     {
-        last_mapped_addr[vpmu::get_core_id()] = new_info;
+        last_mapped_addr = new_info;
     }
 
     inline MMapInfo& get_last_mapped_info(void)
     {
-        return last_mapped_addr[vpmu::get_core_id()];
+        return last_mapped_addr;
     }
 
     inline void clear_last_mapped_info(void)
     {
-        last_mapped_addr[vpmu::get_core_id()] = {};
+        last_mapped_addr = {};
     }
 
     void clear_vmmaps(void)
     {
-        vm_maps     = {};
-        max_vm_maps = {};
+        vm_maps          = {};
+        max_vm_maps      = {};
+        pending_bindings = {};
     }
 
     inline uint64_t next_phase_id(void) { return unique_phase_id++; }
@@ -113,9 +120,11 @@ public:
 
     void dump(void);
     void dump_process_info(std::string path);
+    void dump_perf_stat(std::string path);
     void dump_phases(std::string path);
     void dump_timeline(std::string path);
     void dump_phase_similarity(std::string path);
+    void dump_fast_forward(std::string path);
     // Use std::map to sort the output
     std::map<std::string, uint64_t> get_code_mapping(const Phase& phase);
 
@@ -150,10 +159,15 @@ public:
     VPMUSnapshot snapshot_phase = {};
     /// Remember the profiling counters of this process
     VPMUSnapshot prof_counters = {};
+    /// The number of times this process is scheduled out
+    uint64_t context_switches = 0;
     /// Process memory map
     ET_MemoryRegion vm_maps = {};
     /// Process memory map without unmap (just for showing to users)
     ET_MemoryRegion max_vm_maps = {};
+    /// The programs mapped as executable while being parsed, with their base addresses.
+    /// Their functions are bound by EventTracer::bind_pending_programs() when ready.
+    std::vector<std::pair<std::shared_ptr<ET_Program>, uint64_t>> pending_bindings = {};
     /// Binaries bound to this process. (vector of shared pointers)
     std::vector<std::shared_ptr<ET_Program>> binary_list = {};
     /// Processes forked by this process. (vector of shared pointers)
@@ -163,23 +177,39 @@ public:
     std::vector<Phase> phase_list = {};
     /// The current window of this process
     Window current_window = {};
+    /// The target time when the current window begins. It is set by the VPMU_async()
+    /// callbacks of the exec and of the last closed window, in the order of windows.
+    uint64_t window_target_timestamp = 0;
+    /// The closed windows waiting to be classified by the phase worker
+    WindowQueue window_queue;
+    /// Set by the phase worker to bypass the cache and branch streams in next window.
+    /// It is read by the vCPU, access it with __atomic builtins (the process is copied
+    /// on exec, std::atomic is not copyable).
+    bool fast_forward = false;
+    /// The statistics of phase-based fast-forwarding
+    FastForwardReport ff_report = {};
     /// History records of phase ID with a timestamp. pair<hosttime, guesttime, phase ID>
     std::vector<std::array<uint64_t, 3>> phase_history = {};
     /// History records of events with a timestamp. pair<hosttime, guesttime, event ID>
     std::vector<std::array<uint64_t, 3>> event_history = {};
     // The monitored functions of this process
     FunctionMap<uint64_t, void*, ET_Process*> functions;
+    /// The counters of the functions of this process, empty if it's not profiled
+    ET_FunctionProfile profile;
+    /// The addresses traced by this process, released by EventTracer when it's removed
+    std::unordered_set<uint64_t> traced_addresses = {};
 
 private:
-    /// \brief A pointer of type "CPUState *" from QEMU.
+    /// \brief The MMU registers captured when this process is switched in.
     //
-    /// This pointer can be used to translate guest VA to host VA.
+    /// This state can be used to translate guest VA to host VA.
     /// i.e. accessing guest data from host.
-    void* cpu_state = nullptr;
+    VPMUMMUState mmu_state = {};
     /// Used for debugging (logging) things happened on this process
     std::string debug_log = "";
     /// Remember the pointer to lastest mapped region for updating its address at return
-    MMapInfo last_mapped_addr[VPMU_MAX_CPU_CORES] = {};
+    /// One per task, the mmap might return on another core when the task migrates
+    MMapInfo last_mapped_addr = {};
     /// Unique phase id counting from 1
     uint64_t unique_phase_id = 1;
 };
@@ -2,18 +2,22 @@
 #define __VPMU_PROGRAM_HPP_
 #pragma once
 
-#include <string>    // std::string
-#include <vector>    // std::vector
-#include <utility>   // std::forward
-#include <map>       // std::map
-#include <algorithm> // std::remove_if
-#include <mutex>     // std::mutex
-
-#include "vpmu.hpp"         // VPMU common headers
-#include "vpmu-utils.hpp"   // miscellaneous functions
-#include "et-path.hpp"      // ET_Path class
-#include "beg_eng_pair.hpp" // Pair_beg_end class
-#include "json.hpp"         // nlohmann::json
+#include <string>     // std::string
+#include <vector>     // std::vector
+#include <utility>    // std::forward
+#include <map>        // std::map
+#include <algorithm>  // std::remove_if
+#include <mutex>      // std::mutex
+#include <future>     // std::shared_future
+#include <chrono>     // std::chrono::seconds
+#include <functional> // std::function
+
+#include "vpmu.hpp"          // VPMU common headers
+#include "vpmu-utils.hpp"    // miscellaneous functions
+#include "et-path.hpp"       // ET_Path class
+#include "beg_eng_pair.hpp"  // Pair_beg_end class
+#include "et-debug-info.hpp" // ET_DebugInfo, ET_LineTable
+#include "json.hpp"          // nlohmann::json
 
 // TODO VPMU timing model switch
 class ET_Program : public ET_Path
@@ -30,6 +34,7 @@ public:
     {
         std::lock_guard<std::mutex> lock(program_lock);
         sym_table.insert({name, address});
+        symbol_index.clear();
     }
 
     void push_binary(std::shared_ptr<ET_Program>& program)
@@ -43,30 +48,107 @@ public:
         if (program != nullptr) library_list.push_back(program);
     }
 
+    /// @brief Replace the symbols and the line table with the parsed ones
+    void set_debug_info(ET_DebugInfo&& info)
+    {
+        std::lock_guard<std::mutex> lock(program_lock);
+        section_table = std::move(info.section_table);
+        sym_table     = std::move(info.sym_table);
+        line_table    = std::move(info.line_table);
+        symbol_index.clear();
+    }
+
+    /// @brief Set the future of parsing the ELF/DWARF in background
+    void set_debug_info_ready(std::shared_future<void> ready)
+    {
+        std::lock_guard<std::mutex> lock(program_lock);
+        debug_info_ready = ready;
+    }
+
+    /// @brief Block till the ELF/DWARF being parsed in background is loaded
+    void wait_debug_info(void)
+    {
+        std::shared_future<void> ready;
+        {
+            std::lock_guard<std::mutex> lock(program_lock);
+            ready = debug_info_ready;
+        }
+        if (ready.valid()) ready.wait();
+    }
+
+    /// @brief True when nothing is being parsed in background, it never blocks
+    bool is_debug_info_ready(void)
+    {
+        std::lock_guard<std::mutex> lock(program_lock);
+        return !debug_info_ready.valid()
+               || debug_info_ready.wait_for(std::chrono::seconds(0))
+                    == std::future_status::ready;
+    }
+
+    /// @brief Return the address of the symbol, 0 if not found
+    uint64_t find_symbol_addr(const std::string& sym_name)
+    {
+        wait_debug_info();
+        std::lock_guard<std::mutex> lock(program_lock);
+        auto it = sym_table.find(sym_name);
+        return (it != sym_table.end()) ? it->second : 0;
+    }
+
+    /// @brief Visit all the function symbols with their names and addresses
+    void for_each_symbol(std::function<void(const std::string&, uint64_t)> fn)
+    {
+        wait_debug_info();
+        std::lock_guard<std::mutex> lock(program_lock);
+        for (auto& sym : sym_table) fn(sym.first, sym.second);
+    }
+
+    /// @brief Return the name of the function containing the address, "" if not found
+    /// @details Only the start addresses of functions are known, the address belongs to
+    /// the closest function before it in the .text section.
+    std::string find_symbol_name(uint64_t addr)
+    {
+        wait_debug_info();
+        std::lock_guard<std::mutex> lock(program_lock);
+        auto text = section_table.find(".text");
+        if (text != section_table.end()
+            && (addr < text->second.beg || addr >= text->second.end)) {
+            return "";
+        }
+        if (symbol_index.empty()) {
+            // Built on the first lookup, the names point to the keys of sym_table
+            for (auto& sym : sym_table) symbol_index.push_back({sym.second, &sym.first});
+            std::sort(symbol_index.begin(), symbol_index.end());
+        }
+        auto it = std::upper_bound(symbol_index.begin(),
+                                   symbol_index.end(),
+                                   std::make_pair(addr, (const std::string*)UINTPTR_MAX));
+        if (it == symbol_index.begin()) return "";
+        return *(--it)->second;
+    }
+
+    bool has_line_table(void)
+    {
+        wait_debug_info();
+        std::lock_guard<std::mutex> lock(program_lock);
+        return line_table.size() != 0;
+    }
+
     std::string find_code_line_number(uint64_t pc)
     {
-        if (pc < section_table[".text"].beg || pc > section_table[".text"].end) {
+        wait_debug_info();
+        std::lock_guard<std::mutex> lock(program_lock);
+        auto text = section_table.find(".text");
+        if (text == section_table.end() || pc < text->second.beg
+            || pc > text->second.end) {
             // Return not found to all non-text sections
             return "";
         }
-        auto low = line_table.lower_bound(pc);
-        if (low == line_table.end()) {
-            // Not found
-        } else if (low == line_table.begin()) {
-            // Found first element
-            if (low->first == pc) return low->second;
-            // Not found
-        } else {
-            // Found but it's greater than pc
-            if (low->first > pc) low--;
-            // low is now the biggest smaller/equal to pc
-            return low->second;
-        }
-        return "";
+        return line_table.find(pc);
     }
 
     void dump_json(nlohmann::json& j)
     {
+        std::lock_guard<std::mutex> lock(program_lock);
         j["name"]      = name;
         j["fileName"]  = filename;
         j["filePath"]  = path;
@@ -90,13 +172,17 @@ public:
     /// The function address table
     std::map<std::string, uint64_t> sym_table = {};
     /// The dwarf file and line table
-    std::map<uint64_t, std::string> line_table = {};
+    ET_LineTable line_table = {};
+    /// The function addresses sorted with their names, built from sym_table lazily
+    std::vector<std::pair<uint64_t, const std::string*>> symbol_index = {};
     /// Lists of shared pointer objects of dependent libraries
     std::vector<std::shared_ptr<ET_Program>> library_list = {};
     /// Used to identify libraries from binaries
     bool is_shared_library = false;
     /// This mutex protects whole ET_Program
     std::mutex program_lock;
+    /// Ready when the ELF/DWARF parsed in background is loaded
+    std::shared_future<void> debug_info_ready = {};
 };
 
 #endif
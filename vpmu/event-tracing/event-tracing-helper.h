@@ -1,6 +1,8 @@
 #ifndef __VPMU_EVENT_TRACING_HELPER_H_
 #define __VPMU_EVENT_TRACING_HELPER_H_
 
+struct VPMUMMUState;
+
 // The following type of "env" should be "CPUArchState*" when called
 uint64_t et_get_syscall_user_thread_id(void* env);
 uint64_t et_get_syscall_user_thread(void* env);
@@ -9,7 +11,27 @@ uint64_t et_get_ret_addr(void* env);
 uint64_t et_get_ret_value(void* env);
 uint64_t et_get_syscall_num(void* env);
 uint64_t et_get_syscall_arg(void* env, int num);
-void et_parse_dentry_path(void* env, uintptr_t dentry_addr, char* buff, int buff_size);
+// Read the path of the dentry through the MMU state of the task
+void et_parse_dentry_path(struct VPMUMMUState* mmu,
+                          uintptr_t            dentry_addr,
+                          char*                buff,
+                          int                  buff_size);
 uint64_t et_get_switch_to_pid(void *env);
 uint64_t et_get_switch_to_prev_pid(void *env);
+// Invalidate the TBs at vaddr, or when its page is mapped if it is not mapped yet
+void et_invalidate_tb(uint64_t vaddr);
+// Invalidate the TBs at sorted addresses, the ones not mapped yet as et_invalidate_tb()
+void et_invalidate_tbs(const uint64_t* vaddrs, uint64_t num);
+// The number of pages with TBs pending to be invalidated, read without the lock
+extern int et_num_pending_pages;
+// Checked by a vCPU before calling et_invalidate_pending_tbs(), inlined in the lookup
+static inline bool et_has_pending_tbs(void)
+{
+    return __atomic_load_n(&et_num_pending_pages, __ATOMIC_RELAXED) != 0;
+}
+// Called by a vCPU (CPUState*) before it looks up the TB at pc when et_has_pending_tbs(),
+// invalidate the TBs of the page pending to be invalidated
+void et_invalidate_pending_tbs(void* cpu, uint64_t pc);
+// Drop the sorted addresses not traced anymore from the ones pending
+void et_cancel_invalidate_tbs(const uint64_t* vaddrs, uint64_t num);
 #endif
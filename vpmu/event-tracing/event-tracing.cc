@@ -2,12 +2,12 @@ extern "C" {
 #include "vpmu-common.h"   // Include common C headers
 #include "vpmu/linux-mm.h" // VM_EXEC and other mmap() mode states
 }
-#include "vpmu.hpp"          // extern thread_pool
-#include "elf++.hh"          // elf::elf
-#include "dwarf++.hh"        // dwarf::dwarf
-#include "event-tracing.hpp" // EventTracer
-#include "phase/phase.hpp"   // Phase class
-#include "json.hpp"          // nlohmann::json
+#include "vpmu.hpp"               // extern thread_pool
+#include "elf++.hh"               // elf::elf
+#include "event-tracing.hpp"      // EventTracer
+#include "phase/phase.hpp"        // Phase class
+#include "phase/phase-detect.hpp" // phase_detect
+#include "json.hpp"               // nlohmann::json
 
 #include "function-tracing.hpp" // Tracing user functions and custom callbacks
 
@@ -72,30 +72,65 @@ void EventTracer::remove_program(std::string name)
 
 void EventTracer::remove_process(uint64_t pid)
 {
+    std::shared_ptr<ET_Process> process;
+
     if (process_id_map.size() == 0) return;
-    // Lock when updating the process_id_map (thread shared resource)
-    std::lock_guard<std::mutex> lock(process_id_map_lock);
-    // Lock everything below (including the file IO in dump_result)
-    auto process = find_process(pid);
-    if (process == nullptr) return;
+    {
+        // Lock when updating the process_id_map (thread shared resource)
+        std::lock_guard<std::shared_timed_mutex> lock(process_id_map_lock);
+        auto it = process_id_map.find(pid);
+        if (it == process_id_map.end()) return;
+        process = it->second;
+#ifdef CONFIG_VPMU_DEBUG_MSG
+        debug_dump_program_map(process->binary_list[0]);
+        debug_dump_process_map(process);
+#endif
+        log_debug("Remove process %5" PRIu64, pid);
+        process_id_map.erase(it);
+        debug_dump_process_map();
+    }
+    // The slots of other cores are only cleared if they still hold it
+    for (auto& running : running_process) {
+        ET_Process* expected = process.get();
+        running.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed);
+    }
+    untrace_addresses(*process);
 
-    // Always sync before printing the results
+    // Always sync before printing the results. This might block on the back-pressure
+    // of epochs, so no locks are held here.
     VPMU_async([process] {
         // Run this heavy task in a separate thread
-        thread_pool.enqueue_static([process] { process->dump(); });
+        thread_pool.enqueue_static([process] {
+            // The vCPUs might still use the pointer read from running_process. It is
+            // freed after this, with the last copy of the shared_ptr.
+            vpmu_synchronize_vcpus();
+            // Wait for the phase worker to classify the last windows
+            process->window_queue.wait_drained();
+            process->dump();
+            // The phase list is freed with the process
+            phase_detect.forget(process->phase_list);
+        });
     });
+}
 
-#ifdef CONFIG_VPMU_DEBUG_MSG
-    // It's not necessary to find, use it in debug only
-    if (process_id_map.find(pid) != process_id_map.end()) {
-        auto& process = process_id_map[pid];
-        debug_dump_program_map(process->binary_list[0]);
-        debug_dump_process_map(process);
+void EventTracer::untrace_addresses(ET_Process& process)
+{
+    std::vector<uint64_t> old_vaddrs;
+
+    {
+        std::lock_guard<std::mutex> lock(traced_address_lock);
+        for (auto vaddr : process.traced_addresses) {
+            auto it = traced_address.find(vaddr);
+            if (it != traced_address.end() && --it->second == 0) {
+                traced_address.erase(it);
+                old_vaddrs.push_back(vaddr);
+            }
+        }
+        process.traced_addresses.clear();
     }
-#endif
-    log_debug("Remove process %5" PRIu64, pid);
-    process_id_map.erase(pid);
-    debug_dump_process_map();
+    // The addresses of pages never mapped are not invalidated anymore
+    std::sort(old_vaddrs.begin(), old_vaddrs.end());
+    et_cancel_invalidate_tbs(old_vaddrs.data(), old_vaddrs.size());
 }
 
 void EventTracer::clear_shared_libraries(void)
@@ -110,85 +145,131 @@ void EventTracer::clear_shared_libraries(void)
                        program_list.end());
 }
 
-void EventTracer::update_elf_dwarf(std::shared_ptr<ET_Program>& program,
-                                   const char*                  file_name)
+ET_DebugInfo EventTracer::load_elf_dwarf(std::shared_ptr<ET_Program>&     program,
+                                         std::shared_ptr<ET_BinaryImage>& binary,
+                                         uint64_t                         claimed_hash)
 {
-    if (program == nullptr) return;
-    int fd = open(file_name, O_RDONLY);
-    if (fd < 0) {
-        LOG_FATAL("File %s not found!", file_name);
-        return;
+    // Always hash what is received, a cache is never picked by the guest's word
+    uint64_t     hash       = ET_DebugInfo::hash_content(binary->data, binary->size);
+    std::string  cache_path = ET_DebugInfo::cache_path(hash);
+    ET_DebugInfo info;
+
+    if (claimed_hash != 0 && claimed_hash != hash) {
+        log("The content hash of %s from the guest does not match, ignore it",
+            program->name.c_str());
     }
 
-    log_debug("Loading symbol table to %s", program->name.c_str());
-    try {
-        elf::elf ef(elf::create_mmap_loader(fd));
-        for (auto& sec : ef.sections()) {
-            { // Read section information
-                auto& hdr = sec.get_hdr();
-                // Updata section map table
-                program->section_table[sec.get_name()].beg = hdr.addr;
-                program->section_table[sec.get_name()].end = hdr.addr + hdr.size;
-                if (hdr.type != elf::sht::symtab && hdr.type != elf::sht::dynsym)
-                    continue;
-            }
-// Read only symbol sections
-#if 0
-            log_debug("Symbol table '%s':", sec.get_name().c_str());
-            log_debug("%-16s %-5s %-7s %-7s %-5s %s",
-                      "Value",
-                      "Size",
-                      "Type",
-                      "Binding",
-                      "Index",
-                      "Name");
-#endif
-            for (auto sym : sec.as_symtab()) {
-                auto& d = sym.get_data();
-                if (d.type() == elf::stt::func) {
-                    std::string sym_name  = vpmu::str::demangle(sym.get_name());
-#if 0
-                    log_debug("%016" PRIx64 " %5" PRId64 " %-7s %-7s %5s %s",
-                              d.value,
-                              d.size,
-                              to_string(d.type()).c_str(),
-                              to_string(d.binding()).c_str(),
-                              to_string(d.shnxd).c_str(),
-                              sym_name.c_str());
-#endif
-                    program->sym_table[sym_name] = d.value;
-                }
-            }
-        }
+    std::promise<void>       parsed;
+    std::shared_future<void> parsing;
 
-        dwarf::dwarf dw(dwarf::elf::create_loader(ef));
-        for (auto cu : dw.compilation_units()) {
-            // log_debug("--- <%x>\n", (unsigned int)cu.get_section_offset());
-            auto& lt = cu.get_line_table();
-            for (auto& line : lt) {
-                program->line_table[line.address] =
-                  line.file->path + ":" + std::to_string(line.line);
-#if 0
-                if (line.end_sequence)
-                    log_debug("\n");
-                else
-                    log_debug("%-40s%8d%#20" PRIx64 "\n",
-                              line.file->path.c_str(),
-                              line.line,
-                              line.address);
-#endif
-            }
-            // log_debug("\n");
+    {
+        std::lock_guard<std::mutex> lock(parsed_binaries_lock);
+        auto it = parsed_binaries.find(hash);
+        if (it == parsed_binaries.end())
+            parsed_binaries[hash] = parsed.get_future().share();
+        else
+            parsing = it->second;
+    }
+    // The same binary is being parsed for another program, share its cache
+    if (parsing.valid()) return load_elf_dwarf(program, hash);
+
+    if (info.load(cache_path)) {
+        log_debug("Load symbol table of %s from %s",
+                  program->name.c_str(),
+                  cache_path.c_str());
+    } else if (info.parse(binary->fd)) {
+        // Do nothing if the binary is not a valid ELF binary
+        log_debug("Loading symbol table to %s", program->name.c_str());
+        if (info.line_table.size() == 0) {
+            log_debug("Warning: Target binary '%s' does not contatin dwarf sections",
+                      program->name.c_str());
         }
-    } catch (elf::format_error e) {
-        // Do nothing if the file is not a valid ELF binary
-        // LOG_FATAL("bad ELF magic number");
-        return;
-    } catch (dwarf::format_error e) {
-        log_debug("Warning: Target binary '%s' does not contatin dwarf sections",
-                  program->name.c_str());
-        return;
+        info.save(cache_path);
     }
+    parsed.set_value();
+    return info;
+}
+
+ET_DebugInfo EventTracer::load_elf_dwarf(std::shared_ptr<ET_Program>& program,
+                                         uint64_t                     hash)
+{
+    std::string              cache_path = ET_DebugInfo::cache_path(hash);
+    std::shared_future<void> parsing;
+    ET_DebugInfo             info;
+
+    {
+        std::lock_guard<std::mutex> lock(parsed_binaries_lock);
+        auto it = parsed_binaries.find(hash);
+        if (it != parsed_binaries.end()) parsing = it->second;
+    }
+    // The task parsing it runs already, it is safe to wait here
+    if (parsing.valid()) parsing.wait();
+    // A binary failed to be parsed has no cache, it gets nothing as it does in parsing
+    if (info.load(cache_path)) {
+        log_debug("Load symbol table of %s from %s",
+                  program->name.c_str(),
+                  cache_path.c_str());
+    }
+    return info;
+}
+
+void EventTracer::update_elf_dwarf(std::shared_ptr<ET_Program>&    program,
+                                   std::function<ET_DebugInfo()>&& load)
+{
+    if (program == nullptr) return;
+    auto ready = std::make_shared<std::promise<void>>();
+
+    // Parse it in background, the vCPUs only wait when they need the symbols
+    program->set_debug_info_ready(ready->get_future().share());
+    thread_pool.enqueue_static([program, load, ready]() {
+        program->set_debug_info(load());
+        ready->set_value();
+    });
+}
+
+void EventTracer::begin_binary(std::shared_ptr<ET_Program>& program, uint64_t size)
+{
+    receiving_binary  = nullptr;
+    receiving_program = program;
+    receiving_hash    = 0;
+    if (program == nullptr || size == 0) return;
+
+    receiving_binary = std::make_shared<ET_BinaryImage>(size);
+    if (!receiving_binary->valid()) {
+        log("Cannot allocate memory for receiving binary '%s'", program->name.c_str());
+        receiving_binary = nullptr;
+    }
+}
+
+bool EventTracer::find_binary(uint64_t hash)
+{
+    if (receiving_binary == nullptr) return false;
+    // Only a hint, load_elf_dwarf() hashes the content received before reusing a cache
+    receiving_hash = hash;
+
+    std::lock_guard<std::mutex> lock(parsed_binaries_lock);
+    return parsed_binaries.count(hash) != 0
+           || boost::filesystem::exists(ET_DebugInfo::cache_path(hash));
+}
+
+uint64_t EventTracer::receive_binary(void* env, uint64_t vaddr, uint64_t size)
+{
+    if (receiving_binary == nullptr) return 0;
+    uint64_t copied = receiving_binary->receive(env, vaddr, size);
+
+    if (receiving_binary->complete()) {
+        auto program = receiving_program;
+        auto binary  = receiving_binary;
+        auto hash    = receiving_hash;
+        update_elf_dwarf(program, [this, program, binary, hash]() mutable {
+            return load_elf_dwarf(program, binary, hash);
+        });
+        receiving_binary  = nullptr;
+        receiving_program = nullptr;
+    } else if (copied < size) {
+        log("Page fault while receiving binary of %s", receiving_program->name.c_str());
+    }
+    return copied;
 }
 
 void EventTracer::attach_mapped_region(std::shared_ptr<ET_Process>& process,
@@ -245,7 +326,36 @@ void EventTracer::attach_mapped_region(std::shared_ptr<ET_Process>& process,
         process->vm_maps.map_region(program, pc, start_addr, end_addr, mode, fullpath);
         process->max_vm_maps.map_region(program, pc, start_addr, end_addr, mode, fullpath);
     }
-    if (mode & VM_EXEC) ft_load_callbacks(process, program);
+    if (mode & VM_EXEC) bind_mapped_program(process, program, start_addr);
+}
+
+void EventTracer::bind_mapped_program(std::shared_ptr<ET_Process>& process,
+                                      std::shared_ptr<ET_Program>  program,
+                                      uint64_t                     base_addr)
+{
+    // Do not block the vCPU on the binary being parsed
+    if (program && !program->is_debug_info_ready()) {
+        process->pending_bindings.push_back({program, base_addr});
+        return;
+    }
+    ft_load_callbacks(process, program);
+    if (program && function_profile_enabled(process->name))
+        ft_load_profile(process, program, base_addr);
+}
+
+void EventTracer::bind_pending_programs(std::shared_ptr<ET_Process>& process)
+{
+    auto& pending = process->pending_bindings;
+
+    for (size_t i = 0; i < pending.size();) {
+        if (pending[i].first->is_debug_info_ready() == false) {
+            i++;
+            continue;
+        }
+        auto binding = pending[i];
+        pending.erase(pending.begin() + i);
+        bind_mapped_program(process, binding.first, binding.second);
+    }
 }
 
 uint64_t EventTracer::parse_and_set_kernel_symbol(const char* filename)
@@ -477,7 +587,7 @@ bool et_find_process_in_list(const char* name)
     return (event_tracer.find_process(name) != nullptr);
 }
 
-void et_update_program_elf_dwarf(const char* name, const char* host_file_path)
+void et_begin_program_binary(const char* name, uint64_t size)
 {
     auto program = event_tracer.find_program(vpmu::file::basename(name).c_str());
     // Some processes are monitored but binary does not exist in the list.
@@ -490,7 +600,22 @@ void et_update_program_elf_dwarf(const char* name, const char* host_file_path)
             program = process->get_main_program();
         }
     }
-    event_tracer.update_elf_dwarf(program, host_file_path);
+    event_tracer.begin_binary(program, size);
+}
+
+bool et_find_program_binary(uint64_t hash)
+{
+    return event_tracer.find_binary(hash);
+}
+
+uint64_t et_receive_program_binary(void* env, uint64_t vaddr, uint64_t size)
+{
+    return event_tracer.receive_binary(env, vaddr, size);
+}
+
+uint64_t et_program_binary_remaining(void)
+{
+    return event_tracer.binary_remaining();
 }
 
 void et_check_function_call(void*    env,
@@ -499,7 +624,7 @@ void et_check_function_call(void*    env,
                             uint64_t target_addr)
 {
     if (user_mode) {
-        auto process = event_tracer.find_process(VPMU.core[core_id].current_pid);
+        auto process = event_tracer.get_running_process(core_id);
         if (process != nullptr) {
             process->call_event(env, target_addr);
         }
@@ -508,3 +633,13 @@ void et_check_function_call(void*    env,
     }
     return;
 }
+
+void et_trace_address(uint64_t vaddr)
+{
+    event_tracer.trace_address(nullptr, vaddr);
+}
+
+bool et_is_traced_address(uint64_t vaddr)
+{
+    return event_tracer.is_traced_address(vaddr);
+}
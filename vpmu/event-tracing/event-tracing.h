@@ -25,10 +25,26 @@ void et_remove_program_from_list(const char* name);
 bool et_find_program_in_list(const char* name);
 bool et_find_process_in_list(const char* name);
 
-void et_update_program_elf_dwarf(const char* name, const char* host_file_path);
+// Receive the binary of a program in chunks, it is parsed in background when complete
+void et_begin_program_binary(const char* name, uint64_t size);
+// Return true if the binary of the content hash was parsed before, the binary is still
+// received and its cache is reused only if the content received matches
+bool et_find_program_binary(uint64_t hash);
+// Return the number of bytes copied from the guest
+uint64_t et_receive_program_binary(void* env, uint64_t vaddr, uint64_t size);
+uint64_t et_program_binary_remaining(void);
 void et_check_function_call(void*    env,
                             uint64_t core_id,
                             bool     user_mode,
                             uint64_t target_addr);
+// Tag the TBs starting at vaddr so that et_check_function_call() checks them. This is
+// for the kernel, the addresses are never untraced.
+void et_trace_address(uint64_t vaddr);
+// Called by the translators when a TB is translated
+bool et_is_traced_address(uint64_t vaddr);
+// Sample the PCs of all cores, called by the virtual clock tick of VPMU device
+void et_pc_sampler_tick(uint64_t now_us);
+// Sample the PC of the core, called when it executed the number of instructions
+void et_pc_sampler_record(uint64_t core_id);
 
 #endif // __VPMU_EVENT_TRACING_
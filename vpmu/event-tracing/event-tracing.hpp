@@ -13,8 +13,13 @@ extern "C" {
 #include <vector>          // std::vector
 #include <utility>         // std::forward
 #include <map>             // std::map
-#include <algorithm>       // std::remove_if
+#include <unordered_map>   // std::unordered_map
+#include <shared_mutex>    // std::shared_timed_mutex
+#include <algorithm>       // std::remove_if, std::sort
 #include <mutex>           // Mutex
+#include <atomic>          // std::atomic
+#include <future>          // std::shared_future
+#include <functional>      // std::function
 #include "vpmu-log.hpp"    // Log system
 #include "vpmu-utils.hpp"  // Misc. functions
 #include "phase/phase.hpp" // Phase class
@@ -44,15 +49,42 @@ public:
     void remove_program(std::string name);
     void remove_process(uint64_t pid);
     void clear_shared_libraries(void);
-    void update_elf_dwarf(std::shared_ptr<ET_Program>& program, const char* file_name);
+    /// @brief Start receiving the binary of the program in chunks
+    /// @details The transfers are serialized by the VPMU device. A new one drops the
+    /// incomplete one, if any.
+    void begin_binary(std::shared_ptr<ET_Program>& program, uint64_t size);
+    /// @brief Record the content hash of the binary claimed by the guest
+    /// @details The hash is not trusted, the transfer goes on and the host hashes the
+    /// content received. The cache parsed before is reused only if that one matches.
+    /// @return true if a binary of the hash was parsed before
+    bool find_binary(uint64_t hash);
+    /// @brief Receive a chunk of the binary from the guest, return the bytes copied
+    /// @details The binary is parsed in background once all the chunks are received.
+    uint64_t receive_binary(void* env, uint64_t vaddr, uint64_t size);
+    /// The number of bytes of the binary not received yet
+    inline uint64_t binary_remaining(void)
+    {
+        return (receiving_binary != nullptr) ? receiving_binary->remaining() : 0;
+    }
 
     void attach_mapped_region(std::shared_ptr<ET_Process>& process, MMapInfo mmap_info);
+    /// @brief Bind the callbacks and the profiled functions of an executable mapping
+    /// @details The vCPU never waits for a program being parsed in background, the
+    /// binding is deferred to bind_pending_programs() till the parsing completes.
+    void bind_mapped_program(std::shared_ptr<ET_Process>& process,
+                             std::shared_ptr<ET_Program>  program,
+                             uint64_t                     base_addr);
+    /// Bind the deferred programs of the process parsed by now. Called on its events.
+    void bind_pending_programs(std::shared_ptr<ET_Process>& process);
 
     inline std::shared_ptr<ET_Process> add_new_process(const char* name, uint64_t pid)
     {
         // Lock when updating the process_id_map (thread shared resource)
-        std::lock_guard<std::mutex> lock(process_id_map_lock);
+        std::lock_guard<std::shared_timed_mutex> lock(process_id_map_lock);
 
+        auto it = process_id_map.find(pid);
+        // The addresses of the process replaced, e.g. a traced process execs again
+        if (it != process_id_map.end()) untrace_addresses(*it->second);
         auto program = find_program(name);
         // Check if the target program is in the monitoring list
         if (program != nullptr) {
@@ -73,19 +105,22 @@ public:
         return nullptr;
     }
 
+    /// @brief Find a process by its pid. This is for the cold paths (kernel events),
+    /// the vCPU threads use get_running_process() for the process running on them.
     inline std::shared_ptr<ET_Process> find_process(uint64_t pid)
     {
         if (pid == 0) return nullptr; // pid should never be 0
-        for (auto& p_pair : process_id_map) {
-            auto& p = p_pair.second;
-            if (p->pid == pid) return p;
-        }
+        std::shared_lock<std::shared_timed_mutex> lock(process_id_map_lock);
+
+        auto it = process_id_map.find(pid);
+        if (it != process_id_map.end()) return it->second;
         return nullptr;
     }
 
     inline std::shared_ptr<ET_Process> find_process(const char* path)
     {
         if (path == nullptr) return nullptr;
+        std::shared_lock<std::shared_timed_mutex> lock(process_id_map_lock);
 
         for (auto& p_pair : process_id_map) {
             auto& p = p_pair.second;
@@ -100,12 +135,19 @@ public:
         // Fork a new child process
         auto process = std::make_shared<ET_Process>(*parent, child_pid);
         log_debug("Attach process %5" PRIu64 " to %5" PRIu64, child_pid, parent->pid);
+        {
+            // The child checks the functions inherited from its parent
+            std::lock_guard<std::mutex> lock(traced_address_lock);
+            for (auto vaddr : parent->traced_addresses) {
+                retain_address(process.get(), vaddr);
+            }
+        }
         {
             std::lock_guard<std::mutex> lock(process_lock);
             parent->push_child_process(process);
         }
         {
-            std::lock_guard<std::mutex> lock(process_id_map_lock);
+            std::lock_guard<std::shared_timed_mutex> lock(process_id_map_lock);
             process_id_map[child_pid] = process;
         }
         // debug_dump_process_map();
@@ -126,6 +168,83 @@ public:
 
     ET_Kernel& get_kernel(void) { return kernel; }
 
+    /// @brief The traced process running on the core, nullptr if it is not traced.
+    /// @details This is the lookup on the hot path of vCPU threads. The slot is only
+    /// set by the context switches and exec on the same core, so reading it takes
+    /// neither locks nor the atomic reference counts of shared_ptr. A process removed
+    /// from process_id_map is cleared from all slots, and it is freed only after the
+    /// vCPUs leave the TBs they were executing, see remove_process().
+    inline ET_Process* get_running_process(uint64_t core_id)
+    {
+        // The process is published to the core by the lock of process_id_map
+        return running_process[core_id].load(std::memory_order_relaxed);
+    }
+
+    inline void set_running_process(uint64_t core_id, ET_Process* process)
+    {
+        running_process[core_id].store(process, std::memory_order_relaxed);
+    }
+
+    /// @brief Tag the TBs starting at vaddr to be checked for function calls/returns.
+    /// @details The addresses of all processes and the kernel are kept in one set, an
+    /// address traced by one process makes others check it as well, which is harmless.
+    /// The TBs translated before are invalidated to be tagged when translated again.
+    /// @param process The process tracing it, the address is untraced when none of the
+    /// processes tracing it exists. nullptr for the kernel, which is never untraced.
+    inline void trace_address(ET_Process* process, uint64_t vaddr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(traced_address_lock);
+            if (!retain_address(process, vaddr)) return;
+        }
+        et_invalidate_tb(vaddr);
+    }
+
+    /// @brief Tag a batch of addresses, e.g. all the functions of a binary.
+    /// @details Only the addresses not traced yet are invalidated, which skips the
+    /// binaries mapped by other traced processes (e.g. libc). The pages not mapped yet
+    /// are invalidated when a vCPU enters them, see et_invalidate_tbs().
+    inline void trace_addresses(ET_Process* process, const std::vector<uint64_t>& vaddrs)
+    {
+        std::vector<uint64_t> new_vaddrs;
+
+        {
+            std::lock_guard<std::mutex> lock(traced_address_lock);
+            for (auto vaddr : vaddrs) {
+                if (retain_address(process, vaddr)) new_vaddrs.push_back(vaddr);
+            }
+        }
+        // Sorted, the addresses in a page share one translation
+        std::sort(new_vaddrs.begin(), new_vaddrs.end());
+        et_invalidate_tbs(new_vaddrs.data(), new_vaddrs.size());
+    }
+
+    /// @brief Release the addresses traced by the process when it exits or execs
+    /// @details The TBs tagged stay tagged till they are translated again, which only
+    /// costs a check of their calls.
+    void untrace_addresses(ET_Process& process);
+
+    /// @brief Called by the translators, so this is not on the path of executing TBs
+    inline bool is_traced_address(uint64_t vaddr)
+    {
+        std::lock_guard<std::mutex> lock(traced_address_lock);
+        return traced_address.count(vaddr) != 0;
+    }
+
+    /// Set the names of programs to be profiled by functions, "*" for all programs
+    void set_profiled_programs(std::string names)
+    {
+        profiled_programs = vpmu::str::split(names, ",");
+    }
+
+    inline bool function_profile_enabled(const std::string& name)
+    {
+        for (auto& program : profiled_programs) {
+            if (program == "*" || program == name) return true;
+        }
+        return false;
+    }
+
     // Return 0 when parse fail, return linux version number when succeed
     uint64_t parse_and_set_kernel_symbol(const char* filename);
 
@@ -137,19 +256,59 @@ public:
     void debug_dump_binary_list(const ET_Process& process);
     void debug_dump_library_list(const ET_Program& program);
 
+private:
+    /// Run load() in background, the vCPUs only wait when they need the symbols
+    void update_elf_dwarf(std::shared_ptr<ET_Program>&   program,
+                          std::function<ET_DebugInfo()>&& load);
+    /// Load the cache of the binary, or parse it and save the cache. The hash claimed
+    /// by the guest, if not zero, is only checked against the content.
+    ET_DebugInfo load_elf_dwarf(std::shared_ptr<ET_Program>&     program,
+                                std::shared_ptr<ET_BinaryImage>& binary,
+                                uint64_t                         claimed_hash = 0);
+    /// Load the cache of the binary parsed before
+    ET_DebugInfo load_elf_dwarf(std::shared_ptr<ET_Program>& program, uint64_t hash);
+    /// Count a reference of the process to vaddr, return true if it's traced first
+    inline bool retain_address(ET_Process* process, uint64_t vaddr)
+    {
+        // A process counts each address once, the kernel counts all as they are never
+        // released
+        if (process != nullptr && !process->traced_addresses.insert(vaddr).second)
+            return false;
+        // The TBs translated since it was traced are tagged already
+        return traced_address[vaddr]++ == 0;
+    }
+
 public:
     FunctionMap<std::string, void*, ET_Process*> func_callbacks;
 
 private:
     ET_Kernel kernel;
-    std::map<uint64_t, std::shared_ptr<ET_Process>> process_id_map;
+    std::unordered_map<uint64_t, std::shared_ptr<ET_Process>> process_id_map;
     std::vector<std::shared_ptr<ET_Program>> program_list;
-    // This mutex protects: process_id_map
-    std::mutex process_id_map_lock;
+    /// The process running on each core, cached from process_id_map
+    std::atomic<ET_Process*> running_process[VPMU_MAX_CPU_CORES] = {};
+    // This mutex protects: process_id_map. The lookups share it.
+    std::shared_timed_mutex process_id_map_lock;
     // This mutex protects: process
     std::mutex process_lock;
     // This mutex protects: program_list
     std::mutex program_list_lock;
+    /// The start addresses of functions and return addresses being traced, with the
+    /// number of processes tracing them
+    std::unordered_map<uint64_t, uint32_t> traced_address;
+    // This mutex protects: traced_address, ET_Process::traced_addresses
+    std::mutex traced_address_lock;
+    /// The binary being received from the guest and its program
+    std::shared_ptr<ET_BinaryImage> receiving_binary  = nullptr;
+    std::shared_ptr<ET_Program>     receiving_program = nullptr;
+    /// The content hash of the binary being received claimed by the guest, 0 if none
+    uint64_t receiving_hash = 0;
+    /// The content hashes of the binaries parsed, ready when their caches are saved
+    std::unordered_map<uint64_t, std::shared_future<void>> parsed_binaries;
+    // This mutex protects: parsed_binaries
+    std::mutex parsed_binaries_lock;
+    /// The names of programs profiled by ET_FunctionProfile
+    std::vector<std::string> profiled_programs = {};
 };
 
 extern EventTracer event_tracer;
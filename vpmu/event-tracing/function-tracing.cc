@@ -18,9 +18,33 @@ void ft_load_callbacks(std::shared_ptr<ET_Process> process,
                                         funs.pre_call,
                                         funs.on_call,
                                         funs.on_return);
+        // Symbols not found in this binary are at 0, which is never executed
+        if (addr != 0) event_tracer.trace_address(process.get(), addr);
     }
 }
 
+// Profile all the functions of a newly mapped binary
+void ft_load_profile(std::shared_ptr<ET_Process> process,
+                     std::shared_ptr<ET_Program> program,
+                     uint64_t                    base_addr)
+{
+    std::vector<uint64_t> new_addrs;
+    // Add offsets if it is a shared library
+    uint64_t offset = (program->is_shared_library) ? base_addr : 0;
+
+    program->for_each_symbol([&](const std::string& name, uint64_t addr) {
+        // Symbols externed from other libs are at 0
+        if (addr == 0) return;
+#ifdef TARGET_ARM
+        // Clean the Thumb bit
+        addr &= 0xFFFFFFFFFFFFFFFE;
+#endif
+        if (process->profile.add_function(offset + addr, name, program->name))
+            new_addrs.push_back(offset + addr);
+    });
+    event_tracer.trace_addresses(process.get(), new_addrs);
+}
+
 // Register callbacks globally which works on every process
 void ft_register_callbacks(void)
 {
@@ -6,6 +6,9 @@
 
 void ft_load_callbacks(std::shared_ptr<ET_Process> process,
                        std::shared_ptr<ET_Program> program);
+void ft_load_profile(std::shared_ptr<ET_Process> process,
+                     std::shared_ptr<ET_Program> program,
+                     uint64_t                    base_addr);
 void ft_register_callbacks(void);
 
 #endif
@@ -3,15 +3,19 @@ extern "C" {
 #include "vpmu-common.h"   // Include common C headers
 #include "vpmu/linux-mm.h" // VM_EXEC and other mmap() mode states
 }
-#include "event-tracing.hpp" // EventTracer
-#include "phase/phase.hpp"   // Phase class
-#include "json.hpp"          // nlohmann::json
-#include "vpmu-device.h"     // VPMU related definitions
-#include "vpmu-utils.hpp"    // vpmu::host::timestamp_us()
+#include "event-tracing.hpp"      // EventTracer
+#include "phase/phase.hpp"        // Phase class
+#include "phase/phase-detect.hpp" // phase_detect
+#include "json.hpp"               // nlohmann::json
+#include "vpmu-device.h"          // VPMU related definitions
+#include "vpmu-utils.hpp"         // vpmu::host::timestamp_us()
 
 // The global variable storing offsets of kernel struct types
 LinuxStructOffset g_linux_offset;
 LinuxStructSize   g_linux_size;
+// The counters of each core at the last context switch of a traced task.
+// Only accessed by VPMU_async() callbacks, which are run in order by one thread.
+static VPMUSnapshot core_snapshot[VPMU_MAX_CPU_CORES];
 
 /// A helper to print message of mmap
 static inline void print_mode(uintptr_t mode, uintptr_t mask, const char* message)
@@ -210,31 +214,50 @@ bool et_kernel_call_event(void* env, int core_id, uint64_t vaddr)
     return event_tracer.get_kernel().call_event(env, core_id, vaddr);
 }
 
+/// @brief The MMU state of the task running on each core, for the tasks not traced
+/// @details Captured on the kernel events reading the guest memory. Reading through it
+/// never fills the TLB of QEMU.
+static VPMUMMUState core_mmu_state[VPMU_MAX_CPU_CORES] = {};
+
+static inline VPMUMMUState* capture_core_mmu(void* env)
+{
+    VPMUMMUState* mmu = &core_mmu_state[vpmu::get_core_id()];
+    vpmu_mmu_capture(mmu, env);
+    // The state is shared by all the tasks on the core and nothing tells when their
+    // mappings change (e.g. a task exits and another one reuses its page tables), the
+    // reads are one-shot so the translations are never kept across the events
+    vpmu_mmu_flush(mmu);
+    return mmu;
+}
+
 void et_register_callbacks_kernel_events(void)
 {
     auto& kernel = event_tracer.get_kernel();
 
     // Linux Kernel: New process creation
     kernel.events.register_call(ET_KERNEL_EXECV, [](void* env) {
-        const char* bash_path = nullptr;
-        uint64_t    irq_pid   = et_get_syscall_user_thread_id(env);
+        const char*   bash_path = nullptr;
+        uint64_t      irq_pid   = et_get_syscall_user_thread_id(env);
+        VPMUMMUState* mmu       = capture_core_mmu(env);
 
         if (VPMU.platform.linux_version < KERNEL_VERSION(3, 14, 0)) {
             // Old linux pass filename directly as a char*
             bash_path =
-              (const char*)vpmu_read_ptr_from_guest(env, et_get_input_arg(env, 1), 0);
+              (const char*)vpmu_mmu_read_ptr_from_guest(mmu, et_get_input_arg(env, 1), 0);
         } else if (VPMU.platform.linux_version < KERNEL_VERSION(3, 19, 0)) {
             // Later linux pass filename as a struct file *, containing char*
             // but the position of argument is still at the first one.
             uintptr_t name_addr =
-              vpmu_read_uintptr_from_guest(env, et_get_input_arg(env, 1), 0);
-            bash_path = (const char*)vpmu_read_ptr_from_guest(env, name_addr, 0);
+              vpmu_mmu_read_uintptr_from_guest(mmu, et_get_input_arg(env, 1), 0);
+            bash_path = (const char*)vpmu_mmu_read_ptr_from_guest(mmu, name_addr, 0);
         } else {
             // Newer linux pass filename as a struct file *, containing char*
             uintptr_t name_addr =
-              vpmu_read_uintptr_from_guest(env, et_get_input_arg(env, 2), 0);
-            bash_path = (const char*)vpmu_read_ptr_from_guest(env, name_addr, 0);
+              vpmu_mmu_read_uintptr_from_guest(mmu, et_get_input_arg(env, 2), 0);
+            bash_path = (const char*)vpmu_mmu_read_ptr_from_guest(mmu, name_addr, 0);
         }
+        // The file name is not mapped
+        if (bash_path == nullptr) return;
         /*
         DBG(STR_KERNEL "Exec file: %s on core %lu (pid=%lu)\n",
             bash_path,
@@ -247,6 +270,11 @@ void et_register_callbacks_kernel_events(void)
         if (process && !process->is_top_process) {
             // Enter when a script executes a sub-process
             auto timing_model = process->timing_model;
+            // The windows of the old image must not be classified to the new one
+            process->window_queue.wait_drained();
+            phase_detect.forget(process->phase_list);
+            // The addresses of the old image are not traced by the new one
+            event_tracer.untrace_addresses(*process);
             // Create a new process and overwrite all its original contents.
             // This immitates the actual behavior in Linux kernel.
             if (auto program = event_tracer.find_program(bash_path)) {
@@ -279,12 +307,21 @@ void et_register_callbacks_kernel_events(void)
                 process->snapshot         = new_snapshot;
                 process->snapshot_phase   = new_snapshot;
                 process->guest_launchtime = vpmu::target::time_us();
+                // The first window begins here, the others where the last one ends
+                process->window_target_timestamp = process->guest_launchtime;
+                // The counters of this core before exec are not charged to it
+                core_snapshot[core_id] = new_snapshot;
             });
             process->is_running = true;
+            process->profile.switch_in(core_id);
+            event_tracer.set_running_process(core_id, process.get());
             // Since we choose to copy vm_maps on every process/thread creation,
             // there is a need to clear that in a fork-execv condition, i.e. exec a new
             // process instead of pthread multi-threading.
             process->clear_vmmaps();
+            process->flush_tlb();
+            // The state is cleared when a forked process execs
+            process->set_cpu_state(env);
         }
     });
 
@@ -301,35 +338,53 @@ void et_register_callbacks_kernel_events(void)
         */
         VPMU.core[vpmu::get_core_id()].current_pid = pid;
 
-        // Accumulate the profiling counters when a process is scheduled out
+        uint64_t core_id = vpmu::get_core_id();
+        // The pending kernel calls move with the tasks, which might migrate cores
+        event_tracer.get_kernel().switch_return_stack(core_id, prev_pid, pid);
+        auto     process = event_tracer.find_process(pid);
+        event_tracer.set_running_process(core_id, process.get());
+        // The task scheduled out, and the task scheduled in. Null if they are not traced.
+        // NOTE: Sometimes kernel will schedule in a process twice for unknown reason.
+        // We don't need to do snapshot again in this case.
         auto prev_process = event_tracer.find_process(prev_pid);
-        if (prev_pid != pid && prev_process && prev_process->is_running) {
-            uint64_t core_id   = vpmu::get_core_id();
+        auto next_process = process;
+        if (prev_pid == pid || !prev_process || !prev_process->is_running)
+            prev_process = nullptr;
+        if (!next_process || next_process->is_running) next_process = nullptr;
+        // Bind the programs parsed while the task was not running
+        if (next_process) event_tracer.bind_pending_programs(next_process);
+
+        // One per-core snapshot for both tasks. The outgoing one is charged with the
+        // counters of this core since it was scheduled in.
+        if (prev_process || next_process) {
             uint64_t timestamp = vpmu::host::timestamp_us();
-            VPMU_async([prev_process, core_id, timestamp]() {
+            // The functions run in the time slice of the outgoing task
+            ET_FunctionProfile::Slice slice;
+            if (prev_process) slice = prev_process->profile.switch_out();
+            if (next_process) next_process->profile.switch_in(core_id);
+            VPMU_async([prev_process, next_process, core_id, timestamp, slice]() {
                 VPMUSnapshot new_snapshot(true, core_id);
-                prev_process->prof_counters += new_snapshot - prev_process->snapshot;
-                prev_process->snapshot_phase = new_snapshot - prev_process->snapshot_phase;
-                uint64_t target_timestamp = vpmu::target::time_us();
-                prev_process->phase_history.push_back({{timestamp, target_timestamp, 0}});
+                if (prev_process) {
+                    auto delta = new_snapshot - core_snapshot[core_id];
+                    prev_process->prof_counters += delta;
+                    prev_process->profile.charge(slice, delta);
+                    prev_process->context_switches++;
+                    prev_process->snapshot_phase =
+                      new_snapshot - prev_process->snapshot_phase;
+                    uint64_t target_timestamp = vpmu::target::time_us();
+                    prev_process->phase_history.push_back(
+                      {{timestamp, target_timestamp, 0}});
+                }
+                if (next_process) {
+                    next_process->snapshot = new_snapshot;
+                    // Apply previous records before context switching
+                    next_process->snapshot_phase += new_snapshot;
+                }
+                core_snapshot[core_id] = new_snapshot;
             });
-            prev_process->is_running = false;
-        }
-
-        auto process = event_tracer.find_process(pid);
-        // Do snapshot when a process is scheduled in
-        if (process && !process->is_running) {
-            // NOTE: Sometimes kernel will schedule in a process twice for unknown reason.
-            // We don't need to do snapshot again in this case.
-            uint64_t core_id = vpmu::get_core_id();
-            VPMU_async([process, core_id]() {
-                VPMUSnapshot new_snapshot(true, core_id);
-                process->snapshot = new_snapshot;
-                // Apply previous records before context switching
-                process->snapshot_phase += new_snapshot;
-            });
-            process->is_running = true;
         }
+        if (prev_process) prev_process->is_running = false;
+        if (next_process) next_process->is_running = true;
 
         // Turn on/off VPMU depending on the situation
         if (process) {
@@ -352,13 +407,19 @@ void et_register_callbacks_kernel_events(void)
         auto process = event_tracer.find_process(irq_pid);
         if (process) {
             uint64_t core_id = vpmu::get_core_id();
-            VPMU_async([process, core_id]() {
+            auto     slice   = process->profile.switch_out();
+            VPMU_async([process, core_id, slice]() {
                 VPMUSnapshot new_snapshot(true, core_id);
-                process->prof_counters += new_snapshot - process->snapshot;
-                process->snapshot = new_snapshot;
+                auto         delta = new_snapshot - core_snapshot[core_id];
+                process->prof_counters += delta;
+                process->profile.charge(slice, delta);
+                process->snapshot      = new_snapshot;
+                core_snapshot[core_id] = new_snapshot;
             });
             process->is_running = false;
         }
+        // do_exit() never returns, neither do the kernel calls pending in this task
+        event_tracer.get_kernel().clear_return_stack(vpmu::get_core_id(), irq_pid);
         event_tracer.remove_process(irq_pid);
         return;
 
@@ -366,12 +427,24 @@ void et_register_callbacks_kernel_events(void)
 
     // Linux Kernel: wake up the newly forked process
     kernel.events.register_call(ET_KERNEL_WAKE_NEW_TASK, [](void* env) {
-        uint64_t irq_pid    = et_get_syscall_user_thread_id(env);
+        uint64_t      irq_pid = et_get_syscall_user_thread_id(env);
+        auto          parent  = event_tracer.find_process(irq_pid);
+        VPMUMMUState* mmu     = nullptr;
+
+        if (parent) {
+            parent->set_cpu_state(env);
+            mmu = parent->get_mmu_state();
+        } else {
+            mmu = capture_core_mmu(env);
+        }
         uint64_t addr       = et_get_input_arg(env, 1);
         uint64_t offset     = g_linux_offset.task_struct.pid;
-        uint32_t target_pid = vpmu_read_uint32_from_guest(env, addr, offset);
-        // Safe checks are done in this call
-        event_tracer.attach_to_parent(event_tracer.find_process(irq_pid), target_pid);
+        uint32_t target_pid = vpmu_mmu_read_uint32_from_guest(mmu, addr, offset);
+        // pid 0 is never traced, it is returned when the task is not mapped
+        if (target_pid == 0) return;
+        // A new task has no kernel call pending, drop the ones of an old task of the pid
+        event_tracer.get_kernel().drop_return_stack(target_pid);
+        if (parent) event_tracer.attach_to_parent(parent, target_pid);
     });
 
     // Linux Kernel: Fork a process
@@ -385,15 +458,20 @@ void et_register_callbacks_kernel_events(void)
         if (g_linux_offset.dentry.d_iname == 0) return;
         MMapInfo mmap_info = {};
         uint64_t irq_pid   = et_get_syscall_user_thread_id(env);
+        auto     process   = event_tracer.find_process(irq_pid);
+        // The mappings of the tasks not traced are never read
+        if (process == nullptr) return;
 
+        process->set_cpu_state(env);
         // Is struct file * nullptr (anonymous mapping)
         if (et_get_input_arg(env, 1) != 0) {
-            uint64_t addr        = et_get_input_arg(env, 1);
-            uint64_t offset      = g_linux_offset.file.fpath.dentry;
-            uint64_t dentry_addr = vpmu_read_uintptr_from_guest(env, addr, offset);
+            VPMUMMUState* mmu    = process->get_mmu_state();
+            uint64_t      addr   = et_get_input_arg(env, 1);
+            uint64_t      offset = g_linux_offset.file.fpath.dentry;
+            uint64_t dentry_addr = vpmu_mmu_read_uintptr_from_guest(mmu, addr, offset);
             if (dentry_addr == 0) return; // pointer to dentry is zero
             et_parse_dentry_path(
-              env, dentry_addr, mmap_info.fullpath, sizeof(mmap_info.fullpath));
+              mmu, dentry_addr, mmap_info.fullpath, sizeof(mmap_info.fullpath));
         }
         if (VPMU.platform.linux_version < KERNEL_VERSION(3, 9, 0)) {
             mmap_info.mode = et_get_input_arg(env, 5);
@@ -403,12 +481,9 @@ void et_register_callbacks_kernel_events(void)
         mmap_info.vaddr = et_get_input_arg(env, 2);
         mmap_info.len   = et_get_input_arg(env, 3);
 
-        auto process = event_tracer.find_process(irq_pid);
-        if (process != nullptr) {
-            // Remember the latest mapped address for later updating this address value
-            process->set_last_mapped_info(mmap_info);
-            // process->append_debug_log(genlog_mmap(irq_pid, mmap_info));
-        }
+        // Remember the latest mapped address for later updating this address value
+        process->set_last_mapped_info(mmap_info);
+        // process->append_debug_log(genlog_mmap(irq_pid, mmap_info));
     });
 
     kernel.events.register_return(ET_KERNEL_MMAP, [](void* env) {
@@ -417,6 +492,7 @@ void et_register_callbacks_kernel_events(void)
         uint64_t irq_pid = et_get_syscall_user_thread_id(env);
 
         auto process = event_tracer.find_process(irq_pid);
+        if (process) event_tracer.bind_pending_programs(process);
         if (process && process->get_last_mapped_info().vaddr != 0) {
             uint64_t vaddr     = et_get_ret_value(env);
             auto&    mmap_info = process->get_last_mapped_info();
@@ -443,6 +519,7 @@ void et_register_callbacks_kernel_events(void)
         if (process) {
             process->vm_maps.update(start_addr, end_addr, mode);
             process->max_vm_maps.update(start_addr, end_addr, mode);
+            process->flush_tlb();
             // auto buff = genlog_mprotect(irq_pid, {start_addr, end_addr, mode, ""});
             // process->append_debug_log(buff);
             // process->vm_maps.debug_print_vm_map();
@@ -462,6 +539,7 @@ void et_register_callbacks_kernel_events(void)
             (void)end_addr;
             // Unmap the region
             process->vm_maps.unmap(start_addr, end_addr);
+            process->flush_tlb();
             // process->append_debug_log(genlog_unmap(irq_pid, start_addr, end_addr));
             // process->vm_maps.debug_print_vm_map();
         }
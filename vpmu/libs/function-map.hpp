@@ -2,14 +2,243 @@
 #define __FUNCTION_MAP_HPP_
 #pragma once
 
-#include <map>
-#include <functional>
+#include <new>         // placement new
+#include <vector>      // std::vector
+#include <utility>     // std::pair, std::forward
+#include <functional>  // std::hash
+#include <type_traits> // std::enable_if, std::decay
 
 #ifndef likely
 #define likely(x) __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
 #endif
 
+/// @brief A callable stored inline without heap allocations
+/// @details It works like std::function<void(Args...)>, but the callable must fit in
+/// the inline storage, which is checked at compile time. The storage is big enough
+/// for lambdas capturing a few pointers and even a std::function.
+template <class... Args>
+class InlineCallback
+{
+public:
+    static constexpr size_t capacity = 4 * sizeof(void*);
+
+    InlineCallback() {}
+    InlineCallback(std::nullptr_t) {}
+
+    template <class F,
+              class = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, InlineCallback>::value>::type>
+    InlineCallback(F&& f)
+    {
+        using T = typename std::decay<F>::type;
+        static_assert(sizeof(T) <= capacity, "The callable is too big to be inlined");
+        static_assert(alignof(T) <= alignof(void*), "The callable is over-aligned");
+
+        // Keep it empty when it's an empty std::function or a null function pointer
+        if (is_null(f, 0)) return;
+        new (storage) T(std::forward<F>(f));
+        invoker = [](void* p, Args... args) { (*(T*)p)(std::forward<Args>(args)...); };
+        manager = [](void* dst, void* src) {
+            if (dst != nullptr)
+                new (dst) T(*(const T*)src);
+            else
+                ((T*)src)->~T();
+        };
+    }
+
+    InlineCallback(const InlineCallback& rhs) { copy_from(rhs); }
+    InlineCallback& operator=(const InlineCallback& rhs)
+    {
+        if (this != &rhs) {
+            reset();
+            copy_from(rhs);
+        }
+        return *this;
+    }
+    ~InlineCallback() { reset(); }
+
+    explicit operator bool() const { return invoker != nullptr; }
+
+    void operator()(Args... args) const
+    {
+        invoker((void*)storage, std::forward<Args>(args)...);
+    }
+
+private:
+    template <class F>
+    static auto is_null(const F& f, int) -> decltype(!f)
+    {
+        return !f;
+    }
+    template <class F>
+    static bool is_null(const F& f, long)
+    {
+        return false;
+    }
+
+    void copy_from(const InlineCallback& rhs)
+    {
+        if (rhs.manager) rhs.manager(storage, (void*)rhs.storage);
+        invoker = rhs.invoker;
+        manager = rhs.manager;
+    }
+
+    void reset(void)
+    {
+        if (manager) manager(nullptr, storage);
+        invoker = nullptr;
+        manager = nullptr;
+    }
+
+    alignas(void*) char storage[capacity];
+    /// Call the callable stored
+    void (*invoker)(void*, Args...) = nullptr;
+    /// Copy the callable from src to dst, or destroy src when dst is nullptr
+    void (*manager)(void* dst, void* src) = nullptr;
+};
+
+/// @brief An open-addressing hash table with linear probing
+/// @details Keys are never erased, which is the case of the callback tables.
+/// The slots are kept in a contiguous array, so a lookup usually touches only one
+/// cache line. Iterating the table visits the pairs of keys and values like std::map,
+/// but not in the order of keys.
+template <class K, class V>
+class FlatHashMap
+{
+public:
+    using value_type = std::pair<K, V>;
+
+private:
+    struct Slot {
+        bool       used = false;
+        value_type kv   = {};
+    };
+
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator(const Slot* p, const Slot* e) : ptr(p), end(e) { skip(); }
+
+        const value_type& operator*() const { return ptr->kv; }
+        const value_type* operator->() const { return &ptr->kv; }
+        const_iterator&   operator++()
+        {
+            ptr++;
+            skip();
+            return *this;
+        }
+        bool operator==(const const_iterator& rhs) const { return ptr == rhs.ptr; }
+        bool operator!=(const const_iterator& rhs) const { return ptr != rhs.ptr; }
+
+    private:
+        void skip(void)
+        {
+            while (ptr != end && !ptr->used) ptr++;
+        }
+
+        const Slot* ptr;
+        const Slot* end;
+    };
+
+    /// Return nullptr if the key does not exist
+    inline V* find(const K& key)
+    {
+        if (num_used == 0) return nullptr;
+        for (size_t i = index_of(key);; i = (i + 1) & mask()) {
+            Slot& slot = slots[i];
+            if (!slot.used) return nullptr;
+            if (slot.kv.first == key) return &slot.kv.second;
+        }
+    }
+
+    /// @brief Insert a default value if the key does not exist
+    /// @details The reference is valid only till the next insertion, which might grow
+    /// the table and move all the values.
+    V& operator[](const K& key)
+    {
+        bool inserted;
+        return slot_of(key, inserted).kv.second;
+    }
+
+    /// Insert a default value if the key does not exist, return true if it was inserted
+    bool insert(const K& key)
+    {
+        bool inserted;
+        slot_of(key, inserted);
+        return inserted;
+    }
+
+    inline size_t size(void) const { return num_used; }
+
+    /// Drop all the keys, the memory of the slots is released
+    void clear(void)
+    {
+        std::vector<Slot>().swap(slots);
+        num_used = 0;
+        bits     = 2;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(slots.data(), slots.data() + slots.size());
+    }
+    const_iterator end() const
+    {
+        return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+private:
+    inline size_t mask(void) const { return slots.size() - 1; }
+
+    inline size_t index_of(const K& key) const
+    {
+        // Fibonacci hashing, the hash of integers is the value itself
+        uint64_t hash = std::hash<K>()(key) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(hash >> (64 - bits));
+    }
+
+    /// Return the slot of the key, which is used by the key after the call
+    Slot& slot_of(const K& key, bool& inserted)
+    {
+        // Keep the load factor under 1/2 for short probe sequences
+        if ((num_used + 1) * 2 > slots.size()) grow();
+        for (size_t i = index_of(key);; i = (i + 1) & mask()) {
+            Slot& slot = slots[i];
+            if (!slot.used) {
+                slot.used     = true;
+                slot.kv.first = key;
+                num_used++;
+                inserted = true;
+                return slot;
+            }
+            if (slot.kv.first == key) {
+                inserted = false;
+                return slot;
+            }
+        }
+    }
+
+    void grow(void)
+    {
+        std::vector<Slot> old_slots;
+
+        old_slots.swap(slots);
+        bits++;
+        slots.resize((size_t)1 << bits);
+        num_used = 0;
+        for (auto& slot : old_slots) {
+            if (slot.used) (*this)[slot.kv.first] = std::move(slot.kv.second);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t            num_used = 0;
+    /// The table has 2^bits slots
+    uint32_t bits = 2;
+};
+
 /// @brief Callback functions associated with keys
 /// @details This class helps to implement the callbacks for both of user processes
 /// and Linux kernel. Three events are provided, pre_call(), on_call(), and on_return().
@@ -17,6 +246,16 @@
 /// with template in order to use this class.
 /// If you want a reference type, please specify it in template arguments.
 ///
+/// The callbacks are kept in a flat hash table. The calls waiting for their returns
+/// are kept in a small shadow stack, so every level of a recursive function gets its
+/// own on_return(). One FunctionMap is meant to be used by one thread of execution
+/// (e.g. a guest thread), since the calls and the returns are matched in LIFO order.
+/// A table shared by threads in turn must swap the shadow stack of the thread running.
+///
+/// Each pending call records the generation of its function entry, which counts the
+/// registrations of on_return(). A call pending across a re-registration (e.g. a new
+/// binary mapped at the same address) is dropped instead of calling the new callback.
+///
 /// Examples:
 /*! @code
 // key (K): uint64_t, callback args (Args): char*
@@ -41,10 +280,11 @@ int main(int argc, char* argv[]) {
     register_my_callbacks(functions);
 
     // Call without giving/assigning the return event.
-    functions.call_no_ret(1, "no assign");
+    functions.call(1, "no assign");
     functions.call_return(1, "not gonna be called");
     // Call with giving/assigning the return event.
-    functions.call(1, 2, "assign key of return to 2");
+    functions.call(1, "assign key of return to 2");
+    functions.update_return_key(1, 2);
     functions.call_return(2, "hello world!");
 
     return 0;
@@ -54,28 +294,62 @@ int main(int argc, char* argv[]) {
 template <class K, class... Args>
 class FunctionMap
 {
+public:
+    using Callback = InlineCallback<Args...>;
+
+    /// The depth of the shadow stack, the oldest calls are dropped when it overflows
+    static constexpr uint32_t max_pending_returns = 32;
+    /// The number of return keys remembered, they are all forgotten beyond it
+    static constexpr uint32_t max_return_keys = 4096;
+
 private:
     /// @brief The entry of callbacks associated with key (i.e. PC address)
     struct FunctionEntry {
-        std::function<void(Args...)> pre_call;
-        std::function<void(Args...)> on_call;
-        std::function<void(Args...)> on_return;
+        Callback pre_call;
+        Callback on_call;
+        Callback on_return;
+
+        /// True after call() till the key of its return is assigned
+        bool called_flag = false;
+        /// The number of times on_return is registered
+        uint32_t generation = 0;
+    };
 
-        bool called_flag;
+    /// @brief A call waiting for its return on the shadow stack
+    struct PendingReturn {
+        K        key;
+        K        key_ret;
+        uint32_t generation;
     };
 
 public:
+    /// @brief The shadow stack as a ring buffer, the entries in [bottom, top) are valid
+    struct ReturnStack {
+        PendingReturn returns[max_pending_returns] = {};
+        uint64_t      top                          = 0;
+        uint64_t      bottom                       = 0;
+
+        bool empty(void) const { return top == bottom; }
+    };
+
     /// @brief Register the callback events to the target key
+    /// @details The return keys seen are bounded by max_return_keys. Once it is full,
+    /// they are forgotten and reported as new again, the callers tagging the TBs of
+    /// them must tolerate a key reported twice.
     /// @param[in] key The key to "function address".
     /// @param[in] key_ret The key to "function return address".
-    inline void update_return_key(K key, K key_ret)
+    /// @return true when key_ret is registered for the first time.
+    inline bool update_return_key(K key, K key_ret)
     {
-        auto f = funs.find(key);
-        if (f != funs.end()) {
-            auto& entry = f->second;
-            // Register return function if there is one
-            if (entry.on_return) funs_ret[key_ret] = &entry;
+        auto entry = funs.find(key);
+        // Register return function if there is one
+        if (entry == nullptr || !entry->on_return) return false;
+        if (entry->called_flag) {
+            entry->called_flag = false;
+            push_pending({key, key_ret, entry->generation});
         }
+        if (unlikely(ret_keys.size() >= max_return_keys)) ret_keys.clear();
+        return ret_keys.insert(key_ret);
     }
 
     /// @brief Call the callback functions if the key matches
@@ -84,19 +358,18 @@ public:
     /// @return true on success. false when no function found/executed.
     inline bool call(K key, Args... args)
     {
-        auto f = funs.find(key);
-        if (f != funs.end()) {
-            auto& entry = f->second;
-            // Register return function if there is one
-            if (unlikely(entry.on_return)) {
-                entry.called_flag = true;
+        auto entry = funs.find(key);
+        if (entry != nullptr) {
+            // Wait for the key of return if there is a return function
+            if (unlikely(bool(entry->on_return))) {
+                entry->called_flag = true;
             }
-            if (unlikely(entry.pre_call)) {
-                entry.pre_call(std::forward<Args>(args)...);
+            if (unlikely(bool(entry->pre_call))) {
+                entry->pre_call(std::forward<Args>(args)...);
             }
             // Call only when the callback function is defined
-            if (unlikely(entry.on_call)) {
-                entry.on_call(std::forward<Args>(args)...);
+            if (unlikely(bool(entry->on_call))) {
+                entry->on_call(std::forward<Args>(args)...);
                 return true;
             }
         }
@@ -104,68 +377,96 @@ public:
     }
 
     /// @brief Call the callback for function return with the key of "return".
+    /// @details The innermost pending call returning to the key is matched. The calls
+    /// above it never returned normally (e.g. longjmp), they are dropped. So is the
+    /// match when its function is registered again after the call.
     /// @param[in] key The key to "return address" not the "function address".
     /// @param[in] args The arguments passed to the callback function.
     /// @return true on success. false when no function found/executed.
     bool call_return(K key, Args... args)
     {
-        auto f = funs_ret.find(key);
-        if (f != funs_ret.end()) {
-            auto& entry = *(f->second);
-            // Call only when the callback function is defined
-            if (unlikely(entry.called_flag && entry.on_return)) {
-                entry.on_return(std::forward<Args>(args)...);
-                entry.called_flag = false;
+        for (uint64_t i = stack.top; i != stack.bottom; i--) {
+            auto& pending = stack.returns[(i - 1) % max_pending_returns];
+            if (likely(!(pending.key_ret == key))) continue;
+
+            stack.top = i - 1;
+            auto entry  = funs.find(pending.key);
+            // Call only when the callback function is defined, and not replaced
+            if (entry != nullptr && entry->on_return
+                && entry->generation == pending.generation) {
+                entry->on_return(std::forward<Args>(args)...);
                 return true;
             }
+            return false;
         }
         return false;
     }
 
     /// @brief Register the callback function/lambda for target key (i.e. PC address).
-    void register_precall(K key, std::function<void(Args...)> fun)
-    {
-        funs[key].pre_call = fun;
-    }
+    void register_precall(K key, Callback fun) { funs[key].pre_call = fun; }
 
     /// @brief Register the callback function/lambda for target key (i.e. PC address).
-    void register_call(K key, std::function<void(Args...)> fun)
-    {
-        funs[key].on_call = fun;
-    }
+    void register_call(K key, Callback fun) { funs[key].on_call = fun; }
 
     /// @brief Register the callback function/lambda for target key (i.e. PC address).
-    void register_return(K key, std::function<void(Args...)> fun)
+    void register_return(K key, Callback fun)
     {
-        funs[key].on_return = fun;
+        auto& entry     = funs[key];
+        entry.on_return = fun;
+        entry.generation++;
     }
 
     /// @brief Register the callback function/lambda for target key (i.e. PC address).
-    void register_all(const K                      key,
-                      std::function<void(Args...)> entry_pre_call,
-                      std::function<void(Args...)> entry_call,
-                      std::function<void(Args...)> entry_return)
+    void register_all(const K  key,
+                      Callback entry_pre_call,
+                      Callback entry_call,
+                      Callback entry_return)
     {
-        funs[key].pre_call  = entry_pre_call;
-        funs[key].on_call   = entry_call;
-        funs[key].on_return = entry_return;
+        auto& entry     = funs[key];
+        entry.pre_call  = entry_pre_call;
+        entry.on_call   = entry_call;
+        entry.on_return = entry_return;
+        entry.generation++;
     }
 
-    struct FunctionEntry& operator[](const K idx) { return funs[idx]; }
+    /// @brief Return a copy of the callbacks of the key, empty if it is not registered
+    /// @details A copy since the entries move when the table grows.
+    struct FunctionEntry operator[](const K idx)
+    {
+        auto entry = funs.find(idx);
+        return (entry != nullptr) ? *entry : FunctionEntry();
+    }
 
     /// @brief Find if the key is registered with anything.
-    bool find(K key) { return (funs.find(key) != funs.end()); }
+    bool find(K key) { return (funs.find(key) != nullptr); }
 
-    const std::map<K, struct FunctionEntry>& get_list(void) { return funs; }
+    const FlatHashMap<K, struct FunctionEntry>& get_list(void) { return funs; }
 
     auto begin() const { return funs.begin(); }
     auto end() const { return funs.end(); }
 
+    /// @brief Exchange the shadow stack with another one
+    /// @details A thread of execution moving between FunctionMaps takes its pending
+    /// calls with it, e.g. a guest thread migrating to the table of another core.
+    void swap_return_stack(ReturnStack& other) { std::swap(stack, other); }
+
+    /// True if any call is waiting for its return on the shadow stack
+    bool has_pending_returns(void) const { return !stack.empty(); }
+
 private:
+    void push_pending(PendingReturn&& pending)
+    {
+        if (stack.top - stack.bottom == max_pending_returns) stack.bottom++;
+        stack.returns[stack.top % max_pending_returns] = std::move(pending);
+        stack.top++;
+    }
+
     /// The mapping table for on call events
-    std::map<K, struct FunctionEntry> funs;
-    /// The mapping table for on return events, it takes the pointers of FunctionEntry.
-    std::map<K, struct FunctionEntry*> funs_ret;
+    FlatHashMap<K, struct FunctionEntry> funs;
+    /// The keys of return registered, at most max_return_keys
+    FlatHashMap<K, bool> ret_keys;
+    /// The calls waiting for their returns
+    ReturnStack stack;
 };
 
 #endif
@@ -0,0 +1,215 @@
+#ifndef __VPMU_EPOCH_HPP_
+#define __VPMU_EPOCH_HPP_
+#pragma once
+
+#include <map>                // std::map
+#include <mutex>              // std::mutex
+#include <atomic>             // std::atomic
+#include <thread>             // std::thread
+#include <functional>         // std::function
+#include <condition_variable> // std::condition_variable
+#include <semaphore.h>        // Semaphore related header
+
+#include "vpmu-utils.hpp" // vpmu::utils::name_thread
+
+/// @brief Epoch-based publication of the performance counters
+/// @details Each VPMU_async() opens a new epoch and sends a sync packet carrying the
+/// epoch to every stream, under a lock so that every stream receives them in the
+/// order of epochs. The stream workers publish their counters along with the
+/// largest epoch they have crossed at the barrier (see VPMUStream_Impl::wait_epoch()).
+/// The callbacks are registered to their epochs without locks, and a single dispatcher
+/// thread runs them in the order of epochs once all the streams have crossed them.
+/// Every epoch opened has exactly one callback. A callback waits for the ones of the
+/// earlier epochs, which might still be on their way from other threads, so that the
+/// epochs retire in order. The dispatcher sleeps on semaphores while waiting, it never
+/// polls.
+///
+/// The streams keep the counters of the last vpmu_sync_history_depth epochs, and a
+/// callback reads the counters of its own epoch (see current()). open() applies
+/// back-pressure so that the epochs outstanding never exceed the depth of the history.
+class VPMUEpoch
+{
+public:
+    using Callback = std::function<void(void)>;
+    /// Block till all the streams cross the epoch, return false if they never will.
+    using Waiter = std::function<bool(uint64_t)>;
+
+    VPMUEpoch(const char* new_name, Waiter&& waiter) : wait_epoch(std::move(waiter))
+    {
+        sem_init(&incoming_semaphore, false, 0);
+        dispatcher = std::thread([this, new_name]() {
+            vpmu::utils::name_thread(new_name);
+            dispatch();
+        });
+    }
+
+    ~VPMUEpoch()
+    {
+        stop = true;
+        sem_post(&incoming_semaphore);
+        dispatcher.join();
+        sem_destroy(&incoming_semaphore);
+    }
+
+    VPMUEpoch(const VPMUEpoch&) = delete;
+    VPMUEpoch& operator=(const VPMUEpoch&) = delete;
+
+    /// @brief Open a new epoch and return its number. Epochs start from 1.
+    /// @details Block till there are no more than max_outstanding epochs not retired,
+    /// including the new one. Callbacks never block, they would block the dispatcher.
+    uint64_t open(uint64_t max_outstanding)
+    {
+        uint64_t epoch = ++issued;
+        // The epochs retire in order
+        auto outstanding = [&]() { return (int64_t)(epoch - retired); };
+
+        if (outstanding() > (int64_t)max_outstanding && current() == 0) {
+            std::unique_lock<std::mutex> lock(retire_mutex);
+            waiting++;
+            retire_condition.wait(lock, [&]() {
+                return outstanding() <= (int64_t)max_outstanding || stop;
+            });
+            waiting--;
+        }
+        return epoch;
+    }
+
+    /// @brief Block till a new epoch fits in max_outstanding, without opening it
+    /// @details The caller opens it with try_open(), which fails if another thread takes
+    /// the room first.
+    /// @return false if the caller is never held back, i.e. a callback or the epochs
+    /// are stopped. open() does not block then.
+    bool wait_for_room(uint64_t max_outstanding)
+    {
+        auto full = [&]() {
+            return (int64_t)(issued + 1 - retired) > (int64_t)max_outstanding;
+        };
+
+        if (current() != 0 || stop) return false;
+        if (!full()) return true;
+        std::unique_lock<std::mutex> lock(retire_mutex);
+        waiting++;
+        retire_condition.wait(lock, [&]() { return !full() || stop; });
+        waiting--;
+        return !stop;
+    }
+
+    /// @brief Open a new epoch without blocking, return zero when it would block
+    /// @details For the threads which must not wait, e.g. the main loop of QEMU.
+    uint64_t try_open(uint64_t max_outstanding)
+    {
+        uint64_t epoch = issued;
+
+        do {
+            // Never take an epoch number without a callback, the later ones wait for it
+            if ((int64_t)(epoch + 1 - retired) > (int64_t)max_outstanding) return 0;
+        } while (!issued.compare_exchange_weak(epoch, epoch + 1));
+        return epoch + 1;
+    }
+
+    /// The epoch of the callback running on this thread, zero if it is not a callback
+    static uint64_t& current(void)
+    {
+        static thread_local uint64_t running_epoch = 0;
+        return running_epoch;
+    }
+
+    /// Run the callback after all the streams cross the epoch. This is lock-free.
+    void register_callback(uint64_t epoch, Callback&& callback)
+    {
+        Node* node = new Node{epoch, std::move(callback), incoming.load()};
+
+        pending++;
+        while (!incoming.compare_exchange_weak(node->next, node))
+            ;
+        sem_post(&incoming_semaphore);
+    }
+
+    /// The number of callbacks not run yet
+    inline uint64_t size(void) { return pending; }
+
+private:
+    struct Node {
+        uint64_t epoch;
+        Callback callback;
+        Node*    next;
+    };
+
+    void dispatch(void)
+    {
+        // The callbacks waiting for their epochs, sorted by epochs
+        std::map<uint64_t, Callback> callbacks;
+
+        while (!stop) {
+            sem_wait(&incoming_semaphore);
+            take_incoming(callbacks);
+            // Only run the callback of the epoch next to the last retired one. The later
+            // ones wait for it to be registered.
+            while (!callbacks.empty() && callbacks.begin()->first == retired + 1) {
+                auto it = callbacks.begin();
+                if (stop || wait_epoch(it->first) == false) {
+                    // Exit directly when QEMU is going to be terminated.
+                    retire(callbacks.size());
+                    callbacks.clear();
+                    break;
+                }
+                current() = it->first;
+                it->second();
+                current() = 0;
+                callbacks.erase(it);
+                retire(1);
+                // Keep taking the new ones, they might belong to the epochs crossed
+                take_incoming(callbacks);
+            }
+        }
+        // Drop the callbacks left, their owners see them destroyed without running
+        take_incoming(callbacks);
+        callbacks.clear();
+        // Release the threads blocked in open()
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        retire_condition.notify_all();
+    }
+
+    void retire(uint64_t num)
+    {
+        pending -= num;
+        retired += num;
+        if (waiting) {
+            std::lock_guard<std::mutex> lock(retire_mutex);
+            retire_condition.notify_all();
+        }
+    }
+
+    void take_incoming(std::map<uint64_t, Callback>& callbacks)
+    {
+        Node* node = incoming.exchange(nullptr);
+
+        while (node != nullptr) {
+            Node* next = node->next;
+            callbacks.emplace(node->epoch, std::move(node->callback));
+            delete node;
+            node = next;
+        }
+    }
+
+    /// The function blocking till all the streams cross an epoch
+    Waiter wait_epoch;
+    /// The last epoch opened
+    std::atomic<uint64_t> issued = {0};
+    /// The number of callbacks registered but not run yet
+    std::atomic<uint64_t> pending = {0};
+    /// The number of callbacks run or dropped, i.e. the last epoch retired
+    std::atomic<uint64_t> retired = {0};
+    /// The number of threads blocked by back-pressure in open() or wait_for_room()
+    std::atomic<uint64_t>   waiting = {0};
+    std::mutex              retire_mutex;
+    std::condition_variable retire_condition;
+    /// The lock-free stack of newly registered callbacks
+    std::atomic<Node*> incoming = {nullptr};
+    /// Posted when a callback is registered
+    sem_t            incoming_semaphore;
+    std::atomic_bool stop = {false};
+    std::thread      dispatcher;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "vpmu.hpp"         // VPMU common headers and thread_pool
+#include "vpmu-sampler.hpp" // VPMUSampler
+#include "vpmu-math.hpp"    // vpmu::math::sum_cores
+
+VPMUSampler vpmu_sampler;
+
+// clang-format off
+const char* VPMUSampler::column_names[NUM_COLUMNS] = {
+    "timestampNs",
+    "targetTimeNs",
+    "hostTimeNs",
+    "cpuTimeNs",
+    "branchTimeNs",
+    "cacheTimeNs",
+    "memoryTimeNs",
+    "ioTimeNs",
+    "cycles",
+    "instructions",
+    "loads",
+    "stores",
+    "branches",
+    "branchCorrect",
+    "branchWrong",
+    "l1dRead",
+    "l1dWrite",
+    "l1dReadMiss",
+    "l1dWriteMiss",
+    "l1iRead",
+    "l1iReadMiss",
+    "memoryAccesses",
+};
+// clang-format on
+
+void VPMUSampler::tick(uint64_t now_us)
+{
+    // The interval is rounded up to the period of the device tick
+    if (interval_us == 0 || finished || VPMU.enabled == false) return;
+    if (now_us < next_sample_us) return;
+
+    // Try again on the next tick when the timing threads fall behind
+    if (VPMU_try_async([this]() { this->sample(); }) == false) {
+        skipped++;
+        return;
+    }
+    next_sample_us = now_us + interval_us;
+}
+
+void VPMUSampler::finish(void)
+{
+    if (interval_us == 0 || finished.exchange(true)) return;
+    if (skipped) log("%" PRIu64 " ticks are skipped on back-pressure", skipped);
+    if (blocks[active].rows != 0) swap_blocks();
+
+    std::unique_lock<std::mutex> lock(writing_mutex);
+    writing_condition.wait(lock, [this]() { return !writing; });
+    if (fp != nullptr) fflush(fp);
+}
+
+void VPMUSampler::sample(void)
+{
+    VPMUSnapshot snapshot(true);
+
+    if (has_baseline == false || snapshot.time_ns[5] < last_snapshot.time_ns[5]) {
+        // The first sample, or VPMU_reset() cleared the counters. Start from here.
+        last_snapshot = snapshot;
+        has_baseline  = true;
+        return;
+    }
+
+    using vpmu::math::sum_cores;
+    VPMUSnapshot diff  = snapshot - last_snapshot;
+    auto         insn  = diff.insn_data.sum_all();
+    auto&        l1d   = diff.cache_data.data_cache[PROCESSOR_CPU][VPMU_Cache::L1_CACHE];
+    auto&        l1i   = diff.cache_data.insn_cache[PROCESSOR_CPU][VPMU_Cache::L1_CACHE];
+    Block&       block = blocks[active];
+    uint32_t     r     = block.rows;
+    // Sum up the cache counters of all cores
+    auto sum_l1 = [](uint64_t counters[][VPMU_Cache::SIZE_OF_INDEX], int index) {
+        uint64_t sum = 0;
+        for (int i = 0; i < VPMU.platform.cpu.cores; i++) sum += counters[i][index];
+        return sum;
+    };
+
+    block.values[TIMESTAMP_NS][r]    = snapshot.time_ns[5];
+    block.values[TARGET_TIME_NS][r]  = diff.time_ns[5];
+    block.values[HOST_TIME_NS][r]    = diff.time_ns[6];
+    block.values[CPU_TIME_NS][r]     = diff.time_ns[0];
+    block.values[BRANCH_TIME_NS][r]  = diff.time_ns[1];
+    block.values[CACHE_TIME_NS][r]   = diff.time_ns[2];
+    block.values[MEMORY_TIME_NS][r]  = diff.time_ns[3];
+    block.values[IO_TIME_NS][r]      = diff.time_ns[4];
+    block.values[CYCLES][r]          = insn.cycles;
+    block.values[INSTRUCTIONS][r]    = insn.total_insn;
+    block.values[LOADS][r]           = insn.load;
+    block.values[STORES][r]          = insn.store;
+    block.values[BRANCHES][r]        = insn.branch;
+    block.values[BRANCH_CORRECT][r]  = sum_cores(diff.branch_data.correct);
+    block.values[BRANCH_WRONG][r]    = sum_cores(diff.branch_data.wrong);
+    block.values[L1D_READ][r]        = sum_l1(l1d, VPMU_Cache::READ);
+    block.values[L1D_WRITE][r]       = sum_l1(l1d, VPMU_Cache::WRITE);
+    block.values[L1D_READ_MISS][r]   = sum_l1(l1d, VPMU_Cache::READ_MISS);
+    block.values[L1D_WRITE_MISS][r]  = sum_l1(l1d, VPMU_Cache::WRITE_MISS);
+    block.values[L1I_READ][r]        = sum_l1(l1i, VPMU_Cache::READ);
+    block.values[L1I_READ_MISS][r]   = sum_l1(l1i, VPMU_Cache::READ_MISS);
+    block.values[MEMORY_ACCESSES][r] = diff.cache_data.memory_accesses;
+
+    last_snapshot = snapshot;
+    block.rows++;
+    if (block.rows == rows_per_block) swap_blocks();
+}
+
+void VPMUSampler::swap_blocks(void)
+{
+    {
+        std::unique_lock<std::mutex> lock(writing_mutex);
+        // Only wait when the writer is slower than filling a whole block
+        writing_condition.wait(lock, [this]() { return !writing; });
+        writing = true;
+    }
+
+    const Block* full = &blocks[active];
+    active ^= 1;
+    blocks[active].rows = 0;
+
+    thread_pool.enqueue_static([this, full]() {
+        this->write_block(*full);
+
+        std::lock_guard<std::mutex> lock(writing_mutex);
+        writing = false;
+        writing_condition.notify_all();
+    });
+}
+
+void VPMUSampler::write_block(const Block& block)
+{
+    uint32_t num_columns = NUM_COLUMNS;
+
+    if (fp == nullptr) {
+        std::string path = std::string(VPMU.output_path) + "/counter_samples.bin";
+        uint32_t    version     = 1;
+        uint64_t    interval_ns = interval_us * 1000;
+
+        fp = fopen(path.c_str(), "wb");
+        if (fp == nullptr) {
+            log("Fail to open %s for writing samples", path.c_str());
+            return;
+        }
+        fwrite("VPMUSMPL", 8, 1, fp);
+        fwrite(&version, sizeof(version), 1, fp);
+        fwrite(&num_columns, sizeof(num_columns), 1, fp);
+        fwrite(&interval_ns, sizeof(interval_ns), 1, fp);
+        for (auto&& name : column_names) fwrite(name, strlen(name) + 1, 1, fp);
+    }
+
+    fwrite(&block.rows, sizeof(block.rows), 1, fp);
+    fwrite(&num_columns, sizeof(num_columns), 1, fp);
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        fwrite(block.values[c], sizeof(uint64_t), block.rows, fp);
+    }
+}
+
+void vpmu_sampler_tick(uint64_t now_us)
+{
+    vpmu_sampler.tick(now_us);
+}
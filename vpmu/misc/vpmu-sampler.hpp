@@ -0,0 +1,108 @@
+#ifndef __VPMU_SAMPLER_HPP_
+#define __VPMU_SAMPLER_HPP_
+#pragma once
+
+#include <mutex>              // std::mutex
+#include <atomic>             // std::atomic
+#include <string>             // std::string
+#include <condition_variable> // std::condition_variable
+
+#include "vpmu-log.hpp"      // VPMULog
+#include "vpmu-snapshot.hpp" // VPMUSnapshot
+
+/// @brief Periodic sampling of the performance counters into a time series
+/// @details The virtual clock tick of VPMU device calls tick(). Every interval of the
+/// target time, it takes a VPMUSnapshot asynchronously (VPMU_try_async) and appends the
+/// difference from the last sample as a row of the current block. The timer runs on
+/// the main loop of QEMU, so it skips the sample instead of waiting on back-pressure.
+/// The blocks are written in columns to a binary file by thread_pool while the other
+/// block is being filled (double buffering), so neither the vCPU threads nor the timer
+/// wait for I/O.
+///
+/// File layout (all integers are little endian as in the host):
+///   "VPMUSMPL", uint32_t version, uint32_t number of columns, uint64_t interval in ns,
+///   the null-terminated names of columns, then the blocks.
+/// Block layout:
+///   uint32_t number of rows, uint32_t number of columns,
+///   uint64_t values[number of columns][number of rows]
+class VPMUSampler : public VPMULog
+{
+public:
+    enum Column {
+        TIMESTAMP_NS,   ///< The target time at the end of the sample
+        TARGET_TIME_NS, ///< The elapsed target time of the sample
+        HOST_TIME_NS,
+        CPU_TIME_NS,
+        BRANCH_TIME_NS,
+        CACHE_TIME_NS,
+        MEMORY_TIME_NS,
+        IO_TIME_NS,
+        CYCLES,
+        INSTRUCTIONS,
+        LOADS,
+        STORES,
+        BRANCHES,
+        BRANCH_CORRECT,
+        BRANCH_WRONG,
+        L1D_READ,
+        L1D_WRITE,
+        L1D_READ_MISS,
+        L1D_WRITE_MISS,
+        L1I_READ,
+        L1I_READ_MISS,
+        MEMORY_ACCESSES,
+        NUM_COLUMNS
+    };
+
+    static constexpr uint32_t rows_per_block = 1024;
+
+    VPMUSampler() : VPMULog("Sampler") {}
+    VPMUSampler(const char* module_name) : VPMULog(module_name) {}
+
+    /// Set the sampling interval in target time, zero disables sampling
+    void set_interval(uint64_t new_interval_us) { interval_us = new_interval_us; }
+    uint64_t get_interval(void) { return interval_us; }
+
+    /// Called by the virtual clock of VPMU device with the current virtual time
+    void tick(uint64_t now_us);
+    /// Stop sampling and write the remaining samples. Called when VPMU finalizes.
+    void finish(void);
+
+private:
+    struct Block {
+        uint32_t rows = 0;
+        uint64_t values[NUM_COLUMNS][rows_per_block];
+    };
+
+    static const char* column_names[NUM_COLUMNS];
+
+    /// Run by VPMU_try_async, append a sample to the active block
+    void sample(void);
+    /// Hand the active block to the writer and switch to the other one
+    void swap_blocks(void);
+    void write_block(const Block& block);
+
+    uint64_t interval_us    = 0;
+    uint64_t next_sample_us = 0;
+    /// Set by the finalizing thread, read by the timer
+    std::atomic<bool> finished{false};
+    /// The samples skipped when the history of epochs is full, counted by the timer
+    uint64_t skipped = 0;
+    /// The snapshot of the last sample
+    VPMUSnapshot last_snapshot = {};
+    bool         has_baseline  = false;
+
+    /// The block being filled and the block being written
+    Block blocks[2];
+    int   active = 0;
+    /// True when a block is handed to the writer and not written yet
+    bool                    writing = false;
+    std::mutex              writing_mutex;
+    std::condition_variable writing_condition;
+    /// Only accessed by the writer
+    FILE* fp = nullptr;
+};
+
+extern VPMUSampler vpmu_sampler;
+
+#endif
@@ -26,18 +26,18 @@ public:
 
     void take_snapshot(int64_t core = -1)
     {
-        // TODO support per core data getter
-        insn_data   = vpmu_insn_stream.get_data();
-        branch_data = vpmu_branch_stream.get_data();
-        cache_data  = vpmu_cache_stream.get_data();
-
-        if (core > 0) {
-            insn_data.mask_out_except(core);
-            branch_data.mask_out_except(core);
-            cache_data.mask_out_except(core);
+        if (core >= 0) {
+            // Only read the counters of this core from the streams
+            insn_data   = vpmu_insn_stream.get_core_data(core);
+            branch_data = vpmu_branch_stream.get_core_data(core);
+            cache_data  = vpmu_cache_stream.get_core_data(core);
             // TODO Should design two different snapshot classes
             // One with per-core info, the other without.
             sum_cores();
+        } else {
+            insn_data   = vpmu_insn_stream.get_data();
+            branch_data = vpmu_branch_stream.get_data();
+            cache_data  = vpmu_cache_stream.get_data();
         }
 
         // TODO support per core time getter
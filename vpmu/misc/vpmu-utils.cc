@@ -7,9 +7,10 @@
 #include "vpmu-utils.hpp" // miscellaneous functions
 #include "json.hpp"       // nlohmann::json
 
-#include "vpmu-insn.hpp"   // vpmu_insn_stream
-#include "vpmu-cache.hpp"  // vpmu_cache_stream
-#include "vpmu-branch.hpp" // vpmu_branch_stream
+#include "vpmu-insn.hpp"     // vpmu_insn_stream
+#include "vpmu-cache.hpp"    // vpmu_cache_stream
+#include "vpmu-branch.hpp"   // vpmu_branch_stream
+#include "vpmu-snapshot.hpp" // VPMUSnapshot
 
 #include <boost/core/demangle.hpp>    // boost::core::demangle
 #include <boost/algorithm/string.hpp> // String processing
@@ -327,11 +328,24 @@ namespace target
 {
     double scale_factor(void) { return 1 / (VPMU.platform.cpu.frequency / 1000.0); }
 
-    uint64_t cpu_cycles(void) { return vpmu_insn_stream.get_cycles(); }
+    // The instruction model reported by cpu_cycles(). An OoO model already counts the
+    // cache penalties in its cycles, so only the ones of this model are subtracted.
+    static const int reported_insn_model = 0;
+
+    uint64_t cpu_cycles(void)
+    {
+        return vpmu_insn_stream.get_cycles(reported_insn_model, -1);
+    }
 
     uint64_t branch_cycles(void) { return vpmu_branch_stream.get_cycles(); }
 
-    uint64_t cache_cycles(void) { return vpmu_cache_stream.get_cache_cycles(); }
+    uint64_t cache_cycles(void)
+    {
+        uint64_t cycles  = vpmu_cache_stream.get_cache_cycles();
+        uint64_t charged = vpmu_insn_stream.get_cache_cycles(reported_insn_model);
+        // The penalties in cpu_cycles() already, counted by the reported model
+        return (cycles > charged) ? cycles - charged : 0;
+    }
 
     uint64_t in_cpu_cycles(void)
     {
@@ -363,12 +377,50 @@ namespace target
         // it's correct when running sleep in guest
         return in_cpu_cycles() * vpmu::target::scale_factor() // In-CPU time
                + memory_time_ns() + io_time_ns()              // Out-of-CPU time
-               + VPMU.cpu_idle_time_ns;                       // Extra time
+               + VPMU.cpu_idle_time_ns                        // Extra time
+               + __atomic_load_n(&VPMU.fast_forward_time_ns,  // Extrapolated time
+                                 __ATOMIC_RELAXED);
     }
 
     uint64_t time_us(void) { return time_ns() / 1000; }
     uint64_t time_ms(void) { return time_us() / 1000; }
 
+    uint64_t cpu_cycles(VPMUSnapshot& snapshot)
+    {
+        return vpmu_insn_stream.get_cycles(snapshot.insn_data, -1);
+    }
+
+    uint64_t branch_cycles(VPMUSnapshot& snapshot)
+    {
+        return vpmu_branch_stream.get_cycles(snapshot.branch_data, 0, -1);
+    }
+
+    uint64_t cache_cycles(VPMUSnapshot& snapshot)
+    {
+        uint64_t cycles  = vpmu_cache_stream.get_cache_cycles(snapshot.cache_data, 0, -1);
+        uint64_t charged = vpmu_insn_stream.get_cache_cycles(snapshot.insn_data);
+        // The snapshot holds the counters of the reported model, see cache_cycles()
+        return (cycles > charged) ? cycles - charged : 0;
+    }
+
+    uint64_t in_cpu_cycles(VPMUSnapshot& snapshot)
+    {
+        return cpu_cycles(snapshot) + branch_cycles(snapshot) + cache_cycles(snapshot);
+    }
+
+    uint64_t memory_time_ns(VPMUSnapshot& snapshot)
+    {
+        return snapshot.cache_data.memory_time_ns;
+    }
+
+    uint64_t time_ns(VPMUSnapshot& snapshot)
+    {
+        // Only the time of the counted events, the idle, IO and extrapolated time
+        // are not counted per snapshot
+        return in_cpu_cycles(snapshot) * vpmu::target::scale_factor()
+               + memory_time_ns(snapshot);
+    }
+
 } // End of namespace vpmu::target
 
 } // End of namespace vpmu
@@ -19,6 +19,8 @@ extern "C" {
 // A thread local storage for saving the running core id of each thread
 extern thread_local uint64_t vpmu_running_core_id;
 
+class VPMUSnapshot; // The counters of all streams, defined in vpmu-snapshot.hpp
+
 namespace vpmu
 {
 inline uint64_t get_core_id(void)
@@ -180,6 +182,13 @@ namespace target
     uint64_t time_ns(void);
     uint64_t time_us(void);
     uint64_t time_ms(void);
+    // The same on the counters of a snapshot, e.g. the counters of a task
+    uint64_t cpu_cycles(VPMUSnapshot& snapshot);
+    uint64_t branch_cycles(VPMUSnapshot& snapshot);
+    uint64_t cache_cycles(VPMUSnapshot& snapshot);
+    uint64_t in_cpu_cycles(VPMUSnapshot& snapshot);
+    uint64_t memory_time_ns(VPMUSnapshot& snapshot);
+    uint64_t time_ns(VPMUSnapshot& snapshot);
 } // End of namespace vpmu::target
 
 } // End of namespace vpmu
@@ -53,24 +53,40 @@ public:
             }
         }
 
+        /// Copy the counters of core_id from src, which is the same as
+        /// mask_out_except(core_id) on a copy of src.
+        void copy_core(const Data &src, int core_id)
+        {
+            this->correct[core_id] = src.correct[core_id];
+            this->wrong[core_id]   = src.wrong[core_id];
+        }
+
         Data operator+(const Data &rhs)
         {
-            Data out = {}; // Copy elision
+            Data            out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
 
-            for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
-                out.correct[i] = this->correct[i] + rhs.correct[i];
-                out.wrong[i]   = this->wrong[i] + rhs.wrong[i];
+            // All members are uint64_t, add them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(Data) / sizeof(uint64_t); i++) {
+                o[i] = l[i] + r[i];
             }
             return out;
         }
 
         Data operator-(const Data &rhs)
         {
-            Data out = {}; // Copy elision
+            Data            out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
 
-            for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
-                out.correct[i] = this->correct[i] - rhs.correct[i];
-                out.wrong[i]   = this->wrong[i] - rhs.wrong[i];
+            // All members are uint64_t, subtract them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(Data) / sizeof(uint64_t); i++) {
+                o[i] = l[i] - r[i];
             }
             return out;
         }
@@ -94,7 +110,7 @@ public:
     // Timing simulator model information that VPMU required for some functions
     Model model;
     // Synchronization Counter to identify the serial number of synchronized data
-    volatile uint32_t sync_counter;
+    volatile uint64_t sync_counter;
     // Synchronization flag to indicate whether it's done (true/false)
     volatile uint32_t synced_flag;
 
@@ -73,51 +73,61 @@ public:
             }
         }
 
-        Data operator+(const Data &rhs)
+        /// Copy the counters of core_id from src, which is the same as
+        /// mask_out_except(core_id) on a copy of src.
+        void copy_core(const Data &src, int core_id)
         {
-            Data out = {}; // Copy elision
-
             for (int c = 0; c < ALL_PROC; c++) {
-                // Skip if that processing core does not exist
-                if (c == PROCESSOR_GPU && VPMU.platform.gpu.cores == 0) continue;
-                for (int m = L1_CACHE; m < MAX_LEVEL; m++) {
-                    for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
+                for (int m = 0; m < MEMORY; m++) {
+                    // TODO Use variable to set the shared level of cache
+                    if (m == L1_CACHE) {
                         for (int j = 0; j < SIZE_OF_INDEX; j++) {
-                            out.insn_cache[c][m][i][j] =
-                              this->insn_cache[c][m][i][j] + rhs.insn_cache[c][m][i][j];
-                            out.data_cache[c][m][i][j] =
-                              this->data_cache[c][m][i][j] + rhs.data_cache[c][m][i][j];
+                            this->insn_cache[c][m][core_id][j] =
+                              src.insn_cache[c][m][core_id][j];
+                            this->data_cache[c][m][core_id][j] =
+                              src.data_cache[c][m][core_id][j];
                         }
+                    } else {
+                        memcpy(this->insn_cache[c][m],
+                               src.insn_cache[c][m],
+                               sizeof(src.insn_cache[c][m]));
+                        memcpy(this->data_cache[c][m],
+                               src.data_cache[c][m],
+                               sizeof(src.data_cache[c][m]));
                     }
                 }
             }
-            out.memory_accesses = this->memory_accesses + rhs.memory_accesses;
-            out.memory_time_ns  = this->memory_time_ns + rhs.memory_time_ns;
+            this->memory_accesses = src.memory_accesses;
+            this->memory_time_ns  = src.memory_time_ns;
+        }
 
+        Data operator+(const Data &rhs)
+        {
+            Data            out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
+
+            // All members are uint64_t, add them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(Data) / sizeof(uint64_t); i++) {
+                o[i] = l[i] + r[i];
+            }
             return out;
         }
 
         Data operator-(const Data &rhs)
         {
-            Data out = {}; // Copy elision
-
-            for (int c = 0; c < ALL_PROC; c++) {
-                // Skip if that processing core does not exist
-                if (c == PROCESSOR_GPU && VPMU.platform.gpu.cores == 0) continue;
-                for (int m = L1_CACHE; m < MAX_LEVEL; m++) {
-                    for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
-                        for (int j = 0; j < SIZE_OF_INDEX; j++) {
-                            out.insn_cache[c][m][i][j] =
-                              this->insn_cache[c][m][i][j] - rhs.insn_cache[c][m][i][j];
-                            out.data_cache[c][m][i][j] =
-                              this->data_cache[c][m][i][j] - rhs.data_cache[c][m][i][j];
-                        }
-                    }
-                }
+            Data            out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
+
+            // All members are uint64_t, subtract them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(Data) / sizeof(uint64_t); i++) {
+                o[i] = l[i] - r[i];
             }
-            out.memory_accesses = this->memory_accesses - rhs.memory_accesses;
-            out.memory_time_ns  = this->memory_time_ns - rhs.memory_time_ns;
-
             return out;
         }
     };
@@ -154,7 +164,7 @@ public:
     // Timing simulator model information that VPMU required for some functions
     Model model;
     // Synchronization Counter to identify the serial number of synchronized data
-    volatile uint32_t sync_counter;
+    volatile uint64_t sync_counter;
     // Synchronization flag to indicate whether it's done (true/false)
     volatile uint32_t synced_flag;
 
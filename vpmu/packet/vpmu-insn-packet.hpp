@@ -30,6 +30,8 @@ public:
         uint64_t load[VPMU_MAX_CPU_CORES];
         uint64_t store[VPMU_MAX_CPU_CORES];
         uint64_t branch[VPMU_MAX_CPU_CORES];
+        /// The cache miss penalties already included in cycles by an OoO model
+        uint64_t cache_cycles[VPMU_MAX_CPU_CORES];
 
         void reduce(void)
         {
@@ -39,12 +41,14 @@ public:
                 this->load[0] += this->load[i];
                 this->store[0] += this->store[i];
                 this->branch[0] += this->branch[i];
-
-                this->cycles[i]     = 0;
-                this->total_insn[i] = 0;
-                this->load[i]       = 0;
-                this->store[i]      = 0;
-                this->branch[i]     = 0;
+                this->cache_cycles[0] += this->cache_cycles[i];
+
+                this->cycles[i]       = 0;
+                this->total_insn[i]   = 0;
+                this->load[i]         = 0;
+                this->store[i]        = 0;
+                this->branch[i]       = 0;
+                this->cache_cycles[i] = 0;
             }
         }
 
@@ -52,11 +56,12 @@ public:
         {
             for (int i = 0; i < VPMU.platform.cpu.cores; i++) {
                 if (i != core_id) {
-                    this->cycles[i]     = 0;
-                    this->total_insn[i] = 0;
-                    this->load[i]       = 0;
-                    this->store[i]      = 0;
-                    this->branch[i]     = 0;
+                    this->cycles[i]       = 0;
+                    this->total_insn[i]   = 0;
+                    this->load[i]         = 0;
+                    this->store[i]        = 0;
+                    this->branch[i]       = 0;
+                    this->cache_cycles[i] = 0;
                 }
             }
         }
@@ -96,31 +101,42 @@ public:
                    / sizeof(uint64_t);  // Size of each member
         }
 
-        DataCell operator+(const DataCell &rhs)
+        /// Copy the counters of core_id from src, which is the same as
+        /// mask_out_except(core_id) on a copy of src.
+        void copy_core(const DataCell &src, int core_id)
         {
-            DataCell  out = {}; // Copy elision
-            DataCell &lhs = *this;
-
-            for (int i = 0; i < out.size(); i++) {
-                for (int j = 0; j < VPMU.platform.cpu.cores; j++) {
-                    out[i][j] = lhs[i][j] + rhs[i][j];
-                }
+            for (int i = 0; i < size(); i++) {
+                (*this)[i][core_id] = src[i][core_id];
             }
+        }
 
+        DataCell operator+(const DataCell &rhs)
+        {
+            DataCell        out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
+
+            // All members are uint64_t, add them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(DataCell) / sizeof(uint64_t); i++) {
+                o[i] = l[i] + r[i];
+            }
             return out;
         }
 
         DataCell operator-(const DataCell &rhs)
         {
-            DataCell  out = {}; // Copy elision
-            DataCell &lhs = *this;
-
-            for (int i = 0; i < out.size(); i++) {
-                for (int j = 0; j < VPMU.platform.cpu.cores; j++) {
-                    out[i][j] = lhs[i][j] - rhs[i][j];
-                }
+            DataCell        out = {}; // Copy elision
+            const uint64_t *l   = (const uint64_t *)this;
+            const uint64_t *r   = (const uint64_t *)&rhs;
+            uint64_t *      o   = (uint64_t *)&out;
+
+            // All members are uint64_t, subtract them as a flat array
+            _PragmaVectorize
+            for (size_t i = 0; i < sizeof(DataCell) / sizeof(uint64_t); i++) {
+                o[i] = l[i] - r[i];
             }
-
             return out;
         }
     };
@@ -131,6 +147,7 @@ public:
         uint64_t load;
         uint64_t store;
         uint64_t branch;
+        uint64_t cache_cycles;
     } DataCell_Summed;
 
     // The data/states of each simulators for VPMU
@@ -180,6 +197,14 @@ public:
             this->system.mask_out_except(core_id);
         }
 
+        /// Copy the counters of core_id from src, which is the same as
+        /// mask_out_except(core_id) on a copy of src.
+        void copy_core(const Data &src, int core_id)
+        {
+            this->user.copy_core(src.user, core_id);
+            this->system.copy_core(src.system, core_id);
+        }
+
         Data operator+(const Data &rhs)
         {
             Data out = {}; // Copy elision
@@ -220,7 +245,7 @@ public:
     // Timing simulator model information that VPMU required for some functions
     Model model;
     // Synchronization Counter to identify the serial number of synchronized data
-    volatile uint32_t sync_counter;
+    volatile uint64_t sync_counter;
     // Synchronization flag to indicate whether it's done (true/false)
     volatile uint32_t synced_flag;
 
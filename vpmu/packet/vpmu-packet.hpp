@@ -32,15 +32,19 @@ public:
     using Reference = typename T::Reference;
     using Data      = typename T::Data;
 
-    VPMUPlatformInfo platform_info;                ///< The cpu information
-    T                common[VPMU_MAX_NUM_WORKERS]; ///< Configs/states
-    uint32_t         token;                        ///< Token variable
-    uint64_t         heart_beat;                   ///< Heartbeat signals
-    uint64_t         padding[8];                   ///< 8 words of padding
+    VPMUPlatformInfo platform_info;                         ///< The cpu information
+    T                common[VPMU_MAX_NUM_WORKERS];          ///< Configs/states
+    uint32_t         token;                                 ///< Token variable
+    uint64_t         heart_beat;                            ///< Heartbeat signals
+    uint64_t         sync_seq[VPMU_MAX_NUM_WORKERS];        ///< Seqlock of sync_data
+    uint64_t         epoch_waiter[VPMU_MAX_NUM_WORKERS];    ///< Epoch waited, or zero
+    sem_t            epoch_semaphore[VPMU_MAX_NUM_WORKERS]; ///< Posted at epoch_waiter
+    uint64_t         padding[8];                            ///< 8 words of padding
     /// The buffer for sending traces. This must be the last member for correct layout.
     RingBuffer<Reference, SIZE, VPMU_MAX_NUM_WORKERS> trace;
-    /// The buffer for receiving the performance counters asychronously
-    Data sync_data[VPMU_MAX_NUM_WORKERS][32];
+    /// The latest performance counters of each worker. The counters at each epoch
+    /// are sized at run time and kept apart (see VPMUStream_Impl::attach_history()).
+    Data sync_data[VPMU_MAX_NUM_WORKERS];
 };
 #pragma pack(pop) // restore original alignment from stack
 
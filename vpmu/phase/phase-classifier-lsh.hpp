@@ -0,0 +1,221 @@
+#ifndef __PHASE_CLASSIFIER_LSH_HPP_
+#define __PHASE_CLASSIFIER_LSH_HPP_
+#pragma once
+
+#include <cmath>         // std::abs
+#include <limits>        // std::numeric_limits
+#include <array>         // std::array
+#include <vector>        // std::vector
+#include <algorithm>     // std::sort, std::unique, std::find_if
+#include <mutex>         // std::mutex
+#include <unordered_map> // std::unordered_map
+
+#include "phase.hpp"            // Phase class
+#include "phase-classifier.hpp" // PhaseClassifier class
+
+/// @brief Approximate nearest cluster classifier using locality sensitive hashing
+/// @details Each phase list (one per process) has an index of num_tables hash tables.
+/// The key of a normalized BBV in a table is the signs of its dot products with
+/// num_bits random hyperplanes. A query only computes the distances to the phases in
+/// the buckets of its keys and the buckets one bit away from them.
+/// The distance and the threshold are the same as NearestCluster, so a phase is only
+/// missed when it is not hashed near the query, not when it is too far away.
+///
+/// The phases are appended to phase_list and updated by the caller, after classify()
+/// returns or anywhere else. The new phases are inserted at the next call. The entries
+/// of a bucket carry the version of the phase when it was hashed, so an updated phase
+/// is re-hashed when a query meets one of its stale entries. Until then, it stays in
+/// the buckets of its old keys, which are close to the new ones after a merge.
+/// An index belongs to the phase list of the serial number of its first phase, so the
+/// list of a new process never reuses the index of a dead one at the same address.
+/// The index of a removed process is dropped by forget(), which may run on another
+/// thread than the queries.
+class LSHCluster : public PhaseClassifier
+{
+public:
+    Phase &classify(std::vector<Phase> &phase_list, const Phase &phase) override
+    {
+        return search(phase_list, phase.get_normalized_vector());
+    }
+
+    Phase &classify(std::vector<Phase> &phase_list, const Window &window) override
+    {
+        auto n_vector = window.branch_vector;
+        vpmu::math::normalize(n_vector);
+        return search(phase_list, n_vector);
+    }
+
+    void forget(const std::vector<Phase> &phase_list) override
+    {
+        std::lock_guard<std::mutex> lock(index_lock);
+        indexes.erase(&phase_list);
+    }
+
+private:
+    static constexpr int num_tables = 8;
+    static constexpr int num_bits   = 12;
+
+    using Keys = std::array<uint32_t, num_tables>;
+
+    /// An entry of a bucket
+    struct Entry {
+        /// The index of the phase in phase_list
+        uint32_t phase;
+        /// The version of the phase when it was hashed
+        uint64_t version;
+    };
+
+    struct Index {
+        /// The serial number of the first phase of the phase list
+        uint64_t owner = 0;
+        /// The number of phases inserted to the tables
+        size_t size = 0;
+        /// The keys of each phase, for removing them from the buckets when re-hashing
+        std::vector<Keys> keys = {};
+        /// The buckets of each table <key, entries of phases>
+        std::array<std::unordered_map<uint32_t, std::vector<Entry>>, num_tables> tables =
+          {};
+    };
+
+    /// The random hyperplanes, num_tables * num_bits vectors of the BBV dimension
+    std::valarray<double> planes = {};
+    /// The dimension of the BBVs in the indexes
+    size_t dimension = 0;
+    /// The indexes of each phase list
+    std::unordered_map<const std::vector<Phase> *, Index> indexes = {};
+    /// Guards the indexes against forget()
+    std::mutex index_lock;
+
+    Phase &search(std::vector<Phase> &phase_list, const std::valarray<double> &n_vector)
+    {
+        std::lock_guard<std::mutex> lock(index_lock);
+        if (phase_list.size() == 0) {
+            // A new process, or a new phase list at the address of a dead one
+            indexes.erase(&phase_list);
+            return Phase::not_found;
+        }
+        if (n_vector.size() != dimension) build_planes(n_vector.size());
+        auto &index = indexes[&phase_list];
+        if (index.owner != phase_list[0].get_serial() || index.size > phase_list.size()) {
+            index       = {};
+            index.owner = phase_list[0].get_serial();
+        }
+
+        for (; index.size < phase_list.size(); index.size++) {
+            index.keys.push_back({});
+            insert(index, index.size, phase_list[index.size]);
+        }
+
+        // Gather the candidates in the buckets of the query and their neighbours
+        std::vector<uint32_t> candidates, stale;
+        Keys                  keys = hash(n_vector);
+        for (int t = 0; t < num_tables; t++) {
+            for (int b = -1; b < num_bits; b++) {
+                uint32_t key = (b < 0) ? keys[t] : (keys[t] ^ (1u << b));
+                auto     it  = index.tables[t].find(key);
+                if (it == index.tables[t].end()) continue;
+                for (auto &entry : it->second) {
+                    if (entry.version == phase_list[entry.phase].get_version())
+                        candidates.push_back(entry.phase);
+                    else
+                        stale.push_back(entry.phase);
+                }
+            }
+        }
+        // The phases updated since they were hashed are still compared this time
+        std::sort(stale.begin(), stale.end());
+        stale.erase(std::unique(stale.begin(), stale.end()), stale.end());
+        for (auto &&i : stale) {
+            remove(index, i);
+            insert(index, i, phase_list[i]);
+            candidates.push_back(i);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                         candidates.end());
+
+        // Find cloest distance with the same rule as NearestCluster
+        int64_t idx     = -1;
+        double  min_val = std::numeric_limits<double>::max();
+        for (auto &&i : candidates) {
+            double val =
+              manhatten_distance(phase_list[i].get_normalized_vector(), n_vector);
+            if (0.0 < val && val < min_val) {
+                idx     = i;
+                min_val = val;
+            }
+        }
+
+        if (idx == -1 || min_val > this->similarity_threshold) return Phase::not_found;
+        return phase_list[idx];
+    }
+
+    void build_planes(size_t new_dimension)
+    {
+        uint64_t seed = UINT64_C(0x9e3779b97f4a7c15);
+
+        dimension = new_dimension;
+        planes.resize(num_tables * num_bits * dimension);
+        for (size_t i = 0; i < planes.size(); i++) {
+            // xorshift64, mapped to a uniform random number in [-1, 1)
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            planes[i] = (double)(seed >> 11) / (UINT64_C(1) << 52) - 1.0;
+        }
+        // The keys of the old dimension are meaningless now
+        indexes.clear();
+    }
+
+    Keys hash(const std::valarray<double> &n_vector)
+    {
+        Keys keys = {};
+
+        if (n_vector.size() != dimension) return keys;
+        for (int t = 0; t < num_tables; t++) {
+            for (int b = 0; b < num_bits; b++) {
+                const double *plane = &planes[(t * num_bits + b) * dimension];
+                double        dot   = 0.0;
+                _PragmaVectorize
+                for (size_t i = 0; i < dimension; i++) {
+                    dot += plane[i] * n_vector[i];
+                }
+                if (dot >= 0.0) keys[t] |= 1u << b;
+            }
+        }
+        return keys;
+    }
+
+    void insert(Index &index, uint32_t i, const Phase &phase)
+    {
+        index.keys[i] = hash(phase.get_normalized_vector());
+        for (int t = 0; t < num_tables; t++) {
+            index.tables[t][index.keys[i][t]].push_back({i, phase.get_version()});
+        }
+    }
+
+    void remove(Index &index, uint32_t i)
+    {
+        for (int t = 0; t < num_tables; t++) {
+            auto &bucket = index.tables[t][index.keys[i][t]];
+            auto  it     = std::find_if(
+              bucket.begin(), bucket.end(), [i](const Entry &e) { return e.phase == i; });
+            if (it != bucket.end()) bucket.erase(it);
+        }
+    }
+
+    inline double manhatten_distance(const std::valarray<double> &v1,
+                                     const std::valarray<double> &v2)
+    {
+        double m_distance = 0.0f;
+
+        if (v1.size() != v2.size()) return std::numeric_limits<double>::max();
+        _PragmaVectorize
+        for (size_t i = 0; i < v1.size(); i++) {
+            m_distance += std::abs(v1[i] - v2[i]);
+        }
+        return m_distance;
+    }
+};
+
+#endif
@@ -14,7 +14,7 @@ class NearestCluster : public PhaseClassifier
 public:
     Phase &classify(std::vector<Phase> &phase_list, const Phase &phase) override
     {
-        auto n_vector = phase.get_normalized_vector();
+        auto &n_vector = phase.get_normalized_vector();
         // Calaulate the distances
         double distance_array[phase_list.size()];
         _PragmaVectorize
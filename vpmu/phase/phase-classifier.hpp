@@ -27,6 +27,9 @@ public:
         return Phase::not_found;
     }
 
+    /// Drop the state kept for a phase list, called when its process is removed
+    virtual void forget(const std::vector<Phase>& phase_list) {}
+
 protected:
     uint64_t similarity_threshold = 1;
 };
@@ -4,6 +4,11 @@
 
 #define DEFAULT_WINDOW_SIZE 200000 // 200k instructions
 #define DEFAULT_VECTOR_SIZE 2048   // 2048 buckets per BBV
+#define DEFAULT_PROJECTION_SIZE 0  // Use the dense BBV by default
+
+#define DEFAULT_FF_MIN_WINDOWS 8       // Detailed windows before fast-forwarding a phase
+#define DEFAULT_FF_TOLERANCE 0.05      // Max. relative deviation of a stable phase
+#define DEFAULT_FF_VALIDATE_INTERVAL 16 // Fast windows between two detailed windows
 
 #include <utility> // std::pair
 
@@ -16,4 +21,21 @@ struct GPUFriendnessCounter {
     uint64_t branch;
 };
 
+/// The statistics of phase-based fast-forwarding of a process
+struct FastForwardReport {
+    uint64_t detailed_windows;
+    uint64_t fast_windows;
+    uint64_t validations;        // Detailed windows of stable phases
+    uint64_t invalidations;      // Validations exceeding the tolerance
+    uint64_t windows_since_check; // Fast windows since the last detailed window
+    double   error_sum;          // Sum of relative errors of validations
+    double   error_max;          // Max. relative error of validations
+    double   last_penalty;       // ns per instruction of the last detailed window
+    uint64_t detailed_insn;
+    uint64_t detailed_host_ns;
+    uint64_t fast_insn;
+    uint64_t fast_host_ns;
+    uint64_t extrapolated_ns;
+};
+
 #endif
@@ -2,6 +2,8 @@
 #define __PHASE_DETECT_HPP_
 #pragma once
 
+#include <boost/algorithm/string.hpp> // boost::split
+
 #include "vpmu.hpp"             // Include types and basic headers
 #include "vpmu-log.hpp"         // VPMULog
 #include "vpmu-utils.hpp"       // Various functions
@@ -38,12 +40,68 @@ public:
         return classifier->classify(phase_list, phase);
     }
 
+    inline void forget(const std::vector<Phase>& phase_list)
+    {
+        classifier->forget(phase_list);
+    }
+
     void set_window_size(uint64_t new_size) { window_size = new_size; }
 
     inline uint64_t get_window_size(void) { return window_size; }
 
+    /// Set the dimension of the random projected phase signature, zero for dense BBV
+    void set_projection_size(uint32_t new_size) { projection_size = new_size; }
+
+    inline uint32_t get_projection_size(void) { return projection_size; }
+
+    /// Classify the windows on the phase worker (true) or in the VPMU_async() callbacks
+    void set_async(bool new_async) { async = new_async; }
+
+    inline bool is_async(void) { return async; }
+
+    /// @brief Set the programs to be fast-forwarded, a comma separated list of names.
+    /// "*" enables all the traced programs.
+    void set_fast_forward_programs(std::string names)
+    {
+        fast_forward_programs.clear();
+        boost::split(fast_forward_programs, names, boost::is_any_of(","));
+    }
+
+    inline bool fast_forward_enabled(const std::string& name)
+    {
+        for (auto& program : fast_forward_programs) {
+            if (program == "*" || program == name) return true;
+        }
+        return false;
+    }
+
+    /// Set the number of detailed windows before a phase is fast-forwarded
+    void set_ff_min_windows(uint64_t new_num) { ff_min_windows = new_num; }
+
+    inline uint64_t get_ff_min_windows(void) { return ff_min_windows; }
+
+    /// Set the max. relative deviation of the counters in a stable phase
+    void set_ff_tolerance(double new_tolerance) { ff_tolerance = new_tolerance; }
+
+    inline double get_ff_tolerance(void) { return ff_tolerance; }
+
+    /// Set the number of fast windows between two detailed windows of a phase
+    void set_ff_validate_interval(uint64_t new_interval)
+    {
+        ff_validate_interval = new_interval;
+    }
+
+    inline uint64_t get_ff_validate_interval(void) { return ff_validate_interval; }
+
 private:
     uint64_t window_size;
+    uint32_t projection_size      = DEFAULT_PROJECTION_SIZE;
+    bool     async                = true;
+    uint64_t ff_min_windows       = DEFAULT_FF_MIN_WINDOWS;
+    double   ff_tolerance         = DEFAULT_FF_TOLERANCE;
+    uint64_t ff_validate_interval = DEFAULT_FF_VALIDATE_INTERVAL;
+    /// Programs allowed to skip detailed timing in the recurring phases
+    std::vector<std::string> fast_forward_programs = {};
     // C++ must use pointer in order to call the derived class virtual functions
     std::unique_ptr<PhaseClassifier> classifier;
 };
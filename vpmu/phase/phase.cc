@@ -8,15 +8,20 @@
 #include "vpmu-branch.hpp"            // BranchStream
 #include "vpmu-snapshot.hpp"          // VPMUSanpshot
 #include "vpmu-log.hpp"               // CONSOLE_LOG, VPMULog
+#include "ThreadPool.hpp"             // ThreadPool
 
 // Put your own phase classifier below
-#include "phase/phase-classifier-nn.hpp" // NearestCluster classifier
+#include "phase/phase-classifier-nn.hpp"  // NearestCluster classifier
+#include "phase/phase-classifier-lsh.hpp" // LSHCluster classifier
 
 // Put you own phase classifier above
 
-Phase Phase::not_found = Phase();
+std::atomic<uint64_t> Phase::num_phases{0};
+Phase                 Phase::not_found = Phase();
 
 PhaseDetect phase_detect(DEFAULT_WINDOW_SIZE, std::make_unique<NearestCluster>());
+// The phase worker. One thread keeps the windows of each process in order.
+static ThreadPool phase_thread_pool("vpmu_phase", 1);
 
 // TODO Output better features for machine learning
 nlohmann::json Phase::json_fingerprint(void)
@@ -35,8 +40,13 @@ nlohmann::json Phase::json_fingerprint(void)
     return j;
 }
 
-static void update_phase(std::shared_ptr<ET_Process>& process, const Window& window)
+// Classify the window to a phase and merge the window into the phase.
+// The phase IDs only depend on the order of the windows of each process.
+static Phase& classify_window(std::shared_ptr<ET_Process>& process, Window& window)
 {
+    window.project();
+    // Sort the walk counts once for merging them into the phase
+    window.code_walk_count.sort();
     // Classify the window to phase
     auto& res = phase_detect.classify(process->phase_list, window);
     if (res == Phase::not_found) {
@@ -46,19 +56,6 @@ static void update_phase(std::shared_ptr<ET_Process>& process, const Window& win
     auto& phase = (res != Phase::not_found) ? res : process->phase_list.back();
 
     phase.update(window);
-    uint64_t core_id = vpmu::get_core_id();
-    VPMU_async([core_id, &phase, process, window]() {
-        VPMUSnapshot new_snapshot(true, core_id);
-        // Update the counter values of this phase
-        phase.update(new_snapshot - process->snapshot_phase);
-        // Update the last checkpoint of this process (for phase detection only)
-        process->snapshot_phase = new_snapshot;
-        // Update process phase history
-        process->phase_history.push_back({{window.timestamp,        // Construct an array
-                                           window.target_timestamp, // with {{ ... }}
-                                           phase.id}});
-    });
-
     if (res == Phase::not_found) {
         DBG(STR_PHASE "pid: %" PRIu64 ", name: %s\n" STR_PHASE
                       "Create new phase id %zu @ Timestamp: %lu ms\n",
@@ -67,10 +64,150 @@ static void update_phase(std::shared_ptr<ET_Process>& process, const Window& win
             phase.id,
             window.timestamp / 1000);
     }
+    return phase;
+}
+
+// Account a closed window for fast-forwarding and decide the mode of the next window.
+// Detailed windows record the time per instruction of the cache and branch streams in
+// the phase, and validate it if the phase is stable. Fast windows extrapolate the time
+// from the phase. This runs in order with the windows of the process.
+static void fast_forward_window(const std::shared_ptr<ET_Process>& process,
+                                Phase&                             phase,
+                                const Window&                      window,
+                                const VPMUSnapshot&                diff)
+{
+    auto&    ff          = process->ff_report;
+    uint64_t insn        = window.instruction_count;
+    uint64_t min_windows = phase_detect.get_ff_min_windows();
+    double   tolerance   = phase_detect.get_ff_tolerance();
+
+    if (insn == 0) return;
+    if (window.fast_forward) {
+        double penalty =
+          (phase.get_penalty_count() > 0) ? phase.get_penalty() : ff.last_penalty;
+        uint64_t extrapolated_ns = penalty * insn;
+
+        // The timing threads and the vCPUs read it for the target time
+        __atomic_fetch_add(&VPMU.fast_forward_time_ns, extrapolated_ns, __ATOMIC_RELAXED);
+        ff.extrapolated_ns += extrapolated_ns;
+        ff.fast_windows++;
+        ff.fast_insn += insn;
+        ff.fast_host_ns += diff.time_ns[6];
+        ff.windows_since_check++;
+    } else {
+        // Branch, cache and system memory time
+        double penalty = diff.time_ns[1] + diff.time_ns[2] + diff.time_ns[3];
+        penalty /= insn;
+
+        if (phase.is_stable(min_windows, tolerance)) {
+            double error = std::abs(phase.get_penalty() - penalty);
+            if (penalty > 0.0) error /= penalty;
+            else error = (error > 0.0); // Count as 100% error
+            ff.validations++;
+            ff.error_sum += error;
+            if (error > ff.error_max) ff.error_max = error;
+            if (error > tolerance) {
+                // The phase behaves differently now, learn it again
+                ff.invalidations++;
+                phase.reset_penalty();
+            }
+        }
+        phase.update_penalty(penalty);
+        ff.last_penalty = penalty;
+        ff.detailed_windows++;
+        ff.detailed_insn += insn;
+        ff.detailed_host_ns += diff.time_ns[6];
+        ff.windows_since_check = 0;
+    }
+
+    // Assume the phase recurs in the next window. Resume the detailed simulation
+    // periodically to validate the phase. The vCPU reads it when a window begins, so
+    // in the asynchronous mode it applies to a window after the queued ones.
+    bool fast_forward =
+      phase_detect.fast_forward_enabled(process->name)
+      && phase.is_stable(min_windows, tolerance)
+      && ff.windows_since_check < phase_detect.get_ff_validate_interval();
+    __atomic_store_n(&process->fast_forward, fast_forward, __ATOMIC_RELAXED);
+}
+
+// Classify a closed window and account its counters in the phase. Only one thread
+// calls this for a process, so the phase list may grow without invalidating others.
+static void apply_window(std::shared_ptr<ET_Process>& process, WindowRecord* rec)
+{
+    auto&        phase = classify_window(process, rec->window);
+    VPMUSnapshot diff  = rec->snapshot - process->snapshot_phase;
+    // Update the counter values of this phase, fast windows lack some of them
+    if (!rec->window.fast_forward) phase.update(diff);
+    fast_forward_window(process, phase, rec->window, diff);
+    // Update the last checkpoint of this process (for phase detection only)
+    process->snapshot_phase = rec->snapshot;
+    // Update process phase history
+    process->phase_history.push_back(
+      {{rec->window.timestamp, rec->window.target_timestamp, phase.id}});
+}
+
+// Classify all the queued windows of a process. This runs on the phase worker.
+static void drain_windows(std::shared_ptr<ET_Process> process)
+{
+    do {
+        WindowRecord* rec;
+        while ((rec = process->window_queue.pop()) != nullptr) {
+            apply_window(process, rec);
+            process->window_queue.release(rec);
+        }
+    } while (process->window_queue.unschedule());
+}
+
+// The vCPU thread never touches the phase list. The window is classified by the
+// callback taking its snapshot, which runs in the order of the windows.
+static void update_phase_sync(std::shared_ptr<ET_Process>& process, Window& window)
+{
+    uint64_t core_id = vpmu::get_core_id();
+    auto     rec     = process->window_queue.acquire();
+
+    std::swap(rec->window, window);
+    VPMU_async([process, rec, core_id]() mutable {
+        rec->snapshot                = VPMUSnapshot(true, core_id);
+        rec->window.target_timestamp = process->window_target_timestamp;
+        // The next window of this process begins where this one ends
+        process->window_target_timestamp = vpmu::target::time_us();
+        apply_window(process, rec);
+        process->window_queue.release(rec);
+    });
+}
+
+// The vCPU thread only swaps the closed window with a pooled one. The record is queued
+// to the phase worker by the callback taking its snapshot, so the worker never waits.
+static void update_phase_async(std::shared_ptr<ET_Process>& process, Window& window)
+{
+    uint64_t core_id = vpmu::get_core_id();
+    auto     rec     = process->window_queue.acquire();
+
+    std::swap(rec->window, window);
+    VPMU_async([process, rec, core_id]() {
+        rec->snapshot                = VPMUSnapshot(true, core_id);
+        rec->window.target_timestamp = process->window_target_timestamp;
+        // The next window of this process begins where this one ends
+        process->window_target_timestamp = vpmu::target::time_us();
+        process->window_queue.push(rec);
+        if (process->window_queue.schedule()) {
+            phase_thread_pool.enqueue_static([process]() { drain_windows(process); });
+        }
+    });
+}
+
+static void update_phase(std::shared_ptr<ET_Process>& process, Window& window)
+{
+    if (phase_detect.is_async())
+        update_phase_async(process, window);
+    else
+        update_phase_sync(process, window);
 }
 
 static inline bool update_window(Window& window, const ExtraTBInfo* extra_tb_info)
 {
+    // Apply the signature mode at the beginning of each window
+    if (window.flag_reset) window.set_projection_size(phase_detect.get_projection_size());
     window.update(extra_tb_info);
     if (window.instruction_count > phase_detect.get_window_size()) {
         return true;
@@ -88,8 +225,11 @@ void phasedet_ref(bool               last_tb_user_mode,
     static uint64_t window_cnt = 0;
 #endif
 
-    uint64_t pid     = (user_mode) ? VPMU.core[vpmu::get_core_id()].current_pid : 0;
-    auto     process = event_tracer.find_process(pid);
+    // The process running on this core, without touching the reference counts
+    ET_Process* process = nullptr;
+    if (user_mode) process = event_tracer.get_running_process(core_id);
+    // Only the windows of a fast-forwarded process bypass the streams
+    VPMU.core[core_id].fast_forward = false;
     if (process != nullptr) {
         if (!user_mode) return; // Currently we do not support kernel mode phase profiling
         if (user_mode && !last_tb_user_mode) {
@@ -97,9 +237,18 @@ void phasedet_ref(bool               last_tb_user_mode,
         } else if (!user_mode && last_tb_user_mode) {
             // Change from user mode to kernel mode
         }
+        // The mode of a window is decided when it begins
+        if (process->current_window.flag_reset) {
+            process->current_window.fast_forward =
+              __atomic_load_n(&process->fast_forward, __ATOMIC_RELAXED);
+        }
         bool flag_w = update_window(process->current_window, extra_tb_info);
-        if (flag_w) update_phase(process, process->current_window);
-        if (flag_w) process->current_window.reset();
+        if (flag_w) {
+            // The only reference taken per window, shared by its asynchronous tasks
+            auto owner = process->shared_from_this();
+            update_phase(owner, process->current_window);
+        }
+        VPMU.core[core_id].fast_forward = process->current_window.fast_forward;
         process->stack_ptr = stack_ptr;
 #ifdef CONFIG_VPMU_DEBUG_MSG
         if (flag_w) {
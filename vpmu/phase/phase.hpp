@@ -8,12 +8,15 @@ extern "C" {
 }
 // #include <eigen3/Eigen/Dense> // Use Eigen for vector and its operations
 #include <valarray> // Use std::valarray to accelerate the operations
+#include <cmath>    // std::sqrt
+#include <atomic>   // std::atomic
 
 #include "vpmu.hpp"          // Include types and basic headers
 #include "phase-common.hpp"  // Common definitions of phase detection
 #include "window.hpp"        // Window class
+#include "window-queue.hpp"  // WindowQueue class
 #include "vpmu-snapshot.hpp" // VPMUSanpshot
-#include "beg_eng_pair.hpp"  // Pair_beg_end
+#include "walk-count.hpp"    // SortedWalkCount
 
 class Phase
 {
@@ -31,11 +34,16 @@ public:
         n_branch_vector.resize(branch_vector.size());
         vpmu::math::normalize(branch_vector, n_branch_vector);
         // Set up other configurations
-        num_windows     = 1;
-        code_walk_count = window.code_walk_count;
-        counters        = window.counters;
+        num_windows = 1;
+        counters    = window.counters;
+        update_walk_count(window.code_walk_count);
     }
 
+    /// @brief A number unique to this phase among all phases, kept by the copies
+    inline uint64_t get_serial(void) const { return serial; }
+    /// @brief Changed whenever the vector of this phase changes
+    inline uint64_t get_version(void) const { return version; }
+
     // Default comparison is pointer comparison
     inline bool operator==(const Phase& rhs) { return (this == &rhs); }
     inline bool operator!=(const Phase& rhs) { return !(this == &rhs); }
@@ -69,6 +77,35 @@ public:
         return n_branch_vector;
     }
 
+    /// @brief Add the time per instruction of the bypassed streams of a detailed window
+    void update_penalty(double penalty)
+    {
+        // Welford's online algorithm of mean and variance
+        penalty_count++;
+        double delta = penalty - penalty_mean;
+        penalty_mean += delta / penalty_count;
+        penalty_m2 += delta * (penalty - penalty_mean);
+    }
+
+    inline void reset_penalty(void)
+    {
+        penalty_count = 0;
+        penalty_mean  = 0.0;
+        penalty_m2    = 0.0;
+    }
+
+    inline uint64_t get_penalty_count(void) const { return penalty_count; }
+    inline double   get_penalty(void) const { return penalty_mean; }
+
+    /// @brief A phase is stable when its time per instruction of the bypassed streams
+    /// deviates less than the tolerance after min_windows detailed windows.
+    bool is_stable(uint64_t min_windows, double tolerance) const
+    {
+        if (penalty_count < min_windows || penalty_count < 2) return false;
+        double stddev = std::sqrt(penalty_m2 / (penalty_count - 1));
+        return stddev <= tolerance * penalty_mean;
+    }
+
     nlohmann::json json_counters(void);
     nlohmann::json json_fingerprint(void);
 
@@ -81,6 +118,7 @@ private:
         }
         branch_vector += vec;
         vpmu::math::normalize(branch_vector, n_branch_vector);
+        version++;
     }
 
     inline void update_counter(const GPUFriendnessCounter w_counter)
@@ -93,14 +131,30 @@ private:
         counters.branch += w_counter.branch;
     }
 
-    inline void update_walk_count(const std::map<Pair_beg_end, uint32_t>& walk_count)
+    inline void update_walk_count(const WindowWalkCount& walk_count)
     {
-        for (auto&& wc : walk_count) {
-            code_walk_count[wc.first] += wc.second;
+        if (walk_count.is_sorted()) {
+            merge_walk_count(code_walk_count, walk_count.begin(), walk_count.end());
+        } else {
+            SortedWalkCount sorted(walk_count.begin(), walk_count.end());
+            std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+                return a.first < b.first;
+            });
+            merge_walk_count(code_walk_count, sorted.begin(), sorted.end());
         }
     }
 
+    inline void update_walk_count(const SortedWalkCount& walk_count)
+    {
+        merge_walk_count(code_walk_count, walk_count.begin(), walk_count.end());
+    }
+
 private:
+    /// The number of phases ever created, for the serial numbers
+    static std::atomic<uint64_t> num_phases;
+
+    uint64_t serial  = num_phases++;
+    uint64_t version = 0;
     /// The basic block vector. (Perhapse using Eigen::VectorXd?)
     std::valarray<double> branch_vector = {};
     /// The normalized basic block vector. (Perhapse using Eigen::VectorXd?)
@@ -109,6 +163,10 @@ private:
     uint64_t num_windows = 0;
     /// The counters used for GPU friendliness prediction
     GPUFriendnessCounter counters = {};
+    /// The statistics of branch, cache and memory time per instruction (ns)
+    uint64_t penalty_count = 0;
+    double   penalty_mean  = 0.0;
+    double   penalty_m2    = 0.0;
 
 public:
     /// An ID to identify the ID of this phase
@@ -116,7 +174,8 @@ public:
     /// The snapshot of counters associated with this phase
     VPMUSnapshot snapshot = {};
     /// The walk-count associated with this phase. <<addr_beg, addr_end>, count>
-    std::map<Pair_beg_end, uint32_t> code_walk_count = {};
+    /// It is sorted by the addresses for merging.
+    SortedWalkCount code_walk_count = {};
 };
 
 #endif
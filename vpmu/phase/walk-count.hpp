@@ -0,0 +1,164 @@
+#ifndef __WALK_COUNT_HPP_
+#define __WALK_COUNT_HPP_
+#pragma once
+
+#include <vector>    // std::vector
+#include <utility>   // std::pair
+#include <algorithm> // std::sort
+
+#include "beg_eng_pair.hpp" // Pair_beg_end
+
+/// The walk count of a basic block <<BB beg, BB end>, count>
+using WalkCount = std::pair<Pair_beg_end, uint32_t>;
+
+/// The walk counts of a phase, sorted by the address of basic blocks
+using SortedWalkCount = std::vector<WalkCount>;
+
+/// @brief Merge the sorted walk counts in [first, last) into a sorted vector in place.
+/// @details Both inputs are sorted. The first pass adds up the counts of the basic
+/// blocks already in dst and counts the new ones, the second pass grows dst by the new
+/// ones and merges them from the back, so the existing entries are moved at most once
+/// and nothing is copied when the window has no new basic block.
+template <typename Iterator>
+inline void merge_walk_count(SortedWalkCount& dst, Iterator first, Iterator last)
+{
+    size_t num_new = 0;
+    auto   it      = dst.begin();
+
+    for (auto src = first; src != last; src++) {
+        while (it != dst.end() && it->first < src->first) it++;
+        if (it != dst.end() && !(src->first < it->first))
+            it->second += src->second;
+        else
+            num_new++;
+    }
+    if (num_new == 0) return;
+
+    size_t old_size = dst.size();
+    dst.resize(old_size + num_new);
+    // Merge backward, the entries in dst are already added up
+    auto out = dst.end();
+    auto d   = dst.begin() + old_size;
+    auto src = last;
+    while (src != first) {
+        auto& s = *(src - 1);
+        if (d != dst.begin() && s.first < (d - 1)->first) {
+            *--out = *--d;
+        } else {
+            if (d == dst.begin() || (d - 1)->first < s.first) *--out = s;
+            src--;
+        }
+    }
+}
+
+/// @brief The walk counts of basic blocks in a window
+/// @details This is an open addressing hash table with linear probing. The entries
+/// are stored densely in an arena (a vector keeping its memory across windows) and
+/// the slots only hold the indexes of entries tagged with an epoch. Resetting the
+/// window bumps the epoch and clears the arena, so it is O(1) and does not free
+/// anything. When a window closes, sort() sorts the arena in place for merging the
+/// entries into a phase with merge_walk_count().
+class WindowWalkCount
+{
+public:
+    WindowWalkCount() { slots.resize(initial_slots); }
+
+    inline void add(uint64_t beg, uint64_t end)
+    {
+        if (flag_sorted) rehash(slots.size());
+        uint64_t mask = slots.size() - 1;
+        for (uint64_t i = hash(beg, end) & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.epoch != epoch) {
+                // An empty slot, insert a new entry
+                slot.epoch = epoch;
+                slot.index = entries.size();
+                entries.push_back({{beg, end}, 1});
+                // Keep the load factor below 1/2
+                if (entries.size() * 2 > slots.size()) rehash(slots.size() * 2);
+                return;
+            }
+            WalkCount& entry = entries[slot.index];
+            if (entry.first.beg == beg && entry.first.end == end) {
+                entry.second++;
+                return;
+            }
+        }
+    }
+
+    void reset(void)
+    {
+        entries.clear();
+        flag_sorted = false;
+        if (++epoch == 0) {
+            // The epoch wraps around, clear the tags of all slots
+            for (auto& slot : slots) slot.epoch = 0;
+            epoch = 1;
+        }
+    }
+
+    /// Sort the entries by the address. The table is rebuilt if add() is called after
+    void sort(void)
+    {
+        if (flag_sorted) return;
+        std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) {
+            return a.first < b.first;
+        });
+        flag_sorted = true;
+    }
+
+    inline bool   is_sorted(void) const { return flag_sorted; }
+    inline size_t size(void) const { return entries.size(); }
+
+    inline std::vector<WalkCount>::const_iterator begin(void) const
+    {
+        return entries.begin();
+    }
+    inline std::vector<WalkCount>::const_iterator end(void) const
+    {
+        return entries.end();
+    }
+
+private:
+    struct Slot {
+        uint32_t epoch = 0;
+        uint32_t index = 0;
+    };
+
+    static constexpr size_t initial_slots = 1024;
+
+    inline uint64_t hash(uint64_t beg, uint64_t end)
+    {
+        uint64_t key = beg ^ (end * UINT64_C(0x9e3779b97f4a7c15));
+        key          = (key ^ (key >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        key          = (key ^ (key >> 27)) * UINT64_C(0x94d049bb133111eb);
+        return key ^ (key >> 31);
+    }
+
+    void rehash(size_t new_size)
+    {
+        slots.assign(new_size, Slot());
+        epoch       = 1;
+        flag_sorted = false;
+
+        uint64_t mask = slots.size() - 1;
+        for (uint32_t idx = 0; idx < entries.size(); idx++) {
+            auto&    addr = entries[idx].first;
+            uint64_t i    = hash(addr.beg, addr.end) & mask;
+            while (slots[i].epoch == epoch) i = (i + 1) & mask;
+            slots[i].epoch = epoch;
+            slots[i].index = idx;
+        }
+    }
+
+    /// The arena of entries in this window
+    std::vector<WalkCount> entries = {};
+    /// The hash table, the size is always a power of two
+    std::vector<Slot> slots = {};
+    /// The slots tagged with other epochs are empty
+    uint32_t epoch = 1;
+    /// Set when the entries are sorted and the slots are out of date
+    bool flag_sorted = false;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef __WINDOW_QUEUE_HPP_
+#define __WINDOW_QUEUE_HPP_
+#pragma once
+
+#include <atomic>             // std::atomic
+#include <mutex>              // std::mutex
+#include <condition_variable> // std::condition_variable
+
+#include "window.hpp"        // Window class
+#include "vpmu-snapshot.hpp" // VPMUSanpshot
+
+/// @brief The link of the records in WindowQueue
+struct WindowNode {
+    std::atomic<WindowNode*> next = {nullptr};
+};
+
+/// @brief A closed window waiting to be classified
+/// @details The records are recycled by WindowQueue. The window is swapped with the
+/// one of the process, so a record keeps the memory of its window across uses.
+struct WindowRecord : public WindowNode {
+    /// The window closed by the vCPU thread, or a reset one when it is in the pool
+    Window window;
+    /// The counters at the end of this window, taken by VPMU_async()
+    VPMUSnapshot snapshot = {};
+};
+
+/// @brief Per-process lock-free queue of closed windows
+/// @details This is an intrusive multiple-producer single-consumer queue (Vyukov's
+/// MPSC queue). The records are pushed without locks in the order of the windows, and
+/// the single phase worker pops them in the order they are pushed. It also tracks
+/// whether a drain task of this queue is scheduled on the phase worker so that only
+/// one is scheduled when the queue becomes non-empty.
+///
+/// The records come from a pool of the queue. The vCPU running the process acquires
+/// one when a window closes and the phase worker releases it after classifying the
+/// window. New records are only allocated while all of them are in flight, so the
+/// pool grows to the depth of the pipeline in the first windows and nothing is
+/// allocated afterward.
+class WindowQueue
+{
+public:
+    WindowQueue() : head(&stub), tail(&stub) {}
+    ~WindowQueue()
+    {
+        WindowRecord* rec;
+        while ((rec = pop()) != nullptr) delete rec;
+        free_list(spare);
+        free_list(released.load());
+    }
+
+    // The records belong to the queue object. Copying a process does not copy them.
+    WindowQueue(const WindowQueue& rhs) : WindowQueue() {}
+    WindowQueue& operator=(const WindowQueue& rhs) { return *this; }
+
+    /// @brief Take a record with a reset window from the pool.
+    /// @details Only the vCPU running the process calls this, one at a time.
+    WindowRecord* acquire(void)
+    {
+        // Take all the released records at once, there is no ABA problem on the stack
+        if (spare == nullptr) spare = released.exchange(nullptr);
+        WindowRecord* rec = static_cast<WindowRecord*>(spare);
+        if (rec != nullptr)
+            spare = rec->next.load();
+        else
+            rec = new WindowRecord();
+        // Count it first so that wait_drained() sees the windows being closed
+        pending++;
+        return rec;
+    }
+
+    /// @brief Return a record to the pool after classifying its window.
+    void release(WindowRecord* rec)
+    {
+        rec->window.reset();
+        WindowNode* top = released.load();
+        do {
+            rec->next.store(top);
+        } while (!released.compare_exchange_weak(top, rec));
+        // Only wake up the waiters when the last record comes back
+        if (--pending == 0 && waiters != 0) {
+            std::lock_guard<std::mutex> lock(drained_mutex);
+            drained.notify_all();
+        }
+    }
+
+    /// @brief Push an acquired record.
+    void push(WindowRecord* rec)
+    {
+        // Count it first so that the consumer never sees fewer queued records
+        queued++;
+        link(rec);
+    }
+
+    /// @brief Pop a record, return nullptr if none is ready. Called by the consumer.
+    WindowRecord* pop(void)
+    {
+        WindowNode* t    = tail;
+        WindowNode* next = t->next.load();
+
+        if (t == &stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            t    = next;
+            next = next->next.load();
+        }
+        if (next == nullptr) {
+            // Another producer is linking its record after t
+            if (t != head.load()) return nullptr;
+            link(&stub);
+            next = t->next.load();
+            if (next == nullptr) return nullptr;
+        }
+        tail = next;
+        queued--;
+        return static_cast<WindowRecord*>(t);
+    }
+
+    /// @brief Try to take the right to drain this queue.
+    /// @return True if the caller should schedule a drain task.
+    inline bool schedule(void) { return !scheduled.exchange(true); }
+
+    /// @brief Release the right to drain this queue after popping all the records.
+    /// @return True if new records arrived in between and the caller still owns it.
+    inline bool unschedule(void)
+    {
+        scheduled = false;
+        return queued != 0 && schedule();
+    }
+
+    /// @brief Block until all the records acquired so far are released.
+    void wait_drained(void)
+    {
+        // Announce it before reading pending, release() reads them in reverse order
+        waiters++;
+        {
+            std::unique_lock<std::mutex> lock(drained_mutex);
+            drained.wait(lock, [this]() { return pending == 0; });
+        }
+        waiters--;
+    }
+
+private:
+    inline void link(WindowNode* node)
+    {
+        node->next.store(nullptr);
+        WindowNode* prev = head.exchange(node);
+        prev->next.store(node);
+    }
+
+    static void free_list(WindowNode* node)
+    {
+        while (node != nullptr) {
+            WindowNode* next = node->next.load();
+            delete static_cast<WindowRecord*>(node);
+            node = next;
+        }
+    }
+
+    /// The dummy node which keeps the queue non-empty for the producers
+    WindowNode               stub;
+    std::atomic<WindowNode*> head;
+    WindowNode*              tail;
+    std::atomic<uint64_t>    queued    = {0};
+    std::atomic<bool>        scheduled = {false};
+    /// The records acquired and not released yet
+    std::atomic<uint64_t> pending = {0};
+    /// The number of threads in wait_drained()
+    std::atomic<uint32_t> waiters = {0};
+    /// Notified when pending drops to zero, with the mutex held
+    std::mutex              drained_mutex;
+    std::condition_variable drained;
+    /// The stack of records released by the phase worker
+    std::atomic<WindowNode*> released = {nullptr};
+    /// The records taken from the stack, only used by acquire()
+    WindowNode* spare = nullptr;
+};
+
+#endif
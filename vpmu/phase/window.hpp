@@ -5,7 +5,7 @@
 // #include <eigen3/Eigen/Dense> // Use Eigen for vector and its operations
 #include <valarray> // Use std::valarray to accelerate the operations
 
-#include "beg_eng_pair.hpp" // Pair_beg_end
+#include "walk-count.hpp"   // WindowWalkCount
 #include "phase-common.hpp" // Common definitions of phase detection
 #include "vpmu.hpp"         // Include types and basic headers
 #include "vpmu-utils.hpp"   // vpmu::host::timestamp_us()
@@ -21,32 +21,67 @@ public:
         uint64_t pc     = extra_tb_info->start_addr;
         uint64_t pc_end = pc + extra_tb_info->counters.size_bytes;
         // Update timestamp if this window is cleared before,
-        // which means this is a new window.
-        if (flag_reset) {
-            this->timestamp = vpmu::host::timestamp_us();
-            VPMU_async([this]() { this->target_timestamp = vpmu::target::time_us(); });
-        }
+        // which means this is a new window. The owner of the window takes the target
+        // timestamp in order with the timing streams.
+        if (flag_reset) this->timestamp = vpmu::host::timestamp_us();
         flag_reset = false;
         update_bbv(pc);
         update_counter(extra_tb_info);
         instruction_count += extra_tb_info->counters.total;
 
-        code_walk_count[Pair_beg_end({pc, pc_end})] += 1;
+        code_walk_count.add(pc, pc_end);
     }
 
     void reset(void)
     {
         flag_reset        = true;
+        fast_forward      = false;
         timestamp         = 0;
         instruction_count = 0;
         counters          = {};
         memset(&branch_vector[0], 0, branch_vector.size() * sizeof(branch_vector[0]));
-        code_walk_count.clear();
+        code_walk_count.reset();
+    }
+
+    /// @brief Set the dimension of the phase signature, zero to use the dense BBV.
+    /// @details With a non-zero size, the BBV is reduced to a random projection of
+    /// this size by project() (SimPoint-style). The branch_vector is then the projected
+    /// signature.
+    void set_projection_size(uint32_t new_size)
+    {
+        if (new_size == projection_size) return;
+        projection_size = new_size;
+        branch_vector.resize((new_size != 0) ? new_size : DEFAULT_VECTOR_SIZE);
+    }
+
+    /// @brief Reduce the sparse BBV to the projected signature at window close.
+    /// @details The sparse BBV is the walk count of the window, which already counts
+    /// each basic block without allocating. The random matrix is not stored. Each
+    /// column is generated from the hash of the PC, so the same basic block always
+    /// maps to the same column.
+    void project(void)
+    {
+        if (projection_size == 0) return;
+        branch_vector = 0.0;
+        for (auto&& bb : code_walk_count) {
+            uint64_t seed  = bitmix_hash(bb.first.beg);
+            double   count = bb.second;
+            for (uint32_t i = 0; i < projection_size; i++) {
+                // xorshift64, mapped to a uniform random number in [-1, 1)
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                double r = (double)(seed >> 11) / (UINT64_C(1) << 52) - 1.0;
+                branch_vector[i] += count * r;
+            }
+        }
     }
 
 private:
     inline void update_bbv(uint64_t pc)
     {
+        // The projected signature is computed from the walk count
+        if (projection_size != 0) return;
         // Get the hased index for current pc address
         uint64_t hashed_key = simple_hash(pc / 4, branch_vector.size());
         branch_vector[hashed_key]++;
@@ -77,16 +112,20 @@ private:
 public:
     /// Flag to indicate whether the window is reset before
     bool flag_reset = true;
+    /// Flag to indicate whether the cache and branch streams are bypassed in this window
+    bool fast_forward = false;
     /// The timestamp of begining of this window
     uint64_t timestamp = 0;
     /// The timestamp of begining of this window
     uint64_t target_timestamp = 0;
     /// The basic block vector. (Perhapse using Eigen::VectorXd?)
     std::valarray<double> branch_vector = {};
+    /// The dimension of the projected signature, zero for the dense BBV
+    uint32_t projection_size = 0;
     /// Instruction count
     uint64_t instruction_count = 0;
     /// Walk count of basic blocks <<BB beg, BB end>, count>
-    std::map<Pair_beg_end, uint32_t> code_walk_count;
+    WindowWalkCount code_walk_count;
     /// Extra information carried in a phase for GPU prediction
     GPUFriendnessCounter counters = {};
 };
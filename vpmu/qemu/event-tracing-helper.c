@@ -137,7 +137,7 @@ static inline void __append_str(char *buff, int *position, int size_buff, const
     }
 }
 
-static void parse_dentry_path(CPUArchState *env,
+static void parse_dentry_path(VPMUMMUState *mmu,
                               uintptr_t     dentry_addr,
                               char *        buff,
                               int *         position,
@@ -150,22 +150,22 @@ static void parse_dentry_path(CPUArchState *env,
     char *    name               = NULL;
 
     // Safety checks
-    if (env == NULL || buff == NULL || position == NULL || size_buff == 0) return;
+    if (mmu == NULL || buff == NULL || position == NULL || size_buff == 0) return;
     // Stop condition 1 (reach user defined limition or null pointer)
     if (max_levels == 0 || dentry_addr == 0) return;
-    name =
-      (char *)vpmu_read_ptr_from_guest(env, dentry_addr, g_linux_offset.dentry.d_iname);
-    // Faulty condition, stop and return
-    if (name[0] == '\0') return;
+    name = (char *)vpmu_mmu_read_ptr_from_guest(
+      mmu, dentry_addr, g_linux_offset.dentry.d_iname);
+    // Faulty condition (not mapped or no name), stop and return
+    if (name == NULL || name[0] == '\0') return;
 
     // Find parent node (dentry->d_parent)
-    parent_dentry_addr =
-      vpmu_read_uintptr_from_guest(env, dentry_addr, g_linux_offset.dentry.d_parent);
+    parent_dentry_addr = vpmu_mmu_read_uintptr_from_guest(
+      mmu, dentry_addr, g_linux_offset.dentry.d_parent);
     // TODO mount point will stop here and we need to further trace it.
     // Maybe try dentry->d_flags & DCACHE_MOUNTED ?? The following is its experiment code.
     {
         #define DCACHE_MOUNTED 0x00010000 /* is a mountpoint */
-        d_flags = vpmu_read_uint32_from_guest(env, dentry_addr, 0);
+        d_flags = vpmu_mmu_read_uint32_from_guest(mmu, dentry_addr, 0);
         // All the dirs are mounted. Only the fake root is not mounted.
         if (dentry_addr == parent_dentry_addr && !(d_flags & DCACHE_MOUNTED)) {
             //CONSOLE_LOG(STR_KERNEL "Warning: Tracing mount point is not implemented yet. "
@@ -175,10 +175,10 @@ static void parse_dentry_path(CPUArchState *env,
     }
     // Is ROOT (include/linux/dcache.h). Return!
     if (dentry_addr == parent_dentry_addr) return;
-    parse_dentry_path(env, parent_dentry_addr, buff, position, size_buff, max_levels - 1);
+    parse_dentry_path(mmu, parent_dentry_addr, buff, position, size_buff, max_levels - 1);
     // Append path/name
-    name =
-      (char *)vpmu_read_ptr_from_guest(env, dentry_addr, g_linux_offset.dentry.d_iname);
+    name = (char *)vpmu_mmu_read_ptr_from_guest(
+      mmu, dentry_addr, g_linux_offset.dentry.d_iname);
     __append_str(buff, position, size_buff, "/");
     __append_str(buff, position, size_buff, name);
 
@@ -321,8 +321,254 @@ uint64_t et_get_syscall_arg(void *env, int num)
     return get_syscall_arg(env, num);
 }
 
-void et_parse_dentry_path(void *env, uint64_t dentry_addr, char *buff, int buff_size)
+void et_parse_dentry_path(VPMUMMUState *mmu,
+                          uintptr_t     dentry_addr,
+                          char *        buff,
+                          int           buff_size)
 {
     int position = 0; // The buffer position index for recursive function
-    parse_dentry_path(env, dentry_addr, buff, &position, buff_size, 64);
+    parse_dentry_path(mmu, dentry_addr, buff, &position, buff_size, 64);
+}
+
+// The page table of the running task, which identifies its address space
+static inline uint64_t get_page_table(CPUArchState *env)
+{
+#if defined(TARGET_ARM)
+    return env->cp15.ttbr0_el[1];
+#elif defined(TARGET_X86_64) || defined(TARGET_I386)
+    return env->cr[3];
+#endif
+}
+
+// The traced addresses whose pages were not mapped when they were traced. The TBs
+// translated at them before, e.g. by other processes sharing the page of a library, are
+// only known once the page is mapped. They are invalidated by the first vCPU looking up
+// a TB in the page of the address space, see et_invalidate_pending_tbs().
+typedef struct PendingPage {
+    uint64_t vpage;
+    uint64_t page_table; // 0 for the page in all address spaces, e.g. the kernel
+} PendingPage;
+
+// A filter of the pages pending, a vCPU only takes the lock when the bit of its page
+// is set. The bits are cleared when no pages are pending.
+#define PENDING_FILTER_BITS 4096
+
+static GHashTable *pending_pages; // PendingPage -> GArray of the traced addresses
+static QemuSpin    pending_pages_lock;
+int                et_num_pending_pages; // Read without the lock
+static unsigned long pending_filter[BITS_TO_LONGS(PENDING_FILTER_BITS)];
+
+static inline long pending_filter_bit(uint64_t vaddr)
+{
+    return (vaddr >> TARGET_PAGE_BITS) % PENDING_FILTER_BITS;
+}
+
+static guint pending_page_hash(gconstpointer key)
+{
+    const PendingPage *page = key;
+    return g_int64_hash(&page->vpage) ^ g_int64_hash(&page->page_table);
+}
+
+static gboolean pending_page_equal(gconstpointer a, gconstpointer b)
+{
+    const PendingPage *lhs = a, *rhs = b;
+    return lhs->vpage == rhs->vpage && lhs->page_table == rhs->page_table;
+}
+
+static void add_pending_tb(uint64_t vaddr, uint64_t page_table)
+{
+    PendingPage key = {vaddr & TARGET_PAGE_MASK, page_table};
+    GArray *    vaddrs;
+
+    qemu_spin_lock(&pending_pages_lock);
+    if (pending_pages == NULL) {
+        pending_pages = g_hash_table_new_full(
+          pending_page_hash, pending_page_equal, g_free, (GDestroyNotify)g_array_unref);
+    }
+    vaddrs = g_hash_table_lookup(pending_pages, &key);
+    if (vaddrs == NULL) {
+        vaddrs = g_array_new(false, false, sizeof(uint64_t));
+        g_hash_table_insert(pending_pages, g_memdup(&key, sizeof(key)), vaddrs);
+        set_bit_atomic(pending_filter_bit(vaddr), pending_filter);
+        atomic_set(&et_num_pending_pages, g_hash_table_size(pending_pages));
+    }
+    g_array_append_val(vaddrs, vaddr);
+    qemu_spin_unlock(&pending_pages_lock);
+}
+
+// Check if the page of the address space, or of all address spaces, is pending
+static bool is_pending_page(uint64_t vpage, uint64_t page_table)
+{
+    PendingPage key[2] = {{vpage, page_table}, {vpage, 0}};
+    bool        found  = false;
+
+    qemu_spin_lock(&pending_pages_lock);
+    found = g_hash_table_contains(pending_pages, &key[0])
+            || g_hash_table_contains(pending_pages, &key[1]);
+    qemu_spin_unlock(&pending_pages_lock);
+    return found;
+}
+
+// Take the addresses pending of the page, return NULL if there are none
+static GArray *take_pending_tbs(uint64_t vpage, uint64_t page_table)
+{
+    PendingPage key    = {vpage, page_table};
+    GArray *    vaddrs = NULL;
+
+    qemu_spin_lock(&pending_pages_lock);
+    if (pending_pages) vaddrs = g_hash_table_lookup(pending_pages, &key);
+    if (vaddrs) {
+        g_array_ref(vaddrs);
+        g_hash_table_remove(pending_pages, &key);
+        atomic_set(&et_num_pending_pages, g_hash_table_size(pending_pages));
+        if (et_num_pending_pages == 0) bitmap_zero(pending_filter, PENDING_FILTER_BITS);
+    }
+    qemu_spin_unlock(&pending_pages_lock);
+    return vaddrs;
+}
+
+static void
+invalidate_tbs_at(CPUState *cpu, GArray *vaddrs, hwaddr phys, MemTxAttrs attrs)
+{
+    AddressSpace *as = cpu->cpu_ases[cpu_asidx_from_attrs(cpu, attrs)].as;
+    guint         i;
+
+    for (i = 0; i < vaddrs->len; i++) {
+        uint64_t vaddr = g_array_index(vaddrs, uint64_t, i);
+        tb_invalidate_phys_addr(as, phys | (vaddr & ~TARGET_PAGE_MASK));
+    }
+    g_array_unref(vaddrs);
+}
+
+// Called by a vCPU before it looks up the TB at pc in the hash table of TBs, if any
+// page is pending (see et_has_pending_tbs()). A page is entered through here before
+// any of its TBs runs, the TBs are only chained in a page.
+void et_invalidate_pending_tbs(void *cs, uint64_t pc)
+{
+    CPUState * cpu   = (CPUState *)cs;
+    uint64_t   vpage = pc & TARGET_PAGE_MASK;
+    uint64_t   page_table;
+    GArray *   vaddrs[2];
+    MemTxAttrs attrs;
+    hwaddr     phys;
+    int        i;
+
+    if (!test_bit(pending_filter_bit(pc), pending_filter)) return;
+    page_table = get_page_table(cpu->env_ptr);
+    if (!is_pending_page(vpage, page_table)) return;
+    phys = cpu_get_phys_page_attrs_debug(cpu, vpage, &attrs);
+    // Not mapped yet, the lookup raises the page fault
+    if (phys == -1) return;
+    vaddrs[0] = take_pending_tbs(vpage, page_table);
+    vaddrs[1] = take_pending_tbs(vpage, 0);
+    for (i = 0; i < 2; i++) {
+        if (vaddrs[i]) invalidate_tbs_at(cpu, vaddrs[i], phys, attrs);
+    }
+}
+
+static int compare_vaddr(const void *a, const void *b)
+{
+    uint64_t lhs = *(const uint64_t *)a, rhs = *(const uint64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// The sorted addresses not traced anymore
+typedef struct UntracedAddrs {
+    const uint64_t *vaddrs;
+    uint64_t        num;
+} UntracedAddrs;
+
+static gboolean cancel_pending_tbs(gpointer key, gpointer value, gpointer user_data)
+{
+    GArray *             vaddrs   = value;
+    const UntracedAddrs *untraced = user_data;
+    guint                i;
+
+    for (i = vaddrs->len; i > 0; i--) {
+        if (bsearch(&g_array_index(vaddrs, uint64_t, i - 1),
+                    untraced->vaddrs,
+                    untraced->num,
+                    sizeof(uint64_t),
+                    compare_vaddr)) {
+            g_array_remove_index_fast(vaddrs, i - 1);
+        }
+    }
+    return vaddrs->len == 0; // Remove the page with no addresses pending
+}
+
+void et_cancel_invalidate_tbs(const uint64_t *vaddrs, uint64_t num)
+{
+    UntracedAddrs untraced = {vaddrs, num};
+
+    if (num == 0 || atomic_read(&et_num_pending_pages) == 0) return;
+    qemu_spin_lock(&pending_pages_lock);
+    g_hash_table_foreach_remove(pending_pages, cancel_pending_tbs, &untraced);
+    atomic_set(&et_num_pending_pages, g_hash_table_size(pending_pages));
+    if (et_num_pending_pages == 0) bitmap_zero(pending_filter, PENDING_FILTER_BITS);
+    qemu_spin_unlock(&pending_pages_lock);
+}
+
+// Invalidate the TBs translated at vaddr so they are translated (tagged) again.
+// This does the same as breakpoint_invalidate() when inserting a breakpoint.
+void et_invalidate_tb(uint64_t vaddr)
+{
+    CPUState * cpu = current_cpu;
+    MemTxAttrs attrs;
+    hwaddr     phys;
+
+    if (cpu == NULL) {
+        // Not called by a vCPU (e.g. parsing vmlinux), the page table is unknown.
+        // Drop the page from the TLBs, the next lookup in it invalidates the TBs.
+        add_pending_tb(vaddr, 0);
+        CPU_FOREACH(cpu) tlb_flush_page(cpu, vaddr);
+        return;
+    }
+    phys = cpu_get_phys_page_attrs_debug(cpu, vaddr, &attrs);
+    if (phys == -1) {
+        // Not mapped yet, the TBs of other processes might be at the page once mapped
+        add_pending_tb(vaddr, get_page_table(cpu->env_ptr));
+        return;
+    }
+    tb_invalidate_phys_addr(cpu->cpu_ases[cpu_asidx_from_attrs(cpu, attrs)].as,
+                            phys | (vaddr & ~TARGET_PAGE_MASK));
+}
+
+// Invalidate the TBs translated at a batch of addresses sorted, e.g. the functions of
+// a binary. The pages not mapped yet are deferred as et_invalidate_tb() does, most of
+// a binary is not mapped when it is loaded.
+void et_invalidate_tbs(const uint64_t *vaddrs, uint64_t num)
+{
+    CPUState * cpu        = current_cpu;
+    uint64_t   last_page  = -1;
+    uint64_t   page_table = 0;
+    hwaddr     phys       = -1;
+    MemTxAttrs attrs;
+    uint64_t   i;
+
+    if (num == 0) return;
+    if (cpu == NULL) {
+        // Not called by a vCPU (e.g. parsing vmlinux), the page table is unknown
+        for (i = 0; i < num; i++) {
+            add_pending_tb(vaddrs[i], 0);
+            if ((vaddrs[i] & TARGET_PAGE_MASK) == last_page) continue;
+            last_page = vaddrs[i] & TARGET_PAGE_MASK;
+            CPU_FOREACH(cpu) tlb_flush_page(cpu, last_page);
+        }
+        return;
+    }
+    page_table = get_page_table(cpu->env_ptr);
+    for (i = 0; i < num; i++) {
+        // Walk the page table only once for each page of the batch
+        if ((vaddrs[i] & TARGET_PAGE_MASK) != last_page) {
+            last_page = vaddrs[i] & TARGET_PAGE_MASK;
+            phys      = cpu_get_phys_page_attrs_debug(cpu, last_page, &attrs);
+        }
+        if (phys == -1) {
+            // Not mapped yet, the TBs of other processes might be at the page once mapped
+            add_pending_tb(vaddrs[i], page_table);
+            continue;
+        }
+        tb_invalidate_phys_addr(cpu->cpu_ases[cpu_asidx_from_attrs(cpu, attrs)].as,
+                                phys | (vaddrs[i] & ~TARGET_PAGE_MASK));
+    }
 }
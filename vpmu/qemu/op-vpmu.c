@@ -57,6 +57,12 @@ static inline int vpmu_get_arch_mode(CPUArchState *env)
 {
     int mode = 0;
 #ifdef TARGET_ARM
+#ifdef TARGET_AARCH64
+    if (is_a64(env)) {
+        // AArch64 has no CPSR.M, map EL0 to User and the others to Supervisor
+        return (arm_current_el(env) == 0) ? VPMU_ARCH_MODE_USR : VPMU_ARCH_MODE_SVC;
+    }
+#endif
     // mode = User(USR)/Supervisor(SVC)/Interrupt Request(IRQ)
     mode = env->uncached_cpsr & CPSR_M;
 #elif defined(TARGET_X86_64) || defined(TARGET_I386)
@@ -93,7 +99,7 @@ void HELPER(vpmu_memory_access)(CPUArchState *env,
     // Exit if VPMU is not enabled
     if (unlikely(env == NULL || !VPMU.enabled)) return;
 
-    if (vpmu_model_has(VPMU_DCACHE_SIM, VPMU)) {
+    if (vpmu_model_has(VPMU_DCACHE_SIM, VPMU) && !VPMU.core[core_id].fast_forward) {
         addr = vaddr_to_mvaddr(env, addr, rw);
         if (unlikely(VPMU.iomem_access_flag)) {
             // IO segment
@@ -134,8 +140,9 @@ void HELPER(vpmu_accumulate_tb_info)(CPUArchState *env, void *opaque)
     if (unlikely(VPMU.qemu_terminate_flag)) return;
 
 #ifdef CONFIG_VPMU_SET
-    // Only need to check function calls when TB is not contiguous
-    if (!contiguous_pc_flag) {
+    // Only need to check function calls when TB is not contiguous and its start
+    // address is traced (tagged at translation time, see et_is_traced_address())
+    if (!contiguous_pc_flag && extra_tb_info->et_traced) {
         et_check_function_call(
           env, cs->cpu_index, (mode == VPMU_ARCH_MODE_USR), extra_tb_info->start_addr);
     }
@@ -144,6 +151,19 @@ void HELPER(vpmu_accumulate_tb_info)(CPUArchState *env, void *opaque)
     // Exit if VPMU is not enabled, must be done after event tracing functions
     if (unlikely(env == NULL || !VPMU.enabled)) return;
 
+#ifdef CONFIG_VPMU_SET
+    // Counted after the call check, so the TB at a function entry is charged to the
+    // callee. Nothing is profiled or sampled while VPMU is disabled.
+    VPMU.core[core_id].insn_count += extra_tb_info->counters.total;
+    // The PC sampler reads the TB being executed
+    VPMU.core[core_id].current_pc        = extra_tb_info->start_addr;
+    VPMU.core[core_id].current_user_mode = (mode == VPMU_ARCH_MODE_USR);
+    uint64_t next_sample_insn            = VPMU.core[core_id].next_sample_insn;
+    if (unlikely(next_sample_insn && VPMU.core[core_id].insn_count >= next_sample_insn)) {
+        et_pc_sampler_record(core_id);
+    }
+#endif
+
     // The following codes send traces accordingly
     if (vpmu_model_has(VPMU_JIT_MODEL_SELECT, VPMU)) {
         uint64_t distance = VPMU.modelsel[core_id].total_tb_visit_count
@@ -173,7 +193,7 @@ void HELPER(vpmu_accumulate_tb_info)(CPUArchState *env, void *opaque)
         vpmu_insn_ref(core_id, mode, extra_tb_info);
     } // End of VPMU_INSN_COUNT_SIM
 
-    if (vpmu_model_has(VPMU_ICACHE_SIM, VPMU)) {
+    if (vpmu_model_has(VPMU_ICACHE_SIM, VPMU) && !VPMU.core[core_id].fast_forward) {
         uint16_t type = CACHE_PACKET_INSN;
         if (extra_tb_info->modelsel.hot_tb_flag) {
             type |= VPMU_PACKET_HOT;
@@ -189,7 +209,7 @@ void HELPER(vpmu_accumulate_tb_info)(CPUArchState *env, void *opaque)
         VPMU.ticks += extra_tb_info->ticks;
     } // End of VPMU_PIPELINE_SIM
 
-    if (vpmu_model_has(VPMU_BRANCH_SIM, VPMU)) {
+    if (vpmu_model_has(VPMU_BRANCH_SIM, VPMU) && !VPMU.core[core_id].fast_forward) {
         // Add global counter value of branch count.
         if (VPMU.core[core_id].last_tb_has_branch) {
             if (contiguous_pc_flag) {
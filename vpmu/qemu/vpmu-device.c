@@ -37,24 +37,21 @@ static const VMStateDescription vpmu_vmstate = {
                      VMSTATE_UINT64_ARRAY(last_tick, vpmu_state_t, QEMU_CLOCK_MAX),
                      VMSTATE_END_OF_LIST()}};
 
-static void save_binary_file(const char *file, const char *buff, size_t buff_size)
-{
-    FILE *fp = NULL;
-
-    fp = fopen(file, "wb");
-    if (fp) {
-        fwrite(buff, buff_size, 1, fp);
-        fclose(fp);
-    }
-    return;
-}
-
 static uint64_t special_read(void *opaque, hwaddr addr, unsigned size)
 {
     uint64_t      ret    = 0;
     vpmu_state_t *status = (vpmu_state_t *)opaque;
 
     DBG(STR_VPMU "read vpmu device at addr=0x%lx\n", addr);
+    switch (addr) {
+#ifdef CONFIG_VPMU_SET
+    case VPMU_MMAP_GET_PROC_LEFT:
+        ret = et_program_binary_remaining();
+        break;
+#endif
+    default:
+        break;
+    }
     (void)status;
     return ret;
 }
@@ -65,9 +62,8 @@ static void special_write(void *opaque, hwaddr addr, uint64_t value, unsigned si
     static char *kallsym_name = NULL;
     static char *binary_name  = NULL;
     void *       paddr        = NULL;
-    char *       buffer       = NULL;
-    static int   buffer_size  = 0;
     void *       per_core_env = NULL;
+    uint64_t     chunk_size   = 0;
 #endif
 
 #if TARGET_LONG_BITS == 64
@@ -154,25 +150,33 @@ static void special_write(void *opaque, hwaddr addr, uint64_t value, unsigned si
         break;
     case VPMU_MMAP_SET_PROC_SIZE:
         if (VPMU.platform.kvm_enabled) break;
-        buffer_size = value;
+        if (binary_name == NULL) {
+            // No process to bind it to, the chunks are ignored and nothing is left
+            ERR_MSG(STR_VPMU "SET_PROC_SIZE before ADD_PROC_NAME, binary ignored\n");
+            break;
+        }
+        // The binary is assembled in host memory, nothing is allocated for it here
+        et_begin_program_binary(binary_name, value);
         break;
-    case VPMU_MMAP_SET_PROC_BIN:
+    case VPMU_MMAP_SET_PROC_HASH:
         if (VPMU.platform.kvm_enabled) break;
-        if (value == 0 || buffer_size == 0) break;
-        buffer = (char *)malloc(buffer_size);
-        if (buffer == NULL) {
-            ERR_MSG("Cannot allocate memory for receiving binary\n");
-            break;
+        // The transfer goes on, the host verifies the hash over the content received
+        if (et_find_program_binary(value)) {
+            DBG(STR_VPMU "Binary '%s' may be received before\n", binary_name);
         }
+        break;
+    case VPMU_MMAP_SET_PROC_BIN:
+    case VPMU_MMAP_SET_PROC_CHUNK:
+        if (VPMU.platform.kvm_enabled) break;
+        if (value == 0) break;
+        // Copy till the end of the page, the vCPU stalls for a page at most
+        chunk_size   = TARGET_PAGE_SIZE - (value & ~TARGET_PAGE_MASK);
         per_core_env = VPMU.core[vpmu_get_core_id()].cpu_arch_state;
-        vpmu_copy_from_guest(buffer, value, buffer_size, per_core_env);
-        save_binary_file("/tmp/vpmu-traced-bin", buffer, buffer_size);
-        free(buffer);
-        buffer      = NULL;
-        buffer_size = 0;
-        DBG(STR_VPMU "Save binary '%s' to /tmp/vpmu-traced-bin\n", binary_name);
-        if (binary_name != NULL) {
-            et_update_program_elf_dwarf(binary_name, "/tmp/vpmu-traced-bin");
+        et_receive_program_binary(per_core_env, value, chunk_size);
+        if (addr == VPMU_MMAP_SET_PROC_BIN && et_program_binary_remaining() != 0) {
+            DBG(STR_VPMU "Binary '%s' is partially received, "
+                         "push the rest with SET_PROC_CHUNK\n",
+                binary_name);
         }
         break;
     case VPMU_MMAP_OFFSET_FILE_f_path_dentry:
@@ -227,16 +231,32 @@ static void start_vpmu_tick(vpmu_state_t *status)
     }
 }
 
+// The period of the virtual tick, shortened for sampling the PCs more often
+static uint64_t tick_virtual_period_us = 10000; // 10ms
+
+static void vpmu_set_tick_virtual_period(uint64_t period_us)
+{
+    if (period_us != 0 && period_us < tick_virtual_period_us)
+        tick_virtual_period_us = period_us;
+}
+
 static void vpmu_tick_virtual(void *opaque)
 {
     vpmu_state_t *status = (vpmu_state_t *)opaque;
     uint64_t      tick   = status->last_tick[QEMU_CLOCK_VIRTUAL];
+    uint64_t      now    = qemu_clock_get_us(QEMU_CLOCK_VIRTUAL);
 
-    tick += 10000; // 10ms
+    tick += tick_virtual_period_us;
     // DBG("tick virtual %lu\n", tick);
 
     // Periodically synchronize simulator data back to VPMU
     // VPMU_sync_non_blocking();
+    // Periodically sample the performance counters if it's enabled
+    vpmu_sampler_tick(now);
+#ifdef CONFIG_VPMU_SET
+    // Periodically sample the PCs if it's enabled
+    et_pc_sampler_tick(now);
+#endif
 
     timer_mod(status->timer[QEMU_CLOCK_VIRTUAL], tick);
     status->last_tick[QEMU_CLOCK_VIRTUAL] = tick;
@@ -259,6 +279,8 @@ static void vpmu_tick_real(void *opaque)
 void vpmu_dev_init(uint32_t base)
 {
     CONSOLE_LOG(STR_VPMU "init vpmu device on addr 0x%x. \n", base);
+    // The samplers of VPMU shorten the virtual clock tick through it
+    vpmu_register_tick_virtual_period_hook(vpmu_set_tick_virtual_period);
 
     sysbus_create_simple(VPMU_DEVICE_NAME, base, NULL);
 }
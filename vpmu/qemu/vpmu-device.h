@@ -15,8 +15,28 @@
 // ... reserved
 #define VPMU_MMAP_ADD_PROC_NAME     0x0040
 #define VPMU_MMAP_REMOVE_PROC_NAME  0x0048
+// Transfer the binary of the process added by VPMU_MMAP_ADD_PROC_NAME
+//   1. Write the size of the binary to VPMU_MMAP_SET_PROC_SIZE.
+//   2. Optionally write the content hash to VPMU_MMAP_SET_PROC_HASH. The hash is
+//      ET_DebugInfo::hash_content(), it is only a hint. The transfer is never skipped,
+//      the host hashes the content received and reuses the symbols parsed before only
+//      if they match. The guest computes it over the binary of size bytes as:
+//        mix(x) = x ^= x >> 30, x *= 0xbf58476d1ce4e5b9,
+//                 x ^= x >> 27, x *= 0x94d049bb133111eb, x ^= x >> 31
+//        hash   = mix(size)
+//        hash   = mix(hash ^ w) for each 64-bit little endian word w in order
+//        hash   = mix(hash ^ b) for each of the remaining (size % 8) bytes b
+//      mix() is the finalizer of SplitMix64 (vpmu::math::bitmix_hash).
+//   3. While reading VPMU_MMAP_GET_PROC_LEFT returns a non-zero number of bytes left,
+//      write the address of (binary + size - left) to VPMU_MMAP_SET_PROC_CHUNK. Each
+//      write copies the data till the end of the guest page.
+// VPMU_MMAP_SET_PROC_BIN is the old name of VPMU_MMAP_SET_PROC_CHUNK. It copies a page
+// at most as well, the guest pushes the rest of the binary as in step 3.
 #define VPMU_MMAP_SET_PROC_SIZE     0x0050
 #define VPMU_MMAP_SET_PROC_BIN      0x0058
+#define VPMU_MMAP_SET_PROC_HASH     0x0060
+#define VPMU_MMAP_SET_PROC_CHUNK    0x0068
+#define VPMU_MMAP_GET_PROC_LEFT     0x0070
 // ... reserved
 #define VPMU_MMAP_OFFSET_FILE_f_path_dentry      0x0100
 #define VPMU_MMAP_OFFSET_DENTRY_d_iname          0x0108
@@ -6,6 +6,7 @@
 #include "cpu.h"           // QEMU CPU definitions and macros (CPUArchState)
 #include "exec/exec-all.h" // tlb_fill()
 #include "qom/cpu.h"       // cpu_get_phys_page_attrs_debug(), cpu_has_work(), etc.
+#include "exec/memory.h"   // address_space_translate()
 
 #ifdef CONFIG_SOFTMMU
 #include "hw/sysbus.h" // SysBusDevice
@@ -110,6 +111,9 @@ size_t vpmu_copy_from_guest(void *dst, uintptr_t src, const size_t size, void *c
             dst = ((uint8_t *)dst) + valid_len;
             src += valid_len;
             left_size -= valid_len;
+        } else {
+            // The page is not mapped, stop here instead of retrying forever
+            break;
         }
     }
 
@@ -177,6 +181,166 @@ void vpmu_qemu_free_cpu_arch_state(void *env)
     return;
 }
 
+// The scratch CPU state of each core for walking the page tables of a captured state
+static void *mmu_scratch_env[VPMU_MAX_CPU_CORES] = {};
+
+void vpmu_mmu_capture(VPMUMMUState *mmu, void *env)
+{
+    CPUArchState *cpu_env = (CPUArchState *)env;
+    VPMUMMUState  new_mmu = {};
+
+#if defined(TARGET_ARM)
+    // Linux runs in the non-secure EL1, the same banks as AArch64 EL1
+    new_mmu.regs.page_table[0] = cpu_env->cp15.ttbr0_el[1];
+    new_mmu.regs.page_table[1] = cpu_env->cp15.ttbr1_el[1];
+    new_mmu.regs.control[0]    = cpu_env->cp15.sctlr_el[1];
+    new_mmu.regs.control[1]    = cpu_env->cp15.tcr_el[1].raw_tcr;
+    new_mmu.regs.control[2]    = ((uint64_t)cpu_env->cp15.tcr_el[1].base_mask << 32)
+                               | cpu_env->cp15.tcr_el[1].mask;
+    new_mmu.regs.attrs[0]      = cpu_env->cp15.dacr_ns;
+    new_mmu.regs.attrs[1]      = cpu_env->cp15.mair_el[1];
+    new_mmu.regs.asid          = cpu_env->cp15.contextidr_el[1];
+    new_mmu.regs.mode          = ((uint64_t)cpu_env->aarch64 << 32)
+                               | (cpu_env->aarch64 ? cpu_env->pstate
+                                                    : cpu_env->uncached_cpsr);
+#elif defined(TARGET_X86_64) || defined(TARGET_I386)
+    new_mmu.regs.page_table[0] = cpu_env->cr[3];
+    new_mmu.regs.control[0]    = cpu_env->cr[0];
+    new_mmu.regs.control[1]    = cpu_env->cr[4];
+    new_mmu.regs.control[2]    = cpu_env->efer;
+    new_mmu.regs.mode          = cpu_env->hflags;
+#else
+#error "VPMU does not support this architecture!"
+#endif
+
+    if (!mmu->valid || memcmp(&mmu->regs, &new_mmu.regs, sizeof(mmu->regs)) != 0) {
+        mmu->regs  = new_mmu.regs;
+        mmu->valid = true;
+        vpmu_mmu_flush(mmu);
+    }
+}
+
+void vpmu_mmu_flush(VPMUMMUState *mmu)
+{
+    int i;
+
+    for (i = 0; i < VPMU_MMU_TLB_SIZE; i++) {
+        mmu->tlb[i].vpage = (uint64_t)-1;
+    }
+}
+
+static void vpmu_mmu_restore(VPMUMMUState *mmu, CPUArchState *cpu_env)
+{
+#if defined(TARGET_ARM)
+    cpu_env->cp15.ttbr0_el[1]         = mmu->regs.page_table[0];
+    cpu_env->cp15.ttbr1_el[1]         = mmu->regs.page_table[1];
+    cpu_env->cp15.sctlr_el[1]         = mmu->regs.control[0];
+    cpu_env->cp15.tcr_el[1].raw_tcr   = mmu->regs.control[1];
+    cpu_env->cp15.tcr_el[1].mask      = (uint32_t)mmu->regs.control[2];
+    cpu_env->cp15.tcr_el[1].base_mask = mmu->regs.control[2] >> 32;
+    cpu_env->cp15.dacr_ns             = mmu->regs.attrs[0];
+    cpu_env->cp15.mair_el[1]          = mmu->regs.attrs[1];
+    cpu_env->cp15.contextidr_el[1]    = mmu->regs.asid;
+    cpu_env->aarch64                  = mmu->regs.mode >> 32;
+    if (cpu_env->aarch64)
+        cpu_env->pstate = (uint32_t)mmu->regs.mode;
+    else
+        cpu_env->uncached_cpsr = (uint32_t)mmu->regs.mode;
+#elif defined(TARGET_X86_64) || defined(TARGET_I386)
+    cpu_env->cr[3]  = mmu->regs.page_table[0];
+    cpu_env->cr[0]  = mmu->regs.control[0];
+    cpu_env->cr[4]  = mmu->regs.control[1];
+    cpu_env->efer   = mmu->regs.control[2];
+    cpu_env->hflags = mmu->regs.mode;
+#endif
+}
+
+// Walk the page tables of the captured state, return the host address of the page
+static void *vpmu_mmu_walk(VPMUMMUState *mmu, uintptr_t vpage)
+{
+#ifdef CONFIG_SOFTMMU
+    uint64_t      core_id = vpmu_get_core_id();
+    void *        host    = NULL;
+    hwaddr        len     = TARGET_PAGE_SIZE;
+    hwaddr        paddr, xlat;
+    CPUState *    cpu;
+    MemoryRegion *mr;
+
+    if (mmu_scratch_env[core_id] == NULL) {
+        // Clone once per core, it is only a container for the registers restored
+        if (VPMU.core[core_id].cpu_arch_state == NULL) return NULL;
+        mmu_scratch_env[core_id] =
+          vpmu_qemu_clone_cpu_arch_state(VPMU.core[core_id].cpu_arch_state);
+    }
+    vpmu_mmu_restore(mmu, (CPUArchState *)mmu_scratch_env[core_id]);
+    cpu = CPU(ENV_GET_CPU((CPUArchState *)mmu_scratch_env[core_id]));
+    // The debug walker neither touches the TLB of QEMU nor raises faults
+    paddr = cpu_get_phys_page_debug(cpu, vpage);
+    if (paddr == -1) return NULL;
+
+    rcu_read_lock();
+    mr = address_space_translate(cpu->as, paddr, &xlat, &len, false);
+    if (memory_region_is_ram(mr)) {
+        host = (uint8_t *)memory_region_get_ram_ptr(mr) + xlat;
+    }
+    rcu_read_unlock();
+    return host;
+#else
+    return (void *)vpage;
+#endif
+}
+
+void *vpmu_mmu_get_host_addr(VPMUMMUState *mmu, uintptr_t vaddr)
+{
+    uint64_t vpage = vaddr & TARGET_PAGE_MASK;
+    int      index = (vaddr >> TARGET_PAGE_BITS) & (VPMU_MMU_TLB_SIZE - 1);
+
+    // If KVM is enabled, softMMU will not work
+    if (VPMU.platform.kvm_enabled || !mmu->valid) return NULL;
+
+    if (mmu->tlb[index].vpage != vpage) {
+        // Software TLB miss, only the pages mapped are cached
+        uint8_t *host_page = (uint8_t *)vpmu_mmu_walk(mmu, vpage);
+        if (host_page == NULL) {
+            ERR_MSG(STR_VPMU "Fail to translate vaddr 0x%lx\n", vaddr);
+            return NULL;
+        }
+        mmu->tlb[index].vpage  = vpage;
+        mmu->tlb[index].addend = (uintptr_t)host_page - vpage;
+    }
+    return (void *)(vaddr + mmu->tlb[index].addend);
+}
+
+uint8_t *vpmu_mmu_read_ptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    return (uint8_t *)vpmu_mmu_get_host_addr(mmu, addr + offset);
+}
+
+uint32_t
+vpmu_mmu_read_uint32_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    uint32_t *ptr = (uint32_t *)vpmu_mmu_read_ptr_from_guest(mmu, addr, offset);
+    // Zero when it is not mapped, the same as a null pointer read from the guest
+    return (ptr) ? *ptr : 0;
+}
+
+uint64_t
+vpmu_mmu_read_uint64_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    uint64_t *ptr = (uint64_t *)vpmu_mmu_read_ptr_from_guest(mmu, addr, offset);
+    return (ptr) ? *ptr : 0;
+}
+
+uintptr_t
+vpmu_mmu_read_uintptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+#if (TARGET_LONG_BITS == 32)
+    return (uintptr_t)vpmu_mmu_read_uint32_from_guest(mmu, addr, offset);
+#else
+    return (uintptr_t)vpmu_mmu_read_uint64_from_guest(mmu, addr, offset);
+#endif
+}
+
 #endif // CONFING_VPMU_SET
 
 #if 0
@@ -196,6 +360,12 @@ static void dump_symbol_table(EFD *efd)
 }
 #endif
 
+void vpmu_synchronize_vcpus(void)
+{
+    // The vCPUs execute the TBs (and the helpers) in RCU read-side critical sections
+    synchronize_rcu();
+}
+
 void vpmu_dump_elf_symbols(const char *file_path)
 {
     //    EFD *efd = efd_open_elf((char *)file_path);
@@ -226,27 +396,33 @@ uint64_t toc(struct timespec *t1, struct timespec *t2)
 
 uint8_t *vpmu_read_ptr_from_guest(void *cs, uint64_t addr, uint64_t offset)
 {
-    return (uint8_t *)vpmu_tlb_get_host_addr((void *)cs, (uint64_t)addr) + offset;
+    uint8_t *host = (uint8_t *)vpmu_tlb_get_host_addr((void *)cs, (uint64_t)addr);
+    return (host) ? host + offset : NULL;
 }
 
 uint8_t vpmu_read_uint8_from_guest(void *cs, uint64_t addr, uint64_t offset)
 {
-    return *((uint8_t *)vpmu_read_ptr_from_guest(cs, addr, offset));
+    uint8_t *ptr = (uint8_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+    // Zero when it is not mapped, the same as a null pointer read from the guest
+    return (ptr) ? *ptr : 0;
 }
 
 uint16_t vpmu_read_uint16_from_guest(void *cs, uint64_t addr, uint64_t offset)
 {
-    return *((uint16_t *)vpmu_read_ptr_from_guest(cs, addr, offset));
+    uint16_t *ptr = (uint16_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+    return (ptr) ? *ptr : 0;
 }
 
 uint32_t vpmu_read_uint32_from_guest(void *cs, uint64_t addr, uint64_t offset)
 {
-    return *((uint32_t *)vpmu_read_ptr_from_guest(cs, addr, offset));
+    uint32_t *ptr = (uint32_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+    return (ptr) ? *ptr : 0;
 }
 
 uint64_t vpmu_read_uint64_from_guest(void *cs, uint64_t addr, uint64_t offset)
 {
-    return *((uint64_t *)vpmu_read_ptr_from_guest(cs, addr, offset));
+    uint64_t *ptr = (uint64_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+    return (ptr) ? *ptr : 0;
 }
 
 uintptr_t vpmu_read_uintptr_from_guest(void *cs, uint64_t addr, uint64_t offset)
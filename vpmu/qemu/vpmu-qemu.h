@@ -4,7 +4,7 @@
 #include "../vpmu-common.h" // Common headers and macros
 #include "../vpmu-conf.h"   // Common definitions of macros
 
-enum VPMU_CPU_MODE { VPMU_CPU_MODE_ARM, VPMU_CPU_MODE_THUMB };
+enum VPMU_CPU_MODE { VPMU_CPU_MODE_ARM, VPMU_CPU_MODE_THUMB, VPMU_CPU_MODE_ARM64 };
 
 typedef struct VPMUPlatformInfo {
     struct {
@@ -33,6 +33,7 @@ typedef struct VPMU_Struct {
     struct timespec start_time; ///< start time of the whole QEMU process
 
     uint64_t cpu_idle_time_ns;
+    uint64_t fast_forward_time_ns; // Extrapolated time of the bypassed streams (atomic)
     uint64_t ticks;
 
     uint64_t iomem_count;
@@ -52,6 +53,11 @@ typedef struct VPMU_Struct {
         uint64_t last_tb_pc;         // Remember PC for each core
         bool     last_tb_has_branch; // Remember branch of each core
         uint32_t last_tb_mode;       // Remember CPU mode of each core
+        bool     fast_forward;       // Bypass cache and branch streams on this core
+        uint64_t insn_count;         // Instructions executed, never reset
+        uint64_t current_pc;         // The start of the TB being executed
+        bool     current_user_mode;  // The TB being executed is in user mode
+        uint64_t next_sample_insn;   // Sample the PC at this insn_count, 0 if disabled
         uint64_t padding[8];         // 8 words of padding
     } core[VPMU_MAX_CPU_CORES];
 
@@ -67,6 +73,30 @@ typedef struct VPMU_Struct {
     VPMUPlatformInfo platform;
 } VPMU_Struct;
 
+// The number of entries of the software TLB of VPMUMMUState, must be a power of 2
+#define VPMU_MMU_TLB_SIZE 16
+
+// The MMU related registers of a guest process, a few hundred bytes instead of a
+// whole CPU state. The guest virtual addresses of the process are translated from
+// it through a small direct-mapped software TLB.
+typedef struct VPMUMMUState {
+    // ARM: TTBR0/TTBR1, SCTLR, TCR, TCR masks, DACR, MAIR, CONTEXTIDR and PSTATE/CPSR
+    //      of EL1. DACR decides the faults of short descriptors, MAIR the attributes.
+    // x86: CR3, CR0, CR4, EFER, and hflags
+    struct {
+        uint64_t page_table[2];
+        uint64_t control[3];
+        uint64_t attrs[2];
+        uint64_t asid;
+        uint64_t mode;
+    } regs;
+    bool valid; // False before the first capture
+    struct {
+        uint64_t  vpage;
+        uintptr_t addend; // host address = guest virtual address + addend
+    } tlb[VPMU_MMU_TLB_SIZE];
+} VPMUMMUState;
+
 // A structure storing VPMU configuration
 extern struct VPMU_Struct VPMU;
 
@@ -83,6 +113,10 @@ void VPMU_dump_result(void);
 void vpmu_dump_readable_message(void);
 void vpmu_print_status(VPMU_Struct *vpmu);
 uint64_t vpmu_target_time_ns(void);
+void vpmu_sampler_tick(uint64_t now_us);
+// VPMU device registers the function setting the period of its virtual clock tick.
+// The period requested before (e.g. by VPMU_init()) is set on registering.
+void vpmu_register_tick_virtual_period_hook(void (*hook)(uint64_t period_us));
 
 // These two are thread local values which could be used in multi-threaded tcg
 uint64_t vpmu_get_core_id(void);
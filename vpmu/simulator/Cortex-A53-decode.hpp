@@ -0,0 +1,316 @@
+#ifndef __CPU_CORTEX_A53_DECODE_HPP_
+#define __CPU_CORTEX_A53_DECODE_HPP_
+#pragma once
+
+extern "C" {
+#include "vpmu-arm-insnset.h" // Instruction Set
+}
+#include <cstdint> // uint16_t, uint32_t
+
+/// @brief Constexpr decode table of AArch64 (A64) instructions for the Cortex-A53 model
+/// @details The table is indexed by bits [31:21] of an instruction, which determine
+/// the instruction class of all branch, data processing and load/store instructions
+/// in the A64 encoding. Each entry is an index of ARM64_Instructions, whose tick count
+/// is patched from the json config at CPU_CortexA53::Translation::build().
+/// Entries which need the opcode in bits [20:10] (data processing 1/2 source, system
+/// instructions and scalar floating-point) are marked and decoded by the small
+/// functions below when the instruction is translated.
+namespace arm64_decode
+{
+/// Data processing (1/2 source), e.g. UDIV, LSLV, CRC32
+constexpr uint16_t ARM64_DECODE_DP_SRC = ARM64_INSTRUCTION_TOTAL_COUNTS;
+/// System instructions, e.g. NOP, DMB, MSR, MRS
+constexpr uint16_t ARM64_DECODE_SYSTEM = ARM64_INSTRUCTION_TOTAL_COUNTS + 1;
+/// Floating-point data processing, e.g. FADD, FMUL, FDIV, FCVT
+constexpr uint16_t ARM64_DECODE_FP = ARM64_INSTRUCTION_TOTAL_COUNTS + 2;
+
+constexpr uint32_t table_size = 1 << 11;
+
+constexpr uint32_t key_of(uint32_t insn) { return insn >> 21; }
+
+constexpr uint32_t insn_of(uint32_t key) { return key << 21; }
+
+constexpr uint16_t decode_data_proc_imm(uint32_t insn)
+{
+    switch ((insn >> 23) & 0x7) {
+    case 0x0:
+    case 0x1:
+        return ARM64_INSTRUCTION_ADR;
+    case 0x2:
+    case 0x3:
+        return ARM64_INSTRUCTION_ADD_IMM;
+    case 0x4:
+        return ARM64_INSTRUCTION_LOGIC_IMM;
+    case 0x5:
+        return ARM64_INSTRUCTION_MOV_WIDE;
+    case 0x6:
+        return ARM64_INSTRUCTION_BFM;
+    default:
+        return ARM64_INSTRUCTION_EXTR;
+    }
+}
+
+constexpr uint16_t decode_branch(uint32_t insn)
+{
+    switch ((insn >> 25) & 0x7f) {
+    case 0x0a:
+    case 0x0b:
+        return ARM64_INSTRUCTION_B;
+    case 0x4a:
+    case 0x4b:
+        return ARM64_INSTRUCTION_BL;
+    case 0x1a:
+    case 0x5a:
+        return ARM64_INSTRUCTION_CBZ;
+    case 0x1b:
+    case 0x5b:
+        return ARM64_INSTRUCTION_TBZ;
+    case 0x2a:
+        return ARM64_INSTRUCTION_B_COND;
+    case 0x6a:
+        return (insn & (1 << 24)) ? ARM64_DECODE_SYSTEM : ARM64_INSTRUCTION_SVC;
+    case 0x6b:
+        switch ((insn >> 21) & 0xf) {
+        case 0x0:
+            return ARM64_INSTRUCTION_BR;
+        case 0x1:
+            return ARM64_INSTRUCTION_BLR;
+        case 0x2:
+            return ARM64_INSTRUCTION_RET;
+        case 0x4:
+            return ARM64_INSTRUCTION_ERET;
+        default:
+            return ARM64_INSTRUCTION_UNKNOWN;
+        }
+    default:
+        return ARM64_INSTRUCTION_UNKNOWN;
+    }
+}
+
+constexpr uint16_t decode_ldst(uint32_t insn)
+{
+    uint32_t size   = insn >> 30;
+    uint32_t opc    = (insn >> 22) & 0x3;
+    bool     vector = insn & (1 << 26);
+
+    switch ((insn >> 24) & 0x3f) {
+    case 0x08:
+        // Load/store exclusive, load-acquire/store-release
+        return (insn & (1 << 22)) ? ARM64_INSTRUCTION_LDXR : ARM64_INSTRUCTION_STXR;
+    case 0x18:
+    case 0x1c:
+        // Load register (literal), the opc field is at [31:30]
+        if (!vector && size == 3) return ARM64_INSTRUCTION_PRFM;
+        return ARM64_INSTRUCTION_LDR_LIT;
+    case 0x28:
+    case 0x29:
+    case 0x2c:
+    case 0x2d:
+        return (insn & (1 << 22)) ? ARM64_INSTRUCTION_LDP : ARM64_INSTRUCTION_STP;
+    case 0x38:
+    case 0x39:
+    case 0x3c:
+    case 0x3d:
+        // Load/store register (all forms)
+        if (vector) return (opc & 1) ? ARM64_INSTRUCTION_LDR : ARM64_INSTRUCTION_STR;
+        switch (opc) {
+        case 0x0:
+            return ARM64_INSTRUCTION_STR;
+        case 0x1:
+            return ARM64_INSTRUCTION_LDR;
+        case 0x2:
+            return (size == 3) ? ARM64_INSTRUCTION_PRFM : ARM64_INSTRUCTION_LDR;
+        default:
+            return (size == 3) ? ARM64_INSTRUCTION_UNKNOWN : ARM64_INSTRUCTION_LDR;
+        }
+    case 0x0c:
+    case 0x0d:
+        // AdvSIMD load/store multiple/single structures
+        return ARM64_INSTRUCTION_SIMD_LDST;
+    default:
+        return ARM64_INSTRUCTION_UNKNOWN;
+    }
+}
+
+constexpr uint16_t decode_data_proc_reg(uint32_t insn)
+{
+    bool sf = insn & (1u << 31);
+
+    switch ((insn >> 24) & 0x1f) {
+    case 0x0a:
+        return ARM64_INSTRUCTION_LOGIC_REG;
+    case 0x0b:
+        return (insn & (1 << 21)) ? ARM64_INSTRUCTION_ADD_EXT : ARM64_INSTRUCTION_ADD_REG;
+    case 0x1a:
+        switch ((insn >> 21) & 0x7) {
+        case 0x0:
+            return ARM64_INSTRUCTION_ADC;
+        case 0x2:
+            return ARM64_INSTRUCTION_CCMP;
+        case 0x4:
+            return ARM64_INSTRUCTION_CSEL;
+        case 0x6:
+            return (insn & (1 << 30)) ? ARM64_INSTRUCTION_DP1 : ARM64_DECODE_DP_SRC;
+        default:
+            return ARM64_INSTRUCTION_UNKNOWN;
+        }
+    case 0x1b:
+        // Data processing (3 source)
+        if (insn & (3 << 29)) return ARM64_INSTRUCTION_UNKNOWN;
+        switch ((insn >> 21) & 0x7) {
+        case 0x0:
+            return ARM64_INSTRUCTION_MUL;
+        case 0x1:
+        case 0x5:
+            return (sf) ? ARM64_INSTRUCTION_MULL : ARM64_INSTRUCTION_UNKNOWN;
+        case 0x2:
+        case 0x6:
+            return (sf) ? ARM64_INSTRUCTION_MULH : ARM64_INSTRUCTION_UNKNOWN;
+        default:
+            return ARM64_INSTRUCTION_UNKNOWN;
+        }
+    default:
+        return ARM64_INSTRUCTION_UNKNOWN;
+    }
+}
+
+constexpr uint16_t decode_simd_fp(uint32_t insn)
+{
+    // Scalar floating-point instructions have bit 30 cleared
+    if ((insn & (1 << 30)) == 0) {
+        switch ((insn >> 24) & 0x1f) {
+        case 0x1e:
+            // Floating-point <-> fixed-point conversions do not have bit 21 set
+            return (insn & (1 << 21)) ? ARM64_DECODE_FP : ARM64_INSTRUCTION_FP_CVT;
+        case 0x1f:
+            return ARM64_INSTRUCTION_FP_MAC;
+        }
+    }
+    return ARM64_INSTRUCTION_SIMD_DP;
+}
+
+/// Decode an instruction with only the bits in the key, i.e. insn_of(key)
+constexpr uint16_t decode_key(uint32_t key)
+{
+    uint32_t insn = insn_of(key);
+
+    switch ((insn >> 25) & 0xf) {
+    case 0x8:
+    case 0x9:
+        return decode_data_proc_imm(insn);
+    case 0xa:
+    case 0xb:
+        return decode_branch(insn);
+    case 0x4:
+    case 0x6:
+    case 0xc:
+    case 0xe:
+        return decode_ldst(insn);
+    case 0x5:
+    case 0xd:
+        return decode_data_proc_reg(insn);
+    case 0x7:
+    case 0xf:
+        return decode_simd_fp(insn);
+    default:
+        return ARM64_INSTRUCTION_UNKNOWN;
+    }
+}
+
+/// Data processing (1/2 source) with the opcode at bits [15:10]
+inline uint16_t decode_dp_src(uint32_t insn)
+{
+    uint32_t opcode = (insn >> 10) & 0x3f;
+
+    if (opcode == 0x2) return ARM64_INSTRUCTION_UDIV;
+    if (opcode == 0x3) return ARM64_INSTRUCTION_SDIV;
+    if ((opcode & 0x3c) == 0x08) return ARM64_INSTRUCTION_SHIFT;
+    if ((opcode & 0x38) == 0x10) return ARM64_INSTRUCTION_CRC32;
+    return ARM64_INSTRUCTION_UNKNOWN;
+}
+
+/// System instructions with op0 at bits [20:19] and CRn at bits [15:12]
+inline uint16_t decode_system(uint32_t insn)
+{
+    bool     l   = insn & (1 << 21);
+    uint32_t op0 = (insn >> 19) & 0x3;
+
+    if (op0 == 0) {
+        if (l) return ARM64_INSTRUCTION_UNKNOWN;
+        switch ((insn >> 12) & 0xf) {
+        case 0x2:
+            return ARM64_INSTRUCTION_HINT;
+        case 0x3:
+            return ARM64_INSTRUCTION_BARRIER;
+        case 0x4:
+            return ARM64_INSTRUCTION_MSR; // MSR (immediate) to PSTATE fields
+        default:
+            return ARM64_INSTRUCTION_UNKNOWN;
+        }
+    }
+    if (op0 == 1) return ARM64_INSTRUCTION_SYS;
+    return (l) ? ARM64_INSTRUCTION_MRS : ARM64_INSTRUCTION_MSR;
+}
+
+/// Scalar floating-point data processing, selected by bits [15:10]
+inline uint16_t decode_fp(uint32_t insn)
+{
+    switch ((insn >> 10) & 0x3) {
+    case 0x1: // Floating-point conditional compare
+    case 0x3: // Floating-point conditional select
+        return ARM64_INSTRUCTION_FP_ALU;
+    case 0x2: // Floating-point data processing (2 source)
+        switch ((insn >> 12) & 0xf) {
+        case 0x0:
+        case 0x8:
+            return ARM64_INSTRUCTION_FP_MUL; // FMUL, FNMUL
+        case 0x1:
+            return ARM64_INSTRUCTION_FP_DIV;
+        default:
+            return ARM64_INSTRUCTION_FP_ALU;
+        }
+    default:
+        break;
+    }
+    // Bits [15:12] determine the rest, see the A64 encoding index
+    uint32_t op = (insn >> 12) & 0xf;
+    // Conversions between floating-point and integer
+    if (op == 0) return ARM64_INSTRUCTION_FP_CVT;
+    // FMOV (immediate), FCMP
+    if (op & 0x3) return ARM64_INSTRUCTION_FP_ALU;
+    if ((op & 0x7) != 0x4) return ARM64_INSTRUCTION_UNKNOWN;
+    // Floating-point data processing (1 source)
+    switch ((insn >> 15) & 0x3f) {
+    case 0x3:
+        return ARM64_INSTRUCTION_FP_SQRT;
+    case 0x4:
+    case 0x5:
+    case 0x7:
+        return ARM64_INSTRUCTION_FP_CVT;
+    default:
+        return ARM64_INSTRUCTION_FP_ALU;
+    }
+}
+
+class DecodeTable
+{
+public:
+    constexpr DecodeTable() : index()
+    {
+        for (uint32_t key = 0; key < table_size; key++) {
+            index[key] = decode_key(key);
+        }
+    }
+
+    constexpr uint16_t operator[](uint32_t key) const { return index[key]; }
+
+private:
+    uint16_t index[table_size];
+};
+
+/// The table is generated at compile time
+constexpr DecodeTable table = {};
+
+} // End of namespace arm64_decode
+
+#endif
@@ -0,0 +1,337 @@
+extern "C" {
+#include "vpmu-arm-translate.h" // Interface header between QEMU and VPMU
+#include "vpmu-arm-insnset.h"   // Instruction Set
+}
+
+#include "vpmu.hpp" // VPMU common headers
+#include "Cortex-A53.hpp"
+#include "Cortex-A53-decode.hpp"
+#include "vpmu-utils.hpp"
+#include "vpmu-template-output.hpp"
+
+VPMU_Insn::Model CPU_CortexA53::build(void)
+{
+    log_debug("Initializing");
+
+    log_debug(json_config.dump().c_str());
+
+    auto model_name = vpmu::utils::get_json<std::string>(json_config, "name");
+    strncpy(insn_model.name, model_name.c_str(), sizeof(insn_model.name));
+    insn_model.frequency  = vpmu::utils::get_json<int>(json_config, "frequency");
+    insn_model.dual_issue = vpmu::utils::get_json<bool>(json_config, "dual_issue");
+
+    translator.build(json_config);
+    log_debug("Initialized");
+    return insn_model;
+}
+
+CPU_CortexA53::RetStatus CPU_CortexA53::packet_processor(int                         id,
+                                                         const VPMU_Insn::Reference& ref)
+{
+#ifdef CONFIG_VPMU_DEBUG_MSG
+    debug_packet_num_cnt++;
+    if (ref.type == VPMU_PACKET_DUMP_INFO) {
+        CONSOLE_LOG("    %'" PRIu64 " packets received\n", debug_packet_num_cnt);
+        debug_packet_num_cnt = 0;
+    }
+#endif
+
+    switch (ref.type) {
+    case VPMU_PACKET_BARRIER:
+    case VPMU_PACKET_SYNC_DATA:
+        return insn_data;
+        break;
+    case VPMU_PACKET_DUMP_INFO:
+        CONSOLE_LOG("  [%d] type : Cortex A53\n", id);
+        vpmu::output::CPU_counters(insn_model, insn_data);
+
+        break;
+    case VPMU_PACKET_RESET:
+        memset(&insn_data, 0, sizeof(VPMU_Insn::Data));
+        break;
+    case VPMU_PACKET_DATA:
+        accumulate(ref);
+        break;
+    default:
+        LOG_FATAL("Unexpected packet");
+    }
+    return insn_data;
+}
+
+void CPU_CortexA53::accumulate(const VPMU_Insn::Reference& ref)
+{
+    VPMU_Insn::DataCell* cell = nullptr;
+    // Defining the types (struct) for communication
+    enum CPU_MODE { // Copy from QEMU cpu.h
+        USR = 0x10,
+        SVC = 0x13,
+    };
+
+    if (ref.mode == USR) {
+        cell = &insn_data.user;
+    } else {
+        cell = &insn_data.system;
+    }
+    cell->total_insn[ref.core] += ref.tb_counters_ptr->counters.total;
+    cell->load[ref.core] += ref.tb_counters_ptr->counters.load;
+    cell->store[ref.core] += ref.tb_counters_ptr->counters.store;
+    cell->branch[ref.core] += ref.tb_counters_ptr->has_branch;
+    cell->cycles[ref.core] += ref.tb_counters_ptr->ticks;
+}
+
+void CPU_CortexA53::Translation::build(nlohmann::json config)
+{
+    auto model_name = vpmu::utils::get_json<std::string>(config, "name");
+    strncpy(cpu_model.name, model_name.c_str(), sizeof(cpu_model.name));
+    cpu_model.frequency  = vpmu::utils::get_json<int>(config, "frequency");
+    cpu_model.dual_issue = vpmu::utils::get_json<bool>(config, "dual_issue");
+
+    // The classes not listed in the config take one tick
+    for (auto& t : arm64_instr_time) t = 1;
+    nlohmann::json root = config["instruction"];
+    for (nlohmann::json::iterator it = root.begin(); it != root.end(); ++it) {
+        std::string key   = it.key();
+        uint32_t    value = it.value();
+
+        arm64_instr_time[get_index_of_arm64_insn(key.c_str())] = value;
+    }
+}
+
+uint16_t CPU_CortexA53::Translation::_decode_arm64_insn(uint32_t insn)
+{
+    uint16_t index = arm64_decode::table[arm64_decode::key_of(insn)];
+
+    // Only a few classes need the opcode fields in the lower bits
+    switch (index) {
+    case arm64_decode::ARM64_DECODE_DP_SRC:
+        return arm64_decode::decode_dp_src(insn);
+    case arm64_decode::ARM64_DECODE_SYSTEM:
+        return arm64_decode::decode_system(insn);
+    case arm64_decode::ARM64_DECODE_FP:
+        return arm64_decode::decode_fp(insn);
+    default:
+        return index;
+    }
+}
+
+//====================  VPMU Translation Instrumentation   ===================
+uint16_t CPU_CortexA53::Translation::get_arm64_ticks(TBSummaryBuilder& tb_summary,
+                                                     uint64_t          insn)
+{
+    uint16_t index = _decode_arm64_insn(insn);
+
+    return _issue_arm64_insn(tb_summary, insn, index, arm64_instr_time[index]);
+}
+
+// Decode the operands of an A64 instruction for the per-TB summary and return the
+// ticks it takes after dual issuing.
+// Bits 0-30 of the masks are X0-X30, bit 31 is NZCV flags and bits 32-63 are V0-V31.
+// SP and XZR (register 31) are not tracked. The operands are approximated per class,
+// e.g. the write back of the base register is ignored.
+uint16_t CPU_CortexA53::Translation::_issue_arm64_insn(TBSummaryBuilder& tb_summary,
+                                                      uint32_t          insn,
+                                                      uint16_t          index,
+                                                      uint16_t          ticks)
+{
+    const uint64_t FLAGS = 1ULL << 31;
+    const uint64_t LR    = 1ULL << 30;
+
+    auto x = [](uint32_t r) -> uint64_t { return (r == 31) ? 0 : (1ULL << r); };
+    auto v = [](uint32_t r) -> uint64_t { return 1ULL << (32 + r); };
+
+    uint32_t     rd   = insn & 0x1f;
+    uint32_t     rn   = (insn >> 5) & 0x1f;
+    uint32_t     ra   = (insn >> 10) & 0x1f; // Also Rt2 of load/store pair
+    uint32_t     rm   = (insn >> 16) & 0x1f; // Also Rs of store exclusive
+    bool         s    = insn & (1 << 29);    // Set flags of add/sub
+    bool         vec  = insn & (1 << 26);    // SIMD&FP register of load/store
+    uint64_t     src  = 0;
+    uint64_t     dst  = 0;
+    VPMU_FU_Type fu   = VPMU_FU_ALU;
+    auto         rt   = [&](uint32_t r) { return (vec) ? v(r) : x(r); };
+
+    switch (index) {
+    case ARM64_INSTRUCTION_B:
+        fu = VPMU_FU_BRANCH;
+        break;
+    case ARM64_INSTRUCTION_BL:
+        fu  = VPMU_FU_BRANCH;
+        dst = LR;
+        break;
+    case ARM64_INSTRUCTION_B_COND:
+        fu  = VPMU_FU_BRANCH;
+        src = FLAGS;
+        break;
+    case ARM64_INSTRUCTION_CBZ:
+    case ARM64_INSTRUCTION_TBZ:
+        fu  = VPMU_FU_BRANCH;
+        src = x(rd);
+        break;
+    case ARM64_INSTRUCTION_BR:
+    case ARM64_INSTRUCTION_RET:
+        fu  = VPMU_FU_BRANCH;
+        src = x(rn);
+        break;
+    case ARM64_INSTRUCTION_BLR:
+        fu  = VPMU_FU_BRANCH;
+        src = x(rn);
+        dst = LR;
+        break;
+    case ARM64_INSTRUCTION_ADR:
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_MOV_WIDE:
+        // MOVK keeps the other bits of Rd
+        src = (((insn >> 29) & 0x3) == 0x3) ? x(rd) : 0;
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_BFM:
+        // BFM keeps the other bits of Rd
+        src = x(rn) | ((((insn >> 29) & 0x3) == 0x1) ? x(rd) : 0);
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_LOGIC_IMM:
+    case ARM64_INSTRUCTION_LOGIC_REG:
+        // ANDS, BICS
+        s = (((insn >> 29) & 0x3) == 0x3);
+        /* fall through */
+    case ARM64_INSTRUCTION_ADD_IMM:
+    case ARM64_INSTRUCTION_ADD_REG:
+    case ARM64_INSTRUCTION_ADD_EXT:
+    case ARM64_INSTRUCTION_EXTR:
+    case ARM64_INSTRUCTION_DP1:
+    case ARM64_INSTRUCTION_SHIFT:
+    case ARM64_INSTRUCTION_CRC32:
+        src = x(rn);
+        // The immediate forms and the 1 source instructions do not read Rm
+        if (index != ARM64_INSTRUCTION_ADD_IMM && index != ARM64_INSTRUCTION_LOGIC_IMM
+            && index != ARM64_INSTRUCTION_DP1) {
+            src |= x(rm);
+        }
+        dst = x(rd) | ((s) ? FLAGS : 0);
+        break;
+    case ARM64_INSTRUCTION_ADC:
+        src = x(rn) | x(rm) | FLAGS;
+        dst = x(rd) | ((s) ? FLAGS : 0);
+        break;
+    case ARM64_INSTRUCTION_CCMP:
+        src = x(rn) | ((insn & (1 << 11)) ? 0 : x(rm)) | FLAGS;
+        dst = FLAGS;
+        break;
+    case ARM64_INSTRUCTION_CSEL:
+        src = x(rn) | x(rm) | FLAGS;
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_UDIV:
+    case ARM64_INSTRUCTION_SDIV:
+    case ARM64_INSTRUCTION_MUL:
+    case ARM64_INSTRUCTION_MULL:
+    case ARM64_INSTRUCTION_MULH:
+        fu  = VPMU_FU_MUL;
+        // Ra is only in the 3 source instructions
+        src = x(rn) | x(rm) | ((insn & (1 << 24)) ? x(ra) : 0);
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_LDR:
+    case ARM64_INSTRUCTION_LDXR:
+        fu  = VPMU_FU_LOAD;
+        src = x(rn);
+        dst = rt(rd);
+        break;
+    case ARM64_INSTRUCTION_LDR_LIT:
+        fu  = VPMU_FU_LOAD;
+        dst = rt(rd);
+        break;
+    case ARM64_INSTRUCTION_LDP:
+        fu  = VPMU_FU_LOAD;
+        src = x(rn);
+        dst = rt(rd) | rt(ra);
+        break;
+    case ARM64_INSTRUCTION_PRFM:
+        fu  = VPMU_FU_LOAD;
+        src = x(rn);
+        break;
+    case ARM64_INSTRUCTION_STR:
+        fu  = VPMU_FU_STORE;
+        src = x(rn) | rt(rd);
+        break;
+    case ARM64_INSTRUCTION_STP:
+        fu  = VPMU_FU_STORE;
+        src = x(rn) | rt(rd) | rt(ra);
+        break;
+    case ARM64_INSTRUCTION_STXR:
+        fu  = VPMU_FU_STORE;
+        src = x(rn) | x(rd);
+        dst = x(rm);
+        break;
+    case ARM64_INSTRUCTION_SIMD_LDST:
+        if (insn & (1 << 22)) {
+            fu  = VPMU_FU_LOAD;
+            src = x(rn);
+            dst = v(rd);
+        } else {
+            fu  = VPMU_FU_STORE;
+            src = x(rn) | v(rd);
+        }
+        break;
+    case ARM64_INSTRUCTION_MRS:
+        dst = x(rd);
+        break;
+    case ARM64_INSTRUCTION_MSR:
+    case ARM64_INSTRUCTION_SYS:
+        src = x(rd);
+        break;
+    case ARM64_INSTRUCTION_SVC:
+    case ARM64_INSTRUCTION_ERET:
+    case ARM64_INSTRUCTION_BARRIER:
+        // Serialize the instructions around it
+        src = TBSummaryBuilder::all_regs;
+        dst = TBSummaryBuilder::all_regs;
+        break;
+    case ARM64_INSTRUCTION_FP_ALU:
+        fu  = VPMU_FU_FPU;
+        src = v(rn) | v(rm);
+        dst = v(rd);
+        // FCMP and FCCMP write the flags instead
+        if ((insn & 0x3c00) == 0x2000 || (insn & 0xc00) == 0x400) dst = FLAGS;
+        // FCSEL reads the flags
+        if ((insn & 0xc00) == 0xc00) src |= FLAGS;
+        break;
+    case ARM64_INSTRUCTION_FP_MUL:
+    case ARM64_INSTRUCTION_FP_DIV:
+    case ARM64_INSTRUCTION_FP_SQRT:
+    case ARM64_INSTRUCTION_SIMD_DP:
+        fu  = VPMU_FU_FPU;
+        src = v(rn) | v(rm);
+        dst = v(rd);
+        break;
+    case ARM64_INSTRUCTION_FP_MAC:
+        fu  = VPMU_FU_FPU;
+        src = v(rn) | v(rm) | v(ra);
+        dst = v(rd);
+        break;
+    case ARM64_INSTRUCTION_FP_CVT:
+        // The direction of FMOV and the conversions is not decoded
+        fu  = VPMU_FU_FPU;
+        src = x(rn) | v(rn);
+        dst = x(rd) | v(rd);
+        break;
+    default:
+        // HINT and the unknown instructions
+        break;
+    }
+    tb_summary.add_insn(fu, src, dst, ticks);
+
+    if (cpu_model.dual_issue) {
+        auto& last = tb_summary.state;
+        // Pair with the former instruction when both take a single tick, they are
+        // independent, and they do not compete for the same non-ALU unit.
+        bool pair = !last.last_paired && ticks == 1 && (src & last.last_dst) == 0
+                    && (fu == VPMU_FU_ALU || fu != last.last_fu);
+        last.last_paired = pair || ticks != 1;
+        last.last_dst    = dst;
+        last.last_fu     = fu;
+        if (pair) return 0;
+    }
+    return ticks;
+}
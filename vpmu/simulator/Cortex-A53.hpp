@@ -0,0 +1,109 @@
+#ifndef __CPU_CORTEX_A53_HPP_
+#define __CPU_CORTEX_A53_HPP_
+#pragma once
+
+extern "C" {
+#include "vpmu-qemu.h"        // ExtraTBInfo
+#include "vpmu-arm-insnset.h" // Instruction Set
+}
+#include "vpmu-sim.hpp"         // VPMUSimulator
+#include "vpmu-translate.hpp"   // VPMUARMTranslate
+#include "vpmu-insn-packet.hpp" // VPMU_Insn
+
+/// @brief Cortex A53 component simulator class for AArch64 guests
+/// @details The structure follows CPU_CortexA9. The A64 instructions are classified
+/// by a decode table (see Cortex-A53-decode.hpp) when QEMU translates them, and the
+/// ticks of each class are read from the "instruction" object of the json config
+/// with the names in ARM64_INSTRUCTION, e.g. "LDR", "MUL", "FP_DIV".
+/// Classes which are not listed in the config take one tick.
+///
+/// The dual issue of A53 is modeled by pairing two adjacent single-tick instructions
+/// which are independent and do not use the same non-ALU unit.
+/// AArch32 code is counted as one tick per instruction.
+class CPU_CortexA53 : public VPMUSimulator<VPMU_Insn>
+{
+private: // VPMUARMTranslate
+    /// @brief Translation class of VPMUARMTranslate
+    class Translation : public VPMUARMTranslate
+    {
+    public:
+        typedef struct Model {
+            char     name[1024];
+            uint32_t frequency;
+            uint32_t dual_issue;
+        } Model;
+
+        void     build(nlohmann::json config);
+        uint16_t get_arm64_ticks(TBSummaryBuilder& tb_summary, uint64_t insn) override;
+        uint16_t get_arm_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override
+        {
+            return _get_aarch32_ticks(tb_summary);
+        }
+        uint16_t get_thumb_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override
+        {
+            return _get_aarch32_ticks(tb_summary);
+        }
+        uint16_t get_cp14_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override
+        {
+            return 0;
+        }
+
+        void begin_tb_summary(TBSummaryBuilder& tb_summary) override
+        {
+            tb_summary.reset();
+            // The states of the previous instruction for dual issue, nothing to pair
+            // with at the beginning of a TB
+            tb_summary.state.last_fu     = VPMU_FU_ALU;
+            tb_summary.state.last_paired = true;
+        }
+
+    private:
+        Model    cpu_model;
+        // One more entry for the unknown names in json config
+        uint32_t arm64_instr_time[ARM64_INSTRUCTION_TOTAL_COUNTS + 1];
+
+        uint16_t _decode_arm64_insn(uint32_t insn);
+        uint16_t _issue_arm64_insn(TBSummaryBuilder& tb_summary,
+                                   uint32_t          insn,
+                                   uint16_t          index,
+                                   uint16_t          ticks);
+        uint16_t _get_aarch32_ticks(TBSummaryBuilder& tb_summary)
+        {
+            tb_summary.add_insn(VPMU_FU_ALU, 0, 0, 1);
+            return 1;
+        }
+    }; // End of class Translation
+
+public: // VPMUSimulator
+    CPU_CortexA53() : VPMUSimulator("CortexA53") {}
+    ~CPU_CortexA53() {}
+
+    /// Must override this. This is called in translation time.
+    VPMUARMTranslate& get_translator_handle(void) override { return translator; }
+
+    /// @brief This is where to release/free/deallocate resources holded by simulator.
+    void destroy(void) override { ; }
+    /// @brief Initiate and allocate resource required by this timing simulator.
+    VPMU_Insn::Model build(void) override;
+    /// @brief The main function of each timing simulator for processing traces.
+    RetStatus packet_processor(int id, const VPMU_Insn::Reference& ref) override;
+
+private:
+#ifdef CONFIG_VPMU_DEBUG_MSG
+    /// The total number of packets counter for debugging
+    uint64_t debug_packet_num_cnt = 0;
+#endif
+    /// Rename platform_info. The CPU configurations for timing model
+    using VPMUSimulator::platform_info;
+    /// The instance of Translator called from QEMU when doing binary translation
+    Translation translator = {};
+    // The data stored in this simulator
+    VPMU_Insn::Data insn_data = {};
+    // The model stored in this simulator
+    VPMU_Insn::Model insn_model = {};
+
+    /// @brief Accumulate the counters and cycles of a TB per-core.
+    void accumulate(const VPMU_Insn::Reference& ref);
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef __CPU_CORTEX_A9_DECODE_HPP_
+#define __CPU_CORTEX_A9_DECODE_HPP_
+#pragma once
+
+extern "C" {
+#include "vpmu-arm-insnset.h" // Instruction Set
+}
+#include <cstdint> // uint16_t, uint32_t
+
+/// @brief Constexpr decode table of ARM (A32) instructions for the Cortex-A9 model
+/// @details The table is indexed by bits [27:20] and [7:4] of an instruction, which
+/// determine the instruction class of most data processing, multiply and load/store
+/// instructions. Each entry is an index of ARM_Instructions, whose tick count is
+/// patched from the json config at CPU_CortexA9::Translation::build().
+/// Entries which need more bits to tell the instruction (media instructions, MSR and
+/// unconditional instructions) are marked as ARM_DECODE_SLOW and decoded by
+/// CPU_CortexA9::Translation::_decode_arm_insn_slow() as before.
+///
+/// This table must follow the exact behavior of the slow decoder, including the
+/// instructions it does not recognize (ARM_DECODE_ILLEGAL).
+namespace arm_decode
+{
+/// Not recognized by the decoder, it takes one tick
+constexpr uint16_t ARM_DECODE_ILLEGAL = ARM_INSTRUCTION_TOTAL_COUNTS;
+/// Need the full decoder to tell the instruction
+constexpr uint16_t ARM_DECODE_SLOW = ARM_INSTRUCTION_TOTAL_COUNTS + 1;
+/// Load/store multiple, which depends on the register list
+constexpr uint16_t ARM_DECODE_LDM_STM = ARM_INSTRUCTION_TOTAL_COUNTS + 2;
+
+constexpr uint32_t table_size = 1 << 12;
+
+constexpr uint32_t key_of(uint32_t insn)
+{
+    return ((insn >> 16) & 0xff0) | ((insn >> 4) & 0xf);
+}
+
+constexpr uint32_t insn_of(uint32_t key)
+{
+    // Use condition code AL and zeros for the bits not in the key
+    return 0xe0000000 | ((key & 0xff0) << 16) | ((key & 0xf) << 4);
+}
+
+constexpr uint16_t decode_load_store(uint32_t insn, uint32_t op1)
+{
+    // Undefined extension instructions: xxxx 0111 1111 xxxx  xxxx xxxx 1111 xxxx
+    const uint32_t sh = (0xf << 20) | (0xf << 4);
+    if (op1 == 0x7 && ((insn & sh) == sh)) return ARM_DECODE_ILLEGAL;
+
+    if (insn & (1 << 20)) {
+        return (insn & (1 << 22)) ? ARM_INSTRUCTION_LDRB : ARM_INSTRUCTION_LDR;
+    } else {
+        return (insn & (1 << 22)) ? ARM_INSTRUCTION_STRB : ARM_INSTRUCTION_STR;
+    }
+}
+
+constexpr uint16_t decode_misc(uint32_t insn)
+{
+    uint32_t op1 = (insn >> 21) & 3;
+    uint32_t sh  = (insn >> 4) & 0xf;
+
+    switch (sh) {
+    case 0x0:
+        return (op1 & 1) ? ARM_INSTRUCTION_MSR : ARM_INSTRUCTION_MRS;
+    case 0x1:
+        if (op1 == 1) return ARM_INSTRUCTION_BX;
+        if (op1 == 3) return ARM_INSTRUCTION_CLZ;
+        return ARM_DECODE_ILLEGAL;
+    case 0x2:
+        return (op1 == 1) ? ARM_INSTRUCTION_BXJ : ARM_DECODE_ILLEGAL;
+    case 0x3:
+        return (op1 == 1) ? ARM_INSTRUCTION_BLX : ARM_DECODE_ILLEGAL;
+    case 0x5:
+        // QDADD is counted as QADD
+        if (op1 & 2) return (op1 & 1) ? ARM_INSTRUCTION_QDSUB : ARM_INSTRUCTION_QADD;
+        return (op1 & 1) ? ARM_INSTRUCTION_QSUB : ARM_INSTRUCTION_QADD;
+    case 0x7:
+        return ARM_INSTRUCTION_BKPT;
+    case 0x8:
+    case 0xa:
+    case 0xc:
+    case 0xe:
+        if (op1 == 1)
+            return ((sh & 2) == 0) ? ARM_INSTRUCTION_SMLAWY : ARM_INSTRUCTION_SMULWY;
+        if (op1 == 3) return ARM_INSTRUCTION_SMULXY;
+        if (op1 == 2) return ARM_INSTRUCTION_SMLALXY;
+        return ARM_INSTRUCTION_SMLAXY;
+    default:
+        return ARM_DECODE_ILLEGAL;
+    }
+}
+
+constexpr uint16_t decode_data_processing(uint32_t insn)
+{
+    const uint16_t dp_insn[16] = {ARM_INSTRUCTION_AND,
+                                  ARM_INSTRUCTION_EOR,
+                                  ARM_INSTRUCTION_SUB,
+                                  ARM_INSTRUCTION_RSB,
+                                  ARM_INSTRUCTION_ADD,
+                                  ARM_INSTRUCTION_ADC,
+                                  ARM_INSTRUCTION_SBC,
+                                  ARM_INSTRUCTION_RSC,
+                                  ARM_INSTRUCTION_TST,
+                                  ARM_INSTRUCTION_TEQ,
+                                  ARM_INSTRUCTION_CMP,
+                                  ARM_INSTRUCTION_CMN,
+                                  ARM_INSTRUCTION_ORR,
+                                  ARM_INSTRUCTION_MOV,
+                                  ARM_INSTRUCTION_BIC,
+                                  ARM_INSTRUCTION_MVN};
+
+    return dp_insn[(insn >> 21) & 0xf];
+}
+
+constexpr uint16_t decode_mul_extra_ldst(uint32_t insn, uint32_t op1)
+{
+    uint32_t sh = (insn >> 5) & 3;
+
+    if (sh == 0) {
+        if (op1 == 0x0) {
+            switch ((insn >> 20) & 0xf) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 6:
+                // 32 bit multiplies are not counted by the decoder
+                return ARM_DECODE_ILLEGAL;
+            default: {
+                // 64 bit multiplies
+                uint16_t index = (insn & (1 << 22)) ? ARM_INSTRUCTION_SMULL
+                                                    : ARM_INSTRUCTION_UMULL;
+                if (insn & (1 << 21)) {
+                    index = (insn & (1 << 22)) ? ARM_INSTRUCTION_SMLAL
+                                               : ARM_INSTRUCTION_UMLAL;
+                }
+                if (insn & (1 << 20)) index++;
+                return index;
+            }
+            }
+        }
+        if (insn & (1 << 23)) {
+            // Load/store exclusive
+            return (insn & (1 << 20)) ? ARM_INSTRUCTION_LDREX : ARM_INSTRUCTION_STREX;
+        }
+        return (insn & (1 << 22)) ? ARM_INSTRUCTION_SWPB : ARM_INSTRUCTION_SWP;
+    }
+    // Misc load/store
+    if (insn & (1 << 20)) {
+        if (sh == 1) return ARM_INSTRUCTION_LDRH;
+        if (sh == 2) return ARM_INSTRUCTION_LDRSB;
+        return ARM_DECODE_ILLEGAL;
+    }
+    if (sh & 2) return (sh & 1) ? ARM_INSTRUCTION_STRD : ARM_INSTRUCTION_LDRD;
+    return ARM_INSTRUCTION_STRH;
+}
+
+/// Decode an instruction with only the bits in the key, i.e. insn_of(key)
+constexpr uint16_t decode_key(uint32_t key)
+{
+    uint32_t insn = insn_of(key);
+
+    if ((insn & 0x0f900000) == 0x03000000) {
+        if ((insn & (1 << 21)) == 0) {
+            return (insn & (1 << 22)) ? ARM_INSTRUCTION_MOVT : ARM_INSTRUCTION_MOVW;
+        }
+        // MSR (immediate) depends on bits [19:16]
+        return ARM_DECODE_SLOW;
+    } else if ((insn & 0x0f900000) == 0x01000000 && (insn & 0x00000090) != 0x00000090) {
+        return decode_misc(insn);
+    } else if (((insn & 0x0e000000) == 0 && (insn & 0x00000090) != 0x90)
+               || ((insn & 0x0e000000) == (1 << 25))) {
+        return decode_data_processing(insn);
+    }
+
+    uint32_t op1 = (insn >> 24) & 0xf;
+    switch (op1) {
+    case 0x0:
+    case 0x1:
+        return decode_mul_extra_ldst(insn, op1);
+    case 0x4:
+    case 0x5:
+        return decode_load_store(insn, op1);
+    case 0x6:
+    case 0x7:
+        // Armv6 media instructions depend on most of the bits
+        if (insn & (1 << 4)) return ARM_DECODE_SLOW;
+        return decode_load_store(insn, op1);
+    case 0x8:
+    case 0x9:
+        return ARM_DECODE_LDM_STM;
+    case 0xa:
+    case 0xb:
+        return ARM_INSTRUCTION_B;
+    case 0xc:
+    case 0xd:
+    case 0xe:
+        return ARM_INSTRUCTION_COPROCESSOR;
+    case 0xf:
+        return ARM_INSTRUCTION_SWI;
+    default:
+        return ARM_DECODE_ILLEGAL;
+    }
+}
+
+/// Load/store multiple. NOTE: The decoder checks bits [2] and [0] (register list)
+/// instead of bits [22] and [20]. The behavior is kept for the same results.
+inline uint16_t decode_ldm_stm(uint32_t insn)
+{
+    switch (insn & 0x5) {
+    case 0x0:
+        return ARM_INSTRUCTION_STM1;
+    case 0x1:
+        return ARM_INSTRUCTION_LDM1;
+    case 0x4:
+        return ARM_INSTRUCTION_STM2;
+    default:
+        return (insn & (1 << 15)) ? ARM_INSTRUCTION_LDM3 : ARM_INSTRUCTION_LDM2;
+    }
+}
+
+class DecodeTable
+{
+public:
+    constexpr DecodeTable() : index()
+    {
+        for (uint32_t key = 0; key < table_size; key++) {
+            index[key] = decode_key(key);
+        }
+    }
+
+    constexpr uint16_t operator[](uint32_t key) const { return index[key]; }
+
+private:
+    uint16_t index[table_size];
+};
+
+/// The table is generated at compile time
+constexpr DecodeTable table = {};
+
+} // End of namespace arm_decode
+
+#endif
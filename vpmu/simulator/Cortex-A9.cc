@@ -5,6 +5,7 @@ extern "C" {
 #include "vpmu.hpp"       // VPMU common headers
 #include "vpmu-utils.hpp" // miscellaneous functions
 #include "Cortex-A9.hpp"
+#include "Cortex-A9-decode.hpp" // arm_decode::table
 #include "vpmu-template-output.hpp"
 
 #ifdef CONFIG_VPMU_VFP
@@ -1491,10 +1492,11 @@ illegal_op:
 #endif
 
 /* Implement by evo0209
- * It's almost the same as analyze_arm_ticks, but return the insn latency.
+ * It's almost the same as analyze_arm_ticks, but return the insn index.
  * It aims to calculate the ticks in each TB, instead of in helper function
+ * Most of instructions are decoded by arm_decode::table. This is the fallback.
  */
-uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
+uint16_t CPU_CortexA9::Translation::_decode_arm_insn_slow(uint32_t insn)
 {
 
     unsigned int cond, op1, shift, rn, rd, sh;
@@ -1506,58 +1508,58 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         if (((insn >> 25) & 7) == 1) {
             /* NEON Data processing.  */
             // arm_count[ARM_INSTRUCTION_NEON_DP]+=1;
-            return arm_instr_time[ARM_INSTRUCTION_NEON_DP];
+            return ARM_INSTRUCTION_NEON_DP;
         }
         if ((insn & 0x0f100000) == 0x04000000) {
             /* NEON load/store.  */
             // arm_count[ARM_INSTRUCTION_NEON_LS]+=1;
-            return arm_instr_time[ARM_INSTRUCTION_NEON_LS];
+            return ARM_INSTRUCTION_NEON_LS;
         }
         if ((insn & 0x0d70f000) == 0x0550f000) {
             // arm_count[ARM_INSTRUCTION_PLD]+=1;
-            return arm_instr_time[ARM_INSTRUCTION_PLD]; /* PLD */
+            return ARM_INSTRUCTION_PLD; /* PLD */
         } else if ((insn & 0x0ffffdff) == 0x01010000) {
             // arm_count[ARM_INSTRUCTION_SETEND]+=1;//tianman
             /* setend */
-            return arm_instr_time[ARM_INSTRUCTION_SETEND];
+            return ARM_INSTRUCTION_SETEND;
         } else if ((insn & 0x0fffff00) == 0x057ff000) {
             switch ((insn >> 4) & 0xf) {
             case 1: /* clrex */
                 // arm_count[ARM_INSTRUCTION_CLREX]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_CLREX];
+                return ARM_INSTRUCTION_CLREX;
             case 4: /* dsb */
                 // arm_count[ARM_INSTRUCTION_DSB]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_DSB];
+                return ARM_INSTRUCTION_DSB;
             case 5: /* dmb */
                 // arm_count[ARM_INSTRUCTION_DMB]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_DMB];
+                return ARM_INSTRUCTION_DMB;
             case 6: /* isb */
                 // arm_count[ARM_INSTRUCTION_ISB]+=1;//tianman
                 /* We don't emulate caches so these are a no-op.  */
-                return arm_instr_time[ARM_INSTRUCTION_ISB];
+                return ARM_INSTRUCTION_ISB;
             default:
                 goto illegal_op;
             }
         } else if ((insn & 0x0e5fffe0) == 0x084d0500) {
             /* srs */
             // arm_count[ARM_INSTRUCTION_SRS]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_SRS];
+            return ARM_INSTRUCTION_SRS;
         } else if ((insn & 0x0e5fffe0) == 0x081d0a00) {
             /* rfe */
             // arm_count[ARM_INSTRUCTION_RFE]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_RFE];
+            return ARM_INSTRUCTION_RFE;
         } else if ((insn & 0x0e000000) == 0x0a000000) {
             /* branch link and change to thumb (blx <offset>) */
             // arm_count[ARM_INSTRUCTION_BLX]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_BLX];
+            return ARM_INSTRUCTION_BLX;
         } else if ((insn & 0x0e000f00) == 0x0c000100) {
             // LDC,STC?
             if (insn & (1 << 20)) {
                 // arm_count[ARM_INSTRUCTION_LDC]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_LDC];
+                return ARM_INSTRUCTION_LDC;
             } else {
                 // arm_count[ARM_INSTRUCTION_STC]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_STC];
+                return ARM_INSTRUCTION_STC;
             }
             // return;
         } else if ((insn & 0x0fe00000) == 0x0c400000) {
@@ -1565,10 +1567,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             // MCRR, MRRC
             if (insn & (1 << 20)) {
                 // arm_count[ARM_INSTRUCTION_MRRC]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MRRC];
+                return ARM_INSTRUCTION_MRRC;
             } else {
                 // arm_count[ARM_INSTRUCTION_MCRR]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MCRR];
+                return ARM_INSTRUCTION_MCRR;
             }
             // return;
         } else if ((insn & 0x0f000010) == 0x0e000010) {
@@ -1576,16 +1578,16 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             // MCR,MRC
             if (insn & (1 << 20)) {
                 // arm_count[ARM_INSTRUCTION_MRC]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MRC];
+                return ARM_INSTRUCTION_MRC;
             } else {
                 // arm_count[ARM_INSTRUCTION_MCR]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MCR];
+                return ARM_INSTRUCTION_MCR;
             }
             // return;
         } else if ((insn & 0x0ff10020) == 0x01000000) {
             /* cps (privileged) */
             // arm_count[ARM_INSTRUCTION_CPS]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_CPS];
+            return ARM_INSTRUCTION_CPS;
         }
         goto illegal_op;
     }
@@ -1595,18 +1597,18 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             if ((insn & (1 << 22)) == 0) {
                 /* MOVW */
                 // arm_count[ARM_INSTRUCTION_MOVW]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MOVW];
+                return ARM_INSTRUCTION_MOVW;
             } else {
                 /* MOVT */
                 // arm_count[ARM_INSTRUCTION_MOVT]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MOVT];
+                return ARM_INSTRUCTION_MOVT;
             }
         } else {
             if (((insn >> 16) & 0xf) == 0) {
             } else {
                 /* CPSR = immediate */
                 // arm_count[ARM_INSTRUCTION_MSR]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MSR];
+                return ARM_INSTRUCTION_MSR;
             }
         }
     } else if ((insn & 0x0f900000) == 0x01000000 && (insn & 0x00000090) != 0x00000090) {
@@ -1618,22 +1620,22 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             if (op1 & 1) {
                 /* PSR = reg */
                 // arm_count[ARM_INSTRUCTION_MSR]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MSR];
+                return ARM_INSTRUCTION_MSR;
             } else {
                 /* reg = PSR */
                 // arm_count[ARM_INSTRUCTION_MRS]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_MRS];
+                return ARM_INSTRUCTION_MRS;
             }
             break;
         case 0x1:
             if (op1 == 1) {
                 // arm_count[ARM_INSTRUCTION_BX]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_BX];
+                return ARM_INSTRUCTION_BX;
                 /* branch/exchange thumb (bx).  */
             } else if (op1 == 3) {
                 /* clz */
                 // arm_count[ARM_INSTRUCTION_CLZ]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_CLZ];
+                return ARM_INSTRUCTION_CLZ;
             } else {
                 goto illegal_op;
             }
@@ -1641,7 +1643,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         case 0x2:
             if (op1 == 1) {
                 // arm_count[ARM_INSTRUCTION_BXJ]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_BXJ];
+                return ARM_INSTRUCTION_BXJ;
             } else {
                 goto illegal_op;
             }
@@ -1649,7 +1651,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         case 0x3:
             if (op1 != 1) goto illegal_op;
             // arm_count[ARM_INSTRUCTION_BLX]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_BLX];
+            return ARM_INSTRUCTION_BLX;
 
             /* branch link/exchange thumb (blx) */
             break;
@@ -1657,23 +1659,23 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             if (op1 & 2) {
                 if (op1 & 1) {
                     // arm_count[ARM_INSTRUCTION_QDSUB]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_QDSUB];
+                    return ARM_INSTRUCTION_QDSUB;
                 } else {
                     // arm_count[ARM_INSTRUCTION_QDADD]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_QADD];
+                    return ARM_INSTRUCTION_QADD;
                 }
             }
             if (op1 & 1) {
                 // arm_count[ARM_INSTRUCTION_QSUB]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_QSUB];
+                return ARM_INSTRUCTION_QSUB;
             } else {
                 // arm_count[ARM_INSTRUCTION_QADD]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_QADD];
+                return ARM_INSTRUCTION_QADD;
             }
             break;
         case 7: /* bkpt */
             // arm_count[ARM_INSTRUCTION_BKPT]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_BKPT];
+            return ARM_INSTRUCTION_BKPT;
             break;
         case 0x8: /* signed multiply */
         case 0xa:
@@ -1683,22 +1685,22 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                 /* (32 * 16) >> 16 */
                 if ((sh & 2) == 0) {
                     // arm_count[ARM_INSTRUCTION_SMLAWY]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_SMLAWY];
+                    return ARM_INSTRUCTION_SMLAWY;
                 }
                 // arm_count[ARM_INSTRUCTION_SMULWY]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_SMULWY];
+                return ARM_INSTRUCTION_SMULWY;
             } else {
                 /* 16 * 16 */
                 if (op1 == 3) {
                     // arm_count[ARM_INSTRUCTION_SMULXY]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_SMULXY];
+                    return ARM_INSTRUCTION_SMULXY;
                 } else if (op1 == 2) {
                     // arm_count[ARM_INSTRUCTION_SMLALXY]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_SMLALXY];
+                    return ARM_INSTRUCTION_SMLALXY;
                 } else {
                     if (op1 == 0) {
                         // arm_count[ARM_INSTRUCTION_SMLAXY]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_SMLAXY];
+                        return ARM_INSTRUCTION_SMLAXY;
                     }
                 }
             }
@@ -1753,68 +1755,68 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         switch (op1) {
         case 0x00:
             // arm_count[ARM_INSTRUCTION_AND]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_AND];
+            return ARM_INSTRUCTION_AND;
             break;
         case 0x01:
             // arm_count[ARM_INSTRUCTION_EOR]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_EOR];
+            return ARM_INSTRUCTION_EOR;
             break;
         case 0x02:
             // arm_count[ARM_INSTRUCTION_SUB]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_SUB];
+            return ARM_INSTRUCTION_SUB;
             break;
         case 0x03:
             // arm_count[ARM_INSTRUCTION_RSB]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_RSB];
+            return ARM_INSTRUCTION_RSB;
             break;
         case 0x04:
             // arm_count[ARM_INSTRUCTION_ADD]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_ADD];
+            return ARM_INSTRUCTION_ADD;
             break;
         case 0x05:
             // arm_count[ARM_INSTRUCTION_ADC]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_ADC];
+            return ARM_INSTRUCTION_ADC;
             break;
         case 0x06:
             // arm_count[ARM_INSTRUCTION_SBC]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_SBC];
+            return ARM_INSTRUCTION_SBC;
             break;
         case 0x07:
             // arm_count[ARM_INSTRUCTION_RSC]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_RSC];
+            return ARM_INSTRUCTION_RSC;
             break;
         case 0x08:
             // arm_count[ARM_INSTRUCTION_TST]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_TST];
+            return ARM_INSTRUCTION_TST;
             break;
         case 0x09:
             // arm_count[ARM_INSTRUCTION_TEQ]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_TEQ];
+            return ARM_INSTRUCTION_TEQ;
             break;
         case 0x0a:
             // arm_count[ARM_INSTRUCTION_CMP]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_CMP];
+            return ARM_INSTRUCTION_CMP;
             break;
         case 0x0b:
             // arm_count[ARM_INSTRUCTION_CMN]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_CMN];
+            return ARM_INSTRUCTION_CMN;
             break;
         case 0x0c:
             // arm_count[ARM_INSTRUCTION_ORR]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_ORR];
+            return ARM_INSTRUCTION_ORR;
             break;
         case 0x0d:
             // arm_count[ARM_INSTRUCTION_MOV]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_MOV];
+            return ARM_INSTRUCTION_MOV;
             break;
         case 0x0e:
             // arm_count[ARM_INSTRUCTION_BIC]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_BIC];
+            return ARM_INSTRUCTION_BIC;
             break;
         default:
         case 0x0f:
             // arm_count[ARM_INSTRUCTION_MVN]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_MVN];
+            return ARM_INSTRUCTION_MVN;
             break;
         }
     } else {
@@ -1867,7 +1869,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             instr_index++;
                         }
                         // arm_count[instr_index]+=1;//tianman
-                        return arm_instr_time[instr_index];
+                        return instr_index;
                         break;
                     }
                 } else {
@@ -1888,7 +1890,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             default:
                                 abort();
                             }
-                            return arm_instr_time[ARM_INSTRUCTION_LDREX];
+                            return ARM_INSTRUCTION_LDREX;
                         } else {
                             // arm_count[ARM_INSTRUCTION_STREX]+=1;//tianman
                             switch (op1) {
@@ -1903,7 +1905,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             default:
                                 abort();
                             }
-                            return arm_instr_time[ARM_INSTRUCTION_STREX];
+                            return ARM_INSTRUCTION_STREX;
                         }
                     } else {
                         /* SWP instruction */
@@ -1913,10 +1915,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                            so it is good enough.  */
                         if (insn & (1 << 22)) {
                             // arm_count[ARM_INSTRUCTION_SWPB]+=1;//tianman
-                            return arm_instr_time[ARM_INSTRUCTION_SWPB];
+                            return ARM_INSTRUCTION_SWPB;
                         } else {
                             // arm_count[ARM_INSTRUCTION_SWP]+=1;//tianman
-                            return arm_instr_time[ARM_INSTRUCTION_SWP];
+                            return ARM_INSTRUCTION_SWP;
                         }
                     }
                 }
@@ -1930,15 +1932,15 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                     switch (sh) {
                     case 1:
                         // arm_count[ARM_INSTRUCTION_LDRH]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_LDRH];
+                        return ARM_INSTRUCTION_LDRH;
                         break;
                     case 2:
                         // arm_count[ARM_INSTRUCTION_LDRSB]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_LDRSB];
+                        return ARM_INSTRUCTION_LDRSB;
                         break;
                     default:
                         // arm_count[ARM_INSTRUCTION_LDRSH]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_LDRSH];
+                        return ARM_INSTRUCTION_LDRSH;
                     case 3:
                         break;
                     }
@@ -1947,16 +1949,16 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                     if (sh & 1) {
                         /* store */
                         // arm_count[ARM_INSTRUCTION_STRD]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_STRD];
+                        return ARM_INSTRUCTION_STRD;
                     } else {
                         /* load */
                         // arm_count[ARM_INSTRUCTION_LDRD]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_LDRD];
+                        return ARM_INSTRUCTION_LDRD;
                     }
                 } else {
                     /* store */
                     // arm_count[ARM_INSTRUCTION_STRH]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_STRH];
+                    return ARM_INSTRUCTION_STRH;
                 }
                 /* Perform base writeback before the loaded value to
                    ensure correct behavior with overlapping index registers.
@@ -1986,11 +1988,11 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             /* pkhtb */
                             // arm_count[ARM_INSTRUCTION_PKHTB]+=1;//tianman
                             if (shift == 0) shift = 31;
-                            return arm_instr_time[ARM_INSTRUCTION_PKHTB];
+                            return ARM_INSTRUCTION_PKHTB;
                         } else {
                             /* pkhbt */
                             // arm_count[ARM_INSTRUCTION_PKHBT]+=1;//tianman
-                            return arm_instr_time[ARM_INSTRUCTION_PKHBT];
+                            return ARM_INSTRUCTION_PKHBT;
                         }
                     } else if ((insn & 0x00200020) == 0x00200000) {
                         /* [us]sat */
@@ -1998,10 +2000,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                         if (sh != 0) {
                             if (insn & (1 << 22)) {
                                 // arm_count[ARM_INSTRUCTION_USAT]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_USAT];
+                                return ARM_INSTRUCTION_USAT;
                             } else {
                                 // arm_count[ARM_INSTRUCTION_SSAT]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_SSAT];
+                                return ARM_INSTRUCTION_SSAT;
                             }
                         }
                     } else if ((insn & 0x00300fe0) == 0x00200f20) {
@@ -2010,16 +2012,16 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                         if (sh != 0) {
                             if (insn & (1 << 22)) {
                                 // arm_count[ARM_INSTRUCTION_USAT16]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_USAT16];
+                                return ARM_INSTRUCTION_USAT16;
                             } else {
                                 // arm_count[ARM_INSTRUCTION_SSAT16]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_SSAT16];
+                                return ARM_INSTRUCTION_SSAT16;
                             }
                         }
                     } else if ((insn & 0x00700fe0) == 0x00000fa0) {
                         /* Select bytes.  */
                         // arm_count[ARM_INSTRUCTION_SEL]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_SEL];
+                        return ARM_INSTRUCTION_SEL;
                     } else if ((insn & 0x000003e0) == 0x00000060) {
                         // shift = (insn >> 10) & 3;
                         /* ??? In many cases it's not neccessary to do a
@@ -2055,7 +2057,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             instr_index -= 3; // tianman
                         }
                         // arm_count[instr_index]+=1;//tianman
-                        return arm_instr_time[instr_index];
+                        return instr_index;
                     } else if ((insn & 0x003f0f60) == 0x003f0f20) {
                         /* rev */
                         if (insn & (1 << 22)) {
@@ -2065,10 +2067,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                         } else {
                             if (insn & (1 << 7)) {
                                 // arm_count[ARM_INSTRUCTION_REV16]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_REV16];
+                                return ARM_INSTRUCTION_REV16;
                             } else {
                                 // arm_count[ARM_INSTRUCTION_REV]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_REV];
+                                return ARM_INSTRUCTION_REV;
                             }
                         }
                     } else {
@@ -2082,14 +2084,14 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                         if (rd != 15) {
                             if (insn & (1 << 6)) {
                                 // arm_count[ARM_INSTRUCTION_SMMLS]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_SMMLS];
+                                return ARM_INSTRUCTION_SMMLS;
                             } else {
                                 // arm_count[ARM_INSTRUCTION_SMMLA]+=1;//tianman
-                                return arm_instr_time[ARM_INSTRUCTION_SMMLA];
+                                return ARM_INSTRUCTION_SMMLA;
                             }
                         } else {
                             // arm_count[ARM_INSTRUCTION_SMMUL]+=1;//tianman
-                            return arm_instr_time[ARM_INSTRUCTION_SMMUL];
+                            return ARM_INSTRUCTION_SMMUL;
                         }
                     } else {
                         /* This addition cannot overflow.  */
@@ -2102,7 +2104,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             /* smlald, smlsld */
                             instr_index += ARM_INSTRUCTION_SMLALD; // tianman
                             // arm_count[instr_index]+=1;//tianman
-                            return arm_instr_time[instr_index];
+                            return instr_index;
                         } else {
                             /* smuad, smusd, smlad, smlsd */
                             rd = (insn >> 12) & 0xf;
@@ -2111,7 +2113,7 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                             }
                             instr_index += ARM_INSTRUCTION_SMUAD; // tianman
                             // arm_count[instr_index]+=1;//tianman
-                            return arm_instr_time[instr_index];
+                            return instr_index;
                         }
                     }
                     break;
@@ -2122,10 +2124,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                         rd = (insn >> 12) & 0xf;
                         if (rd != 15) {
                             // arm_count[ARM_INSTRUCTION_USADA8]+=1;//tianman
-                            return arm_instr_time[ARM_INSTRUCTION_USADA8];
+                            return ARM_INSTRUCTION_USADA8;
                         }
                         // arm_count[ARM_INSTRUCTION_USAD8]+=1;//tianman
-                        return arm_instr_time[ARM_INSTRUCTION_USAD8];
+                        return ARM_INSTRUCTION_USAD8;
                         break;
                     case 0x20:
                     case 0x24:
@@ -2166,19 +2168,19 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
                 /* load */
                 if (insn & (1 << 22)) {
                     // arm_count[ARM_INSTRUCTION_LDRB]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_LDRB];
+                    return ARM_INSTRUCTION_LDRB;
                 } else {
                     // arm_count[ARM_INSTRUCTION_LDR]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_LDR];
+                    return ARM_INSTRUCTION_LDR;
                 }
             } else {
                 /* store */
                 if (insn & (1 << 22)) {
                     // arm_count[ARM_INSTRUCTION_STRB]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_STRB];
+                    return ARM_INSTRUCTION_STRB;
                 } else {
                     // arm_count[ARM_INSTRUCTION_STR]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_STR];
+                    return ARM_INSTRUCTION_STR;
                 }
             }
             //				if (insn & (1 << 20)) {
@@ -2192,23 +2194,23 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             switch (insn & 0x00500000 >> 20) { // tianman
             case 0x0:
                 // arm_count[ARM_INSTRUCTION_STM1]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_STM1];
+                return ARM_INSTRUCTION_STM1;
                 break;
             case 0x1:
                 // arm_count[ARM_INSTRUCTION_LDM1]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_LDM1];
+                return ARM_INSTRUCTION_LDM1;
                 break;
             case 0x4:
                 // arm_count[ARM_INSTRUCTION_STM2]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_STM2];
+                return ARM_INSTRUCTION_STM2;
                 break;
             case 0x5:
                 if (insn & (1 << 15)) {
                     // arm_count[ARM_INSTRUCTION_LDM3]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_LDM3];
+                    return ARM_INSTRUCTION_LDM3;
                 } else {
                     // arm_count[ARM_INSTRUCTION_LDM2]+=1;//tianman
-                    return arm_instr_time[ARM_INSTRUCTION_LDM2];
+                    return ARM_INSTRUCTION_LDM2;
                 }
                 break;
             }
@@ -2309,10 +2311,10 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
             /* branch (and link) */
             if (insn & (1 << 24)) {
                 // arm_count[ARM_INSTRUCTION_B]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_B];
+                return ARM_INSTRUCTION_B;
             } else {
                 // arm_count[ARM_INSTRUCTION_B]+=1;//tianman
-                return arm_instr_time[ARM_INSTRUCTION_B];
+                return ARM_INSTRUCTION_B;
             }
 
         } break;
@@ -2321,12 +2323,12 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         case 0xe:
             /* Coprocessor.  */
             // arm_count[ARM_INSTRUCTION_COPROCESSOR]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_COPROCESSOR];
+            return ARM_INSTRUCTION_COPROCESSOR;
             break;
         case 0xf:
             /* swi */
             // arm_count[ARM_INSTRUCTION_SWI]+=1;//tianman
-            return arm_instr_time[ARM_INSTRUCTION_SWI];
+            return ARM_INSTRUCTION_SWI;
             break;
         default:
         illegal_op:
@@ -2340,7 +2342,24 @@ uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
         }
     }
     // if can't disdinguish the instruction then return 1
-    return 1;
+    return arm_decode::ARM_DECODE_ILLEGAL;
+}
+
+uint16_t CPU_CortexA9::Translation::_decode_arm_insn(uint32_t insn)
+{
+    if ((insn >> 28) != 0xf) {
+        uint16_t index = arm_decode::table[arm_decode::key_of(insn)];
+
+        if (index < arm_decode::ARM_DECODE_SLOW) return index;
+        if (index == arm_decode::ARM_DECODE_LDM_STM)
+            return arm_decode::decode_ldm_stm(insn);
+    }
+    return _decode_arm_insn_slow(insn);
+}
+
+uint32_t CPU_CortexA9::Translation::_get_arm_ticks(uint32_t insn)
+{
+    return arm_instr_time[_decode_arm_insn(insn)];
 }
 
 /* Implement by evo0209
@@ -3012,6 +3031,8 @@ void CPU_CortexA9::Translation::build(nlohmann::json config)
 
         arm_instr_time[get_index_of_arm_insn(key.c_str())] = value;
     }
+    // Instructions which are not recognized by the decoder take one tick
+    arm_instr_time[arm_decode::ARM_DECODE_ILLEGAL] = 1;
 }
 
 // TODO After removeing this from here to a separate module.
@@ -3019,11 +3040,13 @@ void CPU_CortexA9::Translation::build(nlohmann::json config)
 // We should count the instruction count in order to make time move.
 // And the final result of timing should subtract this value.
 //====================  VPMU Translation Instrumentation   ===================
-uint16_t CPU_CortexA9::Translation::get_arm_ticks(uint32_t insn)
+uint16_t CPU_CortexA9::Translation::get_arm_ticks(TBSummaryBuilder& tb_summary,
+                                                  uint32_t          insn)
 {
     uint16_t ticks = 0;
 
     ticks = _get_arm_ticks(insn);
+    _summarize_arm_insn(tb_summary, insn, ticks);
     // TODO FIXME
     if (cpu_model.dual_issue) {
         insn_buf[insn_buf_index] = insn;
@@ -3034,13 +3057,117 @@ uint16_t CPU_CortexA9::Translation::get_arm_ticks(uint32_t insn)
         }
     }
     // DBG("%u\n", ticks);
-    // ticks = get_insn_ticks(insn);
-    // Remove unused function warnig
-    (void)_get_insn_ticks(insn);
     return ticks;
 }
 
-uint16_t CPU_CortexA9::Translation::get_thumb_ticks(uint32_t insn)
+// Decode the operands of an ARM instruction for the per-TB summary.
+// Bits 0-15 of the masks are the general purpose registers, bit 16 is CPSR flags.
+// This is not a complete decoder. Instructions not listed here are considered as
+// ALU operations without register operands.
+void CPU_CortexA9::Translation::_summarize_arm_insn(TBSummaryBuilder& tb_summary,
+                                                    uint32_t          insn,
+                                                    uint16_t          latency)
+{
+    const uint64_t FLAGS = 1ULL << 16;
+    const uint64_t PC    = 1ULL << 15;
+    const uint64_t LR    = 1ULL << 14;
+
+    uint32_t     cond = insn >> 28;
+    uint32_t     op   = (insn >> 25) & 0x7;
+    uint64_t     rn   = 1ULL << ((insn >> 16) & 0xf);
+    uint64_t     rd   = 1ULL << ((insn >> 12) & 0xf);
+    uint64_t     rs   = 1ULL << ((insn >> 8) & 0xf);
+    uint64_t     rm   = 1ULL << (insn & 0xf);
+    uint64_t     src  = 0;
+    uint64_t     dst  = 0;
+    VPMU_FU_Type fu   = VPMU_FU_ALU;
+
+    if (cond == 0xf) {
+        // Unconditional instructions, e.g. PLD, BLX(imm), CPS
+        tb_summary.add_insn(fu, 0, 0, latency);
+        return;
+    }
+    // Conditional execution reads the flags
+    if (cond != 0xe) src |= FLAGS;
+
+    switch (op) {
+    case 0:
+    case 1:
+        if (op == 0 && (insn & 0x0fc000f0) == 0x00000090) {
+            // MUL, MLA
+            fu = VPMU_FU_MUL;
+            src |= rs | rm | ((insn & (1 << 21)) ? rd : 0);
+            dst |= rn;
+        } else if (op == 0 && (insn & 0x0f8000f0) == 0x00800090) {
+            // UMULL, UMLAL, SMULL, SMLAL
+            fu = VPMU_FU_MUL;
+            src |= rs | rm | ((insn & (1 << 21)) ? (rn | rd) : 0);
+            dst |= rn | rd;
+        } else if ((insn & 0x0fffffd0) == 0x012fff10) {
+            // BX, BLX(register)
+            fu = VPMU_FU_BRANCH;
+            src |= rm;
+            dst |= ((insn & (1 << 5)) ? LR : 0);
+        } else if (op == 0 && (insn & 0x90) == 0x90) {
+            // Extra load/store, e.g. LDRH, STRH, LDRD, SWP
+            bool load = insn & (1 << 20);
+            fu        = (load) ? VPMU_FU_LOAD : VPMU_FU_STORE;
+            src |= rn | ((insn & (1 << 22)) ? 0 : rm) | ((load) ? 0 : rd);
+            dst |= ((load) ? rd : 0);
+            // Write back the base register
+            if ((insn & (1 << 21)) || !(insn & (1 << 24))) dst |= rn;
+        } else {
+            // Data processing
+            uint32_t opcode = (insn >> 21) & 0xf;
+            if (opcode != 0xd && opcode != 0xf) src |= rn; // MOV, MVN
+            if (opcode < 0x8 || opcode > 0xb) dst |= rd;   // TST, TEQ, CMP, CMN
+            if (op == 0) src |= rm | ((insn & (1 << 4)) ? rs : 0);
+            if (opcode == 0x5 || opcode == 0x6 || opcode == 0x7) src |= FLAGS;
+            if (insn & (1 << 20)) dst |= FLAGS;
+        }
+        break;
+    case 2:
+    case 3:
+        if (op == 3 && (insn & (1 << 4))) {
+            // Media instructions
+            src |= rn | rm | rs;
+            dst |= rd;
+        } else {
+            // LDR, STR, LDRB, STRB
+            bool load = insn & (1 << 20);
+            fu        = (load) ? VPMU_FU_LOAD : VPMU_FU_STORE;
+            src |= rn | ((op == 3) ? rm : 0) | ((load) ? 0 : rd);
+            dst |= ((load) ? rd : 0);
+            if ((insn & (1 << 21)) || !(insn & (1 << 24))) dst |= rn;
+        }
+        break;
+    case 4: {
+        // LDM, STM
+        bool     load = insn & (1 << 20);
+        uint64_t list = insn & 0xffff;
+        fu            = (load) ? VPMU_FU_LOAD : VPMU_FU_STORE;
+        src |= rn | ((load) ? 0 : list);
+        dst |= ((load) ? list : 0) | ((insn & (1 << 21)) ? rn : 0);
+        break;
+    }
+    case 5:
+        // B, BL
+        fu = VPMU_FU_BRANCH;
+        if (insn & (1 << 24)) dst |= LR;
+        break;
+    default:
+        // Coprocessor instructions and SWI
+        fu = (insn & 0x0f000000) == 0x0f000000 ? VPMU_FU_BRANCH : VPMU_FU_FPU;
+        break;
+    }
+    // Writing PC is a branch
+    if (dst & PC) fu = VPMU_FU_BRANCH;
+
+    tb_summary.add_insn(fu, src, dst, latency);
+}
+
+uint16_t CPU_CortexA9::Translation::get_thumb_ticks(TBSummaryBuilder& tb_summary,
+                                                    uint32_t          insn)
 {
     uint16_t ticks = 0;
 
@@ -3050,14 +3177,17 @@ uint16_t CPU_CortexA9::Translation::get_thumb_ticks(uint32_t insn)
     /* TODO: branch counter for thumb mode */
 }
 
-uint16_t CPU_CortexA9::Translation::get_cp14_ticks(uint32_t insn)
+uint16_t CPU_CortexA9::Translation::get_cp14_ticks(TBSummaryBuilder& tb_summary,
+                                                   uint32_t          insn)
 {
     // TODO This is still not implemented yet
     return 1;
 }
 
 #ifdef CONFIG_VPMU_VFP
-uint16_t CPU_CortexA9::Translation::get_vfp_ticks(uint32_t insn, uint64_t vfp_vec_len)
+uint16_t CPU_CortexA9::Translation::get_vfp_ticks(TBSummaryBuilder& tb_summary,
+                                                  uint32_t          insn,
+                                                  uint64_t          vfp_vec_len)
 {
     uint16_t ticks = 0;
 
@@ -31,20 +31,26 @@ private: // VPMUARMTranslate
         } Model;
 
         void     build(nlohmann::json config);
-        uint16_t get_arm64_ticks(uint64_t insn) override
+        uint16_t get_arm64_ticks(TBSummaryBuilder& tb_summary, uint64_t insn) override
         {
             log_debug("ARM 64 is not supported yet");
             return 0;
         }
-        uint16_t get_arm_ticks(uint32_t insn) override;
-        uint16_t get_thumb_ticks(uint32_t insn) override;
-        uint16_t get_cp14_ticks(uint32_t insn) override;
+        uint16_t get_arm_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override;
+        uint16_t get_thumb_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override;
+        uint16_t get_cp14_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override;
 #ifdef CONFIG_VPMU_VFP
-        uint16_t get_vfp_ticks(uint32_t insn, uint64_t vfp_vec_len);
+        uint16_t get_vfp_ticks(TBSummaryBuilder& tb_summary,
+                               uint32_t          insn,
+                               uint64_t          vfp_vec_len) override;
 #endif
     private:
+        /// tests/bench-arm-decode.cc compares the table decoder with the slow one
+        friend class CortexA9DecodeBench;
+
         Model    cpu_model;
-        uint32_t arm_instr_time[ARM_INSTRUCTION_TOTAL_COUNTS];
+        // One more entry for the instructions not recognized by decoder
+        uint32_t arm_instr_time[ARM_INSTRUCTION_TOTAL_COUNTS + 1];
         uint64_t insn_buf[2]    = {0}; // For future 64 bits ARM insns
         uint8_t  insn_buf_index = 0;
         int      interlocks[16];
@@ -57,11 +63,16 @@ private: // VPMUARMTranslate
 #endif
 
         uint32_t _get_arm_ticks(uint32_t insn);
+        uint16_t _decode_arm_insn(uint32_t insn);
+        uint16_t _decode_arm_insn_slow(uint32_t insn);
         uint16_t _dual_issue_check();
         void     _interlock_def(int reg, int delay);
         int      _interlock_use(int reg);
         int      _get_insn_ticks(uint32_t insn);
         int      _get_insn_ticks_thumb(uint32_t insn);
+        void _summarize_arm_insn(TBSummaryBuilder& tb_summary,
+                                 uint32_t          insn,
+                                 uint16_t          latency);
 #ifdef CONFIG_VPMU_VFP
         void _vfp_lock_release(int insn);
         void _vfp_lock_analyze(int rd, int rn, int rm, int dp, int insn);
@@ -84,6 +95,7 @@ public: // VPMUSimulator
     RetStatus packet_processor(int id, const VPMU_Insn::Reference& ref) override;
 
 private:
+    friend class CortexA9DecodeBench;
 #ifdef CONFIG_VPMU_DEBUG_MSG
     /// The total number of packets counter for debugging
     uint64_t debug_packet_num_cnt = 0;
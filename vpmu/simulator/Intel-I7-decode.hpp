@@ -0,0 +1,355 @@
+#ifndef __CPU_INTEL_I7_DECODE_HPP_
+#define __CPU_INTEL_I7_DECODE_HPP_
+#pragma once
+
+extern "C" {
+#include "vpmu-i386-insnset.h" // Instruction Set
+}
+#include <cstdint> // uint16_t, uint32_t, uint64_t
+
+/// @brief Constexpr table of uop classes of x86 opcodes for the Intel-I7 model
+/// @details The table is indexed by the opcode passed from target/i386/translate.c,
+/// i.e. 0x00-0xff for one byte opcodes and 0x100-0x1ff for two bytes opcodes (0x0f xx).
+/// Each entry is an index of X86_Instructions (uop class), whose latency and
+/// throughput are patched from the json config at CPU_IntelI7::Translation::build().
+/// The group opcodes 0xf6/0xf7 and 0xff are marked and decoded with the reg field
+/// of ModRM by decode_group().
+namespace x86_decode
+{
+/// Group 3 (TEST/NOT/NEG/MUL/IMUL/DIV/IDIV) selected by ModRM.reg
+constexpr uint16_t X86_DECODE_GROUP3 = X86_INSTRUCTION_TOTAL_COUNTS;
+/// Group 5 (INC/DEC/CALL/JMP/PUSH) selected by ModRM.reg
+constexpr uint16_t X86_DECODE_GROUP5 = X86_INSTRUCTION_TOTAL_COUNTS + 1;
+
+constexpr uint32_t table_size = 0x200;
+
+/// Fields of the instruction packed by VPMU_X86_INSN()
+struct Insn {
+    constexpr Insn(uint64_t insn)
+        : opcode(insn & 0xffff)
+        , prefixes((insn >> 16) & 0xff)
+        , dflag((insn >> 24) & 0x3)
+        , rex_r((insn >> 26) & 0x1)
+        , rex_b((insn >> 27) & 0x1)
+        , modrm((insn >> 32) & 0xff)
+        , loads((insn >> 40) & 0xff)
+        , stores((insn >> 48) & 0xff)
+    {
+    }
+
+    uint32_t opcode;
+    uint32_t prefixes;
+    uint32_t dflag;
+    uint32_t rex_r;
+    uint32_t rex_b;
+    uint32_t modrm;
+    uint32_t loads;
+    uint32_t stores;
+};
+
+constexpr uint16_t decode_one_byte(uint32_t b)
+{
+    if (b < 0x40) {
+        // The arithmetic & logic instructions, and DAA/DAS/AAA/AAS
+        return X86_INSTRUCTION_ALU;
+    }
+    if (b < 0x50) return X86_INSTRUCTION_ALU; // INC/DEC (32 bits)
+    if (b < 0x58) return X86_INSTRUCTION_PUSH;
+    if (b < 0x60) return X86_INSTRUCTION_POP;
+    if (b >= 0x70 && b < 0x80) return X86_INSTRUCTION_BRANCH;
+    if (b >= 0x91 && b < 0x98) return X86_INSTRUCTION_MOV; // XCHG with eAX
+    if (b >= 0xb0 && b < 0xc0) return X86_INSTRUCTION_MOV;
+    if (b >= 0xd8 && b < 0xe0) return X86_INSTRUCTION_X87;
+
+    switch (b) {
+    case 0x60: // PUSHA
+    case 0x68:
+    case 0x6a:
+    case 0x9c: // PUSHF
+    case 0xc8: // ENTER
+        return X86_INSTRUCTION_PUSH;
+    case 0x61: // POPA
+    case 0x8f:
+    case 0x9d: // POPF
+    case 0xc9: // LEAVE
+        return X86_INSTRUCTION_POP;
+    case 0x63: // MOVSXD
+    case 0x88:
+    case 0x89:
+    case 0x8a:
+    case 0x8b:
+    case 0xa0:
+    case 0xa1:
+    case 0xa2:
+    case 0xa3:
+    case 0xc4: // LES
+    case 0xc5: // LDS
+    case 0xc6:
+    case 0xc7:
+    case 0xd7: // XLAT
+        return X86_INSTRUCTION_MOV;
+    case 0x69:
+    case 0x6b:
+        return X86_INSTRUCTION_IMUL;
+    case 0x80:
+    case 0x81:
+    case 0x82:
+    case 0x83:
+    case 0x84: // TEST
+    case 0x85:
+    case 0x86: // XCHG
+    case 0x87:
+    case 0x98: // CBW
+    case 0x99: // CWD
+    case 0x9e: // SAHF
+    case 0x9f: // LAHF
+    case 0xa8: // TEST
+    case 0xa9:
+    case 0xd4: // AAM
+    case 0xd5: // AAD
+    case 0xd6: // SALC
+    case 0xf5: // CMC
+    case 0xf8: // CLC
+    case 0xf9: // STC
+    case 0xfc: // CLD
+    case 0xfd: // STD
+    case 0xfe: // INC/DEC (8 bits)
+        return X86_INSTRUCTION_ALU;
+    case 0x8d:
+        return X86_INSTRUCTION_LEA;
+    case 0x90:
+        return X86_INSTRUCTION_NOP;
+    case 0x9a: // LCALL
+    case 0xe8:
+        return X86_INSTRUCTION_CALL;
+    case 0x9b: // FWAIT
+        return X86_INSTRUCTION_X87;
+    case 0xa4: // MOVS
+    case 0xa5:
+    case 0xa6: // CMPS
+    case 0xa7:
+    case 0xaa: // STOS
+    case 0xab:
+    case 0xac: // LODS
+    case 0xad:
+    case 0xae: // SCAS
+    case 0xaf:
+        return X86_INSTRUCTION_STRING;
+    case 0xc0:
+    case 0xc1:
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+        return X86_INSTRUCTION_SHIFT;
+    case 0xc2:
+    case 0xc3:
+    case 0xca: // LRET
+    case 0xcb:
+        return X86_INSTRUCTION_RET;
+    case 0xe0: // LOOPNZ
+    case 0xe1: // LOOPZ
+    case 0xe2: // LOOP
+    case 0xe3: // JCXZ
+    case 0xe9:
+    case 0xea: // LJMP
+    case 0xeb:
+        return X86_INSTRUCTION_BRANCH;
+    case 0xf6:
+    case 0xf7:
+        return X86_DECODE_GROUP3;
+    case 0xff:
+        return X86_DECODE_GROUP5;
+    case 0x62: // BOUND
+    case 0x6c: // INS/OUTS
+    case 0x6d:
+    case 0x6e:
+    case 0x6f:
+    case 0x8c: // MOV Sreg
+    case 0x8e:
+    case 0xcc: // INT3
+    case 0xcd: // INT
+    case 0xce: // INTO
+    case 0xcf: // IRET
+    case 0xe4: // IN/OUT
+    case 0xe5:
+    case 0xe6:
+    case 0xe7:
+    case 0xec:
+    case 0xed:
+    case 0xee:
+    case 0xef:
+    case 0xf1: // INT1
+    case 0xf4: // HLT
+    case 0xfa: // CLI
+    case 0xfb: // STI
+        return X86_INSTRUCTION_SYSTEM;
+    default:
+        return X86_INSTRUCTION_UNKNOWN;
+    }
+}
+
+constexpr uint16_t decode_sse(uint32_t b)
+{
+    switch (b) {
+    case 0x10: // MOVUPS, MOVSS, etc.
+    case 0x11:
+    case 0x12:
+    case 0x13:
+    case 0x14: // UNPCKLPS
+    case 0x15:
+    case 0x16:
+    case 0x17:
+    case 0x28: // MOVAPS
+    case 0x29:
+    case 0x2b: // MOVNTPS
+    case 0x50: // MOVMSKPS
+    case 0x6e: // MOVD
+    case 0x6f: // MOVQ
+    case 0x7e:
+    case 0x7f:
+    case 0xd6:
+    case 0xe7: // MOVNTQ
+    case 0xf7: // MASKMOVQ
+        return X86_INSTRUCTION_SSE_MOV;
+    case 0x51: // SQRTPS
+    case 0x5e: // DIVPS
+        return X86_INSTRUCTION_SSE_DIV;
+    case 0x59: // MULPS
+    case 0xd5: // PMULLW
+    case 0xe4: // PMULHUW
+    case 0xe5: // PMULHW
+    case 0xf4: // PMULUDQ
+    case 0xf5: // PMADDWD
+        return X86_INSTRUCTION_SSE_MUL;
+    case 0x77: // EMMS
+        return X86_INSTRUCTION_X87;
+    case 0x78: // VMREAD
+    case 0x79: // VMWRITE
+    case 0xff:
+        return X86_INSTRUCTION_UNKNOWN;
+    default:
+        return X86_INSTRUCTION_SSE_ALU;
+    }
+}
+
+constexpr uint16_t decode_two_bytes(uint32_t b)
+{
+    if (b < 0x0c) {
+        // SLDT, LGDT, LAR, LSL, SYSCALL, CLTS, SYSRET, INVD, WBINVD, UD2
+        return X86_INSTRUCTION_SYSTEM;
+    }
+    if (b >= 0x18 && b < 0x20) return X86_INSTRUCTION_NOP; // Hints, NOP Ev
+    if (b >= 0x20 && b < 0x28) return X86_INSTRUCTION_SYSTEM; // MOV CRn/DRn
+    if (b >= 0x30 && b < 0x38) return X86_INSTRUCTION_SYSTEM; // RDTSC, RDMSR, etc.
+    if (b >= 0x40 && b < 0x50) return X86_INSTRUCTION_ALU;    // CMOVcc
+    if (b >= 0x80 && b < 0x90) return X86_INSTRUCTION_BRANCH; // Jcc
+    if (b >= 0x90 && b < 0xa0) return X86_INSTRUCTION_ALU;    // SETcc
+    if (b >= 0xc8 && b < 0xd0) return X86_INSTRUCTION_ALU;    // BSWAP
+
+    switch (b) {
+    case 0x0d: // PREFETCH
+        return X86_INSTRUCTION_NOP;
+    case 0x0e: // FEMMS
+        return X86_INSTRUCTION_X87;
+    case 0x0f: // 3DNow!
+    case 0x2a: // CVTPI2PS
+    case 0x2c:
+    case 0x2d:
+    case 0x2e: // UCOMISS
+    case 0x2f:
+    case 0x38: // Three bytes opcodes
+    case 0x3a:
+        return X86_INSTRUCTION_SSE_ALU;
+    case 0xa0: // PUSH FS
+    case 0xa8: // PUSH GS
+        return X86_INSTRUCTION_PUSH;
+    case 0xa1: // POP FS
+    case 0xa9: // POP GS
+        return X86_INSTRUCTION_POP;
+    case 0xa2: // CPUID
+    case 0xae: // FXSAVE, LFENCE, MFENCE, CLFLUSH, etc.
+        return X86_INSTRUCTION_SYSTEM;
+    case 0xa3: // BT
+    case 0xab: // BTS
+    case 0xb0: // CMPXCHG
+    case 0xb1:
+    case 0xb3: // BTR
+    case 0xb8: // POPCNT
+    case 0xba: // BT group
+    case 0xbb: // BTC
+    case 0xbc: // BSF, TZCNT
+    case 0xbd: // BSR, LZCNT
+    case 0xc0: // XADD
+    case 0xc1:
+    case 0xc7: // CMPXCHG8B, RDRAND
+        return X86_INSTRUCTION_ALU;
+    case 0xa4: // SHLD
+    case 0xa5:
+    case 0xac: // SHRD
+    case 0xad:
+        return X86_INSTRUCTION_SHIFT;
+    case 0xaf:
+        return X86_INSTRUCTION_IMUL;
+    case 0xb2: // LSS
+    case 0xb4: // LFS
+    case 0xb5: // LGS
+    case 0xb6: // MOVZX
+    case 0xb7:
+    case 0xbe: // MOVSX
+    case 0xbf:
+    case 0xc3: // MOVNTI
+        return X86_INSTRUCTION_MOV;
+    default:
+        if ((b >= 0x10 && b < 0x18) || (b >= 0x28 && b < 0x30) || b >= 0x50) {
+            return decode_sse(b);
+        }
+        return X86_INSTRUCTION_UNKNOWN;
+    }
+}
+
+constexpr uint16_t decode_opcode(uint32_t opcode)
+{
+    return (opcode < 0x100) ? decode_one_byte(opcode) : decode_two_bytes(opcode & 0xff);
+}
+
+/// The group opcodes with the reg field of ModRM
+inline uint16_t decode_group(uint16_t index, uint32_t modrm)
+{
+    uint32_t op = (modrm >> 3) & 0x7;
+
+    if (index == X86_DECODE_GROUP3) {
+        if (op < 4) return X86_INSTRUCTION_ALU;  // TEST, NOT, NEG
+        if (op < 6) return X86_INSTRUCTION_MUL;  // MUL, IMUL (one operand)
+        return X86_INSTRUCTION_DIV;              // DIV, IDIV
+    }
+    // Group 5
+    if (op < 2) return X86_INSTRUCTION_ALU;      // INC, DEC
+    if (op < 4) return X86_INSTRUCTION_CALL;     // CALL, LCALL
+    if (op < 6) return X86_INSTRUCTION_BRANCH;   // JMP, LJMP
+    if (op == 6) return X86_INSTRUCTION_PUSH;
+    return X86_INSTRUCTION_UNKNOWN;
+}
+
+class DecodeTable
+{
+public:
+    constexpr DecodeTable() : index()
+    {
+        for (uint32_t opcode = 0; opcode < table_size; opcode++) {
+            index[opcode] = decode_opcode(opcode);
+        }
+    }
+
+    constexpr uint16_t operator[](uint32_t opcode) const { return index[opcode]; }
+
+private:
+    uint16_t index[table_size];
+};
+
+/// The table is generated at compile time
+constexpr DecodeTable table = {};
+
+} // End of namespace x86_decode
+
+#endif
@@ -5,25 +5,10 @@ extern "C" {
 
 #include "vpmu.hpp" // VPMU common headers
 #include "Intel-I7.hpp"
+#include "Intel-I7-decode.hpp"
 #include "vpmu-utils.hpp"
 #include "vpmu-template-output.hpp"
 
-// Compute the number of cycles that this instruction will take,
-// not including any I-cache or D-cache misses. This function
-// is called for each instruction in a basic block when that
-// block is being translated.
-// VPMU CORE
-int CPU_IntelI7::Translation::_get_insn_ticks(uint32_t insn)
-{
-    int result = 1; /* by default, use 1 cycle */
-    return result;
-}
-
-uint32_t CPU_IntelI7::Translation::_get_x86_64_ticks(uint64_t insn)
-{
-    return 1;
-}
-
 VPMU_Insn::Model CPU_IntelI7::build(void)
 {
     log_debug("Initializing");
@@ -135,15 +120,30 @@ void CPU_IntelI7::Translation::build(nlohmann::json config)
     cpu_model.frequency  = vpmu::utils::get_json<int>(config, "frequency");
     cpu_model.dual_issue = vpmu::utils::get_json<bool>(config, "dual_issue");
 
+    issue_width = vpmu::utils::get_json<uint32_t>(config, "issue width", 4);
+    if (issue_width == 0) LOG_FATAL("\"issue width\" must be greater than zero");
+
+    // The uop classes not listed in the config take one cycle
+    for (int i = 0; i < X86_INSTRUCTION_TOTAL_COUNTS + 1; i++) {
+        x86_instr_time[i]       = 1;
+        x86_recip_throughput[i] = fixed_one;
+    }
+    // The latency of each uop class
     nlohmann::json root = config["instruction"];
-    // TODO move this to CPU model
     for (nlohmann::json::iterator it = root.begin(); it != root.end(); ++it) {
-        // Skip the attribute next
         std::string key   = it.key();
         uint32_t    value = it.value();
 
         x86_instr_time[get_index_of_x86_insn(key.c_str())] = value;
     }
+    // The reciprocal throughput (cycles per instruction) of each uop class
+    root = config["throughput"];
+    for (nlohmann::json::iterator it = root.begin(); it != root.end(); ++it) {
+        std::string key   = it.key();
+        double      value = it.value();
+
+        x86_recip_throughput[get_index_of_x86_insn(key.c_str())] = value * fixed_one;
+    }
 }
 
 // TODO After removeing this from here to a separate module.
@@ -151,23 +151,127 @@ void CPU_IntelI7::Translation::build(nlohmann::json config)
 // We should count the instruction count in order to make time move.
 // And the final result of timing should subtract this value.
 //====================  VPMU Translation Instrumentation   ===================
-uint16_t CPU_IntelI7::Translation::get_x86_64_ticks(uint64_t insn)
+// The ticks of an instruction are its share of the issue cycles of the TB, which is
+// bounded by the throughput of its uop class, of its memory uops and by the issue
+// width. The fractions are carried to the next instruction, so the ticks of a TB
+// are the rounded up sum of reciprocal throughputs. The latencies are used for the
+// dependency summary of the TB.
+uint16_t CPU_IntelI7::Translation::get_x86_64_ticks(TBSummaryBuilder& tb_summary,
+                                                    uint64_t          insn)
+{
+    x86_decode::Insn i(insn);
+    uint16_t         index = x86_decode::table[i.opcode & (x86_decode::table_size - 1)];
+
+    if (index >= X86_INSTRUCTION_TOTAL_COUNTS)
+        index = x86_decode::decode_group(index, i.modrm);
+
+    uint32_t uops = 1 + i.loads + i.stores;
+    uint32_t cost = x86_recip_throughput[index];
+    if (cost < i.loads * x86_recip_throughput[X86_INSTRUCTION_LOAD])
+        cost = i.loads * x86_recip_throughput[X86_INSTRUCTION_LOAD];
+    if (cost < i.stores * x86_recip_throughput[X86_INSTRUCTION_STORE])
+        cost = i.stores * x86_recip_throughput[X86_INSTRUCTION_STORE];
+    if (cost < uops * fixed_one / issue_width) cost = uops * fixed_one / issue_width;
+
+    uint32_t& issue_cycles = tb_summary.state.issue_cycles;
+    uint32_t  last         = issue_cycles / fixed_one;
+    issue_cycles += cost;
+
+    uint32_t latency = x86_instr_time[index];
+    if (i.loads) latency += x86_instr_time[X86_INSTRUCTION_LOAD];
+    _summarize_x86_insn(tb_summary, insn, index, latency);
+
+    return issue_cycles / fixed_one - last;
+}
+
+// Decode the operands of an instruction for the per-TB summary.
+// Bits 0-15 of the masks are the general purpose registers, bit 16 is EFLAGS.
+// Only the common instructions with a ModRM operand are decoded. The others are
+// considered to depend on all former instructions.
+void CPU_IntelI7::Translation::_summarize_x86_insn(TBSummaryBuilder& tb_summary,
+                                                    uint64_t          insn,
+                                                    uint16_t          index,
+                                                    uint16_t          latency)
 {
-    uint16_t ticks = 0;
-
-    ticks = _get_x86_64_ticks(insn);
-    // TODO FIXME
-    // if (cpu_model.dual_issue) {
-    //     insn_buf[insn_buf_index] = insn;
-    //     insn_buf_index++;
-    //     if (insn_buf_index == 2) {
-    //         ticks -= _dual_issue_check();
-    //         insn_buf_index = 0;
-    //     }
-    // }
-    // DBG("%u\n", ticks);
-    // ticks = get_insn_ticks(insn);
-    // Remove unused function warnig
-    (void)_get_insn_ticks(insn);
-    return ticks;
+    const uint64_t FLAGS = 1ULL << 16;
+    const uint64_t GPRS  = 0xffff;
+
+    x86_decode::Insn i(insn);
+    uint32_t         b    = i.opcode;
+    uint32_t         mod  = i.modrm >> 6;
+    uint32_t         rm   = (i.modrm & 7) | (i.rex_b << 3);
+    uint64_t         reg  = 1ULL << (((i.modrm >> 3) & 7) | (i.rex_r << 3));
+    uint64_t         src  = TBSummaryBuilder::all_regs;
+    uint64_t         dst  = TBSummaryBuilder::all_regs;
+    VPMU_FU_Type     fu   = VPMU_FU_ALU;
+    uint64_t         rmm  = 0;
+
+    if (mod == 3) {
+        rmm = 1ULL << rm;
+    } else if ((i.modrm & 7) == 4) {
+        rmm = GPRS; // The base and index in SIB byte are unknown
+    } else if (!(mod == 0 && (i.modrm & 7) == 5)) {
+        rmm = 1ULL << rm; // The base register, not RIP/disp32
+    }
+
+    if (b < 0x40 && (b & 7) < 4) {
+        // ADD, OR, ADC, SBB, AND, SUB, XOR, CMP with ModRM
+        uint32_t op = (b >> 3) & 7;
+        bool     to_reg = b & 2;
+
+        src = reg | rmm | ((op == 2 || op == 3) ? FLAGS : 0);
+        dst = FLAGS;
+        if (op != 7) dst |= (to_reg) ? reg : ((mod == 3) ? rmm : 0);
+        // Zeroing idioms, e.g. XOR eax, eax
+        if ((op == 5 || op == 6) && mod == 3 && reg == rmm) src = 0;
+    } else if (b == 0x84 || b == 0x85) {
+        // TEST
+        src = reg | rmm;
+        dst = FLAGS;
+    } else if (b >= 0x88 && b <= 0x8b) {
+        // MOV
+        bool to_reg = b & 2;
+
+        src = (to_reg) ? rmm : (reg | ((mod == 3) ? 0 : rmm));
+        dst = (to_reg) ? reg : ((mod == 3) ? rmm : 0);
+    } else if (b == 0x8d || b == 0x63 || b == 0x1b6 || b == 0x1b7 || b == 0x1be
+               || b == 0x1bf) {
+        // LEA, MOVSXD, MOVZX, MOVSX
+        src = rmm;
+        dst = reg;
+    } else if (b == 0x1af) {
+        // IMUL Gv, Ev
+        src = reg | rmm;
+        dst = reg | FLAGS;
+    } else if (b >= 0x140 && b < 0x150) {
+        // CMOVcc
+        src = reg | rmm | FLAGS;
+        dst = reg;
+    }
+
+    switch (index) {
+    case X86_INSTRUCTION_IMUL:
+    case X86_INSTRUCTION_MUL:
+    case X86_INSTRUCTION_DIV:
+        fu = VPMU_FU_MUL;
+        break;
+    case X86_INSTRUCTION_BRANCH:
+    case X86_INSTRUCTION_CALL:
+    case X86_INSTRUCTION_RET:
+        fu = VPMU_FU_BRANCH;
+        break;
+    case X86_INSTRUCTION_X87:
+    case X86_INSTRUCTION_SSE_ALU:
+    case X86_INSTRUCTION_SSE_MUL:
+    case X86_INSTRUCTION_SSE_DIV:
+    case X86_INSTRUCTION_SSE_MOV:
+        fu = VPMU_FU_FPU;
+        break;
+    default:
+        // Moving data from/to memory uses the load/store units
+        if (i.loads) fu = VPMU_FU_LOAD;
+        else if (i.stores) fu = VPMU_FU_STORE;
+        break;
+    }
+    tb_summary.add_insn(fu, src, dst, latency);
 }
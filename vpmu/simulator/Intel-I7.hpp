@@ -23,18 +23,34 @@ private: // VPMUi386Translate
         } Model;
 
         void     build(nlohmann::json config);
-        uint16_t get_x86_64_ticks(uint64_t insn) override;
-        uint16_t get_i386_ticks(uint32_t insn) override
+        uint16_t get_x86_64_ticks(TBSummaryBuilder& tb_summary, uint64_t insn) override;
+        uint16_t get_i386_ticks(TBSummaryBuilder& tb_summary, uint32_t insn) override
         {
             log_debug("X86 32-bit is not supported yet");
             return 0;
         }
 
+        void begin_tb_summary(TBSummaryBuilder& tb_summary) override
+        {
+            tb_summary.reset();
+            // Round up the issue cycles of a TB
+            tb_summary.state.issue_cycles = fixed_one - 1;
+        }
+
     private:
+        /// Reciprocal throughputs are fixed point numbers in 1/256 cycles
+        static constexpr uint32_t fixed_one = 256;
+
         Model    cpu_model;
-        uint32_t x86_instr_time[X86_INSTRUCTION_TOTAL_COUNTS];
-        uint32_t _get_x86_64_ticks(uint64_t insn);
-        int      _get_insn_ticks(uint32_t insn);
+        // One more entry for the unknown names in json config
+        uint32_t x86_instr_time[X86_INSTRUCTION_TOTAL_COUNTS + 1];
+        uint32_t x86_recip_throughput[X86_INSTRUCTION_TOTAL_COUNTS + 1];
+        uint32_t issue_width = 4;
+
+        void _summarize_x86_insn(TBSummaryBuilder& tb_summary,
+                                 uint64_t          insn,
+                                 uint16_t          index,
+                                 uint16_t          latency);
     }; // End of class Translation
 
 public: // VPMUSimulator
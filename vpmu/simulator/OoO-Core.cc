@@ -0,0 +1,224 @@
+#include "vpmu.hpp" // VPMU common headers
+#include "OoO-Core.hpp"
+#include "vpmu-utils.hpp"
+#include "vpmu-template-output.hpp"
+#include "vpmu-cache.hpp" // vpmu_cache_stream
+
+VPMU_Insn::Model CPU_OoOCore::build(void)
+{
+    log_debug("Initializing");
+
+    log_debug(json_config.dump().c_str());
+
+    // The frontend shares the same configuration, e.g. the instruction latencies
+    frontend->set_platform_info(platform_info);
+    frontend->bind(json_config);
+    insn_model = frontend->build();
+
+    rob_size       = vpmu::utils::get_json<uint32_t>(json_config, "rob size", 128);
+    dispatch_width = vpmu::utils::get_json<uint32_t>(json_config, "dispatch width", 4);
+    bht_size       = vpmu::utils::get_json<uint32_t>(json_config, "bht size", 4096);
+    miss_interval =
+      vpmu::utils::get_json<uint32_t>(json_config, "miss feedback interval", 256);
+    if (rob_size == 0 || dispatch_width == 0) {
+        LOG_FATAL("\"rob size\" and \"dispatch width\" must be greater than zero");
+    }
+    if (bht_size == 0 || (bht_size & (bht_size - 1)) != 0) {
+        LOG_FATAL("\"bht size\" must be a power of 2");
+    }
+    if (json_config["fu ports"] != nullptr) {
+        const char* fu_names[VPMU_FU_TOTAL] = {
+          "alu", "mul", "load", "store", "branch", "fpu"};
+        for (int i = 0; i < VPMU_FU_TOTAL; i++) {
+            fu_ports[i] =
+              vpmu::utils::get_json<uint32_t>(json_config["fu ports"], fu_names[i], 1);
+            if (fu_ports[i] == 0) LOG_FATAL("Number of \"%s\" ports is 0", fu_names[i]);
+        }
+    }
+
+    reset();
+    log_debug("Initialized");
+    return insn_model;
+}
+
+CPU_OoOCore::RetStatus CPU_OoOCore::packet_processor(int                         id,
+                                                     const VPMU_Insn::Reference& ref)
+{
+    VPMU_Insn::DataCell cell;
+
+#ifdef CONFIG_VPMU_DEBUG_MSG
+    debug_packet_num_cnt++;
+    if (ref.type == VPMU_PACKET_DUMP_INFO) {
+        CONSOLE_LOG("    %'" PRIu64 " packets received\n", debug_packet_num_cnt);
+        debug_packet_num_cnt = 0;
+    }
+#endif
+
+    switch (ref.type) {
+    case VPMU_PACKET_BARRIER:
+    case VPMU_PACKET_SYNC_DATA:
+        return insn_data;
+        break;
+    case VPMU_PACKET_DUMP_INFO:
+        CONSOLE_LOG("  [%d] type : Out-of-order (ROB %u, width %u)\n",
+                    id,
+                    rob_size,
+                    dispatch_width);
+        vpmu::output::CPU_counters(insn_model, insn_data);
+        cell = insn_data.sum_all_mode();
+        for (int i = 0; i < platform_info.cpu.cores; i++) {
+            CONSOLE_LOG("    core %d: %'" PRIu64 " window drains, %'" PRIu64
+                        " ROB full stalls, %'" PRIu64 " cache miss cycles\n",
+                        i,
+                        core_state[i].mispredicts,
+                        core_state[i].rob_stalls,
+                        cell.cache_cycles[i]);
+        }
+
+        break;
+    case VPMU_PACKET_RESET:
+        reset();
+        break;
+    case VPMU_PACKET_DATA:
+        accumulate(ref);
+        break;
+    default:
+        LOG_FATAL("Unexpected packet");
+    }
+
+    return insn_data;
+}
+
+void CPU_OoOCore::reset(void)
+{
+    memset(&insn_data, 0, sizeof(VPMU_Insn::Data));
+    for (auto& s : core_state) {
+        s     = {};
+        s.bht = std::vector<uint8_t>(bht_size, 1); // Weakly not taken
+    }
+    tb_since_fetch    = 0;
+    has_miss_baseline = false;
+}
+
+void CPU_OoOCore::fetch_miss_cycles(void)
+{
+    uint64_t miss_cycles[VPMU_MAX_CPU_CORES] = {};
+
+    tb_since_fetch  = 0;
+    max_miss_cycles = vpmu_cache_stream.get_max_miss_cycles(0);
+    vpmu_cache_stream.get_miss_cycles(0, miss_cycles);
+    for (int i = 0; i < platform_info.cpu.cores; i++) {
+        CoreState& s = core_state[i];
+        // The counters of cache stream go backward when it is reset after this model
+        if (has_miss_baseline && miss_cycles[i] > s.miss_cycles_seen) {
+            s.miss_cycles_pending += miss_cycles[i] - s.miss_cycles_seen;
+        }
+        s.miss_cycles_seen = miss_cycles[i];
+    }
+    has_miss_baseline = true;
+}
+
+void CPU_OoOCore::resolve_branch(CoreState& s, uint64_t start_addr)
+{
+    if (!s.last_has_branch) return;
+
+    // The outcome is known from the TB executed right after the branch
+    bool     taken     = (start_addr != s.last_fallthrough);
+    uint8_t& counter   = s.bht[(s.last_start_addr >> 1) & (bht_size - 1)];
+    bool     predicted = (counter >= 2);
+
+    if (taken && counter < 3) counter++;
+    if (!taken && counter > 0) counter--;
+
+    if (predicted != taken) {
+        // Nothing new enters the window until the branch is resolved.
+        // The refill of frontend is accounted by the branch stream.
+        s.mispredicts++;
+        if (s.dispatch_cycle < s.last_complete_cycle) {
+            s.dispatch_cycle = s.last_complete_cycle;
+        }
+    }
+}
+
+void CPU_OoOCore::accumulate(const VPMU_Insn::Reference& ref)
+{
+    VPMU_Insn::DataCell* cell = nullptr;
+    const ExtraTBInfo*   tb   = ref.tb_counters_ptr;
+    CoreState&           s    = core_state[ref.core];
+    // Defining the types (struct) for communication
+    enum CPU_MODE { // Copy from QEMU cpu.h
+        USR = 0x10,
+        SVC = 0x13,
+    };
+
+    if (ref.mode == USR) {
+        cell = &insn_data.user;
+    } else {
+        cell = &insn_data.system;
+    }
+    cell->total_insn[ref.core] += tb->counters.total;
+    cell->load[ref.core] += tb->counters.load;
+    cell->store[ref.core] += tb->counters.store;
+    cell->branch[ref.core] += tb->has_branch;
+
+    const TB_Summary& summary       = tb->summary;
+    uint32_t          num_insn      = tb->counters.total;
+    uint64_t          dispatch_time = (num_insn + dispatch_width - 1) / dispatch_width;
+    // Fallback to the serialized ticks when the frontend provides no summary
+    uint64_t exec_time = (summary.critical_path) ? summary.critical_path : tb->ticks;
+    for (int i = 0; i < VPMU_FU_TOTAL; i++) {
+        uint64_t t = (summary.fu_count[i] + fu_ports[i] - 1) / fu_ports[i];
+        if (exec_time < t) exec_time = t;
+    }
+    if (exec_time < dispatch_time) exec_time = dispatch_time;
+
+    resolve_branch(s, tb->start_addr);
+
+    if (miss_interval != 0 && ++tb_since_fetch >= miss_interval) fetch_miss_cycles();
+    // The pending misses delay the memory accesses of this TB
+    uint64_t num_access = tb->counters.load + tb->counters.store;
+    uint64_t miss       = std::min(s.miss_cycles_pending, num_access * max_miss_cycles);
+    s.miss_cycles_pending -= miss;
+    cell->cache_cycles[ref.core] += miss;
+
+    // Retire the TBs which are done before this TB enters the window
+    while (!s.rob.empty() && s.rob.front().complete_cycle <= s.dispatch_cycle) {
+        s.rob_occupancy -= s.rob.front().num_insn;
+        s.rob.pop_front();
+    }
+    // Stall dispatching until there are enough free entries in ROB
+    if (!s.rob.empty() && s.rob_occupancy + num_insn > rob_size) s.rob_stalls++;
+    while (!s.rob.empty() && s.rob_occupancy + num_insn > rob_size) {
+        if (s.dispatch_cycle < s.rob.front().complete_cycle) {
+            s.dispatch_cycle = s.rob.front().complete_cycle;
+        }
+        s.rob_occupancy -= s.rob.front().num_insn;
+        s.rob.pop_front();
+    }
+
+    uint64_t start_cycle = s.dispatch_cycle;
+    s.dispatch_cycle += dispatch_time;
+    // Wait for the registers produced by former TBs
+    for (uint64_t m = summary.live_in; m; m &= m - 1) {
+        int r = __builtin_ctzll(m);
+        if (start_cycle < s.reg_ready[r]) start_cycle = s.reg_ready[r];
+    }
+    uint64_t complete = start_cycle + exec_time + miss;
+    for (uint64_t m = summary.live_out; m; m &= m - 1) {
+        s.reg_ready[__builtin_ctzll(m)] = complete;
+    }
+    // Retire in order
+    if (complete < s.retire_cycle) complete = s.retire_cycle;
+    s.retire_cycle = complete;
+    s.rob.push_back({num_insn, complete});
+    s.rob_occupancy += num_insn;
+
+    s.last_has_branch     = tb->has_branch;
+    s.last_start_addr     = tb->start_addr;
+    s.last_fallthrough    = tb->start_addr + tb->counters.size_bytes;
+    s.last_complete_cycle = complete;
+
+    // Cycles are accounted when TBs retire
+    cell->cycles[ref.core] += s.retire_cycle - s.accounted_cycle;
+    s.accounted_cycle = s.retire_cycle;
+}
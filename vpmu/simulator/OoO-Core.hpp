@@ -0,0 +1,134 @@
+#ifndef __CPU_OOO_CORE_HPP_
+#define __CPU_OOO_CORE_HPP_
+#pragma once
+
+extern "C" {
+#include "vpmu-qemu.h" // ExtraTBInfo
+}
+#include <deque>                // std::deque
+#include <vector>               // std::vector
+#include <memory>               // std::unique_ptr
+#include "vpmu-sim.hpp"         // VPMUSimulator
+#include "vpmu-translate.hpp"   // VPMUArchTranslate
+#include "vpmu-insn-packet.hpp" // VPMU_Insn
+
+/// @brief Out-of-order core timing simulator based on ROB occupancy
+/// @details Instead of summing up the static latencies of instructions, this model
+/// tracks the occupancy of the re-order buffer (ROB) at the granularity of TBs.
+/// A TB is dispatched at most "dispatch width" instructions per cycle, executes in
+/// its critical-path length and retires in order. Consecutive TBs overlap as long as
+/// there is room in the ROB, which is where the ILP of an OoO core comes from.
+///
+/// The per-instruction latencies and the TB summaries are still computed at
+/// translation time by an in-order frontend model (e.g. CPU_IntelI7), so the cost
+/// of this model is per TB, not per instruction. The execution time of a TB is
+/// bounded by its critical path and by the number of functional units, and it
+/// cannot start before the registers it reads (live-ins) are produced.
+///
+/// Miss events are combined as in interval analysis. A mispredicted branch at the
+/// end of a TB blocks dispatching until it is resolved (window drain). The refill
+/// of the frontend is still reported by the branch stream.
+///
+/// The cache stream runs on another thread, so the misses of a TB are not known when
+/// it is dispatched. Every "miss feedback interval" TBs, the miss penalties of each
+/// core are read from the latest synced counters of the cache stream and become
+/// pending. They are then charged to the following TBs with memory accesses, at most
+/// one full miss (all levels) per access. A charged TB completes later, so the TBs
+/// after it fill the ROB and overlap with the miss until the ROB is full. The charged
+/// penalties are counted in VPMU_Insn::DataCell::cache_cycles and are not added to
+/// the total time again by vpmu::target::cache_cycles().
+///
+/// Besides the configurations of the frontend model, the following optional fields
+/// are read from the json config: "rob size", "dispatch width", "bht size",
+/// "miss feedback interval" (0 disables it) and "fu ports" (an object with keys
+/// "alu", "mul", "load", "store", "branch", "fpu").
+class CPU_OoOCore : public VPMUSimulator<VPMU_Insn>
+{
+public:
+    using Frontend_ptr = std::unique_ptr<VPMUSimulator<VPMU_Insn>>;
+
+    /// @brief Construct with an in-order CPU model used as the translation frontend.
+    CPU_OoOCore(Frontend_ptr&& f) : VPMUSimulator("OoOCore"), frontend(std::move(f)) {}
+    ~CPU_OoOCore() {}
+
+    /// The translator of the frontend is used in QEMU binary translation.
+    VPMUArchTranslate& get_translator_handle(void) override
+    {
+        return frontend->get_translator_handle();
+    }
+
+    void destroy(void) override { frontend->destroy(); }
+
+    VPMU_Insn::Model build(void) override;
+
+    RetStatus packet_processor(int id, const VPMU_Insn::Reference& ref) override;
+
+private:
+    /// A TB which is dispatched but not yet retired
+    struct InFlightTB {
+        uint32_t num_insn;       ///< Number of ROB entries occupied by this TB
+        uint64_t complete_cycle; ///< The cycle when this TB retires
+    };
+
+    /// The pipeline states of a single core
+    struct CoreState {
+        uint64_t dispatch_cycle  = 0; ///< The cycle the next TB can start dispatching
+        uint64_t retire_cycle    = 0; ///< The cycle the youngest TB retires
+        uint64_t accounted_cycle = 0; ///< The cycles accumulated into insn_data
+        uint32_t rob_occupancy   = 0; ///< Number of instructions in ROB
+        uint64_t reg_ready[64]   = {}; ///< The cycle when a register is produced
+
+        std::deque<InFlightTB> rob = {};
+
+        // States of the previous TB, used to resolve its branch
+        bool     last_has_branch     = false;
+        uint64_t last_start_addr     = 0;
+        uint64_t last_fallthrough    = 0;
+        uint64_t last_complete_cycle = 0;
+
+        /// Two bits saturated counters indexed by the address of TB
+        std::vector<uint8_t> bht = {};
+
+        uint64_t miss_cycles_seen    = 0; ///< The miss penalties read from cache stream
+        uint64_t miss_cycles_pending = 0; ///< The miss penalties not charged to TBs yet
+
+        uint64_t mispredicts = 0;
+        uint64_t rob_stalls  = 0;
+    };
+
+#ifdef CONFIG_VPMU_DEBUG_MSG
+    /// The total number of packets counter for debugging
+    uint64_t debug_packet_num_cnt = 0;
+#endif
+    /// Rename platform_info. The CPU configurations for timing model
+    using VPMUSimulator::platform_info;
+    /// The in-order CPU model providing translator and instruction latencies
+    Frontend_ptr frontend;
+    // The data stored in this simulator
+    VPMU_Insn::Data insn_data = {};
+    // The model stored in this simulator
+    VPMU_Insn::Model insn_model = {};
+
+    // Configurations of the OoO pipeline
+    uint32_t rob_size                = 128;
+    uint32_t dispatch_width          = 4;
+    uint32_t bht_size                = 4096;
+    uint32_t miss_interval           = 256;
+    uint32_t fu_ports[VPMU_FU_TOTAL] = {3, 1, 2, 1, 1, 1};
+
+    CoreState core_state[VPMU_MAX_CPU_CORES];
+
+    /// The number of TBs since the miss penalties are read from cache stream
+    uint32_t tb_since_fetch = 0;
+    /// The penalty of an access missing all levels, the most charged to an access
+    uint64_t max_miss_cycles = 0;
+    /// False until the first read after a reset, which is the baseline of the misses
+    bool has_miss_baseline = false;
+
+    void reset(void);
+    void fetch_miss_cycles(void);
+    void resolve_branch(CoreState& s, uint64_t start_addr);
+    void accumulate(const VPMU_Insn::Reference& ref);
+};
+
+#endif
@@ -19,12 +19,81 @@
  * @see target-xxx/translate.c:gen_intermediate_code()
  */
 
+extern "C" {
+#include "vpmu-extratb.h" // TB_Summary, TB_SummaryState
+}
 #include <vector>       // std::vector
 #include <string>       // std::string
 #include <thread>       // std::thread
 #include "vpmu-log.hpp" // VPMULog
 #include "json.hpp"     // nlohmann::json
 
+/// @brief Accumulate the dependencies of instructions into a TB_Summary.
+/// @details Translators call add_insn() for every instruction they decode.
+/// The summary is reset when QEMU starts translating a TB and written back to
+/// ExtraTBInfo when the TB is done, so the cost is paid only once per TB.
+/// Each bit of the masks represents a register (or a flag) of the architecture.
+/// The builder is a view of the TB_SummaryState in the DisasContext of QEMU, which
+/// is passed to every call of the translator.
+class TBSummaryBuilder
+{
+public:
+    static constexpr int      max_regs = TB_SUMMARY_MAX_REGS;
+    static constexpr uint64_t all_regs = ~0ULL; ///< Use when operands are unknown
+
+    TBSummaryBuilder(TB_SummaryState &new_state) : state(new_state) {}
+
+    void reset(void) { state = {}; }
+
+    void add_insn(VPMU_FU_Type fu, uint64_t src_mask, uint64_t dst_mask, uint16_t latency)
+    {
+        TB_Summary &summary    = state.summary;
+        uint32_t    start      = 0;
+        uint16_t    load_depth = 0;
+
+        for (uint64_t m = src_mask; m; m &= m - 1) {
+            int r = __builtin_ctzll(m);
+            if (start < state.reg_ready[r]) start = state.reg_ready[r];
+            if (load_depth < state.reg_load_depth[r])
+                load_depth = state.reg_load_depth[r];
+        }
+        if (fu == VPMU_FU_LOAD) {
+            if (load_depth > 0) saturated_inc(summary.dependent_loads);
+            saturated_inc(load_depth);
+            if (summary.load_chain < load_depth) summary.load_chain = load_depth;
+        } else if (fu == VPMU_FU_STORE && load_depth > 0) {
+            saturated_inc(summary.dependent_stores);
+        }
+
+        uint32_t finish = saturated_add(start, (latency) ? latency : 1);
+        for (uint64_t m = dst_mask; m; m &= m - 1) {
+            int r                   = __builtin_ctzll(m);
+            state.reg_ready[r]      = finish;
+            state.reg_load_depth[r] = load_depth;
+        }
+        if (summary.critical_path < finish) summary.critical_path = finish;
+        saturated_inc(summary.fu_count[fu]);
+        summary.live_in |= src_mask & ~summary.live_out;
+        summary.live_out |= dst_mask;
+    }
+
+    void finalize(TB_Summary &out) { out = state.summary; }
+
+    /// The state of the TB being translated, the models keep their per-TB states here
+    TB_SummaryState &state;
+
+private:
+    inline void saturated_inc(uint16_t &v)
+    {
+        if (v < UINT16_MAX) v++;
+    }
+
+    inline uint32_t saturated_add(uint32_t a, uint32_t b)
+    {
+        return (a > UINT32_MAX - b) ? UINT32_MAX : a + b;
+    }
+};
+
 class VPMUARMTranslate : public VPMULog
 {
 public:
@@ -35,13 +104,39 @@ public:
     // VPMUStream is not copyable.
     VPMUARMTranslate(const VPMUARMTranslate &) = delete;
 
-    virtual uint16_t get_arm64_ticks(uint64_t insn) { return 0; }
-    virtual uint16_t get_arm_ticks(uint32_t insn) { return 0; }
-    virtual uint16_t get_thumb_ticks(uint32_t insn) { return 0; }
-    virtual uint16_t get_cp14_ticks(uint32_t insn) { return 0; }
+    // The summary of the TB being translated is passed to every call, the translator
+    // is shared by the vCPUs and keeps no state of a TB.
+    virtual uint16_t get_arm64_ticks(TBSummaryBuilder &tb_summary, uint64_t insn)
+    {
+        return 0;
+    }
+    virtual uint16_t get_arm_ticks(TBSummaryBuilder &tb_summary, uint32_t insn)
+    {
+        return 0;
+    }
+    virtual uint16_t get_thumb_ticks(TBSummaryBuilder &tb_summary, uint32_t insn)
+    {
+        return 0;
+    }
+    virtual uint16_t get_cp14_ticks(TBSummaryBuilder &tb_summary, uint32_t insn)
+    {
+        return 0;
+    }
 #ifdef CONFIG_VPMU_VFP
-    virtual uint16_t get_vfp_ticks(uint32_t insn, uint64_t vfp_vec_len) { return 0; }
+    virtual uint16_t
+    get_vfp_ticks(TBSummaryBuilder &tb_summary, uint32_t insn, uint64_t vfp_vec_len)
+    {
+        return 0;
+    }
 #endif
+
+    /// Called by QEMU before translating the first instruction of a TB.
+    virtual void begin_tb_summary(TBSummaryBuilder &tb_summary) { tb_summary.reset(); }
+    /// Called by QEMU after the last instruction of a TB is translated.
+    virtual void end_tb_summary(TBSummaryBuilder &tb_summary, TB_Summary &summary)
+    {
+        tb_summary.finalize(summary);
+    }
 };
 
 class VPMUi386Translate : public VPMULog
@@ -55,8 +150,24 @@ public:
     VPMUi386Translate(const VPMUi386Translate &) = delete;
 
     // TODO x86 models
-    virtual uint16_t get_x86_64_ticks(uint64_t insn) { return 0; }
-    virtual uint16_t get_i386_ticks(uint32_t insn) { return 0; }
+    // The summary of the TB being translated is passed to every call, the translator
+    // is shared by the vCPUs and keeps no state of a TB.
+    virtual uint16_t get_x86_64_ticks(TBSummaryBuilder &tb_summary, uint64_t insn)
+    {
+        return 0;
+    }
+    virtual uint16_t get_i386_ticks(TBSummaryBuilder &tb_summary, uint32_t insn)
+    {
+        return 0;
+    }
+
+    /// Called by QEMU before translating the first instruction of a TB.
+    virtual void begin_tb_summary(TBSummaryBuilder &tb_summary) { tb_summary.reset(); }
+    /// Called by QEMU after the last instruction of a TB is translated.
+    virtual void end_tb_summary(TBSummaryBuilder &tb_summary, TB_Summary &summary)
+    {
+        tb_summary.finalize(summary);
+    }
 };
 
 #if defined(TARGET_ARM)
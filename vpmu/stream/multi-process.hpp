@@ -23,6 +23,8 @@ private:
 
     using VPMUStream_Impl<T>::vpmu_stream;
     using VPMUStream_Impl<T>::num_workers;
+    using VPMUStream_Impl<T>::sync_history;
+    using VPMUStream_Impl<T>::sync_history_tag;
 
 public:
     using Reference = typename T::Reference;
@@ -45,8 +47,9 @@ public:
         shared_memory_object::remove("vpmu_cache_ring_buffer");
         shm = shared_memory_object(create_only, "vpmu_cache_ring_buffer", read_write);
 
-        // Set size
-        shm.truncate(sizeof(Layout));
+        // Set size, the history of the counters follows the layout
+        size_t history_offset = (sizeof(Layout) + 63) & ~(size_t)63;
+        shm.truncate(history_offset + this->history_size());
 
         // Map the whole shared memory in this process
         region = mapped_region(shm, read_write);
@@ -56,6 +59,7 @@ public:
         std::memset(region.get_address(), 0, region.get_size());
         // Initialize with constructor
         vpmu_stream = new (region.get_address()) Layout();
+        this->attach_history((char*)region.get_address() + history_offset);
 
         // Copy (by value) the CPU information to simulators
         vpmu_stream->platform_info = VPMU.platform;
@@ -84,7 +88,9 @@ public:
         boost::interprocess::shared_memory_object::remove("vpmu_cache_ring_buffer");
         if (vpmu_stream != nullptr) {
             // delete vpmu_stream;
-            vpmu_stream = nullptr;
+            vpmu_stream      = nullptr;
+            sync_history     = nullptr;
+            sync_history_tag = nullptr;
         }
     }
 
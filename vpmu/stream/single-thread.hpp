@@ -16,6 +16,8 @@ private:
 
     using VPMUStream_Impl<T>::vpmu_stream;
     using VPMUStream_Impl<T>::num_workers;
+    using VPMUStream_Impl<T>::sync_history;
+    using VPMUStream_Impl<T>::sync_history_tag;
 
 public:
     using Reference = typename T::Reference;
@@ -31,6 +33,10 @@ public:
     {
         if (vpmu_stream != nullptr) delete vpmu_stream;
         vpmu_stream = new Layout();
+        // The history of the counters is sized at run time
+        size_t words = (this->history_size() + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        history_buffer.reset(new uint64_t[words]);
+        this->attach_history(history_buffer.get());
 
         // Copy (by value) the CPU information to simulators
         vpmu_stream->platform_info = VPMU.platform;
@@ -53,6 +59,9 @@ public:
             delete vpmu_stream;
             vpmu_stream = nullptr;
         }
+        history_buffer.reset();
+        sync_history     = nullptr;
+        sync_history_tag = nullptr;
     }
 
     void run(std::vector<Sim_ptr>& works) override
@@ -100,6 +109,8 @@ public:
 
 private:
     std::thread slave;
+    // The memory of sync_history and sync_history_tag
+    std::unique_ptr<uint64_t[]> history_buffer;
 };
 
 #endif
@@ -2,8 +2,12 @@
 #define __VPMU_STREAM_IMPL_HPP_
 #pragma once
 
+#include <time.h>      // clock_gettime
+#include <errno.h>     // errno
 #include <signal.h>    // Signaling header
 #include <semaphore.h> // Semaphore related header
+#include <cstring>     // std::memset
+#include <new>         // Placement new
 
 extern "C" {
 #include "vpmu-qemu.h" // VPMUPlatformInfo
@@ -14,6 +18,9 @@ extern "C" {
 #include "variant.hpp"       // mpark::variant
 #include "variant-match.hpp" // mpark::match
 
+// The number of epochs kept in the history of each worker, see VPMU_SYNC_HISTORY_DEPTH
+extern uint32_t vpmu_sync_history_depth;
+
 template <typename T>
 class VPMUStream_Impl : public VPMULog
 {
@@ -53,9 +60,11 @@ public:
         static uint32_t cnt = 0;
         cnt++;
         if (cnt == 4) {
-            Reference barrier;
+            Reference      barrier;
+            CommandPacket* view = (CommandPacket*)(&barrier);
 
-            barrier.type = VPMU_PACKET_BARRIER;
+            view->type = VPMU_PACKET_BARRIER;
+            view->id   = 0; // Barriers do not cross any epoch
             send(barrier);
             cnt = 0;
         }
@@ -117,8 +126,11 @@ public:
 
     inline void send_sync_none_blocking(void)
     {
-        Reference ref;
-        ref.type = VPMU_PACKET_BARRIER;
+        Reference      ref;
+        CommandPacket* view = (CommandPacket*)(&ref);
+
+        view->type = VPMU_PACKET_BARRIER;
+        view->id   = 0; // Barriers do not cross any epoch
 
         // log_debug("sync none blocking");
         send(ref);
@@ -151,16 +163,44 @@ public:
     {
         if (vpmu_stream == nullptr) return;
         sem_init(&vpmu_stream->common[n].job_semaphore, process_shared, 0);
+        sem_init(&vpmu_stream->epoch_semaphore[n], process_shared, 0);
+        vpmu_stream->epoch_waiter[n] = 0;
     }
 
-    // Get the results from a timing simulator
-    inline Data get_data(int n, int idx = -1)
+    // Get the results from a timing simulator at the epoch, or the latest ones if the
+    // epoch is zero.
+    inline Data get_data(int n, uint64_t epoch = 0)
     {
-        if (pointer_safety_check(n) == false) return {};
-        if (idx < 0) idx = vpmu_stream->common[n].sync_counter % 32;
-        // return vpmu_stream->common[n].data;
-        return vpmu_stream->sync_data[n][idx];
+        Data out = {};
+
+        if (pointer_safety_check(n) == false) return out;
+        read_epoch_data(n, epoch, [&](const Data& data) { out = data; });
+        return out;
+    }
+
+    // Get the results of a single core from a timing simulator at the epoch.
+    // Only the counters of the core are copied, the others are left zero.
+    inline Data get_core_data(int n, int core, uint64_t epoch = 0)
+    {
+        Data out = {};
+
+        if (pointer_safety_check(n) == false) return out;
+        read_epoch_data(n, epoch, [&](const Data& data) { out.copy_core(data, core); });
+        return out;
+    }
+
+    // Run the reader on the latest counters of worker n in place, without copying
+    // them. The reader runs again if the worker publishes new ones meanwhile.
+    template <typename Func>
+    inline void read_latest_data(int n, Func&& reader)
+    {
+        if (pointer_safety_check(n) == false) return;
+        read_sync_data(n, [&]() { reader(vpmu_stream->sync_data[n]); });
     }
+
+    // The number of reads whose epochs are overwritten in the history
+    uint64_t get_num_missed_epochs(void) { return missed_epoch_cnt; }
+
     // Get model configuration back from timing a simulator
     Model get_model(int n)
     {
@@ -202,10 +242,49 @@ public:
         return false;
     }
 
+    // Block till all the workers publish their counters at the epoch, i.e. they have
+    // processed the sync packet of the epoch. The workers wake us up with
+    // epoch_semaphore.
+    bool wait_epoch(uint64_t epoch, uint64_t mili_sec)
+    {
+        if (vpmu_stream == nullptr) return true;
+
+        for (int n = 0; n < num_workers; n++) {
+            if (wait_worker_epoch(n, epoch, mili_sec) == false) return false;
+        }
+        return true;
+    }
+
 protected:
     Layout* vpmu_stream = nullptr;
     // Record how many workers in process
     uint32_t num_workers = 0;
+    // The counters of each worker at the last history_depth epochs, and the epoch
+    // tagging each slot. Slot i of worker n is at [n * history_depth + i].
+    Data*     sync_history     = nullptr;
+    uint64_t* sync_history_tag = nullptr;
+    // The depth of the history, fixed when the stream is built
+    uint32_t history_depth = 0;
+
+    // The size in bytes of the history of vpmu_sync_history_depth epochs
+    static size_t history_size(void)
+    {
+        return (size_t)VPMU_MAX_NUM_WORKERS * vpmu_sync_history_depth
+               * (sizeof(uint64_t) + sizeof(Data));
+    }
+
+    // Place the history in the memory of history_size() bytes, the tags come first
+    void attach_history(void* mem)
+    {
+        static_assert(alignof(Data) <= alignof(uint64_t), "Data is over-aligned");
+        size_t num_slots = (size_t)VPMU_MAX_NUM_WORKERS * vpmu_sync_history_depth;
+
+        history_depth    = vpmu_sync_history_depth;
+        sync_history_tag = (uint64_t*)mem;
+        sync_history     = (Data*)(sync_history_tag + num_slots);
+        std::memset(sync_history_tag, 0, num_slots * sizeof(uint64_t));
+        for (size_t i = 0; i < num_slots; i++) new (&sync_history[i]) Data();
+    }
 
     inline void do_tasks(Sim_ptr& sim, std::vector<Reference>& refs)
     {
@@ -213,23 +292,10 @@ protected:
 
         for (auto& ref : refs) {
             CommandPacket* view = (CommandPacket*)&ref;
-            auto& stream_common = vpmu_stream->common[id];
             switch (ref.type) {
             case VPMU_PACKET_BARRIER:
             case VPMU_PACKET_SYNC_DATA:
-                // Wait for the last signal to be cleared
-                //while (stream_common.synced_flag)
-                //    ;
-
-                // Never exceed the packet ID
-                if (stream_common.sync_counter < view->id) stream_common.sync_counter++;
-                vpmu_stream->sync_data[id][stream_common.sync_counter % 32] =
-                  sim->packet_processor(id, ref);
-
-                // stream_common.data = mpark::get<Data>(sim->packet_processor(id, ref));
-                // stream_common.data = sim->packet_processor(id, ref);
-                // Set synced_flag to tell master it's done
-                //stream_common.synced_flag = true;
+                write_sync_data(id, view->id, sim->packet_processor(id, ref));
                 break;
             case VPMU_PACKET_DUMP_INFO:
                 this->wait_token(id);
@@ -246,9 +312,167 @@ protected:
         }
     }
 
+    // Publish the counters of worker n with its seqlock held. There is only one writer
+    // (the worker itself) for each seqlock.
+    inline void write_sync_data(int n, uint64_t packet_id, const Data& data)
+    {
+        auto&     stream_common = vpmu_stream->common[n];
+        uint64_t& sync_seq      = vpmu_stream->sync_seq[n];
+        uint64_t  seq           = __atomic_load_n(&sync_seq, __ATOMIC_RELAXED);
+
+        __atomic_store_n(&sync_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        // The counter is the largest epoch crossed. Barriers carry no epoch.
+        if (stream_common.sync_counter < packet_id) {
+            stream_common.sync_counter = packet_id;
+        }
+        vpmu_stream->sync_data[n] = data;
+        if (packet_id != 0) {
+            // Keep the counters of this epoch in the history
+            int i = n * history_depth + packet_id % history_depth;
+
+            sync_history[i] = data;
+            // Written after the slot, see epoch_published()
+            __atomic_store_n(&sync_history_tag[i], packet_id, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&sync_seq, seq + 2, __ATOMIC_RELEASE);
+
+        // Wake up VPMU if it is waiting for the counters of the epoch
+        auto&    waiter = vpmu_stream->epoch_waiter[n];
+        uint64_t epoch;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        epoch = __atomic_load_n(&waiter, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch_published(n, epoch)
+            && __atomic_compare_exchange_n(
+                 &waiter, &epoch, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            sem_post(&vpmu_stream->epoch_semaphore[n]);
+    }
+
+    // Locate the counters of worker n at the epoch. The slot in the history is tagged
+    // with the epoch writing it. The sync packets arrive in the order of epochs (see
+    // VPMU_async()), a smaller tag means the sync packet of this one is still on its
+    // way, it is pending. A larger tag means the slot is overwritten by a later epoch,
+    // it is missed (see vpmu_sync_history_depth). The latest counters are returned in
+    // both cases.
+    inline const Data*
+    locate_sync_data(int n, uint64_t epoch, bool& pending, bool& missed)
+    {
+        pending = missed = false;
+        if (epoch == 0) return &vpmu_stream->sync_data[n];
+
+        int      i   = n * history_depth + epoch % history_depth;
+        uint64_t tag = sync_history_tag[i];
+
+        if (tag == epoch) return &sync_history[i];
+        pending = (tag < epoch);
+        missed  = (tag > epoch);
+        return &vpmu_stream->sync_data[n];
+    }
+
+    // True if worker n has published its counters at the epoch, or a later epoch has
+    // overwritten them in the history
+    inline bool epoch_published(int n, uint64_t epoch)
+    {
+        int i = n * history_depth + epoch % history_depth;
+        return __atomic_load_n(&sync_history_tag[i], __ATOMIC_ACQUIRE) >= epoch;
+    }
+
+    // Block till worker n publishes its counters at the epoch. Only one thread, the
+    // dispatcher of VPMUEpoch, waits on a worker at a time.
+    bool wait_worker_epoch(int n, uint64_t epoch, uint64_t mili_sec)
+    {
+        auto& waiter    = vpmu_stream->epoch_waiter[n];
+        auto& semaphore = vpmu_stream->epoch_semaphore[n];
+
+        while (!epoch_published(n, epoch)) {
+            __atomic_store_n(&waiter, epoch, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (epoch_published(n, epoch)) {
+                uint64_t expected = epoch;
+                // The worker has taken the waiter and posted (or will post) it
+                if (!__atomic_compare_exchange_n(&waiter,
+                                                 &expected,
+                                                 0,
+                                                 false,
+                                                 __ATOMIC_SEQ_CST,
+                                                 __ATOMIC_SEQ_CST))
+                    sem_wait(&semaphore);
+                break;
+            }
+            if (timed_wait_semaphore(&semaphore, mili_sec) == false) return false;
+        }
+        return true;
+    }
+
+    // Copy the counters of worker n at the epoch with the copy function. It sleeps till
+    // the slot of a pending epoch is written. Return false if the epoch is missed and
+    // the latest counters are copied instead.
+    template <typename Func>
+    inline bool read_epoch_data(int n, uint64_t epoch, Func&& copy)
+    {
+        bool pending, missed;
+
+        while (true) {
+            read_sync_data(n, [&]() {
+                copy(*locate_sync_data(n, epoch, pending, missed));
+            });
+            if (!pending) break;
+            // The workers are expected to be stopped when QEMU is terminating
+            if (VPMU.qemu_terminate_flag) break;
+            if (wait_worker_epoch(n, epoch, 5000) == false) break;
+        }
+        if (missed) report_missed_epoch(epoch);
+        return !missed;
+    }
+
+    void report_missed_epoch(uint64_t epoch)
+    {
+        // Only warn once, this could be very frequent
+        if (missed_epoch_cnt++ > 0) return;
+        log("Counters of epoch %" PRIu64 " are overwritten, "
+            "consider a larger VPMU_SYNC_HISTORY_DEPTH (%u)",
+            epoch,
+            history_depth);
+    }
+
+    // Run the reader function until it sees a consistent copy of the counters of
+    // worker n, i.e. the seqlock is even and unchanged before and after the read.
+    template <typename Func>
+    inline void read_sync_data(int n, Func&& reader)
+    {
+        uint64_t& sync_seq = vpmu_stream->sync_seq[n];
+        uint64_t  seq;
+
+        do {
+            while ((seq = __atomic_load_n(&sync_seq, __ATOMIC_ACQUIRE)) & 1)
+                std::this_thread::yield();
+            reader();
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (__atomic_load_n(&sync_seq, __ATOMIC_RELAXED) != seq);
+    }
+
 private:
     // The total number of packets counter for debugging
     uint64_t debug_packet_num_cnt = 0;
+    // The number of reads missing their epochs in the history
+    std::atomic<uint64_t> missed_epoch_cnt = {0};
+
+    inline bool timed_wait_semaphore(sem_t* semaphore, uint64_t mili_sec)
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += mili_sec / 1000;
+        ts.tv_nsec += (mili_sec % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        while (sem_timedwait(semaphore, &ts) != 0) {
+            if (errno != EINTR) return false;
+        }
+        return true;
+    }
 
     inline void reset_token() { vpmu_stream->token = 0; };
     inline void pass_token(uint32_t id) { vpmu_stream->token = id + 1; };
@@ -9,6 +9,7 @@ extern "C" {
 #include "vpmu-local-buffer.hpp" // VPMULocalBuffer
 #include "vpmu-sim.hpp"          // VPMUSimulator
 #include "vpmu-stream-impl.hpp"  // VPMUStream_Impl
+#include "vpmu-epoch.hpp"        // VPMUEpoch
 #include "json.hpp"              // nlohmann::json
 
 class VPMUStream : public VPMULog
@@ -29,7 +30,7 @@ public:
     virtual void reset(void) { LOG_FATAL_NOT_IMPL(); }
     virtual void issue_sync(uint64_t) { LOG_FATAL_NOT_IMPL(); }
     virtual void reset_sync_flags(void) { LOG_FATAL_NOT_IMPL(); }
-    virtual void wait_sync(uint64_t) { LOG_FATAL_NOT_IMPL(); }
+    virtual bool wait_epoch(uint64_t) { LOG_FATAL_NOT_IMPL_RET(false); }
     virtual void sync_none_blocking(void) { LOG_FATAL_NOT_IMPL(); }
     virtual void dump(void) { LOG_FATAL_NOT_IMPL(); }
 };
@@ -140,14 +141,17 @@ public:
         impl->send_sync(id);
     }
 
-    void wait_sync(uint64_t id = 0) override
+    bool wait_epoch(uint64_t epoch) override
     {
         // Basic safety check
-        if (impl == nullptr) return;
-        // log_debug("sync");
-        if (impl->timed_wait_sync_flag(5000, id) == false) {
+        if (impl == nullptr) return true;
+        if (impl->wait_epoch(epoch, 5000) == false) {
+            // Simulators are expected to be stopped when QEMU is terminating
+            if (VPMU.qemu_terminate_flag) return false;
             LOG_FATAL("Perhaps some simulator are down!!");
+            return false;
         }
+        return true;
     }
 
     void reset_sync_flags(void) override
@@ -221,8 +225,24 @@ public:
     inline Model get_model(void) { return impl->get_model(0); }
     inline Model get_model(int n) { return impl->get_model(n); }
 
-    inline Data get_data(int n, int idx = -1) { return impl->get_data(n, idx); }
-    inline Data get_data(void) { return impl->get_data(0); }
+    // The counters read by a VPMU_async() callback are the ones at its epoch
+    inline Data get_data(int n) { return impl->get_data(n, VPMUEpoch::current()); }
+    inline Data get_data(void) { return get_data(0); }
+    inline Data get_core_data(int n, int core)
+    {
+        return impl->get_core_data(n, core, VPMUEpoch::current());
+    }
+    inline Data get_core_data(int core) { return get_core_data(0, core); }
+    // Read a few counters of the latest sync of a worker in place, regardless of the
+    // epoch of caller
+    template <typename Func>
+    inline void read_latest_data(int n, Func&& reader)
+    {
+        if (impl == nullptr || !impl->initialized()) return;
+        impl->read_latest_data(n, std::forward<Func>(reader));
+    }
+    // The number of reads of the counters at epochs already overwritten
+    inline uint64_t get_num_missed_epochs(void) { return impl->get_num_missed_epochs(); }
 
 protected:
     // Force to clean out local buffer whenever the packet is a control packet
@@ -0,0 +1,97 @@
+#include "vpmu.hpp"             // VPMU common headers
+#include "Cortex-A9.hpp"        // CPU_CortexA9
+#include "Cortex-A9-decode.hpp" // arm_decode::table
+#include "vpmu-bench.hpp"       // vpmu::bench
+
+// Translation throughput of the Cortex-A9 ARM decoder.
+// It checks the constexpr decode table against the slow (the original) decoder on
+// every key of the table and on random instructions, then measures the time per
+// instruction of both decoders and of get_arm_ticks(), which QEMU calls for every
+// guest instruction it translates.
+//
+// Usage: bench-arm-decode [number of instructions, default 4M]
+
+class CortexA9DecodeBench
+{
+public:
+    CortexA9DecodeBench()
+    {
+#define etype(x) macro_str(x)
+        static const char* names[] = {ARM_INSTRUCTION};
+#undef etype
+        nlohmann::json config;
+
+        config["name"]       = "Cortex-A9";
+        config["frequency"]  = 1000;
+        config["dual_issue"] = false;
+        // Distinct ticks tell the instructions apart
+        for (int i = 0; i < ARM_INSTRUCTION_TOTAL_COUNTS; i++) {
+            config["instruction"][names[i]] = i + 2;
+        }
+        cpu.bind(config);
+        cpu.build();
+    }
+
+    /// Return the number of instructions decoded differently
+    uint64_t check(const std::vector<uint32_t>& insns)
+    {
+        auto&    t          = cpu.translator;
+        uint64_t mismatches = 0;
+
+        for (auto insn : insns) {
+            uint16_t fast = t._decode_arm_insn(insn);
+            uint16_t slow = t._decode_arm_insn_slow(insn);
+            if (fast == slow) continue;
+            if (mismatches++ < 10) {
+                printf("  %08x: table %u, slow decoder %u\n", insn, fast, slow);
+            }
+        }
+        return mismatches;
+    }
+
+    void run(const std::vector<uint32_t>& insns)
+    {
+        auto&            t     = cpu.translator;
+        uint64_t         sum   = 0;
+        TB_SummaryState  state = {};
+        TBSummaryBuilder tb_summary(state);
+
+        vpmu::bench::measure("table decoder", insns.size(), [&]() {
+            for (auto insn : insns) sum += t._get_arm_ticks(insn);
+        });
+        vpmu::bench::measure("slow decoder", insns.size(), [&]() {
+            for (auto insn : insns)
+                sum += t.arm_instr_time[t._decode_arm_insn_slow(insn)];
+        });
+        vpmu::bench::measure("get_arm_ticks()", insns.size(), [&]() {
+            for (auto insn : insns) sum += t.get_arm_ticks(tb_summary, insn);
+        });
+        // Keep the results alive
+        printf("  (checksum %" PRIu64 ")\n", sum);
+    }
+
+private:
+    CPU_CortexA9 cpu;
+};
+
+int main(int argc, char** argv)
+{
+    uint64_t              num = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 4 << 20;
+    std::vector<uint32_t> keys, insns;
+    std::mt19937          rng(1);
+    CortexA9DecodeBench   bench;
+
+    // Every key of the table with random bits elsewhere, in all conditions
+    for (uint32_t key = 0; key < arm_decode::table_size; key++) {
+        for (uint32_t cond = 0; cond < 0xf; cond++) {
+            uint32_t insn = (cond << 28) | (arm_decode::insn_of(key) & 0x0ff000f0);
+            for (int i = 0; i < 4; i++) keys.push_back(insn | (rng() & 0x000fff0f));
+        }
+    }
+    for (uint64_t i = 0; i < num; i++) insns.push_back(rng());
+
+    uint64_t mismatches = bench.check(keys) + bench.check(insns);
+    printf("%" PRIu64 " instructions decoded differently\n", mismatches);
+    bench.run(insns);
+    return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,91 @@
+#include "vpmu.hpp"          // VPMU common headers
+#include "event-tracing.hpp" // event_tracer
+#include "vpmu-bench.hpp"    // vpmu::bench
+
+#include <thread> // std::thread
+
+// Lookups of traced processes with hundreds of them in the map.
+// find_process(pid) is the lookup of kernel events and get_running_process() is the
+// one of the vCPU hot paths. The baseline is the scan of all processes comparing the
+// pids, which find_process() did before it used the key of the map.
+//
+// Usage: bench-find-process [processes, default 500] [lookups, 64K] [threads, 4]
+
+/// The lookup by scanning all processes, with a copy of shared_ptr
+static std::shared_ptr<ET_Process>
+scan_process(std::map<uint64_t, std::shared_ptr<ET_Process>>& process_map, uint64_t pid)
+{
+    for (auto& p_pair : process_map) {
+        auto p = p_pair.second;
+        if (p->pid == pid) return p;
+    }
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t num_processes = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 500;
+    uint64_t num_lookups   = (argc > 2) ? strtoull(argv[2], nullptr, 0) : 1 << 16;
+    uint64_t num_threads   = (argc > 3) ? strtoull(argv[3], nullptr, 0) : 4;
+    std::map<uint64_t, std::shared_ptr<ET_Process>> process_map;
+    std::vector<uint64_t>                           pids;
+    std::mt19937                                    rng(1);
+
+    // Sparse pids as in a guest running for a while
+    for (uint64_t i = 0; i < num_processes; i++) {
+        uint64_t pid = 100 + i * 7;
+        auto     process =
+          event_tracer.add_new_process(("task" + std::to_string(i)).c_str(), pid);
+        process_map[pid] = process;
+        pids.push_back(pid);
+    }
+    // One quarter of the lookups miss, as the kernel events of untraced tasks
+    std::vector<uint64_t> lookups;
+    for (uint64_t i = 0; i < num_lookups; i++) {
+        uint64_t pid = pids[rng() % pids.size()];
+        lookups.push_back((i % 4 == 0) ? pid + 1 : pid);
+    }
+
+    uint64_t found = 0, wrong = 0;
+    for (auto pid : lookups) {
+        auto process = event_tracer.find_process(pid);
+        if (process) found++;
+        if (process != scan_process(process_map, pid)) wrong++;
+    }
+    for (uint64_t c = 0; c < VPMU_MAX_CPU_CORES; c++) {
+        event_tracer.set_running_process(c, process_map[pids[c % pids.size()]].get());
+    }
+
+    uint64_t sum = 0;
+    vpmu::bench::measure("scan of all processes", num_lookups, [&]() {
+        for (auto pid : lookups) sum += (scan_process(process_map, pid) != nullptr);
+    });
+    vpmu::bench::measure("find_process()", num_lookups, [&]() {
+        for (auto pid : lookups) sum += (event_tracer.find_process(pid) != nullptr);
+    });
+    vpmu::bench::measure("find_process() of each thread", num_lookups, [&]() {
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < num_threads; t++) {
+            threads.emplace_back([&, t]() {
+                for (uint64_t i = t; i < num_lookups; i += num_threads)
+                    event_tracer.find_process(lookups[i]);
+            });
+        }
+        for (auto& t : threads) t.join();
+    });
+    vpmu::bench::measure("get_running_process()", num_lookups, [&]() {
+        for (uint64_t i = 0; i < num_lookups; i++) {
+            sum += (uintptr_t)event_tracer.get_running_process(i % VPMU_MAX_CPU_CORES);
+        }
+    });
+    // Keep the results alive
+    printf("  (checksum %" PRIu64 ")\n", sum);
+
+    int failures = 0;
+    failures += vpmu::bench::expect(found == num_lookups - (num_lookups + 3) / 4,
+                                    "the traced pids are found");
+    failures += vpmu::bench::expect(wrong == 0, "the same processes as the scan");
+    failures += vpmu::bench::expect(event_tracer.find_process((uint64_t)0) == nullptr,
+                                    "pid 0 is never found");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
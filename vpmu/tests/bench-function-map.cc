@@ -0,0 +1,164 @@
+#include "vpmu.hpp"         // VPMU common headers
+#include "function-map.hpp" // FunctionMap
+#include "vpmu-bench.hpp"   // vpmu::bench
+
+#include <map> // std::map
+
+// Calls and returns of the callback tables of the event tracer.
+// It checks the matching of calls and returns (recursion, lost returns, a thread
+// moving its shadow stack between tables) and the growth of the flat hash table, then
+// measures a call, its return and a miss against the baseline of std::map and
+// std::function, which FunctionMap used before the flat table.
+//
+// Usage: bench-function-map [calls, default 4M] [functions, 512]
+
+/// The callbacks in std::map with one pending return per function
+template <class K, class... Args>
+class MapFunctionMap
+{
+public:
+    bool update_return_key(K key, K key_ret)
+    {
+        auto f = funs.find(key);
+        if (f == funs.end() || !f->second.on_return) return false;
+        auto& ret      = funs_ret[key_ret];
+        bool  new_flag = (ret == nullptr);
+        ret            = &f->second;
+        return new_flag;
+    }
+
+    bool call(K key, Args... args)
+    {
+        auto f = funs.find(key);
+        if (f == funs.end()) return false;
+        if (f->second.on_return) f->second.called_flag = true;
+        if (f->second.on_call) {
+            f->second.on_call(args...);
+            return true;
+        }
+        return false;
+    }
+
+    bool call_return(K key, Args... args)
+    {
+        auto f = funs_ret.find(key);
+        if (f == funs_ret.end() || !f->second->called_flag) return false;
+        f->second->on_return(args...);
+        f->second->called_flag = false;
+        return true;
+    }
+
+    void register_call(K key, std::function<void(Args...)> fun)
+    {
+        funs[key].on_call = fun;
+    }
+    void register_return(K key, std::function<void(Args...)> fun)
+    {
+        funs[key].on_return = fun;
+    }
+
+private:
+    struct FunctionEntry {
+        std::function<void(Args...)> on_call;
+        std::function<void(Args...)> on_return;
+        bool                         called_flag = false;
+    };
+
+    std::map<K, FunctionEntry>  funs;
+    std::map<K, FunctionEntry*> funs_ret;
+};
+
+/// Return the number of wrong results of calls and returns
+static int check_semantics(void)
+{
+    FunctionMap<uint64_t, int> f;
+    int                        calls = 0, rets = 0, wrong = 0;
+
+    f.register_call(10, [&](int) { calls++; });
+    f.register_return(10, [&](int) { rets++; });
+    f.register_precall(10, std::function<void(int)>());
+    // Recursion, every level gets its own return
+    wrong += !f.call(10, 0);
+    wrong += !f.update_return_key(10, 100);
+    wrong += !f.call(10, 0);
+    wrong += !f.update_return_key(10, 200);
+    wrong += !f.call_return(200, 0);
+    wrong += f.call_return(200, 0);
+    wrong += !f.call_return(100, 0);
+    wrong += f.call_return(100, 0);
+    wrong += (calls != 2 || rets != 2);
+    // A known return key is not reported as new
+    wrong += !f.call(10, 0);
+    wrong += f.update_return_key(10, 100);
+
+    // The pending call moves with the shadow stack to another table
+    FunctionMap<uint64_t, int>              g;
+    FunctionMap<uint64_t, int>::ReturnStack stack;
+    g.register_return(10, [&](int) { rets++; });
+    f.swap_return_stack(stack);
+    g.swap_return_stack(stack);
+    wrong += f.call_return(100, 0);
+    wrong += !g.call_return(100, 0);
+    wrong += (rets != 3);
+
+    // A call pending across a re-registration never calls the new callback
+    g.call(10, 0);
+    g.update_return_key(10, 300);
+    g.register_return(10, [&](int) { rets += 10; });
+    wrong += g.call_return(300, 0);
+    wrong += (rets != 3);
+    // The return keys are bounded, the ones forgotten are reported as new again
+    for (uint64_t i = 0; i <= FunctionMap<uint64_t, int>::max_return_keys; i++) {
+        g.update_return_key(10, 1000 + i);
+    }
+    wrong += !g.update_return_key(10, 1000);
+
+    // The entries are kept when the table grows
+    for (uint64_t i = 0; i < 1000; i++) f.register_call(i * 4096, [](int) {});
+    for (uint64_t i = 0; i < 1000; i++) wrong += !f.find(i * 4096);
+    wrong += f.find(4096 + 1);
+
+    FlatHashMap<uint64_t, bool> tags;
+    for (uint64_t i = 0; i < 1000; i++) wrong += !tags.insert(i * 64);
+    for (uint64_t i = 0; i < 1000; i++) wrong += tags.insert(i * 64);
+    wrong += (tags.size() != 1000);
+    return wrong;
+}
+
+template <class Map>
+static void run(const char* name, uint64_t num_calls, uint64_t num_functions)
+{
+    Map      functions;
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < num_functions; i++) {
+        functions.register_call(0x400000 + i * 64, [&sum](int x) { sum += x; });
+        functions.register_return(0x400000 + i * 64, [&sum](int x) { sum -= x; });
+    }
+    vpmu::bench::measure(name, num_calls, [&]() {
+        for (uint64_t i = 0; i < num_calls; i++) {
+            uint64_t fn  = 0x400000 + (i * 7 % num_functions) * 64;
+            uint64_t ret = 0x800000 + (i % 37) * 4;
+            if (functions.call(fn, 1)) functions.update_return_key(fn, ret);
+            functions.call_return(ret, 1);
+            functions.call(0x100, 1); // A miss
+        }
+    });
+    // Keep the results alive
+    printf("  (checksum %" PRIu64 ")\n", sum);
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t num_calls     = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 4 << 20;
+    uint64_t num_functions = (argc > 2) ? strtoull(argv[2], nullptr, 0) : 512;
+
+    if (num_functions == 0) num_functions = 1;
+    int wrong = check_semantics();
+    run<MapFunctionMap<uint64_t, int>>("std::map", num_calls, num_functions);
+    run<FunctionMap<uint64_t, int>>("FunctionMap", num_calls, num_functions);
+
+    int failures = 0;
+    failures += vpmu::bench::expect(wrong == 0, "calls and returns are matched");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
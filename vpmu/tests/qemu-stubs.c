@@ -0,0 +1,157 @@
+#include "vpmu.h"                 // VPMU common headers, vpmu_read_*_from_guest()
+#include "event-tracing-helper.h" // et_get_*()
+#include "qemu/memfd.h"           // qemu_memfd_alloc()
+
+// The QEMU functions called by VPMU library, for linking the standalone tests.
+// There is no guest, the guest virtual addresses are the host addresses of the test
+// and a CPU state is a plain array of register values.
+
+FILE *qemu_logfile  = NULL;
+int   qemu_loglevel = 0;
+
+void tic(struct timespec *t1)
+{
+    clock_gettime(CLOCK_REALTIME, t1);
+}
+
+void *qemu_memfd_alloc(const char *name, size_t size, unsigned int seals, int *fd)
+{
+    *fd = -1;
+    return malloc(size);
+}
+
+void qemu_memfd_free(void *ptr, size_t size, int fd)
+{
+    free(ptr);
+}
+
+//=======================  Guest memory and registers  ========================
+// The registers of a CPU state used by the event tracing helpers
+enum { STUB_REG_ARG0 = 0, STUB_REG_RET_ADDR = 8, STUB_REG_RET_VALUE, STUB_REG_PID };
+
+uint64_t et_get_input_arg(void *env, int num)
+{
+    return ((uint64_t *)env)[STUB_REG_ARG0 + num];
+}
+
+uint64_t et_get_ret_addr(void *env)
+{
+    return ((uint64_t *)env)[STUB_REG_RET_ADDR];
+}
+
+uint64_t et_get_ret_value(void *env)
+{
+    return ((uint64_t *)env)[STUB_REG_RET_VALUE];
+}
+
+uint64_t et_get_syscall_user_thread_id(void *env)
+{
+    return ((uint64_t *)env)[STUB_REG_PID];
+}
+
+uint64_t et_get_switch_to_pid(void *env)
+{
+    return ((uint64_t *)env)[STUB_REG_ARG0];
+}
+
+uint64_t et_get_switch_to_prev_pid(void *env)
+{
+    return ((uint64_t *)env)[STUB_REG_ARG0 + 1];
+}
+
+void et_parse_dentry_path(VPMUMMUState *mmu,
+                          uintptr_t     dentry_addr,
+                          char *        buff,
+                          int           buff_size)
+{
+    snprintf(buff, buff_size, "%s", (const char *)dentry_addr);
+}
+
+// The number of addresses invalidated and cancelled, checked by the tests
+uint64_t stub_invalidated_tbs = 0;
+uint64_t stub_cancelled_tbs   = 0;
+
+void et_invalidate_tb(uint64_t vaddr)
+{
+    stub_invalidated_tbs++;
+}
+
+void et_invalidate_tbs(const uint64_t *vaddrs, uint64_t num)
+{
+    stub_invalidated_tbs += num;
+}
+
+void et_cancel_invalidate_tbs(const uint64_t *vaddrs, uint64_t num)
+{
+    stub_cancelled_tbs += num;
+}
+
+size_t vpmu_copy_from_guest(void *dst, uintptr_t src, const size_t size, void *cs)
+{
+    memcpy(dst, (void *)src, size);
+    return size;
+}
+
+void vpmu_mmu_capture(VPMUMMUState *mmu, void *env)
+{
+    mmu->valid = true;
+}
+
+void vpmu_mmu_flush(VPMUMMUState *mmu)
+{
+}
+
+void vpmu_synchronize_vcpus(void)
+{
+}
+
+void *vpmu_mmu_get_host_addr(VPMUMMUState *mmu, uintptr_t vaddr)
+{
+    if (!mmu->valid) return NULL;
+    return (void *)vaddr;
+}
+
+uint8_t *vpmu_read_ptr_from_guest(void *cs, uint64_t addr, uint64_t offset)
+{
+    return (uint8_t *)(uintptr_t)(addr + offset);
+}
+
+uint32_t vpmu_read_uint32_from_guest(void *cs, uint64_t addr, uint64_t offset)
+{
+    return *(uint32_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+}
+
+uintptr_t vpmu_read_uintptr_from_guest(void *cs, uint64_t addr, uint64_t offset)
+{
+    return *(uintptr_t *)vpmu_read_ptr_from_guest(cs, addr, offset);
+}
+
+uint8_t *vpmu_mmu_read_ptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    return (uint8_t *)vpmu_mmu_get_host_addr(mmu, addr + offset);
+}
+
+uint32_t
+vpmu_mmu_read_uint32_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    uint32_t *ptr = (uint32_t *)vpmu_mmu_read_ptr_from_guest(mmu, addr, offset);
+    // Zero when it is not mapped, as the one of QEMU
+    return (ptr) ? *ptr : 0;
+}
+
+uint64_t
+vpmu_mmu_read_uint64_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+    uint64_t *ptr = (uint64_t *)vpmu_mmu_read_ptr_from_guest(mmu, addr, offset);
+    return (ptr) ? *ptr : 0;
+}
+
+uintptr_t
+vpmu_mmu_read_uintptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset)
+{
+#if (CONFIG_VPMU_LONG_BITS == 32)
+    return (uintptr_t)vpmu_mmu_read_uint32_from_guest(mmu, addr, offset);
+#else
+    return (uintptr_t)vpmu_mmu_read_uint64_from_guest(mmu, addr, offset);
+#endif
+}
@@ -0,0 +1,130 @@
+#include "vpmu.hpp"                // VPMU common headers
+#include "et-function-profile.hpp" // ET_FunctionProfile
+#include "json.hpp"                // nlohmann::json
+#include "vpmu-bench.hpp"          // vpmu::bench
+
+#include <fstream> // std::ifstream
+#include <sstream> // std::stringstream
+
+// The calling context tree of a guest thread and the dumps of it.
+// A thread with recursion and a function returning to its caller is replayed on the
+// events of the profile, and the instructions of each node are checked in the folded
+// stacks and in the JSON. Then the profile is reset as the thread execs, and a slice
+// taken before the reset is charged after it, which must not show up in the new
+// profile nor grow its counters beyond its nodes. The cycles of a slice include its
+// memory time.
+//
+// The timing models come from the config file in VPMU_CONFIG_FILE.
+// Usage: test-function-profile
+
+/// The CPU state of the stubs, the return address is the register 8
+static uint64_t env[16] = {};
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream     in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+/// Run insn instructions then the event at vaddr, returning to ret_addr if it's a call
+static void run(ET_FunctionProfile& profile, uint64_t insn, uint64_t vaddr, uint64_t ret)
+{
+    VPMU.core[0].insn_count += insn;
+    env[8] = ret;
+    profile.call_event(env, vaddr);
+}
+
+int main(int argc, char** argv)
+{
+    char output_path[] = "/tmp/vpmu-test-XXXXXX";
+
+    if (mkdtemp(output_path) == nullptr) return EXIT_FAILURE;
+    std::string folded_path = std::string(output_path) + "/folded_stacks";
+    std::string json_path   = std::string(output_path) + "/function_profile";
+    const char* vpmu_argv[] = {argv[0], "-vpmu-output", output_path};
+    VPMU_init(3, (char**)vpmu_argv);
+    VPMU.platform.cpu.cores = 1;
+
+    ET_FunctionProfile profile;
+    VPMUSnapshot       delta;
+    profile.add_function(0x100, "main", "a.out");
+    profile.add_function(0x200, "foo", "a.out");
+    profile.add_function(0x300, "fib", "a.out");
+    profile.switch_in(0);
+    run(profile, 5, 0x100, 0x50);  // main()
+    run(profile, 10, 0x200, 0x110); // foo()
+    run(profile, 20, 0x110, 0);     // Return to main()
+    run(profile, 3, 0x300, 0x120);  // fib()
+    run(profile, 4, 0x300, 0x310);  // fib() recursively
+    run(profile, 6, 0x310, 0);      // Return to fib()
+    run(profile, 7, 0x120, 0);      // Return to main()
+    VPMU.core[0].insn_count += 1;
+    auto slice = profile.switch_out();
+    delta.cache_data.memory_time_ns = 56000;
+    profile.charge(slice, delta);
+    delta.cache_data.memory_time_ns = 0;
+
+    profile.dump_folded(folded_path, "prog");
+    profile.dump_json(json_path, "prog");
+    std::string folded = read_file(folded_path);
+    auto        j      = nlohmann::json::parse(read_file(json_path));
+    printf("%s", folded.c_str());
+
+    int failures = 0;
+    failures += vpmu::bench::expect(folded == "prog 5\n"
+                                              "prog;main 14\n"
+                                              "prog;main;foo 20\n"
+                                              "prog;main;fib 11\n"
+                                              "prog;main;fib;fib 6\n",
+                                    "folded stacks of the nodes");
+    failures += vpmu::bench::expect(j["total"]["instructions"] == 56,
+                                    "all the instructions are charged");
+    uint64_t memory_cycles = 56000 / vpmu::target::scale_factor();
+    uint64_t cycles        = j["total"]["cycles"];
+    failures += vpmu::bench::expect(cycles <= memory_cycles
+                                      && cycles + 5 >= memory_cycles,
+                                    "the memory time is charged in cycles");
+    auto& main_stat = j["functions"][0];
+    auto& fib_stat  = j["functions"][2];
+    failures += vpmu::bench::expect(j["functions"].size() == 3
+                                      && main_stat["name"] == "main"
+                                      && main_stat["inclusive"]["instructions"] == 51,
+                                    "functions sorted by inclusive instructions");
+    failures += vpmu::bench::expect(fib_stat["name"] == "fib" && fib_stat["calls"] == 2
+                                      && fib_stat["inclusive"]["instructions"] == 17
+                                      && fib_stat["exclusive"]["instructions"] == 17,
+                                    "a recursive function is counted once inclusively");
+    failures += vpmu::bench::expect(j["edges"].size() == 4, "edges of the call graph");
+
+    // A slice queued before exec, charged after the profile is reset
+    profile.switch_in(0);
+    run(profile, 1, 0x100, 0x50);
+    run(profile, 1, 0x300, 0x120);
+    run(profile, 1, 0x300, 0x310);
+    VPMU.core[0].insn_count += 100;
+    auto stale = profile.switch_out();
+    profile    = ET_FunctionProfile();
+    profile.add_function(0x100, "main", "a.out");
+    profile.switch_in(0);
+    run(profile, 1, 0x100, 0x50);
+    VPMU.core[0].insn_count += 2;
+    slice = profile.switch_out();
+    profile.charge(slice, delta);
+    profile.charge(stale, delta);
+
+    profile.dump_folded(folded_path, "prog");
+    profile.dump_json(json_path, "prog");
+    folded = read_file(folded_path);
+    j      = nlohmann::json::parse(read_file(json_path));
+    failures += vpmu::bench::expect(folded == "prog 1\nprog;main 2\n",
+                                    "a stale slice is not charged after exec");
+    failures += vpmu::bench::expect(j["total"]["instructions"] == 3,
+                                    "the total of the new image only");
+
+    remove(folded_path.c_str());
+    remove(json_path.c_str());
+    rmdir(output_path);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
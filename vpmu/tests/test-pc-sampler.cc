@@ -0,0 +1,118 @@
+#include "vpmu.hpp"          // VPMU common headers
+#include "event-tracing.hpp" // event_tracer
+#include "et-pc-sampler.hpp" // pc_sampler
+#include "vpmu-bench.hpp"    // vpmu::bench
+
+#include <fstream> // std::ifstream
+#include <sstream> // std::stringstream
+
+// The samples of PCs and the folded stacks of them.
+// VPMU_PC_SAMPLE_INTERVAL is parsed by VPMU_init() before VPMU device registers its
+// hook of the virtual clock tick, so the hook must get the period on registering. The
+// timer ticks then sample a traced process in two functions and in the kernel, and the
+// TB helper samples every number of instructions. The samples are symbolized with the
+// symbols of the program mapped in the process, and the kernel ones with the symbols
+// of vmlinux once they are loaded.
+//
+// The timing models come from the config file in VPMU_CONFIG_FILE.
+// Usage: test-pc-sampler
+
+static uint64_t hooked_period_us = 0;
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream     in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+/// Set what the core is running, as the TB helpers do
+static void run(uint64_t pc, uint64_t pid, bool user_mode)
+{
+    VPMU.core[0].current_pc        = pc;
+    VPMU.core[0].current_pid       = pid;
+    VPMU.core[0].current_user_mode = user_mode;
+}
+
+int main(int argc, char** argv)
+{
+    char output_path[] = "/tmp/vpmu-test-XXXXXX";
+
+    if (mkdtemp(output_path) == nullptr) return EXIT_FAILURE;
+    const char* vpmu_argv[] = {argv[0], "-vpmu-output", output_path};
+    // Too big for an int of milliseconds
+    setenv("VPMU_PC_SAMPLE_INTERVAL", "5000000000", 1);
+    VPMU_init(3, (char**)vpmu_argv);
+    vpmu_register_tick_virtual_period_hook(
+      [](uint64_t period_us) { hooked_period_us = period_us; });
+
+    int failures = 0;
+    failures += vpmu::bench::expect(pc_sampler.get_interval() == 5000000000000ull,
+                                    "the interval is parsed as a 64-bit number");
+    failures += vpmu::bench::expect(hooked_period_us == 5000000000000ull,
+                                    "the device gets the period requested before");
+
+    // A traced process with its program mapped at 0x1000
+    auto         program = event_tracer.add_program("app");
+    ET_DebugInfo info;
+    info.section_table[".text"] = {0x1000, 0x3000};
+    info.sym_table["alpha"]     = 0x1000;
+    info.sym_table["beta"]      = 0x2000;
+    program->set_debug_info(std::move(info));
+    auto     process   = event_tracer.add_new_process("app", 42);
+    MMapInfo mmap_info = {};
+    snprintf(mmap_info.fullpath, sizeof(mmap_info.fullpath), "app");
+    mmap_info.vaddr = 0x1000;
+    mmap_info.len   = 0x2000;
+    mmap_info.mode  = VM_EXEC;
+    event_tracer.attach_mapped_region(process, mmap_info);
+
+    pc_sampler.set_interval(1000);
+    run(0x1010, 42, true);
+    pc_sampler.tick(1000);
+    pc_sampler.tick(1500); // Not yet
+    pc_sampler.tick(2000);
+    run(0x2004, 42, true);
+    pc_sampler.tick(3000);
+    run(0xc0001000, 42, false);
+    pc_sampler.tick(4000);
+    // An untraced task, written when VPMU finishes
+    run(0x400000, 7, true);
+    pc_sampler.tick(5000);
+
+    // The instruction sampling replaces the timer
+    pc_sampler.set_insn_interval(100);
+    run(0x2008, 42, true);
+    pc_sampler.tick(6000);
+    VPMU.core[0].insn_count += 100;
+    pc_sampler.record(0);
+    failures += vpmu::bench::expect(VPMU.core[0].next_sample_insn
+                                      == VPMU.core[0].insn_count + 100,
+                                    "the next sample is scheduled");
+
+    std::string path = std::string(output_path) + "/pc_samples_app";
+    pc_sampler.dump(*process, path);
+    std::string folded = read_file(path);
+    printf("%s", folded.c_str());
+    failures += vpmu::bench::expect(folded == "app;[kernel] 1\n"
+                                              "app;app;alpha 2\n"
+                                              "app;app;beta 2\n",
+                                    "samples folded by the symbols");
+
+    // The symbols of vmlinux
+    event_tracer.get_kernel().add_symbol("do_sys_open", 0xc0002000);
+    run(0xc0002010, 7, false);
+    VPMU.core[0].insn_count += 100;
+    pc_sampler.record(0);
+    pc_sampler.finish();
+    folded = read_file(std::string(output_path) + "/pc_samples");
+    printf("%s", folded.c_str());
+    failures += vpmu::bench::expect(folded == "pid(7);[kernel];do_sys_open 1\n"
+                                              "pid(7);[user] 1\n",
+                                    "the untraced tasks at finish");
+
+    VPMU.qemu_terminate_flag = true;
+    VPMU_finalize_all_workers();
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
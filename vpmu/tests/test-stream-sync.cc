@@ -0,0 +1,121 @@
+#include "vpmu.hpp"        // VPMU common headers
+#include "vpmu-branch.hpp" // vpmu_branch_stream
+#include "vpmu-epoch.hpp"  // VPMUEpoch
+#include "vpmu-bench.hpp"  // vpmu::bench
+
+#include <thread>               // std::thread
+#include <shared_mutex>         // std::shared_timed_mutex
+#include <boost/filesystem.hpp> // boost::filesystem
+
+// Stress test of the counters read by VPMU_async() callbacks at their epochs.
+// The producer thread sends a few branch packets before each epoch it opens, and its
+// callbacks expect exactly the number of packets sent before the epoch. The other
+// threads open empty epochs as fast as they can, with or without blocking, racing the
+// producer to send their sync packets, and the producer keeps sending while the
+// callbacks run. All the callbacks must run in the order of their epochs, the counters
+// they read must never go back from an epoch to the next one, and no epoch may be
+// overwritten in the history of the stream.
+//
+// The timing models come from the config file in VPMU_CONFIG_FILE.
+// Usage: test-stream-sync [epochs of the producer, default 20000] [other threads, 4]
+
+static std::atomic<uint64_t> num_callbacks{0};
+static std::atomic<uint64_t> wrong_counters{0};
+static std::atomic<uint64_t> out_of_order{0};
+static std::atomic<uint64_t> went_back{0};
+static uint64_t              last_epoch = 0; // Only touched by the callbacks
+static uint64_t              last_count = 0;
+
+static void check_order(void)
+{
+    uint64_t epoch = VPMUEpoch::current();
+    auto     data  = vpmu_branch_stream.get_data();
+    uint64_t count = data.correct[0] + data.wrong[0];
+
+    if (epoch <= last_epoch) out_of_order++;
+    if (count < last_count) went_back++;
+    last_epoch = epoch;
+    last_count = count;
+    num_callbacks++;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t num_epochs    = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 20000;
+    uint64_t num_threads   = (argc > 2) ? strtoull(argv[2], nullptr, 0) : 4;
+    char     output_path[] = "/tmp/vpmu-test-XXXXXX";
+
+    if (mkdtemp(output_path) == nullptr) return EXIT_FAILURE;
+    const char* vpmu_argv[] = {argv[0], "-vpmu-output", output_path};
+    VPMU_init(3, (char**)vpmu_argv);
+
+    // The local buffers of the stream have one writer, the sync packets flush them.
+    // The other threads back off while the producer is waiting to send. It only guards
+    // the buffers, the sync packets of all the threads race each other.
+    std::shared_timed_mutex send_lock;
+    std::atomic<bool>       sending{false};
+    std::atomic<bool>       done{false};
+    uint64_t                num_sent = 0;
+    std::atomic<uint64_t>   num_other_epochs{0};
+    std::atomic<uint64_t>   num_tries{0};
+
+    auto producer = [&]() {
+        for (uint64_t i = 0; i < num_epochs; i++) {
+            {
+                sending = true;
+                std::unique_lock<std::shared_timed_mutex> lock(send_lock);
+                sending = false;
+                for (uint64_t n = i % 4; n > 0; n--, num_sent++) {
+                    vpmu_branch_stream.send(0, 0x1000 + n * 4, n & 1);
+                }
+            }
+            uint64_t expected = num_sent;
+            VPMU_async([expected]() {
+                auto data = vpmu_branch_stream.get_data();
+                if (data.correct[0] + data.wrong[0] != expected) wrong_counters++;
+                check_order();
+            });
+        }
+    };
+    auto other = [&]() {
+        while (!done) {
+            if (sending) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::shared_lock<std::shared_timed_mutex> lock(send_lock);
+            // Half of them are dropped instead of waiting on back-pressure
+            if (num_tries++ & 1) {
+                VPMU_async([]() { check_order(); });
+                num_other_epochs++;
+            } else if (VPMU_try_async([]() { check_order(); })) {
+                num_other_epochs++;
+            }
+        }
+    };
+
+    vpmu::bench::measure("VPMU_async() of the producer", num_epochs, [&]() {
+        std::vector<std::thread> threads;
+        for (uint64_t i = 0; i < num_threads; i++) threads.emplace_back(other);
+        producer();
+        done = true;
+        for (auto& t : threads) t.join();
+        VPMU_sync();
+    });
+    uint64_t total = num_epochs + num_other_epochs;
+    printf("  %" PRIu64 " epochs in total, %" PRIu64 " packets\n", total, num_sent);
+
+    int failures = 0;
+    failures += vpmu::bench::expect(num_callbacks == total, "all the callbacks run");
+    failures += vpmu::bench::expect(out_of_order == 0, "callbacks run in epoch order");
+    failures +=
+      vpmu::bench::expect(wrong_counters == 0, "callbacks read counters of their epochs");
+    failures += vpmu::bench::expect(went_back == 0, "counters never go back in epochs");
+    failures += vpmu::bench::expect(vpmu_branch_stream.get_num_missed_epochs() == 0,
+                                    "no epoch is overwritten in the history");
+
+    VPMU.qemu_terminate_flag = true;
+    VPMU_finalize_all_workers();
+    boost::filesystem::remove_all(output_path);
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
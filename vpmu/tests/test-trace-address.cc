@@ -0,0 +1,69 @@
+#include "vpmu.hpp"          // VPMU common headers
+#include "event-tracing.hpp" // event_tracer
+#include "vpmu-bench.hpp"    // vpmu::bench
+
+// The addresses tagged at translation time, as the translators see them with
+// et_is_traced_address(). An address is invalidated only when it's traced first, the
+// return address of a callback is traced on the first call, and a forked child keeps
+// the addresses of its parent. The addresses of a process are released when it exits
+// or execs (EventTracer::untrace_addresses()), the ones still traced by others or by
+// the kernel stay tagged and the rest are dropped from the pages pending.
+//
+// Usage: test-trace-address
+
+/// The number of addresses invalidated and cancelled, counted by the stubs
+extern "C" uint64_t stub_invalidated_tbs;
+extern "C" uint64_t stub_cancelled_tbs;
+
+/// The CPU state of the stubs, the return address is the register 8
+static uint64_t env[16] = {};
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+
+    et_trace_address(0x1000); // A kernel event
+    failures += vpmu::bench::expect(et_is_traced_address(0x1000)
+                                      && !et_is_traced_address(0x1004),
+                                    "the kernel address is tagged");
+
+    auto parent = event_tracer.add_new_process("app", 100);
+    event_tracer.trace_address(parent.get(), 0x2000);
+    event_tracer.trace_address(parent.get(), 0x2000);
+    event_tracer.trace_addresses(parent.get(), {0x1000, 0x3000, 0x4000});
+    failures += vpmu::bench::expect(stub_invalidated_tbs == 4,
+                                    "only the addresses traced first are invalidated");
+
+    parent->functions.register_call(0x5000, [](void* env, ET_Process* self) {});
+    parent->functions.register_return(0x5000, [](void* env, ET_Process* self) {});
+    env[8] = 0x6000;
+    parent->call_event(env, 0x5000);
+    parent->call_event(env, 0x5000);
+    failures += vpmu::bench::expect(et_is_traced_address(0x6000)
+                                      && stub_invalidated_tbs == 5,
+                                    "the return address is traced on the first call");
+
+    event_tracer.attach_to_parent(parent, 101);
+    auto child = event_tracer.find_process((uint64_t)101);
+    event_tracer.untrace_addresses(*parent);
+    failures += vpmu::bench::expect(et_is_traced_address(0x2000)
+                                      && et_is_traced_address(0x6000)
+                                      && stub_cancelled_tbs == 0,
+                                    "the child keeps the addresses of its parent");
+
+    event_tracer.untrace_addresses(*child);
+    failures += vpmu::bench::expect(!et_is_traced_address(0x2000)
+                                      && !et_is_traced_address(0x3000)
+                                      && !et_is_traced_address(0x6000),
+                                    "the addresses are untraced when both exit");
+    failures += vpmu::bench::expect(et_is_traced_address(0x1000),
+                                    "the kernel address is never untraced");
+    failures += vpmu::bench::expect(stub_cancelled_tbs == 4,
+                                    "the untraced ones are not pending anymore");
+
+    event_tracer.trace_address(child.get(), 0x2000);
+    failures += vpmu::bench::expect(et_is_traced_address(0x2000)
+                                      && stub_invalidated_tbs == 6,
+                                    "an address untraced is invalidated again");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,42 @@
+#ifndef __VPMU_BENCH_HPP_
+#define __VPMU_BENCH_HPP_
+#pragma once
+
+#include <chrono>  // std::chrono
+#include <random>  // std::mt19937
+#include <vector>  // std::vector
+#include <cstdio>  // printf
+#include <cstdint> // uint64_t
+
+namespace vpmu
+{
+/// Helpers of the standalone tests and benchmarks in vpmu/tests
+namespace bench
+{
+    /// Run func once and print the time per operation of it
+    template <typename Func>
+    inline double measure(const char* name, uint64_t num_ops, Func func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto   end = std::chrono::steady_clock::now();
+        double ns  = std::chrono::duration<double, std::nano>(end - start).count();
+
+        printf("  %-32s %10.2f ns/op  (%" PRIu64 " ops, %.3f s)\n",
+               name,
+               ns / num_ops,
+               num_ops,
+               ns / 1e9);
+        return ns / num_ops;
+    }
+
+    /// Print the result of a check and return 1 if it fails, for summing up failures
+    inline int expect(bool condition, const char* what)
+    {
+        printf("  %-56s %s\n", what, (condition) ? "ok" : "FAILED");
+        return (condition) ? 0 : 1;
+    }
+} // namespace bench
+} // namespace vpmu
+
+#endif
@@ -5,6 +5,12 @@
 #define VPMU_MAX_CPU_CORES 10
 #define VPMU_MAX_GPU_CORES 4
 #define VPMU_MAX_NUM_WORKERS 16
+// The default number of epochs of counters kept by each worker, and the maximum number
+// of outstanding VPMU_async() calls. Set VPMU_SYNC_HISTORY_DEPTH in the environment
+// to change it at run time.
+#ifndef VPMU_SYNC_HISTORY_DEPTH
+#define VPMU_SYNC_HISTORY_DEPTH 32
+#endif
 
 #define LINUX_NAMELEN 16
 
@@ -5,8 +5,8 @@
 
 typedef struct Insn_Counters {
     uint16_t total;
-    uint8_t  load;
-    uint8_t  store;
+    uint16_t load;
+    uint16_t store;
     uint8_t  alu;
     uint8_t  bit; // shift, and, or, xor
 #if defined(TARGET_ARM)
@@ -19,13 +19,55 @@ typedef struct Insn_Counters {
     uint16_t size_bytes;
 } Insn_Counters;
 
+// Classes of functional units used in TB_Summary::fu_count
+enum VPMU_FU_Type {
+    VPMU_FU_ALU = 0,
+    VPMU_FU_MUL,
+    VPMU_FU_LOAD,
+    VPMU_FU_STORE,
+    VPMU_FU_BRANCH,
+    VPMU_FU_FPU,
+    VPMU_FU_TOTAL
+};
+
+// A compact summary of the dependencies of a TB, computed once at translation time.
+// Registers are represented as bit masks. The mapping of bits is defined by the
+// translator of each architecture. A TB has at most 512 (TCG_MAX_INSNS) instructions,
+// the counts are wide enough for it and saturate beyond, so does the critical path.
+typedef struct TB_Summary {
+    uint32_t critical_path;           // Longest latency chain of register dependencies
+    uint16_t fu_count[VPMU_FU_TOTAL]; // Number of instructions per functional unit
+    uint16_t load_chain;              // Longest chain of dependent loads
+    uint16_t dependent_loads;         // Loads whose address depends on a former load
+    uint16_t dependent_stores;        // Stores which consume a loaded value
+    uint64_t live_in;                 // Registers read before written in this TB
+    uint64_t live_out;                // Registers written in this TB
+} TB_Summary;
+
+#define TB_SUMMARY_MAX_REGS 64
+
+// The state of building the TB_Summary of a TB. It lives in the DisasContext of the
+// translation, so the translator objects shared by all vCPUs keep no per-TB state.
+typedef struct TB_SummaryState {
+    TB_Summary summary;
+    uint32_t   reg_ready[TB_SUMMARY_MAX_REGS];      // The cycle when a register is ready
+    uint16_t   reg_load_depth[TB_SUMMARY_MAX_REGS]; // Loads a value depends on
+    // The states of the issue models of the instructions translated so far
+    uint64_t last_dst;     // Registers written by the previous instruction
+    uint32_t issue_cycles; // Issue cycles of the TB, in the fixed point of the model
+    uint8_t  last_fu;      // VPMU_FU_Type of the previous instruction
+    uint8_t  last_paired;  // The previous instruction is paired or can not be paired
+} TB_SummaryState;
+
 // A structure to extend TB info for accumulating counters when executing each TB.
 typedef struct ExtraTBInfo {
     Insn_Counters counters;
     uint8_t       has_branch;
     uint8_t       cpu_mode;
     uint16_t      ticks;
+    uint8_t       et_traced; // The start address is traced by event tracing
     uint64_t      start_addr;
+    TB_Summary    summary;
 
     // Modelsel
     struct {
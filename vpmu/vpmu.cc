@@ -1,4 +1,5 @@
 // Libraries
+#include <future>               // std::promise
 #include <mutex>                // std::mutex
 #include <boost/filesystem.hpp> // boost::filesystem
 #include "json.hpp"             // nlohmann::json
@@ -6,17 +7,21 @@
 extern "C" {
 #include "qemu/vpmu-device.h" // Timing model definition
 }
-#include "vpmu.hpp"             // VPMU common header
-#include "vpmu-stream.hpp"      // VPMUStream, VPMUStream_T
-#include "vpmu-translate.hpp"   // VPMUTranslate
-#include "vpmu-insn.hpp"        // InsnStream
-#include "vpmu-cache.hpp"       // CacheStream
-#include "vpmu-branch.hpp"      // BranchStream
-#include "event-tracing.hpp"    // EventTracer event_tracer
-#include "kernel-event-cb.h"    // et_register_callbacks_kernel_events()
-#include "phase-detect.hpp"     // phase_detect
-#include "function-tracing.hpp" // User process tracing callbacks
-#include "ThreadPool.hpp"       // ThreadPool
+#include "vpmu.hpp"                 // VPMU common header
+#include "vpmu-stream.hpp"          // VPMUStream, VPMUStream_T
+#include "vpmu-translate.hpp"       // VPMUTranslate
+#include "vpmu-insn.hpp"            // InsnStream
+#include "vpmu-cache.hpp"           // CacheStream
+#include "vpmu-branch.hpp"          // BranchStream
+#include "event-tracing.hpp"        // EventTracer event_tracer
+#include "kernel-event-cb.h"        // et_register_callbacks_kernel_events()
+#include "phase-detect.hpp"         // phase_detect
+#include "phase-classifier-lsh.hpp" // LSHCluster
+#include "function-tracing.hpp"     // User process tracing callbacks
+#include "ThreadPool.hpp"           // ThreadPool
+#include "vpmu-epoch.hpp"           // VPMUEpoch
+#include "vpmu-sampler.hpp"         // vpmu_sampler
+#include "et-pc-sampler.hpp"        // pc_sampler
 
 // The global variable that controls all the vpmu streams.
 std::vector<VPMUStream *> vpmu_streams = {};
@@ -38,10 +43,16 @@ extern int   qemu_loglevel;
 #endif
 // Pointer to argv[0] for modifying process name in htop
 char *global_argv_0 = NULL;
-// Thread pool for asynchronizing the performance counters
-ThreadPool timing_thread_pool("vpmu_async", 2);
-// Guard for accessing timing_thread_pool following VPMU stream interface.
-std::mutex timing_thread_pool_mutex;
+// The depth of the history of counters, fixed once the streams are built
+uint32_t vpmu_sync_history_depth = VPMU_SYNC_HISTORY_DEPTH;
+// Epochs for asynchronizing the performance counters
+VPMUEpoch vpmu_epoch("vpmu_async", [](uint64_t epoch) {
+    for (auto s : vpmu_streams) {
+        if (s->wait_epoch(epoch) == false) return false;
+    }
+    // Exit directly when QEMU is going to be terminated.
+    return !VPMU.qemu_terminate_flag;
+});
 // Thread pool for general tasks
 ThreadPool thread_pool("thread_pool", 2);
 
@@ -169,39 +180,61 @@ void VPMU_sync_non_blocking(void)
 
 void VPMU_sync(void)
 {
-    volatile bool wait_flag = true;
-
-    // We have to serialize all sync calls with respect to async calls.
-    // Because any thread can try to sync with the global counter,
-    // all sync events must be serialized in order to preserve the correctness.
-    VPMU_async([&]() { wait_flag = false; });
-    while (wait_flag) usleep(1);
+    auto done   = std::make_shared<std::promise<void>>();
+    auto future = done->get_future();
+
+    // The task of this sync is run after all the earlier epochs are crossed.
+    VPMU_async([done]() { done->set_value(); });
+    // Only the callback owns the promise now. The callbacks are dropped without
+    // running when QEMU is going to be terminated, which breaks the promise and
+    // wakes us up as well.
+    done.reset();
+    future.wait();
 }
 
+/// @brief Taken to open an epoch and send its sync packets
+/// @details Each stream must receive the sync packets in the order of epochs, or the
+/// counters of an epoch could be later than the ones of the next epoch. It is never
+/// held while waiting for the back-pressure, the callbacks open epochs as well.
+static std::mutex vpmu_async_lock;
+
 void VPMU_async(std::function<void(void)> task)
 {
-    // Lock here to ensure the integrity of calling issue_sync() and enqueue_static().
-    // This keeps the order of sync packets and the order of worker queue identical.
-    std::lock_guard<std::mutex> lock(timing_thread_pool_mutex);
-    static uint64_t async_counter = 0;
-
-    ++async_counter;
-    // Send a sync packet and wait the sync events in the thread pool
-    // worker queue so that everything are serialized in order.
-    for (auto s : vpmu_streams) {
-        s->issue_sync(async_counter);
-    }
+    uint64_t epoch = 0;
+
+    do {
+        // Back-pressure, block till the slot of this epoch in the history is free
+        bool held_back = vpmu_epoch.wait_for_room(vpmu_sync_history_depth);
+
+        std::lock_guard<std::mutex> lock(vpmu_async_lock);
+        // Another thread might take the room first, wait again then
+        if (held_back)
+            epoch = vpmu_epoch.try_open(vpmu_sync_history_depth);
+        else
+            epoch = vpmu_epoch.open(vpmu_sync_history_depth);
+        if (epoch == 0) continue;
+        for (auto s : vpmu_streams) {
+            s->issue_sync(epoch);
+        }
+    } while (epoch == 0);
+    vpmu_epoch.register_callback(epoch, std::move(task));
+}
 
-    timing_thread_pool.enqueue_static([task, id = async_counter]() {
-        // Wait till the sync event happened
+bool VPMU_try_async(std::function<void(void)> task)
+{
+    uint64_t epoch;
+
+    {
+        std::lock_guard<std::mutex> lock(vpmu_async_lock);
+        // The history of epochs is full, the caller drops the task instead of waiting
+        epoch = vpmu_epoch.try_open(vpmu_sync_history_depth);
+        if (epoch == 0) return false;
         for (auto s : vpmu_streams) {
-            s->wait_sync(id);
+            s->issue_sync(epoch);
         }
-        // Exit directly when QEMU is going to be terminated.
-        if (VPMU.qemu_terminate_flag) return;
-        // Do the task
-        task();
-    });
+    }
+    vpmu_epoch.register_callback(epoch, std::move(task));
+    return true;
 }
 
 void VPMU_finalize_all_workers(void)
@@ -209,14 +242,18 @@ void VPMU_finalize_all_workers(void)
     int cnt = 0;
 
     // Wait for 5s for all timing tasks done.
-    for (int i = 0; i < 50 && timing_thread_pool.size(); i++) {
+    for (int i = 0; i < 50 && vpmu_epoch.size(); i++) {
         if (cnt % 10 == 0) CONSOLE_LOG(STR_VPMU "Wait for timing threads...\n");
         cnt++;
         usleep(100000); // sleep for 0.1s
     }
-    if (timing_thread_pool.size()) {
+    if (vpmu_epoch.size()) {
         ERR_MSG(STR_VPMU "Failed on waiting responses from timing thread\n");
     }
+    // Write the remaining samples of counters
+    vpmu_sampler.finish();
+    // Write the PC samples of the tasks still running
+    pc_sampler.finish();
     cnt = 0;
     // Blocking wait all async tasks done. (usually output results to files)
     while (thread_pool.size()) {
@@ -231,6 +268,8 @@ void VPMU_reset(void)
     VPMU.cpu_idle_time_ns = 0;
     VPMU.ticks            = 0;
     VPMU.iomem_count      = 0;
+    // The phase worker adds to it
+    __atomic_store_n(&VPMU.fast_forward_time_ns, 0, __ATOMIC_RELAXED);
     memset(VPMU.modelsel, 0, sizeof(VPMU.modelsel));
 
     for (auto s : vpmu_streams) {
@@ -361,6 +400,43 @@ void disable_QEMU_log()
 #endif
 }
 
+/// The hook of VPMU device setting its virtual clock tick, null without the device
+static void (*tick_virtual_period_hook)(uint64_t period_us) = nullptr;
+/// The shortest period requested, passed to the hook when it is registered
+static uint64_t tick_virtual_period_us = 0;
+
+/// Shorten the period of the virtual clock tick, e.g. for sampling the PCs
+static void vpmu_request_tick_virtual_period(uint64_t period_us)
+{
+    if (period_us == 0) return;
+    if (tick_virtual_period_us == 0 || period_us < tick_virtual_period_us)
+        tick_virtual_period_us = period_us;
+    if (tick_virtual_period_hook) tick_virtual_period_hook(tick_virtual_period_us);
+}
+
+void vpmu_register_tick_virtual_period_hook(void (*hook)(uint64_t period_us))
+{
+    tick_virtual_period_hook = hook;
+    // The device is created after VPMU_init() read the requests
+    if (hook && tick_virtual_period_us) hook(tick_virtual_period_us);
+}
+
+/// Parse the interval of the environment variable in milliseconds of the target time
+/// to microseconds. Return 0 and report it if it is not a number or overflows.
+static uint64_t parse_interval_ms(const char *name, const char *str)
+{
+    char *   end = nullptr;
+    uint64_t ms;
+
+    errno = 0;
+    ms    = strtoull(str, &end, 10);
+    if (errno != 0 || end == str || ms > UINT64_MAX / 1000) {
+        ERR_MSG("Invalid %s %s, it is ignored.\n", name, str);
+        return 0;
+    }
+    return ms * 1000;
+}
+
 void VPMU_init(int argc, char **argv)
 {
     char config_file[1024]  = {0};
@@ -433,6 +509,39 @@ void VPMU_init(int argc, char **argv)
           "\tPlease specify '-vpmu-kernel-symbol <PATH>' for boot time tracking.\n\n");
     }
 #endif
+    char *env_sync_history_str = getenv("VPMU_SYNC_HISTORY_DEPTH");
+    if (env_sync_history_str != nullptr) {
+        // The streams are built with this depth by init_simulators() below
+        int env_sync_history = atoi(env_sync_history_str);
+        if (env_sync_history > 0) {
+            vpmu_sync_history_depth = env_sync_history;
+        } else {
+            ERR_MSG("Invalid VPMU_SYNC_HISTORY_DEPTH %s, use %u instead.\n",
+                    env_sync_history_str,
+                    vpmu_sync_history_depth);
+        }
+    }
+    char *env_sample_interval_str = getenv("VPMU_SAMPLE_INTERVAL");
+    if (env_sample_interval_str != nullptr) {
+        vpmu_sampler.set_interval(
+          parse_interval_ms("VPMU_SAMPLE_INTERVAL", env_sample_interval_str));
+    }
+    char *env_pc_sample_str = getenv("VPMU_PC_SAMPLE_INTERVAL");
+    if (env_pc_sample_str != nullptr) {
+        pc_sampler.set_interval(
+          parse_interval_ms("VPMU_PC_SAMPLE_INTERVAL", env_pc_sample_str));
+        vpmu_request_tick_virtual_period(pc_sampler.get_interval());
+    }
+    char *env_pc_sample_insn_str = getenv("VPMU_PC_SAMPLE_INSN");
+    if (env_pc_sample_insn_str != nullptr) {
+        // The number of instructions per sample on each core, it replaces the timer
+        pc_sampler.set_insn_interval(strtoull(env_pc_sample_insn_str, nullptr, 10));
+    }
+    char *env_func_profile_str = getenv("VPMU_FUNC_PROFILE");
+    if (env_func_profile_str != nullptr) {
+        // The names of programs separated by commas, or "*" for all programs
+        event_tracer.set_profiled_programs(env_func_profile_str);
+    }
     char *env_window_size_str = getenv("PHASE_WINDOW_SIZE");
     if (env_window_size_str != nullptr) {
         int env_window_size = atoi(env_window_size_str);
@@ -440,6 +549,34 @@ void VPMU_init(int argc, char **argv)
             phase_detect.set_window_size(env_window_size * 1000);
         }
     }
+    char *env_projection_size_str = getenv("PHASE_PROJECTION_SIZE");
+    if (env_projection_size_str != nullptr) {
+        phase_detect.set_projection_size(atoi(env_projection_size_str));
+    }
+    char *env_async_str = getenv("PHASE_ASYNC");
+    if (env_async_str != nullptr) {
+        phase_detect.set_async(atoi(env_async_str) != 0);
+    }
+    char *env_fast_forward_str = getenv("PHASE_FAST_FORWARD");
+    if (env_fast_forward_str != nullptr) {
+        phase_detect.set_fast_forward_programs(env_fast_forward_str);
+    }
+    char *env_ff_min_windows_str = getenv("PHASE_FF_MIN_WINDOWS");
+    if (env_ff_min_windows_str != nullptr) {
+        phase_detect.set_ff_min_windows(atoi(env_ff_min_windows_str));
+    }
+    char *env_ff_tolerance_str = getenv("PHASE_FF_TOLERANCE");
+    if (env_ff_tolerance_str != nullptr) {
+        phase_detect.set_ff_tolerance(atof(env_ff_tolerance_str));
+    }
+    char *env_ff_validate_str = getenv("PHASE_FF_VALIDATE_INTERVAL");
+    if (env_ff_validate_str != nullptr) {
+        phase_detect.set_ff_validate_interval(atoi(env_ff_validate_str));
+    }
+    char *env_classifier_str = getenv("PHASE_CLASSIFIER");
+    if (env_classifier_str != nullptr && strcmp(env_classifier_str, "lsh") == 0) {
+        phase_detect.change_classifier(std::make_unique<LSHCluster>());
+    }
 
     // this would let print system support comma.
     setlocale(LC_NUMERIC, "");
@@ -497,6 +634,8 @@ void vpmu_dump_readable_message(void)
     CONSOLE_TME("  ->System memory               :", memory_time_ns());
     CONSOLE_TME("  ->I/O memory                  :", io_time_ns());
     CONSOLE_TME("  ->Idle                        :", VPMU.cpu_idle_time_ns);
+    CONSOLE_TME("  ->Fast-forward (extrapolated) :",
+                __atomic_load_n(&VPMU.fast_forward_time_ns, __ATOMIC_RELAXED));
     CONSOLE_TME("Estimated execution time        :", time_ns());
 
     CONSOLE_LOG("\n");
@@ -19,6 +19,13 @@ void vpmu_dump_elf_symbols(const char *file_path);
 void *vpmu_qemu_clone_cpu_arch_state(void *cpu_v);
 void vpmu_qemu_update_cpu_arch_state(void *source_cpu_v, void *target_cpu_v);
 void vpmu_qemu_free_cpu_arch_state(void *env);
+// Capture the MMU state of the running process, the TLB is flushed if it changes
+void vpmu_mmu_capture(VPMUMMUState *mmu, void *env);
+void vpmu_mmu_flush(VPMUMMUState *mmu);
+// Translate with the captured state on a vCPU thread, return NULL if not mapped
+void *vpmu_mmu_get_host_addr(VPMUMMUState *mmu, uintptr_t vaddr);
+// Wait till every vCPU leaves the TBs it is executing, must not be called by a vCPU
+void vpmu_synchronize_vcpus(void);
 
 // Prevent prototype warnings from some compilers
 uint8_t *vpmu_read_ptr_from_guest(void *cs, uint64_t addr, uint64_t offset);
@@ -28,5 +35,13 @@ uint32_t vpmu_read_uint32_from_guest(void *cs, uint64_t addr, uint64_t offset);
 uint64_t vpmu_read_uint64_from_guest(void *cs, uint64_t addr, uint64_t offset);
 // Note: This function reads target long bits (32/64) and cast to uintptr_t
 uintptr_t vpmu_read_uintptr_from_guest(void *cs, uint64_t addr, uint64_t offset);
+// The same as above, but read from the address space of the captured MMU state
+uint8_t *vpmu_mmu_read_ptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset);
+uint32_t
+vpmu_mmu_read_uint32_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset);
+uint64_t
+vpmu_mmu_read_uint64_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset);
+uintptr_t
+vpmu_mmu_read_uintptr_from_guest(VPMUMMUState *mmu, uint64_t addr, uint64_t offset);
 
 #endif
@@ -29,5 +29,7 @@ class TD;             // TD == "Type Displayer"
 extern ThreadPool thread_pool;
 
 void VPMU_async(std::function<void(void)> task);
+// Same as VPMU_async() but never blocks, return false if the task is not issued
+bool VPMU_try_async(std::function<void(void)> task);
 
 #endif